@@ -1,5 +1,6 @@
 // MyTests.cpp
 #include "TestFramework.h"
+#include "TestMock.h"
 #include <iostream>
 #include <vector>
 #include <algorithm>
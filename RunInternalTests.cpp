@@ -2,23 +2,343 @@
 #include "TestFramework.h"
 #include <iostream>
 #include <chrono>
-#include <sstream>
 #include <string>
+#include <vector>
+#include <fstream>
+#include <cstdio>
+#include <iterator>
+#include <algorithm>
+#include <set>
 
-// A helper function to check if a substring is present in a given string
-bool contains(const std::string& text, const std::string& substring) {
-    return text.find(substring) != std::string::npos;
+// Defined in TestFrameworkTests.cpp
+extern void setParameterizedFamilySize(int n);
+extern bool reachedPastFatalAssertion();
+extern void registerLateTest();
+extern int asyncCancelledLocals();
+extern int maxAsyncInFlight();
+extern int takeStressCalls();
+extern unsigned int takeStressThreadsSeen();
+extern int placementCpuCount();
+extern int placementCpu();
+extern void setExitAfterPerWorkerSuite(bool exit);
+
+// Returns the status of each repetition of a test from the most recent run
+std::vector<TestStatus> statusesOf(const TestRunner& runner, const std::string& testName) {
+    std::vector<TestStatus> statuses;
+    for (const TestResult* result : runner.findResults("TestFrameworkInternalTests", testName)) {
+        statuses.push_back(result->status);
+    }
+    return statuses;
+}
+
+// Returns the scaling curve of an internal test from the most recent run, or nullptr if it has none
+const StressResult* stressResultOf(const TestRunner& runner, const std::string& testName) {
+    auto results = runner.findResults("TestFrameworkInternalTests", testName);
+    for (const StressResult& stress : runner.stressResults()) {
+        if (results.size() == 1 && stress.suiteIndex == results[0]->suiteIndex
+            && stress.testIndex == results[0]->testIndex) {
+            return &stress;
+        }
+    }
+    return nullptr;
+}
+
+// Returns the flakiness report of an internal test from the most recent run, or nullptr if it has none
+const FlakinessReport* flakinessOf(const TestRunner& runner, const std::string& testName) {
+    auto results = runner.findResults("TestFrameworkInternalTests", testName);
+    for (const FlakinessReport& report : runner.flakinessReports()) {
+        if (!results.empty() && report.suiteIndex == results[0]->suiteIndex
+            && report.testIndex == results[0]->testIndex) {
+            return &report;
+        }
+    }
+    return nullptr;
+}
+
+// Counts the events a run reports, to check that custom reporters see all of them
+class CountingReporter : public TestReporter {
+public:
+    int starts = 0;
+    int finishes = 0;
+    int testFinishes = 0;
+    size_t failedCount = 0;
+
+    void runStarted() override {
+        ++starts;
+    }
+
+    void report(const ReportEvent& event) override {
+        testFinishes += event.type == ReportEvent::Type::TestFinish;
+    }
+
+    void runFinished(size_t, size_t failed, size_t) override {
+        ++finishes;
+        failedCount = failed;
+    }
+};
+
+// Records the tests of a run in the order they finished
+class OrderReporter : public TestReporter {
+public:
+    std::vector<std::string> finished;
+
+    void report(const ReportEvent& event) override {
+        if (event.type == ReportEvent::Type::TestFinish) {
+            finished.emplace_back(event.testCase->name);
+        }
+    }
+};
+
+// Returns the contents of a file, or an empty string if it cannot be read
+std::string readFile(const std::string& path) {
+    std::ifstream in(path, std::ios::binary);
+    return std::string((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+}
+
+// Prints the outcome of a single check and returns whether it passed
+bool reportCheck(const std::string& name, const std::string& mode, bool passed) {
+    std::cout << "[CHECK] " << name << " (" << mode << "): " << (passed ? "PASSED" : "FAILED") << std::endl;
+    return passed;
+}
+
+// Verifies the structured results of the most recent run against the expected outcome of every internal test
+bool runChecks(const TestRunner& runner, const std::string& mode) {
+    bool allChecksPassed = true;
+
+    // TestSimplePass: Should pass without any assertion failure
+    {
+        auto results = runner.findResults("TestFrameworkInternalTests", "TestSimplePass");
+        bool passed = results.size() == 1 && results[0]->status == TestStatus::Passed
+                      && results[0]->assertionFailures == 0;
+        allChecksPassed &= reportCheck("TestSimplePass", mode, passed);
+    }
+
+    // TestSimpleFail: Expect exactly one assertion failure
+    {
+        auto results = runner.findResults("TestFrameworkInternalTests", "TestSimpleFail");
+        bool passed = results.size() == 1 && results[0]->status == TestStatus::Failed
+                      && results[0]->assertionFailures == 1;
+        allChecksPassed &= reportCheck("TestSimpleFail", mode, passed);
+    }
+
+    // TestDisabledCheck: Expect the test to be skipped
+    {
+        bool passed = statusesOf(runner, "TestDisabledCheck") == std::vector<TestStatus>{TestStatus::Skipped};
+        allChecksPassed &= reportCheck("TestDisabledCheck", mode, passed);
+    }
+
+    // TestExpectedException: The expected exception must be accepted
+    {
+        bool passed = statusesOf(runner, "TestExpectedException") == std::vector<TestStatus>{TestStatus::Passed};
+        allChecksPassed &= reportCheck("TestExpectedException", mode, passed);
+    }
+
+    // TestUnexpectedException: An unexpected exception must fail the test
+    {
+        bool passed = statusesOf(runner, "TestUnexpectedException") == std::vector<TestStatus>{TestStatus::Failed};
+        allChecksPassed &= reportCheck("TestUnexpectedException", mode, passed);
+    }
+
+    // TestClonedFixtureState: Every repetition must see the shared BeforeAll state in its own fixture
+    {
+        auto results = runner.findResults("TestPerWorkerFixtures", "TestClonedFixtureState");
+        bool passed = results.size() == 50;
+        for (const TestResult* result : results) {
+            passed &= result->status == TestStatus::Passed;
+        }
+        allChecksPassed &= reportCheck("TestClonedFixtureState", mode, passed);
+    }
+
+    // TestAllocationProfile: Passes whether or not its allocations are tracked
+    {
+        bool passed = statusesOf(runner, "TestAllocationProfile") == std::vector<TestStatus>{TestStatus::Passed};
+        allChecksPassed &= reportCheck("TestAllocationProfile", mode, passed);
+    }
+
+    // TestWaitsForCancellation: Without a time budget every repetition returns at once and passes
+    {
+        auto results = runner.findResults("TestFrameworkInternalTests", "TestWaitsForCancellation");
+        bool passed = results.size() == 50;
+        for (const TestResult* result : results) {
+            passed &= result->status == TestStatus::Passed;
+        }
+        allChecksPassed &= reportCheck("TestWaitsForCancellation", mode, passed);
+    }
+
+    // TestParameterizedFamily: Sized at run time, one result per instance, only instance 4 fails
+    {
+        auto results = runner.findResults("TestFrameworkInternalTests", "TestParameterizedFamily");
+        bool passed = results.size() == 6;
+        for (size_t i = 0; passed && i < results.size(); ++i) {
+            TestStatus expected = i == 4 ? TestStatus::Failed : TestStatus::Passed;
+            passed = results[i]->instance == static_cast<int>(i) && results[i]->status == expected;
+        }
+        allChecksPassed &= reportCheck("TestParameterizedFamily", mode, passed);
+    }
+
+    // TestCheckOperandsEvaluatedOnce: Passing checks evaluate every operand a single time
+    {
+        bool passed = statusesOf(runner, "TestCheckOperandsEvaluatedOnce") == std::vector<TestStatus>{TestStatus::Passed};
+        allChecksPassed &= reportCheck("TestCheckOperandsEvaluatedOnce", mode, passed);
+    }
+
+    // TestNonFatalChecks: Every failed EXPECT is counted and the body runs to the end
+    {
+        auto results = runner.findResults("TestFrameworkInternalTests", "TestNonFatalChecks");
+        bool passed = results.size() == 1 && results[0]->status == TestStatus::Failed
+                      && results[0]->assertionFailures == 3;
+        allChecksPassed &= reportCheck("TestNonFatalChecks", mode, passed);
+    }
+
+    // TestFatalAssertion: The failed ASSERT ends the test without being reported as an exception
+    {
+        auto results = runner.findResults("TestFrameworkInternalTests", "TestFatalAssertion");
+        bool passed = results.size() == 1 && results[0]->status == TestStatus::Failed
+                      && results[0]->assertionFailures == 1 && !reachedPastFatalAssertion();
+        allChecksPassed &= reportCheck("TestFatalAssertion", mode, passed);
+    }
+
+    // TestMockTypedRecording: Typed mock calls verify by value and by string
+    {
+        bool passed = statusesOf(runner, "TestMockTypedRecording") == std::vector<TestStatus>{TestStatus::Passed};
+        allChecksPassed &= reportCheck("TestMockTypedRecording", mode, passed);
+    }
+
+    // TestMockConcurrentRecording: A mock called from several threads loses no calls
+    {
+        bool passed = statusesOf(runner, "TestMockConcurrentRecording") == std::vector<TestStatus>{TestStatus::Passed};
+        allChecksPassed &= reportCheck("TestMockConcurrentRecording", mode, passed);
+    }
+
+    // TestMockExpectationsMet: Satisfied expectations on a mock without call log
+    {
+        bool passed = statusesOf(runner, "TestMockExpectationsMet") == std::vector<TestStatus>{TestStatus::Passed};
+        allChecksPassed &= reportCheck("TestMockExpectationsMet", mode, passed);
+    }
+
+    // TestMockExpectationViolations: Every broken or unmet expectation counts as one assertion failure
+    {
+        auto results = runner.findResults("TestFrameworkInternalTests", "TestMockExpectationViolations");
+        bool passed = results.size() == 1 && results[0]->status == TestStatus::Failed
+                      && results[0]->assertionFailures == 5;
+        allChecksPassed &= reportCheck("TestMockExpectationViolations", mode, passed);
+    }
+
+    // TestStressFanOut: Four threads made every call, and the runner saw them queue on the profiled mutex
+    {
+        bool passed = statusesOf(runner, "TestStressFanOut") == std::vector<TestStatus>{TestStatus::Passed};
+        int calls = takeStressCalls();
+        unsigned int threadsSeen = takeStressThreadsSeen();
+        // Isolated workers measure in their own processes.
+        if (mode != "isolated") {
+            const StressResult* stress = stressResultOf(runner, "TestStressFanOut");
+            passed = passed && calls == 80 && threadsSeen == 0xF && stress && stress->points.size() == 1
+                     && stress->points[0].threads == 4 && stress->points[0].calls == 80
+                     && stress->points[0].lockAcquisitions == 80 && stress->points[0].contendedAcquisitions > 0
+                     && stress->points[0].lockWaitNanos > 0;
+        }
+        allChecksPassed &= reportCheck("TestStressFanOut", mode, passed);
+    }
+
+    // TestStressFailuresCounted, TestStressFatalStops: Failures on the runner's extra threads count towards the test
+    {
+        auto counted = runner.findResults("TestFrameworkInternalTests", "TestStressFailuresCounted");
+        auto fatal = runner.findResults("TestFrameworkInternalTests", "TestStressFatalStops");
+        bool passed = counted.size() == 1 && counted[0]->status == TestStatus::Failed
+                      && counted[0]->assertionFailures == 5 && fatal.size() == 1
+                      && fatal[0]->status == TestStatus::Failed && fatal[0]->assertionFailures == 1;
+        allChecksPassed &= reportCheck("TestStressFailures", mode, passed);
+    }
+
+    // TestFlakyStable, TestFlakyThreeQuarters: Repetition stops early, and the unneeded ones are not selected.
+    // Workers may finish a few repetitions already in flight, so only sequential runs stop at an exact count.
+    {
+        auto countOf = [&](const std::string& testName, TestStatus status) {
+            std::vector<TestStatus> statuses = statusesOf(runner, testName);
+            return static_cast<uint32_t>(std::count(statuses.begin(), statuses.end(), status));
+        };
+        const FlakinessReport* stable = flakinessOf(runner, "TestFlakyStable");
+        const FlakinessReport* flaky = flakinessOf(runner, "TestFlakyThreeQuarters");
+        bool passed = stable && stable->maxRepetitions == 200 && stable->passes == stable->runs
+                      && (mode == "concurrent" ? stable->runs >= 16 && stable->runs < 200 : stable->runs == 16)
+                      && countOf("TestFlakyStable", TestStatus::Passed) == stable->runs
+                      && countOf("TestFlakyStable", TestStatus::NotSelected) == 200 - stable->runs
+                      && flaky && flaky->runs > 16 && flaky->runs < 400
+                      && countOf("TestFlakyThreeQuarters", TestStatus::Failed) == flaky->runs - flaky->passes
+                      && countOf("TestFlakyThreeQuarters", TestStatus::NotSelected) == 400 - flaky->runs
+                      && flaky->lowerBound < 0.75 && flaky->upperBound > 0.75
+                      && flaky->upperBound - flaky->lowerBound <= 0.2;
+        allChecksPassed &= reportCheck("TestFlaky", mode, passed);
+    }
+
+    // TestAsyncSleeps, TestAsyncEventAndDescriptor: Coroutine bodies resumed by the runner pass
+    {
+        bool passed = statusesOf(runner, "TestAsyncSleeps") == std::vector<TestStatus>{TestStatus::Passed}
+                      && statusesOf(runner, "TestAsyncEventAndDescriptor") == std::vector<TestStatus>{TestStatus::Passed};
+        allChecksPassed &= reportCheck("TestAsyncSleeps", mode, passed);
+    }
+
+    // TestAsyncFatalAssertion: A fatal assertion after a suspension ends the coroutine with one failure
+    {
+        auto results = runner.findResults("TestFrameworkInternalTests", "TestAsyncFatalAssertion");
+        bool passed = results.size() == 1 && results[0]->status == TestStatus::Failed
+                      && results[0]->assertionFailures == 1;
+        allChecksPassed &= reportCheck("TestAsyncFatalAssertion", mode, passed);
+    }
+
+    // TestAsyncTimeoutCancels: Cancelled at its deadline, destroying the sleeping frame instead of waiting 10 s
+    {
+        auto results = runner.findResults("TestFrameworkInternalTests", "TestAsyncTimeoutCancels");
+        int destroyedLocals = asyncCancelledLocals();
+        bool passed = results.size() == 1 && results[0]->status == TestStatus::TimedOut
+                      && results[0]->assertionFailures == 0 && (mode == "isolated" || destroyedLocals == 1);
+        allChecksPassed &= reportCheck("TestAsyncTimeoutCancels", mode, passed);
+    }
+
+    // TestAsyncOverlap_*: All pass; a concurrent run has every one of them waiting at the same time
+    {
+        bool passed = true;
+        for (int i = 0; i < 32; ++i) {
+            passed = passed && statusesOf(runner, "TestAsyncOverlap_" + std::to_string(i))
+                                       == std::vector<TestStatus>{TestStatus::Passed};
+        }
+        int inFlight = maxAsyncInFlight();
+        // Isolated workers run their share sequentially, in separate processes.
+        passed = passed && (mode == "concurrent" ? inFlight == 32 : mode == "sequential" ? inFlight == 1 : true);
+        allChecksPassed &= reportCheck("TestAsyncOverlap", mode, passed);
+    }
+
+    // TestAsyncOwnFixture: The async test of a per-worker suite keeps a fixture to itself
+    {
+        auto results = runner.findResults("TestPerWorkerFixtures", "TestAsyncOwnFixture");
+        bool passed = results.size() == 1 && results[0]->status == TestStatus::Passed;
+        allChecksPassed &= reportCheck("TestAsyncOwnFixture", mode, passed);
+    }
+
+    // TestTimeoutCase: Should be reported as timed out
+    {
+        bool passed = statusesOf(runner, "TestTimeoutCase") == std::vector<TestStatus>{TestStatus::TimedOut};
+        allChecksPassed &= reportCheck("TestTimeoutCase", mode, passed);
+    }
+
+    // TestRepeatedMixed: Only the second repetition fails
+    {
+        std::vector<TestStatus> expected = {TestStatus::Passed, TestStatus::Failed, TestStatus::Passed};
+        bool passed = statusesOf(runner, "TestRepeatedMixed") == expected;
+        allChecksPassed &= reportCheck("TestRepeatedMixed", mode, passed);
+    }
+
+    return allChecksPassed;
 }
 
 int main() {
     TestRunner& runner = TestRunner::getInstance();
 
-    // Capture the original buffer
-    std::streambuf* originalCoutBuffer = std::cout.rdbuf();
+    // Only failures are printed; the checks below read the structured results instead of the output
+    runner.options().quiet = true;
 
-    // Set up a stringstream to capture the output
-    std::stringstream capturedOutput;
-    std::cout.rdbuf(capturedOutput.rdbuf());
+    // The family is registered with three instances; its size is only read when a run starts
+    setParameterizedFamilySize(6);
 
     std::cout << "Running internal tests (TestFrameworkTests) sequentially..." << std::endl;
     auto startSequential = std::chrono::high_resolution_clock::now();
@@ -27,10 +347,7 @@ int main() {
     std::chrono::duration<double> durationSequential = endSequential - startSequential;
     std::cout << "Total time for sequential execution: " << durationSequential.count() << " seconds" << std::endl;
 
-    std::string sequentialOutput = capturedOutput.str();
-
-    capturedOutput.str("");
-    capturedOutput.clear();
+    bool allChecksPassed = runChecks(runner, "sequential");
 
     std::cout << "\nRunning internal tests (TestFrameworkTests) concurrently..." << std::endl;
     auto startConcurrent = std::chrono::high_resolution_clock::now();
@@ -39,95 +356,633 @@ int main() {
     std::chrono::duration<double> durationConcurrent = endConcurrent - startConcurrent;
     std::cout << "Total time for concurrent execution: " << durationConcurrent.count() << " seconds" << std::endl;
 
-    // Capture the concurrent run output
-    std::string concurrentOutput = capturedOutput.str();
+    allChecksPassed &= runChecks(runner, "concurrent");
 
-    // Restore original cout buffer
-    std::cout.rdbuf(originalCoutBuffer);
+    // Filtered run: only the matching tests execute, the others are reported as not selected
+    std::cout << "\nRunning filtered internal tests (TestFrameworkTests)..." << std::endl;
+    runner.options().filter = "TestFrameworkInternalTests.TestSimple*:/.*Expected[A-Z][a-z]+/";
+    runner.run(false);
+    runner.options().filter.clear();
+    {
+        bool passed = statusesOf(runner, "TestSimplePass") == std::vector<TestStatus>{TestStatus::Passed}
+                      && statusesOf(runner, "TestSimpleFail") == std::vector<TestStatus>{TestStatus::Failed}
+                      && statusesOf(runner, "TestExpectedException") == std::vector<TestStatus>{TestStatus::Passed}
+                      && statusesOf(runner, "TestUnexpectedException") == std::vector<TestStatus>{TestStatus::NotSelected}
+                      && statusesOf(runner, "TestTimeoutCase") == std::vector<TestStatus>{TestStatus::NotSelected};
+        allChecksPassed &= reportCheck("Filter", "sequential", passed);
+    }
 
-    bool allChecksPassed = true;
+    runner.options().filter = "/TestFrameworkInternalTests\\.TestSimplePass|TestPerWorkerFixtures\\..*/";
+    runner.run(false);
+    runner.options().filter.clear();
+    {
+        auto clones = runner.findResults("TestPerWorkerFixtures", "TestClonedFixtureState");
+        bool passed = statusesOf(runner, "TestSimplePass") == std::vector<TestStatus>{TestStatus::Passed}
+                      && statusesOf(runner, "TestSimpleFail") == std::vector<TestStatus>{TestStatus::NotSelected}
+                      && clones.size() == 50;
+        for (const TestResult* result : clones) {
+            passed &= result->status == TestStatus::Passed;
+        }
+        allChecksPassed &= reportCheck("FilterAlternation", "sequential", passed);
+    }
+
+    // Benchmark run: only the benchmark executes, with short samples to keep the suite fast
+    std::cout << "\nRunning internal benchmarks (TestFrameworkTests)..." << std::endl;
+    runner.options().filter = "TestFrameworkInternalTests.*";
+    runner.options().benchmarkSamples = 5;
+    runner.options().benchmarkSampleTime = std::chrono::milliseconds(1);
+    runner.options().benchmarkWarmupTime = std::chrono::milliseconds(1);
+    const std::vector<BenchmarkResult>& benchmarks = runner.runBenchmarks();
+    runner.options().filter.clear();
+    {
+        bool passed = benchmarks.size() == 1 && benchmarks[0].passed && benchmarks[0].iterations > 0
+                      && benchmarks[0].samples == 5 && benchmarks[0].minNanos <= benchmarks[0].medianNanos
+                      && benchmarks[0].medianNanos <= benchmarks[0].p99Nanos
+                      && statusesOf(runner, "TestBenchmarkAccumulate") == std::vector<TestStatus>{TestStatus::Passed}
+                      && statusesOf(runner, "TestSimplePass") == std::vector<TestStatus>{TestStatus::NotSelected};
+        allChecksPassed &= reportCheck("Benchmark", "benchmark", passed);
+    }
+
+    // Regression gate: a baseline far faster than anything measurable must flag the benchmark and, once single
+    // samples are allowed, the timed test; one far slower, or one with a zero median, must flag nothing
+    std::cout << "\nChecking internal benchmarks against baselines..." << std::endl;
+    const char* baselinePath = "internal_baseline.csv";
+    auto writeBaseline = [&](const std::string& median) {
+        std::ofstream baseline(baselinePath, std::ios::trunc);
+        baseline << "Benchmark,Passed,Iterations,Samples,MinNs,MedianNs,P99Ns,MeanNs,StdDevNs\n";
+        for (const char* name : {"TestBenchmarkAccumulate", "TestSimplePass"}) {
+            baseline << "TestFrameworkInternalTests." << name << ",1,1,5," << median << "," << median << ","
+                     << median << "," << median << ",0\n";
+        }
+    };
+    runner.options().baselinePath = baselinePath;
+    runner.options().filter = "TestFrameworkInternalTests.TestBenchmarkAccumulate:TestFrameworkInternalTests.TestSimplePass";
+    {
+        writeBaseline("0.001");
+        runner.runBenchmarks();
+        bool benchmarkFlagged = runner.regressions().size() == 1
+                                && runner.regressions()[0].name == "TestFrameworkInternalTests.TestBenchmarkAccumulate";
+        runner.run(false);
+        // The test ran once, so by default it has too few samples to be gated
+        bool singleSampleSkipped = runner.regressions().empty();
+        runner.options().regressionMinSamples = 1;
+        runner.run(false);
+        runner.options().regressionMinSamples = 3;
+        bool testFlagged = runner.regressions().size() == 1
+                           && runner.regressions()[0].name == "TestFrameworkInternalTests.TestSimplePass";
+        writeBaseline("1e12");
+        runner.runBenchmarks();
+        bool fasterPasses = runner.regressions().empty();
+        writeBaseline("0");
+        runner.runBenchmarks();
+        bool zeroMedianIgnored = runner.regressions().empty();
+        allChecksPassed &= reportCheck("RegressionGate", "benchmark",
+                                       benchmarkFlagged && singleSampleSkipped && testFlagged && fasterPasses
+                                           && zeroMedianIgnored);
+    }
+    runner.options().filter.clear();
+    runner.options().baselinePath.clear();
+    std::remove(baselinePath);
+
+    // Hardware counters: one entry per result and per worker. Values are not checked, since virtual machines often
+    // have no counters to read.
+    std::cout << "\nRunning internal tests (TestFrameworkTests) with hardware counters..." << std::endl;
+    runner.options().hardwareCounters = true;
+    runner.options().filter = "TestFrameworkInternalTests.TestSimple*";
+    {
+        auto testsRun = [&]() {
+            size_t total = 0;
+            for (const WorkerCounters& worker : runner.workerCounters()) {
+                total += worker.testsRun;
+            }
+            return total;
+        };
+        runner.run(false);
+        bool passed = runner.counters().size() == runner.results().size() && runner.workerCounters().size() == 1
+                      && testsRun() == 2;
+        runner.run(true);
+        passed = passed && runner.counters().size() == runner.results().size() && testsRun() == 2;
+        allChecksPassed &= reportCheck("HardwareCounters", "counters", passed);
+    }
+    runner.options().filter.clear();
+    runner.options().hardwareCounters = false;
 
-    // Check TestSimplePass: Should pass, so no "Assertion failed"
+    // Trace export: every test body that ran appears as a span in the Chrome trace
+    std::cout << "\nRunning traced internal tests (TestFrameworkTests)..." << std::endl;
+    const char* tracePath = "internal_trace.json";
+    runner.options().tracePath = tracePath;
+    runner.options().filter = "TestFrameworkInternalTests.TestSimple*";
+    runner.run(true);
+    runner.options().filter.clear();
+    runner.options().tracePath.clear();
     {
-        // If "Assertion failed" appears after "Running TestSimplePass", it's incorrect.
-        bool hasAssertionFailed = contains(sequentialOutput, "Running TestSimplePass")
-                                  && contains(sequentialOutput, "Assertion failed");
-        if (hasAssertionFailed) {
-            std::cout << "[CHECK] TestSimplePass: FAILED (Found unexpected assertion failure)" << std::endl;
-            allChecksPassed = false;
-        } else {
-            std::cout << "[CHECK] TestSimplePass: PASSED" << std::endl;
+        std::ifstream trace(tracePath);
+        std::string contents((std::istreambuf_iterator<char>(trace)), std::istreambuf_iterator<char>());
+        bool passed = contents.find("\"traceEvents\"") != std::string::npos
+                      && contents.find("\"name\":\"TestFrameworkInternalTests.TestSimplePass\",\"cat\":\"test\"")
+                                 != std::string::npos
+                      && contents.find("\"name\":\"TestFrameworkInternalTests.TestSimpleFail\",\"cat\":\"test\"")
+                                 != std::string::npos
+                      && contents.find("TestUnexpectedException") == std::string::npos;
+        allChecksPassed &= reportCheck("Trace", "concurrent", passed);
+    }
+    std::remove(tracePath);
+
+    // Scaling curve: the stress test is measured at 1, 2 and 4 threads, each making all of its calls
+    std::cout << "\nMeasuring the scaling of internal stress tests (TestFrameworkTests)..." << std::endl;
+    runner.options().stressScaling = true;
+    runner.options().filter = "TestFrameworkInternalTests.TestStressFanOut";
+    runner.run(true);
+    runner.options().filter.clear();
+    runner.options().stressScaling = false;
+    {
+        const StressResult* stress = stressResultOf(runner, "TestStressFanOut");
+        bool passed = statusesOf(runner, "TestStressFanOut") == std::vector<TestStatus>{TestStatus::Passed} && stress
+                      && stress->points.size() == 3 && takeStressCalls() == 140 && takeStressThreadsSeen() == 0xF;
+        for (size_t i = 0; passed && i < stress->points.size(); ++i) {
+            passed = stress->points[i].threads == 1u << i && stress->points[i].calls == 20u << i
+                     && stress->points[i].callsPerSecond > 0;
         }
+        allChecksPassed &= reportCheck("StressScaling", "concurrent", passed);
     }
 
-    // Check TestSimpleFail: Expect an assertion failure
+    // Placement options are read from the command line
     {
-        bool foundFail = contains(sequentialOutput, "Assertion failed");
-        if (!foundFail) {
-            std::cout << "[CHECK] TestSimpleFail: FAILED" << std::endl;
-            allChecksPassed = false;
-        } else {
-            std::cout << "[CHECK] TestSimpleFail: PASSED" << std::endl;
+        RunnerOptions saved = runner.options();
+        const char* arguments[] = {"run_internal", "--workers=5", "--pin", "1,4-6", "--reserve-cpus=2"};
+        const char* reversedRange[] = {"run_internal", "--pin=6-4"};
+        const char* hugeRange[] = {"run_internal", "--pin=0-2000000000"};
+        bool passed = runner.parseCommandLine(5, const_cast<char**>(arguments)) && runner.options().workerThreads == 5
+                      && runner.options().pinning == CpuPinning::List
+                      && runner.options().pinnedCpus == std::vector<int>{1, 4, 5, 6}
+                      && runner.options().reservedCpus == 2
+                      && !runner.parseCommandLine(2, const_cast<char**>(reversedRange))
+                      && !runner.parseCommandLine(2, const_cast<char**>(hugeRange));
+        runner.options() = saved;
+        allChecksPassed &= reportCheck("PlacementOptions", "sequential", passed);
+    }
+
+#if defined(__linux__)
+    // Worker placement: the worker count is honoured, pinned workers may only use their own CPU, and a run without
+    // pinning gets every CPU back
+    std::cout << "\nRunning an internal test on pinned workers (TestFrameworkTests)..." << std::endl;
+    runner.options().filter = "TestFrameworkInternalTests.TestRecordsPlacement";
+    runner.run(false);
+    {
+        int unpinnedCpus = placementCpuCount();
+        runner.options().workerThreads = 3;
+        runner.run(true);
+        bool passed = runner.workerCpus() == std::vector<int>{-1, -1, -1} && placementCpuCount() == unpinnedCpus;
+        runner.options().pinning = CpuPinning::Compact;
+        runner.run(true);
+        std::vector<int> cpus = runner.workerCpus();
+        passed = passed && cpus.size() == 3 && std::find(cpus.begin(), cpus.end(), -1) == cpus.end()
+                 && placementCpuCount() == 1 && std::find(cpus.begin(), cpus.end(), placementCpu()) != cpus.end();
+        allChecksPassed &= reportCheck("PinnedWorkers", "concurrent", passed);
+
+        int cpu = cpus.empty() ? 0 : cpus.front();
+        runner.options().pinning = CpuPinning::List;
+        runner.options().pinnedCpus = {cpu};
+        runner.run(false);
+        passed = runner.workerCpus() == std::vector<int>{cpu} && placementCpuCount() == 1 && placementCpu() == cpu;
+        runner.options().pinning = CpuPinning::None;
+        runner.options().pinnedCpus.clear();
+        runner.options().workerThreads = 0;
+        runner.run(false);
+        passed = passed && runner.workerCpus() == std::vector<int>{-1} && placementCpuCount() == unpinnedCpus;
+        allChecksPassed &= reportCheck("PinnedWorkers", "sequential", passed);
+    }
+
+    // Without a worker count or pinning, a concurrent run has one worker per CPU in the affinity mask
+    {
+        runner.run(true);
+        bool passed = runner.workerCpus().size() == static_cast<size_t>(placementCpuCount());
+        allChecksPassed &= reportCheck("DefaultWorkers", "concurrent", passed);
+    }
+    runner.options().filter.clear();
+#endif
+
+    // Flakiness database: the timing database accumulates the passes and failures of every run
+    std::cout << "\nRecording the flakiness of internal tests (TestFrameworkTests)..." << std::endl;
+    const char* timingPath = "internal_timings.db";
+    std::remove(timingPath);
+    runner.options().timingDatabasePath = timingPath;
+    runner.options().filter = "TestFrameworkInternalTests.TestFlakyThreeQuarters";
+    {
+        uint32_t runs = 0;
+        uint32_t passes = 0;
+        for (int i = 0; i < 2; ++i) {
+            runner.run(false);
+            const FlakinessReport* report = flakinessOf(runner, "TestFlakyThreeQuarters");
+            runs += report ? report->runs : 0;
+            passes += report ? report->passes : 0;
         }
+        std::ifstream database(timingPath);
+        std::string line;
+        std::string recorded;
+        while (std::getline(database, line)) {
+            if (line.rfind("TestFrameworkInternalTests\tTestFlakyThreeQuarters\t", 0) == 0) {
+                recorded = line.substr(line.find('\t', line.find('\t') + 1) + 1);
+            }
+        }
+        std::string expected = "\t" + std::to_string(passes) + "\t" + std::to_string(runs - passes);
+        bool passed = runs > 0 && recorded.size() > expected.size()
+                      && recorded.compare(recorded.size() - expected.size(), expected.size(), expected) == 0;
+        allChecksPassed &= reportCheck("FlakinessDatabase", "sequential", passed);
     }
+    runner.options().filter.clear();
 
-    // Check TestDisabledCheck: Expect skipping message
+    // Duration-based scheduling: with one worker the tests of a suite run longest first by the database, the
+    // estimated makespan is the longest-first schedule of the recorded durations, and saving blends the stored
+    // durations with the measured ones instead of replacing them
+    std::cout << "\nScheduling internal tests by recorded duration (TestFrameworkTests)..." << std::endl;
+    runner.options().filter = "TestFrameworkInternalTests.TestSimplePass:TestFrameworkInternalTests.TestSimpleFail"
+                              ":TestFrameworkInternalTests.TestExpectedException";
     {
-        bool foundDisabledSkip = contains(sequentialOutput, "Skipping Disabled Test Case: TestDisabledCheck");
-        if (!foundDisabledSkip) {
-            std::cout << "[CHECK] TestDisabledCheck: FAILED" << std::endl;
-            allChecksPassed = false;
-        } else {
-            std::cout << "[CHECK] TestDisabledCheck: PASSED" << std::endl;
+        auto writeTimings = [&] {
+            std::ofstream database(timingPath, std::ios::trunc);
+            database << "# CUnit++ timing database v2\n"
+                     << "TestFrameworkInternalTests\tTestSimplePass\t1000000\t0\t0\n"
+                     << "TestFrameworkInternalTests\tTestSimpleFail\t3000000000\t0\t0\n"
+                     << "TestFrameworkInternalTests\tTestExpectedException\t2000000000\t0\t0\n";
+        };
+        auto storedNanos = [&](const std::string& testName) {
+            std::ifstream database(timingPath);
+            std::string line;
+            std::string prefix = "TestFrameworkInternalTests\t" + testName + "\t";
+            while (std::getline(database, line)) {
+                if (line.rfind(prefix, 0) == 0) {
+                    return std::stoull(line.substr(prefix.size()));
+                }
+            }
+            return 0ull;
+        };
+        auto order = std::make_shared<OrderReporter>();
+        runner.options().reporters = {order};
+        runner.options().workerThreads = 1;
+        writeTimings();
+        runner.run(true);
+        bool longestFirst = order->finished
+                            == std::vector<std::string>{"TestSimpleFail", "TestExpectedException", "TestSimplePass"};
+        bool singleWorkerMakespan = runner.scheduleReport().workers == 1
+                                    && runner.scheduleReport().knownTests == 3
+                                    && runner.scheduleReport().estimatedMakespanNanos == 5001000000ull;
+        // Each test takes far less than a second, so a blended record lands just above half the stored one.
+        unsigned long long blended = storedNanos("TestSimpleFail");
+        bool blendedOnSave = blended >= 1500000000ull && blended < 2000000000ull;
+        runner.options().workerThreads = 2;
+        writeTimings();
+        runner.run(true);
+        bool twoWorkerMakespan = runner.scheduleReport().workers == 2
+                                 && runner.scheduleReport().estimatedMakespanNanos == 3000000000ull;
+        allChecksPassed &= reportCheck("DurationSchedule", "concurrent",
+                                       longestFirst && singleWorkerMakespan && blendedOnSave && twoWorkerMakespan);
+    }
+    runner.options().reporters.clear();
+    runner.options().workerThreads = 0;
+    runner.options().filter.clear();
+    runner.options().timingDatabasePath.clear();
+    std::remove(timingPath);
+
+    // Incremental selection: an unchanged passing test is left out, a failing one reruns, and a change to a file
+    // the dependency map assigns to a test brings it back
+    std::cout << "\nRunning internal tests incrementally (TestFrameworkTests)..." << std::endl;
+    const char* cachePath = "internal_selection.cache";
+    const char* dependencyPath = "internal_dependency.txt";
+    const char* mapPath = "internal_dependency.map";
+    std::remove(cachePath);
+    std::ofstream(dependencyPath) << "first\n";
+    std::ofstream(mapPath) << "# Files covered by each test\n*.TestSimplePass\t" << dependencyPath << "\n";
+    runner.options().selectionCachePath = cachePath;
+    runner.options().dependencyMapPath = mapPath;
+    runner.options().filter = "TestFrameworkInternalTests.TestSimplePass:TestFrameworkInternalTests.TestSimpleFail";
+    {
+        auto ran = [&](const std::string& testName) {
+            std::vector<TestStatus> statuses = statusesOf(runner, testName);
+            return statuses.size() == 1 && statuses[0] != TestStatus::NotSelected;
+        };
+        runner.run(false);
+        bool passed = ran("TestSimplePass") && ran("TestSimpleFail");
+        runner.run(false);
+        passed = passed && !ran("TestSimplePass") && ran("TestSimpleFail");
+        std::ofstream(dependencyPath) << "second\n";
+        runner.run(false);
+        passed = passed && ran("TestSimplePass") && ran("TestSimpleFail");
+        allChecksPassed &= reportCheck("IncrementalSelection", "sequential", passed);
+    }
+    runner.options().filter.clear();
+    runner.options().selectionCachePath.clear();
+    runner.options().dependencyMapPath.clear();
+    std::remove(cachePath);
+    std::remove(dependencyPath);
+    std::remove(mapPath);
+
+    // Reporters: custom reporters and every report file format see the same events, in concurrent and sequential
+    // runs, and binary reports of two shards merge in name order
+    std::cout << "\nRunning internal tests with report files (TestFrameworkTests)..." << std::endl;
+    const char* jsonPath = "internal_report.jsonl";
+    const char* junitPath = "internal_report.xml";
+    const char* binaryPaths[] = {"internal_report_pass.bin", "internal_report_fail.bin", "internal_report.bin"};
+    auto counting = std::make_shared<CountingReporter>();
+    runner.options().reporters = {counting};
+    runner.options().reportFiles = {{ReportFormat::JsonLines, jsonPath}, {ReportFormat::JUnitXml, junitPath}};
+    for (bool concurrent : {true, false}) {
+        *counting = CountingReporter();
+        runner.options().filter = "TestFrameworkInternalTests.TestSimplePass:TestFrameworkInternalTests.TestSimpleFail";
+        runner.run(concurrent);
+        std::string json = readFile(jsonPath);
+        std::string junit = readFile(junitPath);
+        bool passed = counting->starts == 1 && counting->finishes == 1 && counting->testFinishes == 2
+                      && counting->failedCount == 1 && json.rfind("{\"type\":\"run_start\"}\n", 0) == 0
+                      && json.find("\"type\":\"test_finish\",\"suite\":\"TestFrameworkInternalTests\","
+                                   "\"test\":\"TestSimplePass\",\"repetition\":1,\"status\":\"passed\"")
+                                 != std::string::npos
+                      && json.find("\"type\":\"assertion_failure\"") != std::string::npos
+                      && json.find("{\"type\":\"summary\",\"passed\":1,\"failed\":1,\"skipped\":0}")
+                                 != std::string::npos
+                      && junit.find("<testsuite name=\"TestFrameworkInternalTests\" tests=\"2\" failures=\"1\"")
+                                 != std::string::npos
+                      && junit.find("<failure message=") != std::string::npos
+                      && junit.find("</testsuites>") != std::string::npos;
+        allChecksPassed &= reportCheck("Reporters", concurrent ? "concurrent" : "sequential", passed);
+    }
+    runner.options().reportFiles.clear();
+    runner.options().reporters.clear();
+    {
+        runner.options().filter = "TestFrameworkInternalTests.TestSimplePass";
+        runner.options().reportFiles = {{ReportFormat::Binary, binaryPaths[0]}};
+        runner.run(false);
+        runner.options().filter = "TestFrameworkInternalTests.TestSimpleFail";
+        runner.options().reportFiles = {{ReportFormat::Binary, binaryPaths[1]}};
+        runner.run(false);
+        std::vector<ReportedResult> results;
+        bool passed = TestRunner::mergeBinaryReports({binaryPaths[0], binaryPaths[1]}, binaryPaths[2])
+                      && TestRunner::readBinaryReport(binaryPaths[2], results) && results.size() == 2
+                      && results[0].test == "TestSimpleFail" && results[0].status == TestStatus::Failed
+                      && results[1].test == "TestSimplePass" && results[1].status == TestStatus::Passed
+                      && results[1].suite == "TestFrameworkInternalTests" && results[1].repetition == 1
+                      && results[1].instance == -1;
+        allChecksPassed &= reportCheck("BinaryReportMerge", "sequential", passed);
+    }
+    {
+        // Result files of shards merge in registration order, where TestSimplePass precedes TestSimpleFail
+        const char* resultPaths[] = {"internal_results_fail.tsv", "internal_results_pass.tsv",
+                                     "internal_results_merged.tsv", "internal_results_unsharded.tsv"};
+        auto testsIn = [](const std::string& path) {
+            std::vector<std::string> tests;
+            std::ifstream in(path);
+            std::string line;
+            while (std::getline(in, line)) {
+                if (!line.empty() && line[0] != '#') {
+                    size_t first = line.find('\t');
+                    tests.push_back(line.substr(first + 1, line.find('\t', first + 1) - first - 1));
+                }
+            }
+            return tests;
+        };
+        runner.options().reportFiles.clear();
+        runner.options().filter = "TestFrameworkInternalTests.TestSimpleFail";
+        runner.options().resultFilePath = resultPaths[0];
+        runner.run(false);
+        runner.options().filter = "TestFrameworkInternalTests.TestSimplePass";
+        runner.options().resultFilePath = resultPaths[1];
+        runner.run(false);
+        runner.options().filter = "TestFrameworkInternalTests.TestSimplePass:TestFrameworkInternalTests.TestSimpleFail";
+        runner.options().resultFilePath = resultPaths[3];
+        runner.run(false);
+        runner.options().resultFilePath.clear();
+        bool passed = TestRunner::mergeResultFiles({resultPaths[0], resultPaths[1]}, resultPaths[2])
+                      && testsIn(resultPaths[2]) == std::vector<std::string>{"TestSimplePass", "TestSimpleFail"}
+                      && testsIn(resultPaths[2]) == testsIn(resultPaths[3]);
+        allChecksPassed &= reportCheck("ResultFileMerge", "sequential", passed);
+        for (const char* path : resultPaths) {
+            std::remove(path);
         }
     }
+    runner.options().filter.clear();
+    runner.options().reportFiles.clear();
+    std::remove(jsonPath);
+    std::remove(junitPath);
+    for (const char* path : binaryPaths) {
+        std::remove(path);
+    }
 
-    // Check TestExpectedException: Should not report that expected exception wasn't thrown
+    // Sharding: for both strategies the shards of one registry are disjoint and together run every test, the filter
+    // only narrows a shard, and the merged result files list the tests as an unsharded run does
+    std::cout << "\nRunning every shard of the internal tests (TestFrameworkTests)..." << std::endl;
     {
-        // We only fail if "Expected exception of type ... was not thrown" appears.
-        bool noExpectedThrown = contains(sequentialOutput, "Expected exception of type 'std::runtime_error' was not thrown");
-        // Also check no unexpected exception message for this test.
-        bool unexpectedMessage = contains(sequentialOutput, "Unexpected exception thrown in test 'TestExpectedException'");
-        if (noExpectedThrown || unexpectedMessage) {
-            std::cout << "[CHECK] TestExpectedException: FAILED" << std::endl;
-            allChecksPassed = false;
-        } else {
-            std::cout << "[CHECK] TestExpectedException: PASSED" << std::endl;
+        constexpr unsigned int shardCount = 3;
+        const char* shardTimingPath = "internal_shard_timings.db";
+        const char* unshardedPath = "internal_shard_unsharded.tsv";
+        const char* mergedPath = "internal_shard_merged.tsv";
+        const char* shardPaths[shardCount] = {"internal_shard_0.tsv", "internal_shard_1.tsv", "internal_shard_2.tsv"};
+        using TestKey = std::pair<uint32_t, uint32_t>;
+        auto selectedTests = [&] {
+            std::set<TestKey> tests;
+            for (const TestResult& result : runner.results()) {
+                if (result.status != TestStatus::NotSelected) {
+                    tests.insert({result.suiteIndex, result.testIndex});
+                }
+            }
+            return tests;
+        };
+        // The test column of a result file, one entry per test however many repetitions an adaptive test ran
+        auto testsIn = [](const std::string& path) {
+            std::vector<std::string> tests;
+            std::ifstream in(path);
+            std::string line;
+            while (std::getline(in, line)) {
+                if (!line.empty() && line[0] != '#') {
+                    size_t first = line.find('\t');
+                    std::string test = line.substr(0, line.find('\t', first + 1));
+                    if (tests.empty() || tests.back() != test) {
+                        tests.push_back(test);
+                    }
+                }
+            }
+            return tests;
+        };
+        runner.options().quiet = true;
+        runner.options().timingDatabasePath = shardTimingPath;
+        runner.options().resultFilePath = unshardedPath;
+        std::remove(shardTimingPath);
+        runner.run(true);
+        std::set<TestKey> registry;
+        for (const TestResult& result : runner.results()) {
+            registry.insert({result.suiteIndex, result.testIndex});
+        }
+        bool passed = selectedTests() == registry;
+        // Every shard must balance the same recorded durations, so the database is restored before each run.
+        std::string timings = readFile(shardTimingPath);
+        for (ShardStrategy strategy : {ShardStrategy::Hash, ShardStrategy::Duration}) {
+            runner.options().shardStrategy = strategy;
+            runner.options().shardCount = shardCount;
+            std::set<TestKey> covered;
+            size_t coveredCount = 0;
+            std::vector<std::set<TestKey>> shards;
+            for (unsigned int index = 0; index < shardCount; ++index) {
+                std::ofstream(shardTimingPath, std::ios::trunc) << timings;
+                runner.options().shardIndex = index;
+                runner.options().resultFilePath = shardPaths[index];
+                runner.run(true);
+                shards.push_back(selectedTests());
+                covered.insert(shards.back().begin(), shards.back().end());
+                coveredCount += shards.back().size();
+            }
+            // Disjoint shards cover as many distinct tests as they select in total.
+            passed = passed && covered == registry && coveredCount == registry.size();
+            passed = passed && TestRunner::mergeResultFiles({shardPaths, shardPaths + shardCount}, mergedPath)
+                     && !testsIn(mergedPath).empty() && testsIn(mergedPath) == testsIn(unshardedPath);
+
+            runner.options().resultFilePath.clear();
+            runner.options().filter = "TestFrameworkInternalTests.TestSimple*";
+            for (unsigned int index = 0; index < shardCount; ++index) {
+                std::ofstream(shardTimingPath, std::ios::trunc) << timings;
+                runner.options().shardIndex = index;
+                runner.run(true);
+                std::set<TestKey> expected;
+                for (const TestKey& test : shards[index]) {
+                    std::string_view name = runner.getSuites()[test.first]->testCases[test.second].name;
+                    if (name.rfind("TestSimple", 0) == 0) {
+                        expected.insert(test);
+                    }
+                }
+                passed = passed && selectedTests() == expected;
+            }
+            runner.options().filter.clear();
+            allChecksPassed &= reportCheck("Sharding", strategy == ShardStrategy::Hash ? "hash" : "duration", passed);
+        }
+        runner.options().shardCount = 1;
+        runner.options().shardIndex = 0;
+        runner.options().shardStrategy = ShardStrategy::Hash;
+        runner.options().timingDatabasePath.clear();
+        runner.options().quiet = false;
+        std::remove(shardTimingPath);
+        std::remove(unshardedPath);
+        std::remove(mergedPath);
+        for (const char* path : shardPaths) {
+            std::remove(path);
         }
     }
 
-    // Check TestUnexpectedException: Should see "Unexpected exception thrown in test 'TestUnexpectedException'"
+    // Cancellation: after the first failure a fail-fast run leaves the rest of its tests and suites unrun, and a
+    // time budget ends a run whose tests poll for it, draining the queued repetitions
+    std::cout << "\nRunning internal tests with --fail-fast and a time budget (TestFrameworkTests)..." << std::endl;
     {
-        bool foundUnexpected = contains(sequentialOutput, "Unexpected exception thrown in test 'TestUnexpectedException");
-        if (foundUnexpected) {
-            std::cout << "[CHECK] TestUnexpectedException: FAILED" << std::endl;
-            allChecksPassed = false;
-        } else {
-            std::cout << "[CHECK] TestUnexpectedException: PASSED" << std::endl;
+        runner.options().maxFailures = 1;
+        runner.options().filter = "TestFrameworkInternalTests.TestSimplePass:TestFrameworkInternalTests.TestSimpleFail"
+                                  ":TestFrameworkInternalTests.TestExpectedException:TestPerWorkerFixtures.*";
+        runner.run(false);
+        auto clones = runner.findResults("TestPerWorkerFixtures", "TestClonedFixtureState");
+        bool passed = runner.cancelled() && clones.size() == 50
+                      && statusesOf(runner, "TestSimplePass") == std::vector<TestStatus>{TestStatus::Passed}
+                      && statusesOf(runner, "TestSimpleFail") == std::vector<TestStatus>{TestStatus::Failed}
+                      && statusesOf(runner, "TestExpectedException")
+                                 == std::vector<TestStatus>{TestStatus::NotSelected};
+        for (const TestResult* result : clones) {
+            passed &= result->status == TestStatus::NotSelected;
         }
+        allChecksPassed &= reportCheck("FailFast", "sequential", passed);
+        runner.options().maxFailures = 0;
+        runner.run(false);
+        allChecksPassed &= reportCheck("FailFastReset", "sequential", !runner.cancelled());
+    }
+    runner.options().timeBudget = std::chrono::milliseconds(100);
+    runner.options().filter = "TestFrameworkInternalTests.TestWaitsForCancellation";
+    for (bool concurrent : {true, false}) {
+        auto start = std::chrono::steady_clock::now();
+        runner.run(concurrent);
+        auto elapsed = std::chrono::steady_clock::now() - start;
+        std::vector<TestStatus> statuses = statusesOf(runner, "TestWaitsForCancellation");
+        size_t ran = statuses.size() - std::count(statuses.begin(), statuses.end(), TestStatus::NotSelected);
+        size_t workers = concurrent ? runner.workerCpus().size() : 1;
+        bool passed = runner.cancelled() && statuses.size() == 50 && ran >= 1 && ran <= workers
+                      && std::count(statuses.begin(), statuses.end(), TestStatus::Passed) == static_cast<long>(ran)
+                      && elapsed < std::chrono::seconds(3);
+        allChecksPassed &= reportCheck("TimeBudget", concurrent ? "concurrent" : "sequential", passed);
     }
+    runner.options().timeBudget = std::chrono::milliseconds::zero();
+    runner.options().filter.clear();
 
-    // Check TestTimeoutCase: Should see a timeout message "timed out after"
+    // Allocation tracking: a test's blocks, peak and leak are attributed to it, and a test arena serves them
+    std::cout << "\nRunning internal tests with allocation tracking (TestFrameworkTests)..." << std::endl;
+    runner.options().trackAllocations = true;
+    runner.options().filter = "TestFrameworkInternalTests.TestAllocationProfile";
+    for (bool concurrent : {true, false}) {
+        runner.run(concurrent);
+        auto results = runner.findResults("TestFrameworkInternalTests", "TestAllocationProfile");
+        bool passed = results.size() == 1 && runner.allocations().size() == runner.results().size();
+        if (passed) {
+            const AllocationStats& stats = runner.allocations()[results[0] - runner.results().data()];
+            passed = stats.bodyAllocations >= 11 && stats.bodyBytes >= 10000
+                     && stats.allocations >= stats.bodyAllocations && stats.bytes >= stats.bodyBytes
+                     && stats.peakLiveBytes >= 10000 && stats.leakedBytes >= 1000
+                     && stats.leakedBytes < 2000 && stats.arenaBytes == 0;
+        }
+        allChecksPassed &= reportCheck("AllocationTracking", concurrent ? "concurrent" : "sequential", passed);
+    }
+    runner.options().testArenaBytes = 1 << 20;
+    runner.run(false);
     {
-        bool foundTimeout = contains(sequentialOutput, "timed out after");
-        if (!foundTimeout) {
-            std::cout << "[CHECK] TestTimeoutCase: FAILED" << std::endl;
-            allChecksPassed = false;
-        } else {
-            std::cout << "[CHECK] TestTimeoutCase: PASSED" << std::endl;
+        auto results = runner.findResults("TestFrameworkInternalTests", "TestAllocationProfile");
+        bool passed = results.size() == 1 && results[0]->status == TestStatus::Passed
+                      && runner.allocations().size() == runner.results().size();
+        if (passed) {
+            const AllocationStats& stats = runner.allocations()[results[0] - runner.results().data()];
+            passed = stats.arenaBytes >= 10000 && stats.leakedBytes < 1000;
         }
+        allChecksPassed &= reportCheck("TestArena", "sequential", passed);
     }
+    runner.options().testArenaBytes = 0;
+    runner.options().trackAllocations = false;
+    runner.options().filter.clear();
+
+    // Registration: suites and tests are discovered in declaration order, and a test added after the first run
+    // joins the end of its suite on the next one
+    std::cout << "\nRunning a test registered after startup (TestFrameworkTests)..." << std::endl;
+    registerLateTest();
+    runner.options().filter = "TestFrameworkInternalTests.TestRegisteredLate";
+    runner.run(false);
+    runner.options().filter.clear();
+    {
+        const auto& suites = runner.getSuites();
+        bool passed = suites.size() == 2 && suites[0]->name == "TestFrameworkInternalTests"
+                      && suites[1]->name == "TestPerWorkerFixtures"
+                      && suites[0]->testCases.front().name == "TestSimplePass"
+                      && suites[0]->testCases.back().name == "TestRegisteredLate"
+                      && statusesOf(runner, "TestRegisteredLate") == std::vector<TestStatus>{TestStatus::Passed};
+        allChecksPassed &= reportCheck("Registration", "sequential", passed);
+    }
+
+#if defined(__unix__) || defined(__APPLE__)
+    std::cout << "\nRunning internal tests (TestFrameworkTests) in isolated worker processes..." << std::endl;
+    runner.options().isolatedProcesses = 2;
+    runner.run(false);
+    runner.options().isolatedProcesses = 0;
+
+    allChecksPassed &= runChecks(runner, "isolated");
 
-    // Check TestRepeatedMixed: repetition fails
+    // A worker process that exits with an error after its last test neither fails nor re-runs the tests it finished
+    std::cout << "\nRunning an isolated worker that exits with an error after its tests (TestFrameworkTests)..." << std::endl;
     {
-        bool foundMixedTestFail = contains(sequentialOutput, "Assertion failed");
-        if (!foundMixedTestFail) {
-            std::cout << "[CHECK] TestRepeatedMixed: FAILED" << std::endl;
-            allChecksPassed = false;
-        } else {
-            std::cout << "[CHECK] TestRepeatedMixed: PASSED" << std::endl;
+        auto counting = std::make_shared<CountingReporter>();
+        runner.options().reporters = {counting};
+        runner.options().filter = "TestPerWorkerFixtures.TestClonedFixtureState";
+        runner.options().isolatedProcesses = 1;
+        setExitAfterPerWorkerSuite(true);
+        runner.run(false);
+        setExitAfterPerWorkerSuite(false);
+        runner.options().isolatedProcesses = 0;
+        runner.options().filter.clear();
+        runner.options().reporters.clear();
+        auto results = runner.findResults("TestPerWorkerFixtures", "TestClonedFixtureState");
+        bool passed = results.size() == 50 && counting->testFinishes == 50 && counting->failedCount == 0;
+        for (const TestResult* result : results) {
+            passed &= result->status == TestStatus::Passed;
         }
+        allChecksPassed &= reportCheck("IsolatedExitAfterTests", "isolated", passed);
     }
+#endif
 
     // Print overall result
     if (allChecksPassed) {
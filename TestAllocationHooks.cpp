@@ -0,0 +1,71 @@
+// TestAllocationHooks.cpp
+#include "TestFramework.h"
+#include <cstddef>
+#include <new>
+
+// Linked in through the testframework_allocation_hooks target by executables that want
+// RunnerOptions::trackAllocations and RunnerOptions::testArenaBytes. The others keep the standard operators, so their
+// allocations carry no header and sanitizers still intercept them.
+
+namespace {
+
+[[maybe_unused]] const bool hooksRegistered = (registerAllocationHooks(), true);
+
+} // namespace
+
+// Replacements of the global allocation functions, which attribute allocations to the running test and serve them
+// from its arena. Every block carries an AllocationHeader, so delete works whichever thread frees the block and
+// whenever tracking was switched on or off. The over-aligned forms are left to the standard library.
+
+void* operator new(std::size_t size) {
+    while (true) {
+        if (void* pointer = allocationHookAllocate(size)) {
+            return pointer;
+        }
+        std::new_handler handler = std::get_new_handler();
+        if (!handler) {
+            throw std::bad_alloc();
+        }
+        handler();
+    }
+}
+
+void* operator new[](std::size_t size) {
+    return ::operator new(size);
+}
+
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept {
+    try {
+        return ::operator new(size);
+    } catch (...) {
+        return nullptr;
+    }
+}
+
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept {
+    return ::operator new(size, std::nothrow);
+}
+
+void operator delete(void* pointer) noexcept {
+    allocationHookFree(pointer);
+}
+
+void operator delete[](void* pointer) noexcept {
+    allocationHookFree(pointer);
+}
+
+void operator delete(void* pointer, std::size_t) noexcept {
+    allocationHookFree(pointer);
+}
+
+void operator delete[](void* pointer, std::size_t) noexcept {
+    allocationHookFree(pointer);
+}
+
+void operator delete(void* pointer, const std::nothrow_t&) noexcept {
+    allocationHookFree(pointer);
+}
+
+void operator delete[](void* pointer, const std::nothrow_t&) noexcept {
+    allocationHookFree(pointer);
+}
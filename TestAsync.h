@@ -0,0 +1,280 @@
+#ifndef TESTASYNC_H
+#define TESTASYNC_H
+
+#include "TestFramework.h"
+#include <chrono>
+#include <coroutine>
+#include <cstdint>
+#include <exception>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+class AsyncEvent;
+class AsyncLoop;
+struct AsyncTestState;
+
+/**
+ * @brief Coroutine type of an ASYNC_TEST_CASE body and of the helper coroutines it co_awaits.
+ *
+ * The coroutine starts suspended; the runner resumes it on one of its workers. At every co_await on sleepFor(),
+ * waitReadable(), waitWritable() or an AsyncEvent the test gives the worker back, so thousands of tests waiting on
+ * sockets and timers overlap on a few threads. co_await on another AsyncTest runs it until it completes and
+ * rethrows the exception it ended with, if any. An AsyncTest owns its coroutine frame and destroys it with itself.
+ */
+class AsyncTest {
+public:
+    struct promise_type {
+        std::exception_ptr error;
+        // The coroutine awaiting this one, resumed when it completes; null for a test body.
+        std::coroutine_handle<> continuation;
+
+        AsyncTest get_return_object() noexcept {
+            return AsyncTest(std::coroutine_handle<promise_type>::from_promise(*this));
+        }
+
+        std::suspend_always initial_suspend() noexcept {
+            return {};
+        }
+
+        auto final_suspend() noexcept {
+            struct ResumeContinuation {
+                bool await_ready() noexcept {
+                    return false;
+                }
+
+                std::coroutine_handle<> await_suspend(std::coroutine_handle<promise_type> finished) noexcept {
+                    std::coroutine_handle<> continuation = finished.promise().continuation;
+                    return continuation ? continuation : std::noop_coroutine();
+                }
+
+                void await_resume() noexcept {}
+            };
+            return ResumeContinuation{};
+        }
+
+        void return_void() noexcept {}
+
+        void unhandled_exception() noexcept {
+            error = std::current_exception();
+        }
+    };
+
+    using Handle = std::coroutine_handle<promise_type>;
+
+    AsyncTest(AsyncTest&& other) noexcept : handle(std::exchange(other.handle, {})) {}
+
+    AsyncTest& operator=(AsyncTest&& other) noexcept {
+        if (this != &other) {
+            if (handle) {
+                handle.destroy();
+            }
+            handle = std::exchange(other.handle, {});
+        }
+        return *this;
+    }
+
+    ~AsyncTest() {
+        if (handle) {
+            handle.destroy();
+        }
+    }
+
+    /**
+     * @brief The coroutine; the runner resumes it and reads its promise.
+     */
+    Handle coroutine() const noexcept {
+        return handle;
+    }
+
+    bool await_ready() const noexcept {
+        return !handle || handle.done();
+    }
+
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) noexcept {
+        handle.promise().continuation = awaiting;
+        return handle;
+    }
+
+    void await_resume() const {
+        if (handle && handle.promise().error) {
+            std::rethrow_exception(handle.promise().error);
+        }
+    }
+
+private:
+    explicit AsyncTest(Handle handle) noexcept : handle(handle) {}
+
+    Handle handle;
+};
+
+/**
+ * @brief What a suspended async test is waiting for.
+ */
+struct AsyncWait {
+    enum class Kind { Timer, Readable, Writable, Event };
+
+    Kind kind = Kind::Timer;
+    std::chrono::steady_clock::time_point deadline{};
+    int fd = -1;
+    AsyncEvent* event = nullptr;
+};
+
+/**
+ * @brief Called by the awaitables below: suspends the async test running on this thread until `wait` completes.
+ * @return False, so the caller continues immediately, when no async test is running on this thread.
+ */
+bool suspendAsyncTest(std::coroutine_handle<> handle, const AsyncWait& wait);
+
+/**
+ * @brief Awaitable returned by sleepFor(), waitReadable(), waitWritable() and AsyncEvent.
+ */
+class AsyncWaitAwaiter {
+public:
+    explicit AsyncWaitAwaiter(const AsyncWait& wait) : wait(wait) {}
+
+    bool await_ready() const noexcept {
+        return false;
+    }
+
+    bool await_suspend(std::coroutine_handle<> handle) {
+        return suspendAsyncTest(handle, wait);
+    }
+
+    void await_resume() const noexcept {}
+
+private:
+    AsyncWait wait;
+};
+
+/**
+ * @brief Suspends the async test until the given time; other tests use the worker meanwhile.
+ */
+inline AsyncWaitAwaiter sleepUntil(std::chrono::steady_clock::time_point deadline) {
+    AsyncWait wait;
+    wait.deadline = deadline;
+    return AsyncWaitAwaiter(wait);
+}
+
+/**
+ * @brief Suspends the async test for the given duration; `sleepFor(0ms)` just lets other tests run.
+ */
+template <typename Rep, typename Period>
+AsyncWaitAwaiter sleepFor(std::chrono::duration<Rep, Period> duration) {
+    return sleepUntil(std::chrono::steady_clock::now()
+                      + std::chrono::duration_cast<std::chrono::steady_clock::duration>(duration));
+}
+
+/**
+ * @brief Suspends the async test until the file descriptor is readable, or has an error or hang-up pending.
+ *
+ * Supported where poll() is; elsewhere waiting fails the test.
+ */
+inline AsyncWaitAwaiter waitReadable(int fd) {
+    AsyncWait wait;
+    wait.kind = AsyncWait::Kind::Readable;
+    wait.fd = fd;
+    return AsyncWaitAwaiter(wait);
+}
+
+/**
+ * @brief Suspends the async test until the file descriptor is writable, or has an error or hang-up pending.
+ */
+inline AsyncWaitAwaiter waitWritable(int fd) {
+    AsyncWait wait;
+    wait.kind = AsyncWait::Kind::Writable;
+    wait.fd = fd;
+    return AsyncWaitAwaiter(wait);
+}
+
+/**
+ * @brief A flag async tests can co_await, set from any thread, for example by the callback of an I/O library.
+ *
+ * Awaiting a set event continues at once (after letting other tests run); set() resumes every test waiting on it.
+ * The event must outlive the waits on it.
+ */
+class AsyncEvent {
+public:
+    AsyncEvent() = default;
+    AsyncEvent(const AsyncEvent&) = delete;
+    AsyncEvent& operator=(const AsyncEvent&) = delete;
+
+    /**
+     * @brief Sets the event and resumes the tests waiting on it.
+     */
+    void set();
+
+    /**
+     * @brief Clears the event, so the next waits suspend again.
+     */
+    void reset();
+
+    bool isSet() const;
+
+    AsyncWaitAwaiter operator co_await() {
+        AsyncWait wait;
+        wait.kind = AsyncWait::Kind::Event;
+        wait.event = this;
+        return AsyncWaitAwaiter(wait);
+    }
+
+private:
+    friend class AsyncLoop;
+
+    struct Waiter {
+        AsyncTestState* test;
+        uint64_t token;
+    };
+
+    mutable std::mutex mutex;
+    bool signaled = false;
+    std::vector<Waiter> waiters;
+};
+
+/**
+ * @brief Declares the record of an async test whose coroutine is `suiteName##_##testName`, and links it at startup.
+ * @param tag Distinguishes the record's name between the async test case macros.
+ * @param ... Statements adjusting `testCase` before it is registered; they are evaluated at compile time.
+ */
+#define TESTFRAMEWORK_REGISTER_ASYNC_TEST(suiteName, testName, tag, ...) \
+    static constinit TestRegistration suiteName##_##tag##testName##_registration(suiteName, [] { \
+        TestCase testCase(#testName, TestBody(), TestCase::PreStoredName{}); \
+        testCase.asyncFunction = +[](TestFixture* baseFixture, int repetition) { \
+            return suiteName##_##testName(static_cast<suiteName##_Fixture*>(baseFixture), repetition); \
+        }; \
+        testCase.sourceFile = __FILE__; \
+        __VA_ARGS__ \
+        return testCase; \
+    }()); \
+    static RegistryLink suiteName##_##tag##testName##_link(suiteName##_##tag##testName##_registration);
+
+/**
+ * @brief Declares a test case whose body is a coroutine returning AsyncTest.
+ *
+ * The body co_awaits timers, file descriptors and AsyncEvents instead of blocking, and gives its worker back while
+ * it waits, so concurrent runs overlap many of these tests on a few threads. Assertions work as in any test.
+ * @param suiteName The suite in which to declare this test.
+ * @param testName The name of the test case.
+ */
+#define ASYNC_TEST_CASE(suiteName, testName) \
+    AsyncTest suiteName##_##testName(suiteName##_Fixture* fixture, int repetition = 1); \
+    TESTFRAMEWORK_REGISTER_ASYNC_TEST(suiteName, testName, ASYNC_, ) \
+    AsyncTest suiteName##_##testName(suiteName##_Fixture* fixture, int repetition)
+
+/**
+ * @brief Declares an async test case that is cancelled when it does not complete within the timeout.
+ *
+ * A test suspended when its deadline passes is cancelled where it waits: its coroutine frame is destroyed, which
+ * runs the destructors of its locals, and it is reported as timed out. No thread is left behind. A body that is
+ * busy when the deadline passes is cancelled at its next co_await.
+ * @param suiteName The suite in which to declare this test.
+ * @param testName The name of the test case.
+ * @param timeoutMs The time limit in milliseconds.
+ */
+#define ASYNC_TIMEOUT_TEST_CASE(suiteName, testName, timeoutMs) \
+    AsyncTest suiteName##_##testName(suiteName##_Fixture* fixture, int repetition = 1); \
+    TESTFRAMEWORK_REGISTER_ASYNC_TEST(suiteName, testName, ASYNC_TIMEOUT_, \
+                                      testCase.timeout = std::chrono::milliseconds(timeoutMs);) \
+    AsyncTest suiteName##_##testName(suiteName##_Fixture* fixture, int repetition)
+
+#endif // TESTASYNC_H
@@ -1,225 +1,7068 @@
 //TestFramework.cpp
 #include "TestFramework.h"
+#include "TestMock.h"
+#include "TestAsync.h"
+#include <sstream>
+#include <functional>
 #include <iostream>
 #include <thread>
-#include <future>
+#include <map>
 #include <mutex>
-#include <queue>
+#include <deque>
+#include <atomic>
 #include <condition_variable>
+#include <algorithm>
+#include <cstdint>
+#include <ctime>
+#include <cerrno>
+#include <cstring>
+#include <charconv>
+#include <fstream>
+#include <queue>
+#include <limits>
+#include <regex>
+#include <cmath>
+#include <cstdlib>
+#include <optional>
+#include <tuple>
+#include <filesystem>
+#include <iterator>
+#include <cstdio>
+#include <cstddef>
+#include <new>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#define TESTFRAMEWORK_HAS_FORK 1
+#define TESTFRAMEWORK_HAS_POLL 1
+#else
+#define TESTFRAMEWORK_HAS_FORK 0
+#define TESTFRAMEWORK_HAS_POLL 0
+#endif
+
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#endif
+
+namespace {
+
+// Target wall time of one chunk of work items. Chunks are sized from the measured per-test cost so that trivial
+// tests are handed out in large batches while expensive ones are still spread over all workers.
+constexpr uint64_t kTargetChunkNanos = 200000;
+
+// Number of tests listed after a run with allocation tracking, those allocating the most bytes.
+constexpr size_t kHeaviestAllocatorsShown = 5;
+
+// Upper bound on the number of work items handed out in one chunk.
+constexpr size_t kMaxChunkSize = 4096;
+
+/**
+ * @brief Book-keeping for one suite while it is in flight on the scheduler.
+ *
+ * Every enabled test case contributes one segment of work items, one item per repetition, so a suite is a single
+ * contiguous index range that can be split and handed out in chunks. remainingItems counts the items that have not
+ * finished yet; whichever worker finishes the last one runs AfterAll, so suite ordering is kept without joining the
+ * pool between suites.
+ */
+struct SuiteRun {
+    // The work items of one test: its repetitions, or for a family every instance times its repetitions.
+    struct Segment {
+        size_t testIndex;
+        size_t firstItem;
+        size_t itemCount;
+        size_t firstResult;
+    };
+
+    TestSuite* suite = nullptr;
+    size_t suiteIndex = 0;
+    std::vector<Segment> segments;
+    size_t itemCount = 0;
+    std::atomic<size_t> remainingItems{0};
+
+    // One lazily created fixture clone per worker when the suite uses per-worker fixtures, otherwise empty.
+    std::vector<std::shared_ptr<TestFixture>> workerFixtures;
+
+    // Running totals used to estimate the per-item cost of this suite.
+    std::atomic<uint64_t> measuredNanos{0};
+    std::atomic<uint64_t> measuredItems{0};
+
+    /**
+     * @brief Returns the fixture the given worker runs this suite's tests against.
+     *
+     * Each slot is only ever touched by the worker that owns it, so no locking is needed.
+     */
+    TestFixture* fixtureFor(size_t worker) {
+        if (workerFixtures.empty()) {
+            return suite->fixture.get();
+        }
+        std::shared_ptr<TestFixture>& slot = workerFixtures[worker];
+        if (!slot) {
+            slot = suite->cloneFixture(*suite->fixture);
+        }
+        return slot.get();
+    }
+
+    /**
+     * @brief Number of work items a worker should take at once, based on the cost measured so far.
+     *
+     * Until the first chunk has been timed a single item is handed out, which doubles as the cost probe.
+     */
+    size_t chunkSize() const {
+        uint64_t items = measuredItems.load(std::memory_order_relaxed);
+        if (items == 0) {
+            return 1;
+        }
+        uint64_t averageNanos = measuredNanos.load(std::memory_order_relaxed) / items;
+        if (averageNanos == 0) {
+            averageNanos = 1;
+        }
+        uint64_t chunk = kTargetChunkNanos / averageNanos;
+        return static_cast<size_t>(std::clamp<uint64_t>(chunk, 1, kMaxChunkSize));
+    }
+};
+
+/**
+ * @brief Keeps a fixture alive for the rest of the process.
+ *
+ * A timed-out test keeps running on its abandoned thread, so the fixture clone it uses must outlive the run.
+ */
+void parkAbandonedFixture(std::shared_ptr<TestFixture> fixture) {
+    static std::mutex parkedMutex;
+    static auto* parked = new std::vector<std::shared_ptr<TestFixture>>();
+    std::lock_guard<std::mutex> lock(parkedMutex);
+    parked->push_back(std::move(fixture));
+}
+
+std::string jsonEscaped(const std::string& text);
+
+/**
+ * @brief Precedes every block handed out by the framework's operator new: the requested size, and who owns it.
+ */
+struct AllocationHeader {
+    uint64_t size;
+    // The tag of the AllocationTally that counted the block, or zero, with kArenaBlock set for arena memory.
+    uint64_t tag;
+};
+
+static_assert(sizeof(AllocationHeader) % alignof(std::max_align_t) == 0, "blocks must stay suitably aligned");
+
+constexpr uint64_t kArenaBlock = 1;
+
+/**
+ * @brief The allocations counted for the test running on one thread. Tags are even and unique per test, so a
+ * block freed after its test ended is not taken off the tally of another.
+ */
+struct AllocationTally {
+    uint64_t tag = 0;
+    uint64_t allocations = 0;
+    uint64_t bytes = 0;
+    uint64_t liveBytes = 0;
+    uint64_t peakLiveBytes = 0;
+    uint64_t arenaBytes = 0;
+};
+
+/**
+ * @brief A bump allocator for the allocations of one test at a time; delete leaves its blocks alone, and
+ * reset() makes all of it available again.
+ */
+struct BumpArena {
+    char* memory = nullptr;
+    size_t capacity = 0;
+    size_t used = 0;
+
+    AllocationHeader* take(size_t bytes) {
+        size_t rounded = (bytes + alignof(std::max_align_t) - 1) & ~(alignof(std::max_align_t) - 1);
+        if (rounded < bytes || rounded > capacity - used) {
+            return nullptr;
+        }
+        auto* header = reinterpret_cast<AllocationHeader*>(memory + used);
+        used += rounded;
+        return header;
+    }
+
+    void reset() {
+        used = 0;
+    }
+};
+
+// What operator new on this thread counts allocations against and takes memory from, or null. Constant-initialized,
+// so they are safe to read however early or late in a thread's life an allocation happens.
+constinit thread_local AllocationTally* allocationTally = nullptr;
+constinit thread_local BumpArena* bumpArena = nullptr;
+
+std::atomic<uint64_t> nextAllocationTag{2};
+
+// Size of each test's bump arena, from RunnerOptions::testArenaBytes; set when a run starts.
+size_t testArenaBytes = 0;
+
+// Whether TestAllocationHooks.cpp is linked in and its operators replace the global ones.
+constinit std::atomic<bool> allocationHooksInstalled{false};
+
+void* trackedAllocate(size_t size) noexcept {
+    size_t total = size + sizeof(AllocationHeader);
+    if (total < size) {
+        return nullptr;
+    }
+    AllocationHeader* header = nullptr;
+    uint64_t tag = 0;
+    if (BumpArena* arena = bumpArena) {
+        header = arena->take(total);
+        tag = header ? kArenaBlock : 0;
+    }
+    if (!header) {
+        header = static_cast<AllocationHeader*>(std::malloc(total));
+        if (!header) {
+            return nullptr;
+        }
+    }
+    if (AllocationTally* tally = allocationTally) {
+        tag |= tally->tag;
+        ++tally->allocations;
+        tally->bytes += size;
+        tally->liveBytes += size;
+        tally->peakLiveBytes = std::max(tally->peakLiveBytes, tally->liveBytes);
+        if (tag & kArenaBlock) {
+            tally->arenaBytes += size;
+        }
+    }
+    header->size = size;
+    header->tag = tag;
+    return header + 1;
+}
+
+void trackedFree(void* pointer) noexcept {
+    if (!pointer) {
+        return;
+    }
+    AllocationHeader* header = static_cast<AllocationHeader*>(pointer) - 1;
+    AllocationTally* tally = allocationTally;
+    if (tally && (header->tag & ~kArenaBlock) == tally->tag) {
+        tally->liveBytes -= header->size;
+    }
+    if (!(header->tag & kArenaBlock)) {
+        std::free(header);
+    }
+}
+
+/**
+ * @brief Counts the allocations of the calling thread into a fresh tally for as long as it lives.
+ */
+class AllocationScope {
+public:
+    explicit AllocationScope(bool enabled) : previous(allocationTally) {
+        if (enabled) {
+            tally.tag = nextAllocationTag.fetch_add(2, std::memory_order_relaxed);
+            allocationTally = &tally;
+        }
+    }
+
+    ~AllocationScope() {
+        allocationTally = previous;
+    }
+
+    AllocationScope(const AllocationScope&) = delete;
+    AllocationScope& operator=(const AllocationScope&) = delete;
+
+    AllocationTally tally;
+
+private:
+    AllocationTally* previous;
+};
+
+/**
+ * @brief Serves the calling thread's allocations from its test arena while it lives, when the run uses one.
+ */
+class ArenaScope {
+public:
+    ArenaScope() : previous(bumpArena) {
+        if (testArenaBytes > 0) {
+            bumpArena = &threadArena();
+        }
+    }
+
+    ~ArenaScope() {
+        bumpArena = previous;
+    }
+
+    ArenaScope(const ArenaScope&) = delete;
+    ArenaScope& operator=(const ArenaScope&) = delete;
+
+    /**
+     * @brief Makes the calling thread's whole arena available again, once the test no longer uses any of it.
+     */
+    static void resetThreadArena() {
+        if (testArenaBytes > 0) {
+            threadArena().reset();
+        }
+    }
+
+private:
+    BumpArena* previous;
+
+    static BumpArena& threadArena() {
+        struct Storage {
+            std::unique_ptr<char[]> memory;
+            BumpArena arena;
+        };
+        thread_local Storage storage;
+        if (storage.arena.capacity != testArenaBytes) {
+            // Taken from the heap, and not counted against the test that happens to be first.
+            BumpArena* activeArena = std::exchange(bumpArena, nullptr);
+            AllocationTally* activeTally = std::exchange(allocationTally, nullptr);
+            storage.memory.reset(new char[testArenaBytes]);
+            bumpArena = activeArena;
+            allocationTally = activeTally;
+            storage.arena = {storage.memory.get(), testArenaBytes, 0};
+        }
+        return storage.arena;
+    }
+};
+
+/**
+ * @brief Takes the calling thread's allocations off its test arena while it lives, for framework code called from
+ * a test whose allocations outlive it.
+ */
+class ArenaSuspend {
+public:
+    ArenaSuspend() : previous(std::exchange(bumpArena, nullptr)) {}
+
+    ~ArenaSuspend() {
+        bumpArena = previous;
+    }
+
+    ArenaSuspend(const ArenaSuspend&) = delete;
+    ArenaSuspend& operator=(const ArenaSuspend&) = delete;
+
+    /**
+     * @brief Whether an arena was active when this was created.
+     */
+    bool suspended() const {
+        return previous != nullptr;
+    }
+
+private:
+    BumpArena* previous;
+};
+
+// Whether a trace is being recorded. Every probe checks this first, so tracing costs one load when off. Set with
+// release order after the recorder's epoch, so a thread that sees a trace start also sees when it started.
+std::atomic<bool> tracingEnabled{false};
+
+/**
+ * @brief One finished span of the trace: a test body, a fixture hook, a queue lock or a wait.
+ */
+struct TraceSpan {
+    const char* category = nullptr;
+    // A string literal naming the span, or the hook name when `suite` is set.
+    const char* label = nullptr;
+    const TestSuite* suite = nullptr;
+    const TestCase* testCase = nullptr;
+    int instance = -1;
+    int repetition = 1;
+    uint64_t startNanos = 0;
+    uint64_t durationNanos = 0;
+};
+
+/**
+ * @brief Collects spans in per-thread buffers during a traced run and writes them as Chrome trace JSON.
+ *
+ * Each thread appends to its own buffer, so threads never contend with each other; the buffer's mutex is only
+ * shared with writeChromeTrace() and matters for threads abandoned by a timeout that may still finish a span.
+ * Buffers outlive their threads until the next traced run starts.
+ */
+class TraceRecorder {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    /**
+     * @brief The process-wide recorder. Never destroyed, like the EventReporter.
+     */
+    static TraceRecorder& instance() {
+        static TraceRecorder* recorder = new TraceRecorder();
+        return *recorder;
+    }
+
+    static bool enabled() {
+        return tracingEnabled.load(std::memory_order_acquire);
+    }
+
+    /**
+     * @brief Discards the previous trace and starts recording.
+     */
+    void begin() {
+        std::lock_guard<std::mutex> lock(buffersMutex);
+        for (auto it = buffers.begin(); it != buffers.end();) {
+            std::unique_lock<std::mutex> bufferLock((*it)->mutex);
+            if ((*it)->retired) {
+                bufferLock.unlock();
+                it = buffers.erase(it);
+                continue;
+            }
+            (*it)->spans.clear();
+            ++it;
+        }
+        epochTicks.store(Clock::now().time_since_epoch().count(), std::memory_order_relaxed);
+        tracingEnabled.store(true, std::memory_order_release);
+    }
+
+    /**
+     * @brief Stops recording; spans already recorded are kept until the next begin().
+     */
+    void end() {
+        tracingEnabled.store(false, std::memory_order_relaxed);
+    }
+
+    uint64_t sinceEpoch(Clock::time_point time) const {
+        Clock::time_point epoch{Clock::duration(epochTicks.load(std::memory_order_relaxed))};
+        return time <= epoch ? 0 : static_cast<uint64_t>(
+                std::chrono::duration_cast<std::chrono::nanoseconds>(time - epoch).count());
+    }
+
+    void record(const TraceSpan& span) {
+        Buffer& buffer = threadBuffer();
+        std::lock_guard<std::mutex> lock(buffer.mutex);
+        buffer.spans.push_back(span);
+    }
+
+    /**
+     * @brief Names the calling thread in the trace, such as "Worker 3".
+     */
+    void nameThread(std::string name) {
+        Buffer& buffer = threadBuffer();
+        std::lock_guard<std::mutex> lock(buffer.mutex);
+        buffer.threadName = std::move(name);
+    }
+
+    /**
+     * @brief Writes every recorded span to a Chrome trace JSON file, which chrome://tracing and Perfetto open.
+     * @return False if the file could not be written.
+     */
+    bool writeChromeTrace(const std::string& path) {
+        std::ofstream out(path, std::ios::trunc);
+        out << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+        bool first = true;
+        std::string name;
+        char times[96];
+        std::lock_guard<std::mutex> lock(buffersMutex);
+        for (const auto& buffer : buffers) {
+            std::lock_guard<std::mutex> bufferLock(buffer->mutex);
+            out << (first ? "" : ",") << "\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << buffer->id
+                << ",\"args\":{\"name\":\"" << buffer->threadName << "\"}}";
+            first = false;
+            for (const TraceSpan& span : buffer->spans) {
+                name.clear();
+                if (span.testCase) {
+                    name += span.suite->name;
+                    name += '.';
+                    name += span.testCase->name;
+                    if (span.instance >= 0) {
+                        name += '/' + std::to_string(span.instance);
+                    }
+                    if (span.testCase->repetitions > 1) {
+                        name += " #" + std::to_string(span.repetition);
+                    }
+                } else if (span.suite) {
+                    name += span.label;
+                    name += ' ';
+                    name += span.suite->name;
+                } else {
+                    name += span.label;
+                }
+                // Chrome traces count in microseconds; three decimals keep the nanoseconds.
+                std::snprintf(times, sizeof(times), "\"ts\":%.3f,\"dur\":%.3f", span.startNanos / 1000.0,
+                              span.durationNanos / 1000.0);
+                out << ",\n{\"name\":\"" << jsonEscaped(name) << "\",\"cat\":\"" << span.category
+                    << "\",\"ph\":\"X\"," << times << ",\"pid\":1,\"tid\":" << buffer->id << "}";
+            }
+        }
+        out << "\n]}\n";
+        return static_cast<bool>(out);
+    }
+
+private:
+    struct Buffer {
+        std::mutex mutex;
+        uint32_t id = 0;
+        std::string threadName;
+        std::vector<TraceSpan> spans;
+        bool retired = false;
+    };
+
+    /**
+     * @brief Marks a thread's buffer as retired when the thread exits, so the next begin() can drop it.
+     */
+    struct BufferHandle {
+        Buffer* buffer = nullptr;
+        ~BufferHandle() {
+            if (buffer) {
+                std::lock_guard<std::mutex> lock(buffer->mutex);
+                buffer->retired = true;
+            }
+        }
+    };
+
+    std::mutex buffersMutex;
+    std::vector<std::unique_ptr<Buffer>> buffers;
+    uint32_t nextId = 1;
+    // Start of the current trace. Atomic because threads abandoned by an earlier run may still end spans while
+    // begin() moves it.
+    std::atomic<Clock::rep> epochTicks{Clock::now().time_since_epoch().count()};
+
+    TraceRecorder() = default;
+
+    Buffer& threadBuffer() {
+        thread_local BufferHandle handle;
+        if (!handle.buffer) {
+            std::lock_guard<std::mutex> lock(buffersMutex);
+            buffers.push_back(std::make_unique<Buffer>());
+            handle.buffer = buffers.back().get();
+            handle.buffer->id = nextId++;
+            handle.buffer->threadName = "Thread " + std::to_string(handle.buffer->id);
+        }
+        return *handle.buffer;
+    }
+};
+
+/**
+ * @brief Records the enclosing scope, or the part of it up to end(), as a span when tracing is on.
+ */
+class TraceScope {
+public:
+    TraceScope(const char* category, const char* label, const TestSuite* suite = nullptr,
+               const TestCase* testCase = nullptr, int instance = -1, int repetition = 1) {
+        if (TraceRecorder::enabled()) {
+            span.category = category;
+            span.label = label;
+            span.suite = suite;
+            span.testCase = testCase;
+            span.instance = instance;
+            span.repetition = repetition;
+            start = TraceRecorder::Clock::now();
+            active = true;
+        }
+    }
+
+    ~TraceScope() {
+        end();
+    }
+
+    TraceScope(const TraceScope&) = delete;
+    TraceScope& operator=(const TraceScope&) = delete;
+
+    void end() {
+        if (!active) {
+            return;
+        }
+        active = false;
+        TraceRecorder& recorder = TraceRecorder::instance();
+        span.startNanos = recorder.sinceEpoch(start);
+        span.durationNanos = recorder.sinceEpoch(TraceRecorder::Clock::now()) - span.startNanos;
+        recorder.record(span);
+    }
+
+private:
+    TraceSpan span;
+    TraceRecorder::Clock::time_point start;
+    bool active = false;
+};
+
+/**
+ * @brief Names the calling thread in the trace if one is being recorded.
+ */
+void nameTraceThread(const std::string& name) {
+    if (TraceRecorder::enabled()) {
+        TraceRecorder::instance().nameThread(name);
+    }
+}
+
+#if defined(__linux__)
+constexpr int kMaxCpus = CPU_SETSIZE;
+#else
+constexpr int kMaxCpus = 1024;
+#endif
+
+/**
+ * @brief Parses a CPU list such as "0-3,8,10-11", the format of the kernel's cpulist files and of --pin.
+ * @return False if the text is not such a list, names no CPU, or names a CPU a cpu_set_t cannot hold.
+ */
+bool parseCpuList(const std::string& text, std::vector<int>& cpus) {
+    cpus.clear();
+    if (!text.empty() && text.back() == ',') {
+        return false;
+    }
+    size_t position = 0;
+    while (position < text.size()) {
+        size_t comma = text.find(',', position);
+        size_t entryEnd = comma == std::string::npos ? text.size() : comma;
+        const char* begin = text.data() + position;
+        const char* end = text.data() + entryEnd;
+        int first = 0;
+        auto parsed = std::from_chars(begin, end, first);
+        if (parsed.ec != std::errc() || first < 0) {
+            return false;
+        }
+        int last = first;
+        if (parsed.ptr != end) {
+            if (*parsed.ptr != '-') {
+                return false;
+            }
+            auto parsedLast = std::from_chars(parsed.ptr + 1, end, last);
+            if (parsedLast.ec != std::errc() || parsedLast.ptr != end || last < first) {
+                return false;
+            }
+        }
+        if (last >= kMaxCpus) {
+            return false;
+        }
+        for (int cpu = first; cpu <= last; ++cpu) {
+            cpus.push_back(cpu);
+        }
+        position = comma == std::string::npos ? text.size() : comma + 1;
+    }
+    return !cpus.empty();
+}
+
+/**
+ * @brief Where one of the CPUs the process may run on sits in the machine.
+ */
+struct CpuLocation {
+    int cpu = 0;
+    int node = 0;
+    int package = 0;
+    // Physical core within the package; hyperthread siblings share it.
+    int core = 0;
+};
+
+#if defined(__linux__)
+int readSysfsNumber(const std::string& path, int fallback) {
+    std::ifstream in(path);
+    int value = 0;
+    return in >> value ? value : fallback;
+}
+#endif
+
+/**
+ * @brief The CPUs in the affinity mask of the process, with their NUMA node, package and core from sysfs.
+ * @return Empty where CPU affinity is not supported.
+ */
+std::vector<CpuLocation> availableCpus() {
+    std::vector<CpuLocation> cpus;
+#if defined(__linux__)
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0) {
+        return cpus;
+    }
+    // Machines without NUMA support have no node directory; all of their CPUs are on node 0.
+    std::map<int, int> nodeOfCpu;
+    std::error_code error;
+    for (const auto& entry : std::filesystem::directory_iterator("/sys/devices/system/node", error)) {
+        std::string name = entry.path().filename().string();
+        int node = 0;
+        if (name.rfind("node", 0) != 0
+            || std::from_chars(name.data() + 4, name.data() + name.size(), node).ptr != name.data() + name.size()) {
+            continue;
+        }
+        std::ifstream in(entry.path() / "cpulist");
+        std::string list;
+        std::vector<int> nodeCpus;
+        if (std::getline(in, list) && parseCpuList(list, nodeCpus)) {
+            for (int cpu : nodeCpus) {
+                nodeOfCpu[cpu] = node;
+            }
+        }
+    }
+    for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+        if (!CPU_ISSET(cpu, &allowed)) {
+            continue;
+        }
+        std::string topology = "/sys/devices/system/cpu/cpu" + std::to_string(cpu) + "/topology/";
+        CpuLocation location;
+        location.cpu = cpu;
+        auto node = nodeOfCpu.find(cpu);
+        location.node = node == nodeOfCpu.end() ? 0 : node->second;
+        location.package = readSysfsNumber(topology + "physical_package_id", 0);
+        location.core = readSysfsNumber(topology + "core_id", cpu);
+        cpus.push_back(location);
+    }
+#endif
+    return cpus;
+}
+
+/**
+ * @brief How many CPUs the affinity mask of the process allows, without reading their topology.
+ * @return Zero where CPU affinity is not supported.
+ */
+size_t availableCpuCount() {
+#if defined(__linux__)
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) == 0) {
+        return static_cast<size_t>(CPU_COUNT(&allowed));
+    }
+#endif
+    return 0;
+}
+
+/**
+ * @brief Orders CPUs for CpuPinning::Compact or CpuPinning::Scatter; worker i is placed on entry i.
+ */
+std::vector<int> pinningOrder(std::vector<CpuLocation> cpus, CpuPinning policy) {
+    std::sort(cpus.begin(), cpus.end(), [](const CpuLocation& a, const CpuLocation& b) {
+        return std::tie(a.node, a.package, a.core, a.cpu) < std::tie(b.node, b.package, b.core, b.cpu);
+    });
+    std::vector<int> order;
+    if (policy != CpuPinning::Scatter) {
+        for (const CpuLocation& location : cpus) {
+            order.push_back(location.cpu);
+        }
+        return order;
+    }
+
+    // Rank every CPU among the hyperthreads of its core, then list each node's rank 0 CPUs before its rank 1 ones.
+    std::vector<std::pair<int, CpuLocation>> ranked;
+    for (size_t i = 0; i < cpus.size(); ++i) {
+        bool sibling = i > 0 && cpus[i].node == cpus[i - 1].node && cpus[i].package == cpus[i - 1].package
+                       && cpus[i].core == cpus[i - 1].core;
+        ranked.emplace_back(sibling ? ranked.back().first + 1 : 0, cpus[i]);
+    }
+    std::stable_sort(ranked.begin(), ranked.end(), [](const auto& a, const auto& b) {
+        return std::tie(a.second.node, a.first) < std::tie(b.second.node, b.first);
+    });
+    std::vector<std::vector<int>> nodes;
+    for (size_t i = 0; i < ranked.size(); ++i) {
+        if (i == 0 || ranked[i].second.node != ranked[i - 1].second.node) {
+            nodes.emplace_back();
+        }
+        nodes.back().push_back(ranked[i].second.cpu);
+    }
+    for (size_t round = 0; order.size() < ranked.size(); ++round) {
+        for (const std::vector<int>& node : nodes) {
+            if (round < node.size()) {
+                order.push_back(node[round]);
+            }
+        }
+    }
+    return order;
+}
+
+/**
+ * @brief The CPUs the threads of a run are placed on. Every list is empty when the run places nothing.
+ */
+struct CpuPlacement {
+    // CPU of every worker slot, wrapping around; empty when workers are not pinned individually.
+    std::vector<int> workerCpus;
+    // Every CPU of the process except the reserved ones. Unpinned workers and the threads a concurrent test
+    // starts run on these.
+    std::vector<int> freeCpus;
+    // CPUs reserved for the reporter, watchdog and async poller threads.
+    std::vector<int> serviceCpus;
+
+    bool active() const {
+        return !workerCpus.empty() || !serviceCpus.empty();
+    }
+
+    int cpuForWorker(size_t worker) const {
+        return workerCpus.empty() ? -1 : workerCpus[worker % workerCpus.size()];
+    }
+};
+
+/**
+ * @brief Works out where the threads of a run go from the pinning options and the CPUs of the process.
+ *
+ * Problems, such as reserving every CPU or listing CPUs the process may not use, are reported on stderr and the
+ * offending part of the options is ignored.
+ */
+CpuPlacement planPlacement(const RunnerOptions& options) {
+    CpuPlacement placement;
+    if (options.pinning == CpuPinning::None && options.reservedCpus == 0) {
+        return placement;
+    }
+    std::vector<CpuLocation> cpus = availableCpus();
+    if (cpus.empty()) {
+        std::cerr << "Pinning threads to CPUs is not supported on this platform" << std::endl;
+        return placement;
+    }
+
+    if (options.reservedCpus >= cpus.size()) {
+        std::cerr << "Cannot reserve " << options.reservedCpus << " of the " << cpus.size()
+                  << " available CPUs; none are reserved" << std::endl;
+    } else if (options.reservedCpus > 0) {
+        std::vector<int> compact = pinningOrder(cpus, CpuPinning::Compact);
+        placement.serviceCpus.assign(compact.begin(), compact.begin() + options.reservedCpus);
+        cpus.erase(std::remove_if(cpus.begin(), cpus.end(), [&](const CpuLocation& location) {
+            return std::find(placement.serviceCpus.begin(), placement.serviceCpus.end(), location.cpu)
+                   != placement.serviceCpus.end();
+        }), cpus.end());
+    }
+    for (const CpuLocation& location : cpus) {
+        placement.freeCpus.push_back(location.cpu);
+    }
+
+    if (options.pinning == CpuPinning::List) {
+        for (int cpu : options.pinnedCpus) {
+            if (std::find(placement.freeCpus.begin(), placement.freeCpus.end(), cpu) != placement.freeCpus.end()) {
+                placement.workerCpus.push_back(cpu);
+            } else {
+                std::cerr << "Not pinning workers to CPU " << cpu << ": it is reserved or not available" << std::endl;
+            }
+        }
+    } else if (options.pinning != CpuPinning::None) {
+        placement.workerCpus = pinningOrder(cpus, options.pinning);
+    }
+    if (!placement.active()) {
+        placement.freeCpus.clear();
+    }
+    return placement;
+}
+
+/**
+ * @brief Restricts a thread to the given CPUs; does nothing for an empty list.
+ */
+void setThreadCpus([[maybe_unused]] std::thread::native_handle_type thread, const std::vector<int>& cpus) {
+    if (cpus.empty()) {
+        return;
+    }
+#if defined(__linux__)
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int cpu : cpus) {
+        CPU_SET(cpu, &set);
+    }
+    int error = pthread_setaffinity_np(thread, sizeof(set), &set);
+    if (error != 0) {
+        std::cerr << "Could not pin a thread to its CPUs: " << std::strerror(error) << std::endl;
+    }
+#endif
+}
+
+std::thread::native_handle_type currentThreadHandle() {
+#if defined(__linux__)
+    return pthread_self();
+#else
+    return {};
+#endif
+}
+
+/**
+ * @brief The placement of the run in progress, read by its threads as they start.
+ */
+class ActivePlacement {
+public:
+    static ActivePlacement& instance() {
+        static ActivePlacement active;
+        return active;
+    }
+
+    void set(CpuPlacement next) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!next.active() && placement.active()) {
+            // Threads that outlive a run, such as the watchdog, get every CPU back in the next one.
+            next.freeCpus = placement.freeCpus;
+            next.freeCpus.insert(next.freeCpus.end(), placement.serviceCpus.begin(), placement.serviceCpus.end());
+        }
+        placement = std::move(next);
+    }
+
+    /**
+     * @brief Pins a worker thread to its CPU, or lets an unpinned one use the free CPUs. Called before the worker
+     * allocates anything, so its memory is first touched on its own NUMA node.
+     */
+    void placeWorker(std::thread::native_handle_type thread, size_t worker) {
+        std::lock_guard<std::mutex> lock(mutex);
+        int cpu = placement.cpuForWorker(worker);
+        setThreadCpus(thread, cpu >= 0 ? std::vector<int>{cpu} : placement.freeCpus);
+    }
+
+    /**
+     * @brief Moves a reporter, watchdog or poller thread to the reserved CPUs. Without a reservation it may use
+     * every free CPU, so one started by a pinned worker does not compete with that worker.
+     */
+    void placeService(std::thread::native_handle_type thread) {
+        std::lock_guard<std::mutex> lock(mutex);
+        setThreadCpus(thread, placement.serviceCpus.empty() ? placement.freeCpus : placement.serviceCpus);
+    }
+
+    /**
+     * @brief Lets a thread started by a test use every free CPU instead of the CPU of the worker that started it.
+     */
+    void placeHelper(std::thread::native_handle_type thread) {
+        std::lock_guard<std::mutex> lock(mutex);
+        setThreadCpus(thread, placement.freeCpus);
+    }
+
+    CpuPlacement current() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return placement;
+    }
+
+private:
+    std::mutex mutex;
+    CpuPlacement placement;
+};
+
+/**
+ * @brief A schedulable unit of work: starting a suite, running a range of its work items, resuming an async test,
+ * or finishing a suite.
+ */
+struct Task {
+    enum class Kind { StartSuite, RunRange, ResumeAsync, FinishSuite };
+
+    Kind kind = Kind::StartSuite;
+    SuiteRun* suiteRun = nullptr;
+    size_t begin = 0;
+    size_t end = 0;
+    AsyncTestState* asyncTest = nullptr;
+};
+
+/**
+ * @brief A runner-wide thread pool in which every worker owns a task deque.
+ *
+ * Workers take tasks from the front of their own deque, so tests start in registration order, and steal from the
+ * back of other workers' deques when they run dry. Each deque has its own lock, so submitting and stealing never
+ * funnel through a single queue mutex. The pool lives for a whole TestRunner::run() call, which lets tests from
+ * different suites overlap instead of idling the cores at every suite boundary.
+ *
+ * Ranges of work items are split lazily: a worker peels one chunk off the front of a range and puts the rest back
+ * on its own deque, and a thief takes the upper half of whatever range it finds. Workers are only notified when a
+ * range is split or a task is submitted, never once per test.
+ */
+class WorkStealingScheduler {
+public:
+    using Executor = std::function<void(const Task&)>;
+    using WorkerHook = std::function<void(size_t worker)>;
+
+    /**
+     * @brief Starts the given number of worker threads.
+     * @param numWorkers Number of workers to spawn. Values below one are treated as one.
+     * @param executor Callback invoked on a worker for every task (or chunk of a range) it takes.
+     * @param onWorkerStart Invoked on every worker thread, including replacements, before it takes any task.
+     * @param onWorkerStop Invoked on every worker thread that exits normally; abandoned threads skip it.
+     */
+    WorkStealingScheduler(unsigned int numWorkers, Executor executor, WorkerHook onWorkerStart = nullptr,
+                          WorkerHook onWorkerStop = nullptr)
+            : execute(std::move(executor)), onWorkerStart(std::move(onWorkerStart)),
+              onWorkerStop(std::move(onWorkerStop)) {
+        if (numWorkers == 0) {
+            numWorkers = 1;
+        }
+        for (unsigned int i = 0; i < numWorkers; ++i) {
+            queues.push_back(std::make_unique<WorkerQueue>());
+        }
+        std::lock_guard<std::mutex> lock(threadsMutex);
+        for (unsigned int i = 0; i < numWorkers; ++i) {
+            startWorker(i);
+        }
+    }
+
+    /**
+     * @brief Stops the workers once all submitted tasks have been executed and joins them.
+     */
+    ~WorkStealingScheduler() {
+        {
+            std::lock_guard<std::mutex> lock(sleepMutex);
+            stopping = true;
+        }
+        sleepCv.notify_all();
+        std::lock_guard<std::mutex> lock(threadsMutex);
+        for (auto& thread : threads) {
+            thread.join();
+        }
+    }
+
+    WorkStealingScheduler(const WorkStealingScheduler&) = delete;
+    WorkStealingScheduler& operator=(const WorkStealingScheduler&) = delete;
+
+    /**
+     * @brief Queues a task.
+     *
+     * Tasks submitted from a worker go to that worker's own deque; tasks submitted from outside the pool are
+     * spread round-robin over all deques.
+     * @param task The task to execute.
+     */
+    void submit(const Task& task) {
+        size_t index = currentWorker >= 0 ? static_cast<size_t>(currentWorker)
+                                          : nextQueue.fetch_add(1, std::memory_order_relaxed) % queues.size();
+        pending.fetch_add(1);
+        WorkerQueue& queue = *queues[index];
+        {
+            TraceScope wait("scheduler", "Queue lock wait");
+            std::lock_guard<std::mutex> lock(queue.mutex);
+            wait.end();
+            TraceScope hold("scheduler", "Queue lock");
+            queue.tasks.push_back(task);
+        }
+        wakeWorker();
+    }
+
+    /**
+     * @brief Number of worker threads in the pool.
+     */
+    size_t workerCount() const {
+        return queues.size();
+    }
+
+    /**
+     * @brief Index of the worker running on the calling thread, or -1 when called from outside the pool.
+     */
+    static int currentWorkerIndex() {
+        return currentWorker;
+    }
+
+    /**
+     * @brief Gives up on a worker that is stuck in a test and starts a fresh thread serving the same deque.
+     *
+     * The stuck thread is detached; once its test body eventually returns it exits without touching the
+     * scheduler again.
+     * @param index The index of the worker to replace.
+     */
+    void replaceWorker(size_t index) {
+        std::lock_guard<std::mutex> lock(threadsMutex);
+        workerStates[index]->abandoned.store(true);
+        threads[index].detach();
+        startWorker(index);
+    }
+
+private:
+    struct WorkerQueue {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+    };
+
+    // Owned jointly by the scheduler and the worker thread, so an abandoned thread can still read its flag.
+    struct WorkerState {
+        std::atomic<bool> abandoned{false};
+    };
+
+    Executor execute;
+    WorkerHook onWorkerStart;
+    WorkerHook onWorkerStop;
+    std::vector<std::unique_ptr<WorkerQueue>> queues;
+    std::mutex threadsMutex;
+    std::vector<std::thread> threads;
+    std::vector<std::shared_ptr<WorkerState>> workerStates;
+
+    // Tasks sitting in a deque that no worker has taken yet.
+    std::atomic<size_t> pending{0};
+    std::atomic<size_t> nextQueue{0};
+    std::atomic<int> sleepers{0};
+    std::mutex sleepMutex;
+    std::condition_variable sleepCv;
+    bool stopping = false;
+
+    // Index of the worker running on the current thread, or -1 outside the pool.
+    static thread_local int currentWorker;
+
+    void wakeWorker() {
+        if (sleepers.load() == 0) {
+            return;
+        }
+        std::lock_guard<std::mutex> lock(sleepMutex);
+        sleepCv.notify_one();
+    }
+
+    bool popLocal(size_t index, Task& task) {
+        WorkerQueue& queue = *queues[index];
+        TraceScope wait("scheduler", "Queue lock wait");
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        wait.end();
+        TraceScope hold("scheduler", "Queue lock");
+        if (queue.tasks.empty()) {
+            return false;
+        }
+        task = queue.tasks.front();
+        queue.tasks.pop_front();
+        pending.fetch_sub(1);
+        return true;
+    }
+
+    bool steal(size_t thief, Task& task) {
+        size_t numQueues = queues.size();
+        for (size_t offset = 1; offset < numQueues; ++offset) {
+            WorkerQueue& queue = *queues[(thief + offset) % numQueues];
+            std::unique_lock<std::mutex> lock(queue.mutex, std::try_to_lock);
+            if (!lock.owns_lock() || queue.tasks.empty()) {
+                continue;
+            }
+            TraceScope hold("scheduler", "Queue lock (steal)");
+            Task& victim = queue.tasks.back();
+            if (victim.kind == Task::Kind::RunRange && victim.end - victim.begin > 1) {
+                // Take the upper half and leave the lower half for its owner.
+                task = victim;
+                task.begin = victim.begin + (victim.end - victim.begin) / 2;
+                victim.end = task.begin;
+                return true;
+            }
+            task = victim;
+            queue.tasks.pop_back();
+            pending.fetch_sub(1);
+            return true;
+        }
+        return false;
+    }
+
+    void pushFront(size_t index, const Task& task) {
+        pending.fetch_add(1);
+        WorkerQueue& queue = *queues[index];
+        {
+            TraceScope wait("scheduler", "Queue lock wait");
+            std::lock_guard<std::mutex> lock(queue.mutex);
+            wait.end();
+            TraceScope hold("scheduler", "Queue lock");
+            queue.tasks.push_front(task);
+        }
+        wakeWorker();
+    }
+
+    // Expects threadsMutex to be held.
+    void startWorker(size_t index) {
+        auto state = std::make_shared<WorkerState>();
+        if (index < threads.size()) {
+            workerStates[index] = state;
+            threads[index] = std::thread([this, index, state] { workerLoop(index, *state); });
+        } else {
+            workerStates.push_back(state);
+            threads.emplace_back([this, index, state] { workerLoop(index, *state); });
+        }
+    }
+
+    void workerLoop(size_t index, const WorkerState& state) {
+        currentWorker = static_cast<int>(index);
+        ActivePlacement::instance().placeWorker(currentThreadHandle(), index);
+        nameTraceThread("Worker " + std::to_string(index));
+        if (onWorkerStart) {
+            onWorkerStart(index);
+        }
+        while (true) {
+            Task task;
+            if (popLocal(index, task) || steal(index, task)) {
+                if (task.kind == Task::Kind::RunRange) {
+                    size_t chunk = task.suiteRun->chunkSize();
+                    if (task.end - task.begin > chunk) {
+                        Task rest = task;
+                        rest.begin = task.begin + chunk;
+                        task.end = rest.begin;
+                        pushFront(index, rest);
+                    }
+                }
+                execute(task);
+                if (state.abandoned.load()) {
+                    return;
+                }
+                continue;
+            }
+            if (pending.load() > 0) {
+                // Work exists but its deque was locked by someone else; retry instead of sleeping.
+                std::this_thread::yield();
+                continue;
+            }
+            std::unique_lock<std::mutex> lock(sleepMutex);
+            sleepers.fetch_add(1);
+            {
+                TraceScope idle("scheduler", "Idle");
+                sleepCv.wait(lock, [&] { return stopping || pending.load() > 0; });
+            }
+            sleepers.fetch_sub(1);
+            if (stopping && pending.load() == 0) {
+                lock.unlock();
+                if (onWorkerStop) {
+                    onWorkerStop(index);
+                }
+                return;
+            }
+        }
+    }
+};
+
+thread_local int WorkStealingScheduler::currentWorker = -1;
+
+/**
+ * @brief The cancellation token of the run in progress, shared by the runner, its workers, isolated worker
+ * processes and the tests polling testRunCancelled().
+ *
+ * Once set it stays set until the run ends. Workers check it before every work item and drain what is left of
+ * their queues without running it.
+ */
+class RunCancellation {
+public:
+    enum class Reason : uint8_t { None, MaxFailures, TimeBudget, Requested };
+
+    static RunCancellation& instance() {
+        static RunCancellation cancellation;
+        return cancellation;
+    }
+
+    /**
+     * @brief Arms the token for a run with the given failure limit and time budget, zero meaning none.
+     */
+    void begin(unsigned int maxFailures, std::chrono::milliseconds budget) {
+        failures.store(0, std::memory_order_relaxed);
+        failureLimit.store(maxFailures, std::memory_order_relaxed);
+        deadlineNanos.store(budget.count() > 0 ? nowNanos() + std::chrono::nanoseconds(budget).count() : 0,
+                            std::memory_order_relaxed);
+        cancelReason.store(Reason::None, std::memory_order_relaxed);
+        active.store(true, std::memory_order_release);
+    }
+
+    /**
+     * @brief Disarms the token once the run is over.
+     * @return Why the run was cancelled, or Reason::None.
+     */
+    Reason end() {
+        active.store(false, std::memory_order_relaxed);
+        deadlineNanos.store(0, std::memory_order_relaxed);
+        return cancelReason.exchange(Reason::None, std::memory_order_relaxed);
+    }
+
+    bool requested() {
+        if (cancelReason.load(std::memory_order_relaxed) != Reason::None) {
+            return true;
+        }
+        int64_t deadline = deadlineNanos.load(std::memory_order_relaxed);
+        if (deadline != 0 && nowNanos() >= deadline) {
+            cancel(Reason::TimeBudget);
+            return true;
+        }
+        return false;
+    }
+
+    /**
+     * @brief Cancels the run in progress; the first reason given is kept.
+     */
+    void cancel(Reason reason) {
+        if (!active.load(std::memory_order_acquire)) {
+            return;
+        }
+        Reason none = Reason::None;
+        cancelReason.compare_exchange_strong(none, reason, std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief Counts a failed or timed-out test repetition against the failure limit.
+     */
+    void recordFailure() {
+        // Never equal to a limit of zero.
+        if (failures.fetch_add(1, std::memory_order_relaxed) + 1 == failureLimit.load(std::memory_order_relaxed)) {
+            cancel(Reason::MaxFailures);
+        }
+    }
+
+    /**
+     * @brief Milliseconds until the time budget runs out, for poll() timeouts; -1 without a budget.
+     */
+    int millisecondsLeft() const {
+        int64_t deadline = deadlineNanos.load(std::memory_order_relaxed);
+        if (deadline == 0) {
+            return -1;
+        }
+        int64_t left = (deadline - nowNanos() + 999999) / 1000000;
+        return static_cast<int>(std::clamp<int64_t>(left, 0, std::numeric_limits<int>::max()));
+    }
+
+private:
+    std::atomic<bool> active{false};
+    std::atomic<Reason> cancelReason{Reason::None};
+    std::atomic<unsigned int> failures{0};
+    std::atomic<unsigned int> failureLimit{0};
+    // steady_clock time at which the budget runs out, or zero without one. Forked worker processes inherit it and
+    // share the clock, so they stop at the same time as the runner.
+    std::atomic<int64_t> deadlineNanos{0};
+
+    static int64_t nowNanos() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+};
+
+/**
+ * @brief Kinds of structured events produced while tests run, in the order of ReportEvent::Type.
+ */
+enum class TestEventType {
+    SuiteStart,
+    SuiteFinish,
+    TestSkipped,
+    TestStart,
+    AssertionFailure,
+    TestFailure,
+    TestFinish
+};
+
+/**
+ * @brief A single structured report event. Formatting into text happens on the reporter side.
+ */
+struct TestEvent {
+    TestEventType type = TestEventType::TestStart;
+    const TestSuite* suite = nullptr;
+    const TestCase* testCase = nullptr;
+    int repetition = 1;
+    int instance = -1;
+    bool showRepetition = false;
+    // Outcome of a TestFinish event.
+    TestStatus status = TestStatus::Passed;
+    const char* file = nullptr;
+    int line = 0;
+    uint64_t durationNanos = 0;
+    /// Static text of a failed check; the message then only holds its operand values, if any.
+    const char* expression = nullptr;
+    std::string message;
+};
+
+/**
+ * @brief Text of an assertion failure: the checked expression followed by the operand values, if any.
+ */
+std::string checkDescription(const char* expression, const std::string& message) {
+    if (!expression) {
+        return message;
+    }
+    return message.empty() ? std::string(expression) : std::string(expression) + " (" + message + ")";
+}
+
+/**
+ * @brief Identifies the test executing on the current thread, so assertion failures can be attributed to it.
+ */
+struct CurrentTest {
+    const TestSuite* suite = nullptr;
+    const TestCase* testCase = nullptr;
+    int repetition = 1;
+    int instance = -1;
+    bool showRepetition = false;
+    TestResult* result = nullptr;
+    // Held while the failures of result are counted, if a timeout may read them from the watchdog thread.
+    std::mutex* resultMutex = nullptr;
+};
+
+thread_local CurrentTest currentTest;
+
+/**
+ * @brief Adds assertion failures to a result of the current test, under its result lock if it has one.
+ */
+void addAssertionFailures(TestResult& result, uint32_t count) {
+    std::unique_lock<std::mutex> lock;
+    if (currentTest.resultMutex) {
+        lock = std::unique_lock<std::mutex>(*currentTest.resultMutex);
+    }
+    result.assertionFailures += count;
+}
+
+/**
+ * @brief A fixed-capacity single-producer/single-consumer ring of events.
+ *
+ * The owning thread pushes and the reporter thread pops; neither side takes a lock.
+ */
+class EventRing {
+public:
+    static constexpr size_t kCapacity = 1024;
+
+    /**
+     * @brief Appends an event unless the ring is full.
+     * @return The number of events queued after the push, or zero if the ring was full.
+     */
+    size_t tryPush(TestEvent& event) {
+        size_t tail = writeIndex.load(std::memory_order_relaxed);
+        size_t queued = tail - readIndex.load(std::memory_order_acquire);
+        if (queued == kCapacity) {
+            return 0;
+        }
+        slots[tail % kCapacity] = std::move(event);
+        writeIndex.store(tail + 1, std::memory_order_release);
+        return queued + 1;
+    }
+
+    /**
+     * @brief Moves every queued event into the given batch.
+     * @return The number of events drained.
+     */
+    size_t drain(std::vector<TestEvent>& batch) {
+        size_t head = readIndex.load(std::memory_order_relaxed);
+        size_t tail = writeIndex.load(std::memory_order_acquire);
+        for (size_t i = head; i != tail; ++i) {
+            batch.push_back(std::move(slots[i % kCapacity]));
+        }
+        readIndex.store(tail, std::memory_order_release);
+        return tail - head;
+    }
+
+    // Cleared when the owning thread exits, so a later thread can take the ring over.
+    std::atomic<bool> inUse{true};
+
+private:
+    std::vector<TestEvent> slots = std::vector<TestEvent>(kCapacity);
+    std::atomic<size_t> writeIndex{0};
+    std::atomic<size_t> readIndex{0};
+};
+
+/**
+ * @brief Collects test events and turns them into console output.
+ *
+ * In asynchronous mode every producing thread appends to its own EventRing and a single consumer thread drains
+ * the rings in batches, formats them and writes each batch with one call, flushing only when the run ends. In
+ * synchronous mode, used for sequential runs, events are formatted and written as they arrive so they interleave
+ * correctly with the tests' own output.
+ */
+class EventReporter {
+public:
+    /**
+     * @brief The process-wide reporter. It is never destroyed, so late events from runaway threads stay safe.
+     */
+    static EventReporter& instance() {
+        static EventReporter* reporter = new EventReporter();
+        return *reporter;
+    }
+
+    /**
+     * @brief Begins a reporting session.
+     * @param asynchronous Whether events are queued and written by a background thread.
+     * @param quietMode Whether only failures and the summary are printed.
+     * @param sessionReporters Reporters that receive every event of the session besides the console.
+     */
+    void start(bool asynchronous, bool quietMode, std::vector<std::shared_ptr<TestReporter>> sessionReporters = {}) {
+        quiet = quietMode;
+        passedCount = 0;
+        failedCount = 0;
+        skippedCount = 0;
+        reporters = std::move(sessionReporters);
+        for (const auto& reporter : reporters) {
+            reporter->runStarted();
+        }
+        async.store(asynchronous, std::memory_order_release);
+        running.store(true, std::memory_order_release);
+        if (asynchronous) {
+            stopRequested = false;
+            consumer = std::thread([this] { consumeLoop(); });
+        }
+    }
+
+    /**
+     * @brief Ends the session: drains pending events, prints the summary and flushes the output.
+     */
+    void stop() {
+        running.store(false, std::memory_order_release);
+        // Cleared before the consumer stops, so a thread a timeout abandoned that emits from now on writes its event
+        // itself instead of queueing it for a consumer that is gone.
+        if (async.exchange(false, std::memory_order_acq_rel)) {
+            {
+                std::lock_guard<std::mutex> lock(wakeMutex);
+                stopRequested = true;
+            }
+            wakeCv.notify_all();
+            consumer.join();
+            // Picks up events pushed by threads that read `async` just before it was cleared.
+            std::lock_guard<std::mutex> lock(syncMutex);
+            writePending();
+        }
+        std::string text;
+        text += "Summary: " + std::to_string(passedCount) + " passed, " + std::to_string(failedCount)
+                + " failed, " + std::to_string(skippedCount) + " skipped\n";
+        std::cout.write(text.data(), static_cast<std::streamsize>(text.size()));
+        std::cout.flush();
+        for (const auto& reporter : reporters) {
+            reporter->runFinished(passedCount, failedCount, skippedCount);
+        }
+        reporters.clear();
+    }
+
+    /**
+     * @brief Stops passing events to the session's reporters. Called in a forked worker process, whose parent
+     * reports the results and owns the reporters' files and threads.
+     */
+    void muteReporters() {
+        reportersMuted = true;
+    }
+
+    /**
+     * @brief Whether a reporting session is in progress.
+     */
+    bool active() const {
+        return running.load(std::memory_order_acquire);
+    }
+
+    /**
+     * @brief Publishes an event from the calling thread.
+     */
+    void emit(TestEvent&& event) {
+        // A test's arena is reset after the test, before the event may have been formatted.
+        ArenaSuspend heapOnly;
+        if (heapOnly.suspended()) {
+            event.message = std::string(event.message);
+        }
+        // Every outcome passes through here on the thread that produced it, before the reporter thread sees it, so
+        // this is where failures count against --max-failures.
+        if (event.type == TestEventType::TestFinish
+            && (event.status == TestStatus::Failed || event.status == TestStatus::TimedOut)) {
+            RunCancellation::instance().recordFailure();
+        }
+        if (async.load(std::memory_order_acquire)) {
+            EventRing& ring = threadRing();
+            size_t queued;
+            while ((queued = ring.tryPush(event)) == 0 && async.load(std::memory_order_acquire)) {
+                wakeCv.notify_one();
+                std::this_thread::yield();
+            }
+            if (queued == EventRing::kCapacity / 2) {
+                // Nudge the consumer before the ring fills up instead of waiting for its next poll.
+                wakeCv.notify_one();
+            }
+            if (queued > 0) {
+                return;
+            }
+            // The session ended while the ring was full; nobody will drain it, so write the event directly.
+        }
+        std::lock_guard<std::mutex> lock(syncMutex);
+        std::string text;
+        format(event, text);
+        std::cout.write(text.data(), static_cast<std::streamsize>(text.size()));
+    }
+
+private:
+    // Read by every emit(), including from threads a timeout abandoned that may outlive the session.
+    std::atomic<bool> async{false};
+    bool quiet = false;
+    std::atomic<bool> running{false};
+    size_t passedCount = 0;
+    size_t failedCount = 0;
+    size_t skippedCount = 0;
+    std::vector<std::shared_ptr<TestReporter>> reporters;
+    bool reportersMuted = false;
+
+    std::mutex syncMutex;
+
+    std::mutex ringsMutex;
+    std::vector<std::unique_ptr<EventRing>> rings;
+
+    std::thread consumer;
+    std::mutex wakeMutex;
+    std::condition_variable wakeCv;
+    bool stopRequested = false;
+
+    EventReporter() = default;
+
+    /**
+     * @brief Releases a thread's ring when the thread exits.
+     */
+    struct RingHandle {
+        EventRing* ring = nullptr;
+        ~RingHandle() {
+            if (ring) {
+                ring->inUse.store(false, std::memory_order_release);
+            }
+        }
+    };
+
+    EventRing& threadRing() {
+        thread_local RingHandle handle;
+        if (!handle.ring) {
+            std::lock_guard<std::mutex> lock(ringsMutex);
+            for (auto& ring : rings) {
+                bool expected = false;
+                if (ring->inUse.compare_exchange_strong(expected, true)) {
+                    handle.ring = ring.get();
+                    break;
+                }
+            }
+            if (!handle.ring) {
+                rings.push_back(std::make_unique<EventRing>());
+                handle.ring = rings.back().get();
+            }
+        }
+        return *handle.ring;
+    }
+
+    size_t drainAll(std::vector<TestEvent>& batch) {
+        std::lock_guard<std::mutex> lock(ringsMutex);
+        size_t drained = 0;
+        for (auto& ring : rings) {
+            drained += ring->drain(batch);
+        }
+        return drained;
+    }
+
+    void consumeLoop() {
+        ActivePlacement::instance().placeService(currentThreadHandle());
+        nameTraceThread("Reporter");
+        std::vector<TestEvent> batch;
+        std::string text;
+        while (true) {
+            batch.clear();
+            text.clear();
+            size_t drained = drainAll(batch);
+            for (const auto& event : batch) {
+                format(event, text);
+            }
+            if (!text.empty()) {
+                TraceScope write("reporter", "Write output");
+                std::cout.write(text.data(), static_cast<std::streamsize>(text.size()));
+            }
+            if (drained > 0) {
+                continue;
+            }
+            std::unique_lock<std::mutex> lock(wakeMutex);
+            if (stopRequested) {
+                // Producers have finished; one last drain picks up anything pushed after the previous pass.
+                lock.unlock();
+                writePending();
+                return;
+            }
+            wakeCv.wait_for(lock, std::chrono::milliseconds(1));
+        }
+    }
+
+    /**
+     * @brief Drains every ring and writes the events, on the one thread currently consuming them.
+     */
+    void writePending() {
+        std::vector<TestEvent> batch;
+        std::string text;
+        drainAll(batch);
+        for (const auto& event : batch) {
+            format(event, text);
+        }
+        std::cout.write(text.data(), static_cast<std::streamsize>(text.size()));
+    }
+
+    static std::string qualifiedName(const TestEvent& event) {
+        std::string name = event.suite ? event.suite->name + "." : std::string();
+        if (event.testCase) {
+            name += event.testCase->name;
+        }
+        if (event.instance >= 0) {
+            name += "/" + std::to_string(event.instance);
+        }
+        if (event.showRepetition) {
+            name += " (Repetition " + std::to_string(event.repetition) + ")";
+        }
+        return name;
+    }
+
+    void format(const TestEvent& event, std::string& out) {
+        switch (event.type) {
+            case TestEventType::SuiteStart:
+                if (!quiet) {
+                    out += "Running Test Suite: " + event.suite->name + "\n";
+                }
+                break;
+            case TestEventType::SuiteFinish:
+                if (!quiet) {
+                    out += "Finished Test Suite: " + event.suite->name + "\n\n";
+                }
+                break;
+            case TestEventType::TestSkipped:
+                ++skippedCount;
+                if (!quiet) {
+                    out += "Skipping Disabled Test Case: " + std::string(event.testCase->name) + "\n";
+                }
+                break;
+            case TestEventType::TestStart:
+                if (!quiet) {
+                    out += "Running Test Case: " + std::string(event.testCase->name);
+                    if (event.instance >= 0) {
+                        out += "/" + std::to_string(event.instance);
+                    }
+                    if (event.showRepetition) {
+                        out += " (Repetition " + std::to_string(event.repetition) + ")";
+                    }
+                    out += "\n";
+                }
+                break;
+            case TestEventType::AssertionFailure:
+                if (quiet) {
+                    out += qualifiedName(event) + ": ";
+                }
+                out += "Assertion failed in " + std::string(event.file) + " at line " + std::to_string(event.line)
+                       + ": " + checkDescription(event.expression, event.message) + "\n";
+                break;
+            case TestEventType::TestFailure:
+                if (quiet) {
+                    out += qualifiedName(event) + ": ";
+                }
+                out += event.message + "\n";
+                break;
+            case TestEventType::TestFinish:
+                if (event.status == TestStatus::Passed) {
+                    ++passedCount;
+                } else {
+                    ++failedCount;
+                }
+                break;
+        }
+        if (!reporters.empty() && !reportersMuted) {
+            deliver(event);
+        }
+    }
+
+    void deliver(const TestEvent& event) {
+        ReportEvent view;
+        view.type = static_cast<ReportEvent::Type>(event.type);
+        view.suite = event.suite;
+        view.testCase = event.testCase;
+        view.repetition = event.repetition;
+        view.instance = event.instance;
+        view.status = event.status;
+        view.file = event.file;
+        view.line = event.line;
+        view.durationNanos = event.durationNanos;
+        std::string description;
+        if (event.type == TestEventType::AssertionFailure) {
+            description = checkDescription(event.expression, event.message);
+            view.message = description;
+        } else {
+            view.message = event.message;
+        }
+        for (const auto& reporter : reporters) {
+            reporter->report(view);
+        }
+    }
+};
+
+/**
+ * @brief Builds an event attributed to the given test.
+ */
+TestEvent makeTestEvent(TestEventType type, const TestSuite& suite, const TestCase& testCase, int rep, bool showRepetition,
+                        int instance = -1) {
+    TestEvent event;
+    event.type = type;
+    event.suite = &suite;
+    event.testCase = &testCase;
+    event.repetition = rep;
+    event.instance = instance;
+    event.showRepetition = showRepetition;
+    return event;
+}
+
+/**
+ * @brief Where a work item of a test falls: which family instance (or -1) and which repetition.
+ *
+ * A test owns instances times repetitions consecutive work items; all repetitions of an instance are adjacent.
+ */
+struct ItemPosition {
+    int instance;
+    int repetition;
+};
+
+ItemPosition decodeItem(size_t item, const TestCase& testCase) {
+    size_t repetitions = static_cast<size_t>(std::max(1, testCase.repetitions));
+    int instance = testCase.instanceCount ? static_cast<int>(item / repetitions) : -1;
+    return {instance, static_cast<int>(item % repetitions) + 1};
+}
+
+/**
+ * @brief Builds a suite-level event.
+ */
+TestEvent makeSuiteEvent(TestEventType type, const TestSuite& suite) {
+    TestEvent event;
+    event.type = type;
+    event.suite = &suite;
+    return event;
+}
+
+/**
+ * @brief A single timer thread that enforces the timeouts of TIMEOUT_TEST_CASE tests.
+ *
+ * Timed tests run directly on the calling worker. Before the body starts the worker arms an Entry with its
+ * deadline; the watchdog keeps all armed entries ordered by deadline and sleeps until the earliest one. If the
+ * body is still running when the deadline passes, the entry's onTimeout callback runs on the watchdog thread, so the
+ * test is reported as timed out immediately rather than when (or if) it returns. No thread is created per test,
+ * and the watchdog thread itself is only started once the first timed test is armed.
+ */
+class TimeoutWatchdog {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    /**
+     * @brief A timed test registered with the watchdog. Lives on the stack of the worker running the test.
+     */
+    struct Entry {
+        // Runs on the watchdog thread while the watchdog lock is held, so the worker cannot return from disarm()
+        // and destroy the entry while the callback still uses it.
+        std::function<void()> onTimeout;
+        bool fired = false;
+        std::multimap<Clock::time_point, Entry*>::iterator position;
+    };
+
+    TimeoutWatchdog() = default;
+
+    ~TimeoutWatchdog() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        cv.notify_all();
+        if (thread.joinable()) {
+            thread.join();
+        }
+    }
+
+    TimeoutWatchdog(const TimeoutWatchdog&) = delete;
+    TimeoutWatchdog& operator=(const TimeoutWatchdog&) = delete;
+
+    /**
+     * @brief Starts tracking a test that must finish before the given deadline.
+     */
+    void arm(Entry& entry, Clock::time_point deadline) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!thread.joinable()) {
+            thread = std::thread([this] { watchLoop(); });
+        }
+        entry.fired = false;
+        entry.position = deadlines.emplace(deadline, &entry);
+        if (entry.position == deadlines.begin()) {
+            cv.notify_one();
+        }
+    }
+
+    /**
+     * @brief Moves the watchdog thread, if it is running, to the CPUs of the current placement.
+     */
+    void place() {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (thread.joinable()) {
+            ActivePlacement::instance().placeService(thread.native_handle());
+        }
+    }
+
+    /**
+     * @brief The lock held while an entry's onTimeout runs; a timed test counts its failures under it.
+     */
+    std::mutex& timeoutMutex() {
+        return mutex;
+    }
+
+    /**
+     * @brief Stops tracking a test whose body has returned.
+     * @return True if the test finished in time, false if its timeout had already fired.
+     */
+    bool disarm(Entry& entry) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (entry.fired) {
+            return false;
+        }
+        deadlines.erase(entry.position);
+        return true;
+    }
+
+private:
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::multimap<Clock::time_point, Entry*> deadlines;
+    std::thread thread;
+    bool stopping = false;
+
+    void watchLoop() {
+        ActivePlacement::instance().placeService(currentThreadHandle());
+        nameTraceThread("Timeout watchdog");
+        std::unique_lock<std::mutex> lock(mutex);
+        while (!stopping) {
+            if (deadlines.empty()) {
+                cv.wait(lock);
+                continue;
+            }
+            auto earliest = deadlines.begin();
+            if (Clock::now() < earliest->first) {
+                TraceScope wait("watchdog", "Waiting for deadline");
+                cv.wait_until(lock, earliest->first);
+                continue;
+            }
+            Entry* entry = earliest->second;
+            deadlines.erase(earliest);
+            entry->fired = true;
+            TraceScope fired("watchdog", "Timeout");
+            entry->onTimeout();
+        }
+    }
+};
+
+/**
+ * @brief The watchdog of concurrent runs, which lives as long as the process.
+ *
+ * Threads abandoned by a timeout still use it when their test body finally returns, which may be after the run
+ * that started them has ended.
+ */
+TimeoutWatchdog& abandonableWatchdog() {
+    static auto* watchdog = new TimeoutWatchdog();
+    return *watchdog;
+}
+
+/**
+ * @brief Whether runTestCase() ran the test to completion or left it behind on a stuck worker.
+ */
+enum class TestOutcome {
+    Completed,
+    Abandoned
+};
+
+/**
+ * @brief CPU time consumed so far by the calling thread.
+ */
+uint64_t threadCpuNanos() {
+#if defined(CLOCK_THREAD_CPUTIME_ID)
+    timespec now{};
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now);
+    return static_cast<uint64_t>(now.tv_sec) * 1000000000ull + static_cast<uint64_t>(now.tv_nsec);
+#else
+    return 0;
+#endif
+}
+
+// The fields of PerfCounters in the order of the counters ThreadCounters opens.
+uint64_t PerfCounters::* const kCounterFields[] = {&PerfCounters::cycles, &PerfCounters::instructions,
+                                                   &PerfCounters::cacheMisses, &PerfCounters::branchMisses,
+                                                   &PerfCounters::contextSwitches};
+constexpr size_t kCounterCount = sizeof(kCounterFields) / sizeof(kCounterFields[0]);
+
+void addCounters(PerfCounters& total, const PerfCounters& extra) {
+    for (auto field : kCounterFields) {
+        total.*field += extra.*field;
+    }
+}
+
+/**
+ * @brief Counts between two snapshots; multiplexing scales each snapshot separately, so a count is never below zero.
+ */
+PerfCounters countersBetween(const PerfCounters& start, const PerfCounters& end) {
+    PerfCounters delta;
+    for (auto field : kCounterFields) {
+        delta.*field = end.*field > start.*field ? end.*field - start.*field : 0;
+    }
+    return delta;
+}
+
+/**
+ * @brief The performance counters of the calling thread, opened on first use and closed when the thread exits.
+ *
+ * Every counter is its own perf event rather than a member of one group, so a counter the machine lacks does not
+ * take the others down with it. When the kernel has to multiplex them, each value is scaled up by the fraction of
+ * the time the counter was actually scheduled.
+ */
+class ThreadCounters {
+public:
+    static ThreadCounters& current() {
+        thread_local ThreadCounters counters;
+        return counters;
+    }
+
+    ThreadCounters() = default;
+    ThreadCounters(const ThreadCounters&) = delete;
+    ThreadCounters& operator=(const ThreadCounters&) = delete;
+
+    ~ThreadCounters() {
+        reset();
+    }
+
+    /**
+     * @brief Counts since the counters were opened.
+     */
+    PerfCounters read() {
+        PerfCounters values;
+#if defined(__linux__)
+        if (!opened) {
+            open();
+        }
+        for (size_t i = 0; i < kCounterCount; ++i) {
+            values.*kCounterFields[i] = readCounter(fds[i]);
+        }
+#else
+        static std::once_flag warned;
+        std::call_once(warned, [] {
+            std::cerr << "Hardware counters are not supported on this platform; they are reported as zero" << std::endl;
+        });
+#endif
+        return values;
+    }
+
+    /**
+     * @brief Closes the counters. A forked child calls this, because the counters it inherited still count the
+     * parent's thread.
+     */
+    void reset() {
+#if defined(__linux__)
+        for (int& fd : fds) {
+            if (fd >= 0) {
+                ::close(fd);
+                fd = -1;
+            }
+        }
+        opened = false;
+#endif
+    }
+
+    /**
+     * @brief Starts measuring this thread as a worker.
+     */
+    void beginWorker() {
+        workerStart = read();
+        worker = WorkerCounters{};
+    }
+
+    /**
+     * @brief Adds the counts of one test body to the current worker's totals.
+     */
+    void addTest(const PerfCounters& test) {
+        addCounters(worker.inTests, test);
+        ++worker.testsRun;
+    }
+
+    /**
+     * @brief Finishes measuring this thread as a worker.
+     */
+    WorkerCounters endWorker() {
+        worker.total = countersBetween(workerStart, read());
+        return worker;
+    }
+
+private:
+#if defined(__linux__)
+    struct CounterSpec {
+        uint32_t type;
+        uint64_t config;
+        const char* name;
+    };
+
+    static constexpr CounterSpec kSpecs[kCounterCount] = {
+            {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES, "cycles"},
+            {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS, "instructions"},
+            {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES, "cache misses"},
+            {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES, "branch misses"},
+            {PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CONTEXT_SWITCHES, "context switches"}};
+
+    void open() {
+        opened = true;
+        static std::atomic<bool> warned[kCounterCount];
+        for (size_t i = 0; i < kCounterCount; ++i) {
+            perf_event_attr attr{};
+            attr.size = sizeof(attr);
+            attr.type = kSpecs[i].type;
+            attr.config = kSpecs[i].config;
+            attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+            attr.exclude_hv = 1;
+            // Context switches happen in the kernel; the hardware counters only need user space, which
+            // perf_event_paranoid restricts least.
+            attr.exclude_kernel = kSpecs[i].type == PERF_TYPE_HARDWARE;
+            fds[i] = static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, -1, PERF_FLAG_FD_CLOEXEC));
+            if (fds[i] < 0 && !attr.exclude_kernel && (errno == EACCES || errno == EPERM)) {
+                attr.exclude_kernel = 1;
+                fds[i] = static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, -1, PERF_FLAG_FD_CLOEXEC));
+            }
+            if (fds[i] < 0 && !warned[i].exchange(true)) {
+                std::cerr << "Hardware counter for " << kSpecs[i].name << " is unavailable (" << std::strerror(errno)
+                          << "); it is reported as zero" << std::endl;
+            }
+        }
+    }
+
+    static uint64_t readCounter(int fd) {
+        struct {
+            uint64_t value;
+            uint64_t timeEnabled;
+            uint64_t timeRunning;
+        } sample{};
+        if (fd < 0 || ::read(fd, &sample, sizeof(sample)) != static_cast<ssize_t>(sizeof(sample))
+            || sample.timeRunning == 0) {
+            return 0;
+        }
+        if (sample.timeRunning < sample.timeEnabled) {
+            return static_cast<uint64_t>(static_cast<double>(sample.value) * static_cast<double>(sample.timeEnabled)
+                                         / static_cast<double>(sample.timeRunning));
+        }
+        return sample.value;
+    }
+
+    int fds[kCounterCount] = {-1, -1, -1, -1, -1};
+    bool opened = false;
+#endif
+    PerfCounters workerStart;
+    WorkerCounters worker;
+};
+
+/**
+ * @brief Thread and iteration counts of concurrent tests, copied from the RunnerOptions when run() starts.
+ */
+struct StressSettings {
+    unsigned int threads = 2;
+    unsigned int iterations = 1;
+    bool scaling = false;
+};
+
+StressSettings stressSettings;
+
+/**
+ * @brief ProfiledMutex acquisitions made by one thread of a concurrent test during one round.
+ */
+struct LockProfile {
+    uint64_t acquisitions = 0;
+    uint64_t contended = 0;
+    uint64_t waitNanos = 0;
+};
+
+// Set while the calling thread runs the body of a concurrent test.
+thread_local LockProfile* lockProfile = nullptr;
+thread_local unsigned int stressThreadIndex = 0;
+thread_local unsigned int stressThreadCount = 1;
+
+/**
+ * @brief Collects the scaling curves measured by the workers during a run.
+ *
+ * Only completed concurrent tests add an entry, once per execution, so the mutex is taken rarely.
+ */
+class StressLog {
+public:
+    static StressLog& instance() {
+        static StressLog* log = new StressLog();
+        return *log;
+    }
+
+    void clear() {
+        std::lock_guard<std::mutex> lock(mutex);
+        entries.clear();
+    }
+
+    void add(StressResult entry) {
+        std::lock_guard<std::mutex> lock(mutex);
+        entries.push_back(std::move(entry));
+    }
+
+    /**
+     * @brief Removes and returns the collected curves, ordered by suite, test, instance and repetition.
+     */
+    std::vector<StressResult> take() {
+        std::lock_guard<std::mutex> lock(mutex);
+        std::vector<StressResult> taken = std::move(entries);
+        entries.clear();
+        std::sort(taken.begin(), taken.end(), [](const StressResult& a, const StressResult& b) {
+            return std::tie(a.suiteIndex, a.testIndex, a.instance, a.repetition)
+                   < std::tie(b.suiteIndex, b.testIndex, b.instance, b.repetition);
+        });
+        return taken;
+    }
+
+private:
+    std::mutex mutex;
+    std::vector<StressResult> entries;
+};
+
+/**
+ * @brief Calls the body of a concurrent test `iterations` times on each of `threads` threads at once and appends
+ * the measurement to `points`.
+ *
+ * The calling thread, already set up as the running test, is thread zero. The others are started first and spin at
+ * a start barrier until all of them are ready, so every thread begins together. A fatal failure or exception on one
+ * thread stops the others before their next call, and the first such exception is rethrown here once every thread
+ * has finished, to be handled like one thrown by an ordinary body.
+ * @param scratch Receives the assertion failures of the other threads.
+ * @param helperCpuNanos Receives the CPU time of the other threads.
+ */
+void runStressRound(const TestSuite& suite, TestFixture* fixture, const TestCase& testCase, int rep, int instance,
+                    bool showRepetition, TestResult& scratch, unsigned int threads, unsigned int iterations,
+                    std::vector<StressPoint>& points, uint64_t& helperCpuNanos) {
+    std::atomic<unsigned int> ready{0};
+    std::atomic<bool> released{false};
+    std::atomic<bool> stop{false};
+    std::atomic<uint64_t> calls{0};
+    std::mutex errorMutex;
+    std::exception_ptr firstError;
+    std::vector<LockProfile> profiles(threads);
+    std::vector<TestResult> helperResults(threads);
+    std::vector<uint64_t> helperCpu(threads, 0);
+
+    auto callBody = [&](unsigned int index) {
+        stressThreadIndex = index;
+        stressThreadCount = threads;
+        lockProfile = &profiles[index];
+        uint64_t made = 0;
+        try {
+            for (unsigned int i = 0; i < iterations && !stop.load(std::memory_order_relaxed); ++i) {
+                ++made;
+                testCase.function(fixture, rep);
+            }
+        } catch (...) {
+            stop.store(true, std::memory_order_relaxed);
+            std::lock_guard<std::mutex> lock(errorMutex);
+            if (!firstError) {
+                firstError = std::current_exception();
+            }
+        }
+        calls.fetch_add(made, std::memory_order_relaxed);
+        lockProfile = nullptr;
+        stressThreadIndex = 0;
+        stressThreadCount = 1;
+    };
+
+    std::vector<std::thread> helpers;
+    helpers.reserve(threads - 1);
+    try {
+        for (unsigned int index = 1; index < threads; ++index) {
+            helpers.emplace_back([&, index] {
+                ActivePlacement::instance().placeHelper(currentThreadHandle());
+                currentTest = {&suite, &testCase, rep, instance, showRepetition, &helperResults[index]};
+                uint64_t cpuStart = threadCpuNanos();
+                ready.fetch_add(1, std::memory_order_acq_rel);
+                while (!released.load(std::memory_order_acquire)) {
+                    std::this_thread::yield();
+                }
+                {
+                    TraceScope body("test", nullptr, &suite, &testCase, instance, rep);
+                    callBody(index);
+                }
+                helperCpu[index] = threadCpuNanos() - cpuStart;
+                currentTest = {};
+            });
+        }
+    } catch (...) {
+        // Could not start every thread: let the started ones return at once, then fail the test.
+        stop.store(true, std::memory_order_relaxed);
+        released.store(true, std::memory_order_release);
+        for (std::thread& helper : helpers) {
+            helper.join();
+        }
+        throw;
+    }
+
+    while (ready.load(std::memory_order_acquire) < threads - 1) {
+        std::this_thread::yield();
+    }
+    auto start = std::chrono::steady_clock::now();
+    released.store(true, std::memory_order_release);
+    callBody(0);
+    for (std::thread& helper : helpers) {
+        helper.join();
+    }
+    auto wallNanos = static_cast<uint64_t>(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count());
+
+    StressPoint point;
+    uint32_t helperFailures = 0;
+    point.threads = threads;
+    point.calls = calls.load(std::memory_order_relaxed);
+    point.wallNanos = wallNanos;
+    point.callsPerSecond = wallNanos ? static_cast<double>(point.calls) * 1e9 / static_cast<double>(wallNanos) : 0;
+    for (unsigned int index = 0; index < threads; ++index) {
+        point.lockAcquisitions += profiles[index].acquisitions;
+        point.contendedAcquisitions += profiles[index].contended;
+        point.lockWaitNanos += profiles[index].waitNanos;
+        helperFailures += helperResults[index].assertionFailures;
+        helperCpuNanos += helperCpu[index];
+    }
+    addAssertionFailures(scratch, helperFailures);
+    points.push_back(point);
+
+    if (firstError) {
+        std::rethrow_exception(firstError);
+    }
+}
+
+/**
+ * @brief Runs the body of a concurrent test at its thread count, preceded by 1, 2, 4, ... threads when the run
+ * measures scaling curves. The sweep stops at the first round that fails fatally.
+ */
+void runStressTest(const TestSuite& suite, TestFixture* fixture, const TestCase& testCase, int rep, int instance,
+                   bool showRepetition, TestResult& scratch, std::vector<StressPoint>& points,
+                   uint64_t& helperCpuNanos) {
+    unsigned int threads = std::max(1u, testCase.stressThreads ? testCase.stressThreads : stressSettings.threads);
+    unsigned int iterations = testCase.stressIterations ? testCase.stressIterations : stressSettings.iterations;
+    if (stressSettings.scaling) {
+        for (unsigned int count = 1; count < threads; count *= 2) {
+            runStressRound(suite, fixture, testCase, rep, instance, showRepetition, scratch, count, iterations, points,
+                           helperCpuNanos);
+        }
+    }
+    runStressRound(suite, fixture, testCase, rep, instance, showRepetition, scratch, threads, iterations, points,
+                   helperCpuNanos);
+}
+
+/**
+ * @brief Describes an exception that escaped a test body, or returns an empty string if the test declared it.
+ * @param testCase The test whose body threw.
+ * @param error The exception; it must not be a FatalAssertionFailure.
+ */
+std::string unexpectedExceptionMessage(const TestCase& testCase, const std::exception_ptr& error) {
+    bool exceptionExpected = !testCase.expectedExceptionTypeName.empty();
+    // An expected exception must match the declared type; a test without a matcher accepts any exception.
+    if (exceptionExpected && (!testCase.expectedExceptionMatches || testCase.expectedExceptionMatches(error))) {
+        return {};
+    }
+    std::string name(testCase.name);
+    try {
+        std::rethrow_exception(error);
+    } catch (const std::exception& e) {
+        return (exceptionExpected ? "Unexpected exception type in test '" : "Unexpected exception thrown in test '")
+               + name + "': " + e.what();
+    } catch (...) {
+        return exceptionExpected ? "Unexpected exception type in test '" + name + "'"
+                                 : "Unexpected unknown exception thrown in test '" + name + "'";
+    }
+}
+
+/**
+ * @brief Runs a single repetition of a test case, including its BeforeEach/AfterEach hooks.
+ *
+ * Timed tests run on the calling thread under the watchdog. When the deadline passes the watchdog reports the
+ * timeout straight away. If onAbandon is given it is also invoked on the watchdog thread so the caller can carry on
+ * without this thread; the thread then returns TestOutcome::Abandoned as soon as the body comes back, touching
+ * nothing else. Without onAbandon the caller simply waits for the body, but the test stays marked as timed out.
+ * @param suite The suite the test belongs to.
+ * @param fixture The fixture instance the hooks and the test body run against.
+ * @param testCase The test case to execute.
+ * @param rep The repetition number passed to the test function.
+ * @param instance The index of the instance within a parameterized family, or -1.
+ * @param showRepetition Whether the repetition number is printed in the header line.
+ * @param result The results-table entry of this repetition, filled in by this call.
+ * @param counters Receives the hardware counters of the test body, or nullptr to not count.
+ * @param allocations Receives the heap use of the test, or nullptr to not track it.
+ * @param watchdog The watchdog enforcing timeouts.
+ * @param onAbandon Invoked on the watchdog thread when a timed test overruns, or nullptr to wait for the body.
+ * @return Whether the test ran to completion on this thread.
+ */
+TestOutcome runTestCase(TestSuite& suite, TestFixture* fixture, const TestCase& testCase, int rep, int instance,
+                        bool showRepetition, TestResult& result, PerfCounters* counters, AllocationStats* allocations,
+                        TimeoutWatchdog& watchdog, const std::function<void()>* onAbandon) {
+    AllocationScope tracking(allocations != nullptr);
+    EventReporter& reporter = EventReporter::instance();
+    auto fail = [&](std::string message) {
+        TestEvent event = makeTestEvent(TestEventType::TestFailure, suite, testCase, rep, showRepetition, instance);
+        event.message = std::move(message);
+        reporter.emit(std::move(event));
+    };
+    auto finish = [&](TestStatus status, uint64_t wallNanos) {
+        TestEvent event = makeTestEvent(TestEventType::TestFinish, suite, testCase, rep, showRepetition, instance);
+        event.status = status;
+        event.durationNanos = wallNanos;
+        reporter.emit(std::move(event));
+    };
+
+    if (fixture) {
+        TraceScope hook("fixture", "BeforeEach", &suite);
+        ArenaScope arena;
+        fixture->BeforeEach();
+    }
+
+    reporter.emit(makeTestEvent(TestEventType::TestStart, suite, testCase, rep, showRepetition, instance));
+    auto testStart = std::chrono::steady_clock::now();
+
+    bool exceptionCaught = false;
+    bool exceptionExpected = !testCase.expectedExceptionTypeName.empty();
+    bool testPassed = true;
+    bool aborted = false;
+
+    // Assertions are counted here first; a timed test that gets abandoned must not write to the results table
+    // after the watchdog has already filled in its entry.
+    TestResult scratch;
+    PerfCounters scratchCounters;
+    auto storeCounters = [&]() {
+        if (counters) {
+            *counters = scratchCounters;
+            ThreadCounters::current().addTest(scratchCounters);
+        }
+    };
+
+    // Measured by a concurrent test, and published only once it completes.
+    std::vector<StressPoint> stressPoints;
+    uint64_t stressCpuNanos = 0;
+
+    AllocationTally bodyTally;
+    // Called once AfterEach has returned; the abandoned thread of a timed-out test never gets there.
+    auto endTest = [&]() {
+        ArenaScope::resetThreadArena();
+        if (allocations) {
+            const AllocationTally& tally = tracking.tally;
+            *allocations = {tally.allocations, tally.bytes, bodyTally.allocations, bodyTally.bytes,
+                            tally.peakLiveBytes, tally.liveBytes, tally.arenaBytes};
+        }
+    };
+
+    auto executeTest = [&]() {
+        // A timeout snapshots the failure count on the watchdog thread while the body may still be failing.
+        std::mutex* resultMutex = testCase.timeout.count() > 0 ? &watchdog.timeoutMutex() : nullptr;
+        currentTest = {&suite, &testCase, rep, instance, showRepetition, &scratch, resultMutex};
+        uint64_t cpuStart = threadCpuNanos();
+        PerfCounters countersStart;
+        if (counters) {
+            countersStart = ThreadCounters::current().read();
+        }
+        AllocationTally before = tracking.tally;
+        try {
+            TraceScope body("test", nullptr, &suite, &testCase, instance, rep);
+            if (testCase.concurrent) {
+                runStressTest(suite, fixture, testCase, rep, instance, showRepetition, scratch, stressPoints,
+                              stressCpuNanos);
+            } else {
+                ArenaScope arena;
+                testCase.function(fixture, rep);
+            }
+        } catch (const FatalAssertionFailure&) {
+            // Already counted and reported by the assertion; the test just stops here.
+            aborted = true;
+        } catch (...) {
+            exceptionCaught = true;
+            std::string message = unexpectedExceptionMessage(testCase, std::current_exception());
+            if (!message.empty()) {
+                fail(std::move(message));
+                testPassed = false;
+            }
+        }
+        if (counters) {
+            scratchCounters = countersBetween(countersStart, ThreadCounters::current().read());
+        }
+        bodyTally.allocations = tracking.tally.allocations - before.allocations;
+        bodyTally.bytes = tracking.tally.bytes - before.bytes;
+        scratch.cpuNanos = threadCpuNanos() - cpuStart + stressCpuNanos;
+        currentTest = {};
+    };
+
+    if (testCase.timeout.count() > 0) {
+        TimeoutWatchdog::Entry entry;
+        entry.onTimeout = [&] {
+            fail("Test '" + std::string(testCase.name) + "' timed out after " + std::to_string(testCase.timeout.count()) + " ms");
+            result.status = TestStatus::TimedOut;
+            result.assertionFailures = scratch.assertionFailures;
+            result.wallNanos = static_cast<uint64_t>(
+                    std::chrono::duration_cast<std::chrono::nanoseconds>(testCase.timeout).count());
+            finish(TestStatus::TimedOut, result.wallNanos);
+            if (onAbandon) {
+                (*onAbandon)();
+            }
+        };
+        watchdog.arm(entry, testStart + testCase.timeout);
+        executeTest();
+        if (!watchdog.disarm(entry)) {
+            if (onAbandon) {
+                return TestOutcome::Abandoned;
+            }
+            result.assertionFailures = scratch.assertionFailures;
+            result.cpuNanos = scratch.cpuNanos;
+            storeCounters();
+            if (fixture) {
+                TraceScope hook("fixture", "AfterEach", &suite);
+                ArenaScope arena;
+                fixture->AfterEach();
+            }
+            endTest();
+            return TestOutcome::Completed;
+        }
+    } else {
+        executeTest();
+    }
+
+    if (exceptionExpected && !exceptionCaught && !aborted) {
+        fail("Expected exception of type '" + std::string(testCase.expectedExceptionTypeName) + "' was not thrown in test '"
+             + std::string(testCase.name) + "'");
+        testPassed = false;
+    }
+
+    if (scratch.assertionFailures > 0) {
+        testPassed = false;
+    }
+    result.assertionFailures = scratch.assertionFailures;
+    result.cpuNanos = scratch.cpuNanos;
+    storeCounters();
+    result.status = testPassed ? TestStatus::Passed : TestStatus::Failed;
+    result.wallNanos = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - testStart).count());
+    finish(result.status, result.wallNanos);
+
+    if (!stressPoints.empty()) {
+        StressLog::instance().add({result.suiteIndex, result.testIndex, rep, instance, std::move(stressPoints)});
+    }
+
+    if (fixture) {
+        TraceScope hook("fixture", "AfterEach", &suite);
+        ArenaScope arena;
+        fixture->AfterEach();
+    }
+    endTest();
+    return TestOutcome::Completed;
+}
+
+} // namespace
+
+/**
+ * @brief A timer or test deadline kept by an AsyncLoop.
+ */
+struct AsyncTimer {
+    AsyncTestState* test;
+    uint64_t token;
+    bool isDeadline;
+};
+
+/**
+ * @brief One ASYNC_TEST_CASE repetition in flight: what runTestCase() keeps on its stack, kept across suspensions.
+ *
+ * Owned by its AsyncLoop until the end of the run, so a wake-up that arrives after the test ended finds a stale
+ * token instead of freed memory.
+ */
+struct AsyncTestState {
+    AsyncLoop* loop = nullptr;
+    TestSuite* suite = nullptr;
+    const TestCase* testCase = nullptr;
+    int repetition = 1;
+    int instance = -1;
+    bool showRepetition = false;
+    TestFixture* fixture = nullptr;
+    // A clone for this test alone, in a per-worker suite: the test may resume on any worker.
+    std::shared_ptr<TestFixture> ownFixture;
+    TestResult* result = nullptr;
+    TestResult scratch;
+    // Invoked on a worker once the result is stored and AfterEach has run.
+    std::function<void()> onComplete;
+    std::optional<AsyncTest> body;
+    std::chrono::steady_clock::time_point start;
+    // Where the coroutine is suspended, and what it waits for; written by suspendAsyncTest() during a slice.
+    std::coroutine_handle<> resumePoint;
+    AsyncWait pendingWait;
+    bool hasPendingWait = false;
+
+    // Guarded by the loop's mutex. The token identifies the current wait and changes whenever the test resumes or
+    // is cancelled, so only one of the events racing to wake it succeeds.
+    uint64_t token = 0;
+    bool waiting = false;
+    bool timedOut = false;
+    bool completed = false;
+    bool hasDeadline = false;
+    std::multimap<std::chrono::steady_clock::time_point, AsyncTimer>::iterator deadline;
+};
+
+/**
+ * @brief Drives the ASYNC_TEST_CASE coroutines of one run.
+ *
+ * A test runs on a worker until it co_awaits a timer, a file descriptor or an AsyncEvent. The wait is published
+ * when the slice returns to the loop, never from inside the coroutine, so the test cannot be resumed elsewhere
+ * while its worker is still leaving it. The loop keeps the timers, the descriptors and the tests' deadlines; when
+ * a wait completes or a deadline passes it hands the test to `dispatch`, which in a concurrent run queues a task
+ * so any worker resumes it, while a poller thread waits in poll(). In a sequential run there is no poller: the
+ * thread running the test polls the loop itself until the test completes.
+ */
+class AsyncLoop {
+public:
+    using Clock = std::chrono::steady_clock;
+    using Dispatch = std::function<void(AsyncTestState&)>;
+
+    /**
+     * @param dispatch Hands a test that can continue to a worker. Without one, tests are resumed by
+     * runUntilComplete() on the thread calling it.
+     */
+    explicit AsyncLoop(Dispatch dispatch = nullptr) : dispatch(std::move(dispatch)) {
+#if TESTFRAMEWORK_HAS_POLL
+        if (::pipe(wakePipe) == 0) {
+            for (int fd : wakePipe) {
+                ::fcntl(fd, F_SETFL, ::fcntl(fd, F_GETFL) | O_NONBLOCK);
+                ::fcntl(fd, F_SETFD, FD_CLOEXEC);
+            }
+        } else {
+            std::cerr << "Failed to create the async test wake-up pipe: " << std::strerror(errno) << std::endl;
+        }
+#endif
+        if (this->dispatch) {
+            poller = std::thread([this] { pollLoop(); });
+        }
+    }
+
+    ~AsyncLoop() {
+        {
+            std::unique_lock<std::mutex> lock(externalWakeMutex);
+            externalWakesDone.wait(lock, [this] { return externalWakes == 0; });
+        }
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+            notifyLocked();
+        }
+        if (poller.joinable()) {
+            poller.join();
+        }
+#if TESTFRAMEWORK_HAS_POLL
+        for (int fd : wakePipe) {
+            if (fd >= 0) {
+                ::close(fd);
+            }
+        }
+#endif
+    }
+
+    AsyncLoop(const AsyncLoop&) = delete;
+    AsyncLoop& operator=(const AsyncLoop&) = delete;
+
+    /**
+     * @brief The async test whose slice runs on the calling thread, or nullptr.
+     */
+    static AsyncTestState*& running() {
+        thread_local AsyncTestState* test = nullptr;
+        return test;
+    }
+
+    /**
+     * @brief Creates the state of one repetition; the caller fills in the fixture and completion callback.
+     */
+    AsyncTestState& create(TestSuite& suite, const TestCase& testCase, int rep, int instance, bool showRepetition,
+                           TestResult& result) {
+        std::lock_guard<std::mutex> lock(mutex);
+        AsyncTestState& test = tests.emplace_back();
+        test.loop = this;
+        test.suite = &suite;
+        test.testCase = &testCase;
+        test.repetition = rep;
+        test.instance = instance;
+        test.showRepetition = showRepetition;
+        test.result = &result;
+        return test;
+    }
+
+    /**
+     * @brief Runs BeforeEach, creates the coroutine and runs its first slice on the calling thread.
+     */
+    void start(AsyncTestState& test) {
+        if (test.fixture) {
+            TraceScope hook("fixture", "BeforeEach", test.suite);
+            test.fixture->BeforeEach();
+        }
+        EventReporter::instance().emit(makeTestEvent(TestEventType::TestStart, *test.suite, *test.testCase,
+                                                     test.repetition, test.showRepetition, test.instance));
+        test.start = Clock::now();
+        test.body.emplace(test.testCase->asyncFunction(test.fixture, test.repetition));
+        test.resumePoint = test.body->coroutine();
+        if (test.testCase->timeout.count() > 0) {
+            std::lock_guard<std::mutex> lock(mutex);
+            addTimerLocked(test.start + test.testCase->timeout, {&test, 0, true});
+        }
+        resume(test);
+    }
+
+    /**
+     * @brief Runs the test until it suspends or completes, then publishes its wait or completes it.
+     */
+    void resume(AsyncTestState& test) {
+        bool cancel;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            cancel = test.timedOut;
+        }
+        if (!cancel) {
+            runSlice(test);
+            if (test.body->coroutine().done()) {
+                complete(test);
+                return;
+            }
+            if (!test.hasPendingWait) {
+                fail(test, "Async test '" + std::string(test.testCase->name)
+                           + "' suspended on an awaitable other than sleepFor, waitReadable, waitWritable or AsyncEvent");
+                cancel = true;
+            }
+        }
+
+        bool readyNow = false;
+        bool unsupported = false;
+        if (!cancel) {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (test.timedOut) {
+                cancel = true;
+            } else {
+                ++test.token;
+                test.waiting = true;
+                const AsyncWait& wait = test.pendingWait;
+                switch (wait.kind) {
+                    case AsyncWait::Kind::Timer:
+                        addTimerLocked(wait.deadline, {&test, test.token, false});
+                        break;
+                    case AsyncWait::Kind::Readable:
+                    case AsyncWait::Kind::Writable:
+#if TESTFRAMEWORK_HAS_POLL
+                        ioWaits.push_back({&test, test.token, wait.fd, wait.kind == AsyncWait::Kind::Writable});
+                        notifyLocked();
+#else
+                        test.waiting = false;
+                        unsupported = true;
+#endif
+                        break;
+                    case AsyncWait::Kind::Event: {
+                        std::lock_guard<std::mutex> eventLock(wait.event->mutex);
+                        if (wait.event->signaled) {
+                            test.waiting = false;
+                            readyNow = true;
+                        } else {
+                            wait.event->waiters.push_back({&test, test.token});
+                        }
+                        break;
+                    }
+                }
+            }
+        }
+        if (unsupported) {
+            fail(test, "Async test '" + std::string(test.testCase->name)
+                       + "' waited on a file descriptor, which is not supported on this platform");
+            cancel = true;
+        }
+        if (cancel) {
+            // Destroying the frame where it waits runs the destructors of its locals; nothing keeps running.
+            complete(test);
+            return;
+        }
+        if (readyNow) {
+            hand(test);
+        }
+    }
+
+    /**
+     * @brief Announces a wake() from an AsyncEvent, called while the event still lists the test as a waiter.
+     *
+     * The loop is not destroyed until every announced wake has ended, so an event set from another thread while
+     * the run finishes never reaches a destroyed loop.
+     */
+    void beginExternalWake() {
+        std::lock_guard<std::mutex> lock(externalWakeMutex);
+        ++externalWakes;
+    }
+
+    /**
+     * @brief Ends a wake announced by beginExternalWake(); the loop must not be touched afterwards.
+     */
+    void endExternalWake() {
+        std::lock_guard<std::mutex> lock(externalWakeMutex);
+        --externalWakes;
+        // Notified under the lock, so the destructor cannot finish before this call has left the loop.
+        externalWakesDone.notify_all();
+    }
+
+    /**
+     * @brief Resumes a suspended test if it still waits for the wait identified by `token`.
+     */
+    void wake(AsyncTestState& test, uint64_t token) {
+        bool claimed;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            claimed = claimLocked(test, token);
+        }
+        if (claimed) {
+            hand(test);
+        }
+    }
+
+    /**
+     * @brief Runs the loop on the calling thread until the test has completed; used when there is no dispatch.
+     */
+    void runUntilComplete(AsyncTestState& test) {
+        while (true) {
+            AsyncTestState* next = nullptr;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (test.completed) {
+                    return;
+                }
+                if (!ready.empty()) {
+                    next = ready.front();
+                    ready.pop_front();
+                }
+            }
+            if (next) {
+                resume(*next);
+            } else {
+                pollOnce();
+            }
+        }
+    }
+
+private:
+    struct IoWait {
+        AsyncTestState* test;
+        uint64_t token;
+        int fd;
+        bool writable;
+    };
+
+    Dispatch dispatch;
+    std::mutex mutex;
+    // A deque keeps the states in place as it grows.
+    std::deque<AsyncTestState> tests;
+    std::multimap<Clock::time_point, AsyncTimer> timers;
+    std::vector<IoWait> ioWaits;
+    // Tests ready to continue when there is no dispatch.
+    std::deque<AsyncTestState*> ready;
+    std::thread poller;
+    bool polling = false;
+    bool stopping = false;
+    // Wakes from AsyncEvent::set() in progress. Separate from `mutex`, which is taken before an event's lock.
+    std::mutex externalWakeMutex;
+    std::condition_variable externalWakesDone;
+    int externalWakes = 0;
+#if TESTFRAMEWORK_HAS_POLL
+    int wakePipe[2] = {-1, -1};
+#else
+    std::condition_variable wakeCv;
+    bool notified = false;
+#endif
+
+    void runSlice(AsyncTestState& test) {
+        running() = &test;
+        currentTest = {test.suite, test.testCase, test.repetition, test.instance, test.showRepetition, &test.scratch};
+        test.hasPendingWait = false;
+        uint64_t cpuStart = threadCpuNanos();
+        {
+            TraceScope slice("test", nullptr, test.suite, test.testCase, test.instance, test.repetition);
+            test.resumePoint.resume();
+        }
+        test.scratch.cpuNanos += threadCpuNanos() - cpuStart;
+        currentTest = {};
+        running() = nullptr;
+    }
+
+    void fail(AsyncTestState& test, std::string message) {
+        TestEvent event = makeTestEvent(TestEventType::TestFailure, *test.suite, *test.testCase, test.repetition,
+                                        test.showRepetition, test.instance);
+        event.message = std::move(message);
+        EventReporter::instance().emit(std::move(event));
+    }
+
+    /**
+     * @brief Stores the result of a test that returned, threw or was cancelled, and runs AfterEach.
+     */
+    void complete(AsyncTestState& test) {
+        // A test cancelled while it waits on an event leaves it, so a later set() cannot reach this run.
+        if (test.hasPendingWait && test.pendingWait.kind == AsyncWait::Kind::Event) {
+            AsyncEvent& event = *test.pendingWait.event;
+            std::lock_guard<std::mutex> eventLock(event.mutex);
+            std::erase_if(event.waiters, [&](const AsyncEvent::Waiter& waiter) { return waiter.test == &test; });
+        }
+        bool timedOut;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            test.completed = true;
+            test.waiting = false;
+            ++test.token;
+            if (test.hasDeadline) {
+                timers.erase(test.deadline);
+                test.hasDeadline = false;
+            }
+            timedOut = test.timedOut;
+        }
+        const TestCase& testCase = *test.testCase;
+        TestResult& result = *test.result;
+        bool testPassed = true;
+        uint64_t wallNanos = static_cast<uint64_t>(
+                std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - test.start).count());
+
+        if (timedOut) {
+            fail(test, "Test '" + std::string(testCase.name) + "' timed out after "
+                       + std::to_string(testCase.timeout.count()) + " ms");
+            testPassed = false;
+            wallNanos = static_cast<uint64_t>(
+                    std::chrono::duration_cast<std::chrono::nanoseconds>(testCase.timeout).count());
+        } else if (test.body && test.body->coroutine().done()) {
+            bool exceptionCaught = false;
+            bool aborted = false;
+            if (std::exception_ptr error = test.body->coroutine().promise().error) {
+                try {
+                    std::rethrow_exception(error);
+                } catch (const FatalAssertionFailure&) {
+                    aborted = true;
+                } catch (...) {
+                    exceptionCaught = true;
+                    std::string message = unexpectedExceptionMessage(testCase, error);
+                    if (!message.empty()) {
+                        fail(test, std::move(message));
+                        testPassed = false;
+                    }
+                }
+            }
+            if (!testCase.expectedExceptionTypeName.empty() && !exceptionCaught && !aborted) {
+                fail(test, "Expected exception of type '" + std::string(testCase.expectedExceptionTypeName)
+                           + "' was not thrown in test '" + std::string(testCase.name) + "'");
+                testPassed = false;
+            }
+        } else {
+            testPassed = false;
+        }
+
+        // Destructors of the coroutine's locals may still record assertion failures.
+        currentTest = {test.suite, test.testCase, test.repetition, test.instance, test.showRepetition, &test.scratch};
+        test.body.reset();
+        currentTest = {};
+
+        if (test.scratch.assertionFailures > 0) {
+            testPassed = false;
+        }
+        result.assertionFailures = test.scratch.assertionFailures;
+        result.cpuNanos = test.scratch.cpuNanos;
+        result.wallNanos = wallNanos;
+        result.status = timedOut ? TestStatus::TimedOut : testPassed ? TestStatus::Passed : TestStatus::Failed;
+
+        TestEvent finish = makeTestEvent(TestEventType::TestFinish, *test.suite, testCase, test.repetition,
+                                         test.showRepetition, test.instance);
+        finish.status = result.status;
+        finish.durationNanos = wallNanos;
+        EventReporter::instance().emit(std::move(finish));
+
+        if (test.fixture) {
+            TraceScope hook("fixture", "AfterEach", test.suite);
+            test.fixture->AfterEach();
+        }
+        test.ownFixture.reset();
+        // The callback may let the run finish and destroy this loop, so it is moved out of the state first.
+        std::function<void()> onComplete = std::move(test.onComplete);
+        if (onComplete) {
+            onComplete();
+        }
+    }
+
+    bool claimLocked(AsyncTestState& test, uint64_t token) {
+        if (!test.waiting || test.token != token) {
+            return false;
+        }
+        test.waiting = false;
+        ++test.token;
+        return true;
+    }
+
+    void addTimerLocked(Clock::time_point when, AsyncTimer timer) {
+        auto position = timers.emplace(when, timer);
+        if (timer.isDeadline) {
+            timer.test->deadline = position;
+            timer.test->hasDeadline = true;
+        }
+        if (position == timers.begin()) {
+            notifyLocked();
+        }
+    }
+
+    void hand(AsyncTestState& test) {
+        if (dispatch) {
+            dispatch(test);
+            return;
+        }
+        std::lock_guard<std::mutex> lock(mutex);
+        ready.push_back(&test);
+        notifyLocked();
+    }
+
+    // Interrupts a poll in progress so it picks up new waits, an earlier timer, or a stop request.
+    void notifyLocked() {
+        if (!polling) {
+            return;
+        }
+#if TESTFRAMEWORK_HAS_POLL
+        char byte = 1;
+        [[maybe_unused]] ssize_t written = ::write(wakePipe[1], &byte, 1);
+#else
+        notified = true;
+        wakeCv.notify_one();
+#endif
+    }
+
+    void pollLoop() {
+        ActivePlacement::instance().placeService(currentThreadHandle());
+        nameTraceThread("Async test poller");
+        while (true) {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (stopping) {
+                    return;
+                }
+            }
+            pollOnce();
+        }
+    }
+
+    /**
+     * @brief Waits for the next descriptor, timer or deadline, or a notification, and hands out the woken tests.
+     */
+    void pollOnce() {
+        std::vector<AsyncTestState*> woken;
+        std::unique_lock<std::mutex> lock(mutex);
+        int timeoutMs = -1;
+        if (stopping || !ready.empty()) {
+            timeoutMs = 0;
+        } else if (!timers.empty()) {
+            auto until = timers.begin()->first - Clock::now();
+            timeoutMs = until.count() <= 0 ? 0 : static_cast<int>(std::min<int64_t>(
+                    std::chrono::ceil<std::chrono::milliseconds>(until).count(), std::numeric_limits<int>::max()));
+        }
+
+#if TESTFRAMEWORK_HAS_POLL
+        // Waits of tests that have since been resumed or cancelled are dropped here, by the only thread polling.
+        std::erase_if(ioWaits, [](const IoWait& wait) { return !wait.test->waiting || wait.test->token != wait.token; });
+        std::vector<pollfd> fds;
+        fds.reserve(ioWaits.size() + 1);
+        fds.push_back({wakePipe[0], POLLIN, 0});
+        for (const IoWait& wait : ioWaits) {
+            fds.push_back({wait.fd, static_cast<short>(wait.writable ? POLLOUT : POLLIN), 0});
+        }
+        polling = true;
+        lock.unlock();
+        int events = ::poll(fds.data(), static_cast<nfds_t>(fds.size()), timeoutMs);
+        lock.lock();
+        polling = false;
+        if (events > 0) {
+            if (fds[0].revents) {
+                char buffer[64];
+                while (::read(wakePipe[0], buffer, sizeof(buffer)) > 0) {
+                }
+            }
+            // Waits added while polling were appended, so the first entries still match fds.
+            for (size_t i = 1; i < fds.size(); ++i) {
+                if (fds[i].revents && claimLocked(*ioWaits[i - 1].test, ioWaits[i - 1].token)) {
+                    woken.push_back(ioWaits[i - 1].test);
+                }
+            }
+        }
+#else
+        polling = true;
+        if (timeoutMs < 0) {
+            wakeCv.wait(lock, [&] { return notified; });
+        } else {
+            wakeCv.wait_for(lock, std::chrono::milliseconds(timeoutMs), [&] { return notified; });
+        }
+        notified = false;
+        polling = false;
+#endif
+
+        auto now = Clock::now();
+        while (!timers.empty() && timers.begin()->first <= now) {
+            AsyncTimer timer = timers.begin()->second;
+            timers.erase(timers.begin());
+            AsyncTestState& test = *timer.test;
+            if (!timer.isDeadline) {
+                if (claimLocked(test, timer.token)) {
+                    woken.push_back(&test);
+                }
+                continue;
+            }
+            // A suspended test is cancelled by the worker that picks it up; a running one at its next co_await.
+            test.hasDeadline = false;
+            test.timedOut = true;
+            if (test.waiting) {
+                test.waiting = false;
+                ++test.token;
+                woken.push_back(&test);
+            }
+        }
+        lock.unlock();
+        for (AsyncTestState* test : woken) {
+            hand(*test);
+        }
+    }
+};
+
+bool suspendAsyncTest(std::coroutine_handle<> handle, const AsyncWait& wait) {
+    AsyncTestState* test = AsyncLoop::running();
+    if (!test) {
+        std::cerr << "co_await on sleepFor, waitReadable, waitWritable or AsyncEvent outside an ASYNC_TEST_CASE; "
+                     "continuing without waiting" << std::endl;
+        return false;
+    }
+    test->resumePoint = handle;
+    test->pendingWait = wait;
+    test->hasPendingWait = true;
+    return true;
+}
+
+void AsyncEvent::set() {
+    std::vector<Waiter> woken;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        signaled = true;
+        woken.swap(waiters);
+        // While the event lists them the tests cannot complete, so their loops are still alive here.
+        for (const Waiter& waiter : woken) {
+            waiter.test->loop->beginExternalWake();
+        }
+    }
+    for (const Waiter& waiter : woken) {
+        AsyncLoop& loop = *waiter.test->loop;
+        loop.wake(*waiter.test, waiter.token);
+        loop.endExternalWake();
+    }
+}
+
+void AsyncEvent::reset() {
+    std::lock_guard<std::mutex> lock(mutex);
+    signaled = false;
+}
+
+bool AsyncEvent::isSet() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return signaled;
+}
+
+namespace {
+
+// Assumed duration of a repetition when the timing database knows nothing about any test.
+constexpr uint64_t kDefaultEstimateNanos = 1000000;
+
+// Version 2 added the pass and failure counts; version 1 files read as having none.
+constexpr const char* kTimingDatabaseHeader = "# CUnit++ timing database v2";
+
+/**
+ * @brief What the timing database knows about one test.
+ */
+struct TimingRecord {
+    // Recorded duration of one repetition.
+    uint64_t nanos = 0;
+    // Executed repetitions that passed and that failed or timed out, summed over every run recorded.
+    uint64_t passes = 0;
+    uint64_t failures = 0;
+};
+
+// Keyed by "suite\ttest". Ordered so the file diffs cleanly between runs.
+using TimingTable = std::map<std::string, TimingRecord>;
+
+std::string timingKey(const std::string& suiteName, std::string_view testName) {
+    std::string key = suiteName + '\t';
+    key += testName;
+    return key;
+}
+
+/**
+ * @brief Reads a timing database file. A missing file yields an empty table; malformed lines are ignored.
+ */
+TimingTable readTimingTable(const std::string& path) {
+    TimingTable table;
+    std::ifstream in(path);
+    std::string line;
+    while (std::getline(in, line)) {
+        if (line.empty() || line[0] == '#') {
+            continue;
+        }
+        size_t first = line.find('\t');
+        size_t second = first == std::string::npos ? first : line.find('\t', first + 1);
+        if (second == std::string::npos) {
+            continue;
+        }
+        const char* field = line.c_str() + second + 1;
+        char* fieldEnd = nullptr;
+        TimingRecord record;
+        record.nanos = std::strtoull(field, &fieldEnd, 10);
+        if (fieldEnd == field) {
+            continue;
+        }
+        if (*fieldEnd == '\t') {
+            field = fieldEnd + 1;
+            record.passes = std::strtoull(field, &fieldEnd, 10);
+            if (*fieldEnd == '\t') {
+                field = fieldEnd + 1;
+                record.failures = std::strtoull(field, &fieldEnd, 10);
+            }
+        }
+        table[line.substr(0, second)] = record;
+    }
+    return table;
+}
+
+/**
+ * @brief Writes a timing database file, replacing the previous one only once the new contents are complete.
+ */
+void writeTimingTable(const std::string& path, const TimingTable& table) {
+    std::string temporaryPath = path + ".tmp";
+    {
+        std::ofstream out(temporaryPath, std::ios::trunc);
+        out << kTimingDatabaseHeader << "\n";
+        for (const auto& [key, record] : table) {
+            out << key << '\t' << record.nanos << '\t' << record.passes << '\t' << record.failures << "\n";
+        }
+        if (!out) {
+            std::cerr << "Failed to write timing database " << temporaryPath << std::endl;
+            return;
+        }
+    }
+    if (std::rename(temporaryPath.c_str(), path.c_str()) != 0) {
+        std::cerr << "Failed to replace timing database " << path << std::endl;
+    }
+}
+
+/**
+ * @brief Makespan of assigning the given durations, in order, each to the currently least loaded of `workers`.
+ *
+ * With durations sorted in decreasing order this is the longest-processing-time-first schedule.
+ */
+uint64_t listScheduleMakespan(const std::vector<uint64_t>& durations, unsigned int workers) {
+    std::priority_queue<uint64_t, std::vector<uint64_t>, std::greater<uint64_t>> loads;
+    for (unsigned int i = 0; i < workers; ++i) {
+        loads.push(0);
+    }
+    uint64_t makespan = 0;
+    for (uint64_t duration : durations) {
+        uint64_t load = loads.top() + duration;
+        loads.pop();
+        loads.push(load);
+        makespan = std::max(makespan, load);
+    }
+    return makespan;
+}
+
+/**
+ * @brief The z for which the standard normal distribution puts `confidence` of its mass between -z and z.
+ */
+double normalQuantile(double confidence) {
+    confidence = std::clamp(confidence, 0.5, 0.999999);
+    double low = 0;
+    double high = 10;
+    for (int i = 0; i < 64; ++i) {
+        double z = (low + high) / 2;
+        // erfc(z / sqrt(2)) is the mass outside [-z, z].
+        if (std::erfc(z / std::sqrt(2.0)) > 1 - confidence) {
+            low = z;
+        } else {
+            high = z;
+        }
+    }
+    return (low + high) / 2;
+}
+
+/**
+ * @brief Wilson score interval of a pass rate observed as `passes` out of `runs`.
+ *
+ * Unlike the normal approximation it stays inside [0, 1] and does not collapse to a point when every run passed or
+ * every run failed, so it can decide the tests that are not flaky at all.
+ */
+std::pair<double, double> wilsonInterval(uint32_t passes, uint32_t runs, double z) {
+    if (runs == 0) {
+        return {0, 1};
+    }
+    double n = runs;
+    double rate = passes / n;
+    double z2 = z * z;
+    double center = (rate + z2 / (2 * n)) / (1 + z2 / n);
+    double halfWidth = z / (1 + z2 / n) * std::sqrt(rate * (1 - rate) / n + z2 / (4 * n * n));
+    return {std::max(0.0, center - halfWidth), std::min(1.0, center + halfWidth)};
+}
+
+constexpr const char* kResultFileHeader = "# CUnit++ results v2";
+
+const char* statusName(TestStatus status) {
+    switch (status) {
+        case TestStatus::Passed:
+            return "passed";
+        case TestStatus::Failed:
+            return "failed";
+        case TestStatus::TimedOut:
+            return "timed_out";
+        case TestStatus::Skipped:
+            return "skipped";
+        case TestStatus::NotSelected:
+            return "not_selected";
+    }
+    return "unknown";
+}
+
+/**
+ * @brief 64-bit FNV-1a hash, used where shard assignments must be identical on every machine.
+ */
+uint64_t stableHash(const std::string& text) {
+    uint64_t hash = 14695981039346656037ull;
+    for (unsigned char c : text) {
+        hash ^= c;
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+/**
+ * @brief Matches a whole name against a glob where `*` matches any run of characters and `?` any single one.
+ */
+bool globMatches(const std::string& pattern, const std::string& name) {
+    size_t p = 0;
+    size_t n = 0;
+    size_t starPattern = std::string::npos;
+    size_t starName = 0;
+    while (n < name.size()) {
+        if (p < pattern.size() && (pattern[p] == '?' || pattern[p] == name[n])) {
+            ++p;
+            ++n;
+        } else if (p < pattern.size() && pattern[p] == '*') {
+            starPattern = p++;
+            starName = n;
+        } else if (starPattern != std::string::npos) {
+            p = starPattern + 1;
+            n = ++starName;
+        } else {
+            return false;
+        }
+    }
+    while (p < pattern.size() && pattern[p] == '*') {
+        ++p;
+    }
+    return p == pattern.size();
+}
+
+/**
+ * @brief The characters every name matched by a regular expression must start with.
+ *
+ * Conservative: it stops at the first character with a special meaning, and drops the last literal when a
+ * quantifier could make it optional. A top-level alternation has no common prefix, so it yields an empty one.
+ */
+std::string regexLiteralPrefix(const std::string& pattern) {
+    static const std::string special = ".[]{}()*+?|^$\\";
+    bool inBracket = false;
+    int depth = 0;
+    for (size_t i = 0; i < pattern.size(); ++i) {
+        char c = pattern[i];
+        if (c == '\\') {
+            ++i;
+        } else if (inBracket) {
+            inBracket = c != ']';
+        } else if (c == '[') {
+            inBracket = true;
+            // A ']' straight after the opening bracket (or its negation) is a literal member of the set.
+            if (i + 1 < pattern.size() && pattern[i + 1] == '^') {
+                ++i;
+            }
+            if (i + 1 < pattern.size() && pattern[i + 1] == ']') {
+                ++i;
+            }
+        } else if (c == '(') {
+            ++depth;
+        } else if (c == ')') {
+            depth = std::max(depth - 1, 0);
+        } else if (c == '|' && depth == 0) {
+            return {};
+        }
+    }
+    size_t end = 0;
+    while (end < pattern.size() && special.find(pattern[end]) == std::string::npos) {
+        ++end;
+    }
+    if (end > 0 && end < pattern.size() && std::string("*?{").find(pattern[end]) != std::string::npos) {
+        --end;
+    }
+    return pattern.substr(0, end);
+}
+
+/**
+ * @brief Builds the "Suite.Test" name used by filters and shard hashing.
+ */
+std::string qualifiedTestName(const std::string& suiteName, std::string_view testName) {
+    std::string name = suiteName + ".";
+    name += testName;
+    return name;
+}
+
+/**
+ * @brief Parses a non-negative integer command-line value.
+ */
+bool parseCount(const std::string& text, unsigned int& value) {
+    if (text.empty() || text.find_first_not_of("0123456789") != std::string::npos) {
+        return false;
+    }
+    try {
+        unsigned long parsed = std::stoul(text);
+        if (parsed > std::numeric_limits<unsigned int>::max()) {
+            return false;
+        }
+        value = static_cast<unsigned int>(parsed);
+        return true;
+    } catch (const std::exception&) {
+        return false;
+    }
+}
+
+constexpr const char* kSelectionCacheHeader = "# CUnit++ selection cache v1";
+
+/**
+ * @brief What the selection cache knows about one test: how it ended and what its dependencies were when it last ran.
+ */
+struct SelectionRecord {
+    bool passed = false;
+    // Dependency paths, sorted, with the content hash each had.
+    std::vector<std::pair<std::string, uint64_t>> dependencies;
+};
+
+// Keyed by "suite\ttest", like the timing database.
+using SelectionCache = std::map<std::string, SelectionRecord>;
+
+/**
+ * @brief Reads a selection cache file. A missing file yields an empty cache; malformed lines are ignored.
+ */
+SelectionCache readSelectionCache(const std::string& path) {
+    SelectionCache cache;
+    std::ifstream in(path);
+    std::string line;
+    while (std::getline(in, line)) {
+        if (line.empty() || line[0] == '#') {
+            continue;
+        }
+        std::vector<std::string> fields;
+        size_t start = 0;
+        while (true) {
+            size_t tab = line.find('\t', start);
+            fields.push_back(line.substr(start, tab == std::string::npos ? std::string::npos : tab - start));
+            if (tab == std::string::npos) {
+                break;
+            }
+            start = tab + 1;
+        }
+        if (fields.size() < 3 || fields.size() % 2 == 0 || (fields[2] != "passed" && fields[2] != "failed")) {
+            continue;
+        }
+        SelectionRecord record;
+        record.passed = fields[2] == "passed";
+        for (size_t i = 3; i + 1 < fields.size(); i += 2) {
+            record.dependencies.emplace_back(fields[i], std::strtoull(fields[i + 1].c_str(), nullptr, 10));
+        }
+        cache[timingKey(fields[0], fields[1])] = std::move(record);
+    }
+    return cache;
+}
+
+/**
+ * @brief Writes a selection cache file, replacing the previous one only once the new contents are complete.
+ */
+void writeSelectionCache(const std::string& path, const SelectionCache& cache) {
+    std::string temporaryPath = path + ".tmp";
+    {
+        std::ofstream out(temporaryPath, std::ios::trunc);
+        out << kSelectionCacheHeader << "\n";
+        for (const auto& [key, record] : cache) {
+            out << key << '\t' << (record.passed ? "passed" : "failed");
+            for (const auto& [dependency, hash] : record.dependencies) {
+                out << '\t' << dependency << '\t' << hash;
+            }
+            out << "\n";
+        }
+        if (!out) {
+            std::cerr << "Failed to write selection cache " << temporaryPath << std::endl;
+            return;
+        }
+    }
+    if (std::rename(temporaryPath.c_str(), path.c_str()) != 0) {
+        std::cerr << "Failed to replace selection cache " << path << std::endl;
+    }
+}
+
+/**
+ * @brief Reads the `PATTERN<TAB>PATH` lines of a dependency map; blank lines and `#` comments are skipped.
+ */
+std::vector<std::pair<std::string, std::string>> readDependencyMap(const std::string& path) {
+    std::vector<std::pair<std::string, std::string>> entries;
+    std::ifstream in(path);
+    if (!in) {
+        std::cerr << "Failed to read dependency map " << path << std::endl;
+        return entries;
+    }
+    std::string line;
+    while (std::getline(in, line)) {
+        size_t tab = line.find('\t');
+        if (line.empty() || line[0] == '#' || tab == std::string::npos) {
+            continue;
+        }
+        entries.emplace_back(line.substr(0, tab), line.substr(tab + 1));
+    }
+    return entries;
+}
+
+/**
+ * @brief Content hash of a file, or zero if it cannot be read.
+ */
+uint64_t hashFileContents(const std::string& path) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in) {
+        return 0;
+    }
+    std::string contents((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    uint64_t hash = stableHash(contents);
+    return hash != 0 ? hash : 1;
+}
+
+/**
+ * @brief Fixed-size binary record streamed from an isolated worker process to the parent over a pipe.
+ *
+ * Records are far smaller than PIPE_BUF, so each write() arrives whole even though several records may be read
+ * back at once.
+ */
+struct IsolationRecord {
+    enum Type : uint8_t { Started = 0, Finished = 1 };
+
+    uint8_t type = Started;
+    uint8_t status = 0;
+    uint16_t reserved = 0;
+    uint32_t position = 0;
+    uint32_t resultIndex = 0;
+    uint32_t assertionFailures = 0;
+    uint64_t wallNanos = 0;
+    uint64_t cpuNanos = 0;
+    PerfCounters counters;
+    AllocationStats allocations;
+};
+
+// Exit code of an isolated worker process that killed itself because a test overran its timeout.
+constexpr int kIsolationTimeoutExitCode = 3;
+
+/**
+ * @brief Writes one IsolationRecord describing the given result, and its counters and allocations if any, to the
+ * parent process.
+ */
+void sendIsolationRecord(int fd, IsolationRecord::Type type, size_t position, size_t resultIndex, const TestResult& result,
+                         const PerfCounters* counters, const AllocationStats* allocations = nullptr) {
+#if TESTFRAMEWORK_HAS_FORK
+    IsolationRecord record;
+    record.type = type;
+    record.status = static_cast<uint8_t>(result.status);
+    record.position = static_cast<uint32_t>(position);
+    record.resultIndex = static_cast<uint32_t>(resultIndex);
+    record.assertionFailures = result.assertionFailures;
+    record.wallNanos = result.wallNanos;
+    record.cpuNanos = result.cpuNanos;
+    if (counters) {
+        record.counters = *counters;
+    }
+    if (allocations) {
+        record.allocations = *allocations;
+    }
+    const char* data = reinterpret_cast<const char*>(&record);
+    size_t remaining = sizeof(record);
+    while (remaining > 0) {
+        ssize_t written = write(fd, data, remaining);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return;
+        }
+        data += written;
+        remaining -= static_cast<size_t>(written);
+    }
+#else
+    (void)fd;
+    (void)type;
+    (void)position;
+    (void)resultIndex;
+    (void)result;
+    (void)counters;
+#endif
+}
+
+/**
+ * @brief Pins the calling thread to one CPU while in scope and restores its previous affinity afterwards.
+ */
+class ScopedCpuPin {
+public:
+    explicit ScopedCpuPin(int cpu) {
+        if (cpu < 0) {
+            return;
+        }
+#if defined(__linux__)
+        if (cpu >= CPU_SETSIZE || pthread_getaffinity_np(pthread_self(), sizeof(previous), &previous) != 0) {
+            std::cerr << "Could not pin the calling thread to CPU " << cpu << std::endl;
+            return;
+        }
+        cpu_set_t pinned;
+        CPU_ZERO(&pinned);
+        CPU_SET(cpu, &pinned);
+        int error = pthread_setaffinity_np(pthread_self(), sizeof(pinned), &pinned);
+        if (error != 0) {
+            std::cerr << "Could not pin the calling thread to CPU " << cpu << ": " << std::strerror(error)
+                      << std::endl;
+            return;
+        }
+        pinnedThread = true;
+#else
+        std::cerr << "Pinning threads to CPUs is not supported on this platform" << std::endl;
+#endif
+    }
+
+    ~ScopedCpuPin() {
+#if defined(__linux__)
+        if (pinnedThread) {
+            pthread_setaffinity_np(pthread_self(), sizeof(previous), &previous);
+        }
+#endif
+    }
+
+    ScopedCpuPin(const ScopedCpuPin&) = delete;
+    ScopedCpuPin& operator=(const ScopedCpuPin&) = delete;
+
+private:
+#if defined(__linux__)
+    cpu_set_t previous{};
+#endif
+    bool pinnedThread = false;
+};
+
+// Calibration stops growing a benchmark's iteration count here, so a body the compiler reduced to nothing
+// cannot loop for ever.
+constexpr uint64_t kMaxBenchmarkIterations = uint64_t(1) << 40;
+
+/**
+ * @brief Calls a benchmark body `iterations` times and returns the elapsed nanoseconds.
+ */
+uint64_t timeIterations(const TestCase& testCase, TestFixture* fixture, uint64_t iterations) {
+    auto start = std::chrono::steady_clock::now();
+    for (uint64_t i = 0; i < iterations; ++i) {
+        testCase.function(fixture, 1);
+    }
+    ClobberMemory();
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - start).count());
+}
+
+/**
+ * @brief Fills in the statistics of a benchmark from its per-call sample times, which are sorted in place.
+ */
+void summarizeSamples(std::vector<double>& perCall, BenchmarkResult& benchmark) {
+    std::sort(perCall.begin(), perCall.end());
+    size_t count = perCall.size();
+    benchmark.samples = static_cast<uint32_t>(count);
+    benchmark.minNanos = perCall.front();
+    benchmark.medianNanos = count % 2 ? perCall[count / 2] : (perCall[count / 2 - 1] + perCall[count / 2]) / 2;
+    // Nearest rank: the smallest sample that at least 99% of the samples do not exceed.
+    size_t p99Rank = static_cast<size_t>(std::ceil(0.99 * static_cast<double>(count)));
+    benchmark.p99Nanos = perCall[std::max<size_t>(p99Rank, 1) - 1];
+
+    double sum = 0;
+    for (double sample : perCall) {
+        sum += sample;
+    }
+    benchmark.meanNanos = sum / static_cast<double>(count);
+    double squares = 0;
+    for (double sample : perCall) {
+        squares += (sample - benchmark.meanNanos) * (sample - benchmark.meanNanos);
+    }
+    benchmark.stddevNanos = count > 1 ? std::sqrt(squares / static_cast<double>(count - 1)) : 0;
+}
+
+constexpr const char* kBenchmarkFileHeader = "Benchmark,Passed,Iterations,Samples,MinNs,MedianNs,P99Ns,MeanNs,StdDevNs";
+
+/**
+ * @brief The part of a baseline row the regression gate compares against.
+ */
+struct BaselineEntry {
+    uint32_t samples = 0;
+    double medianNanos = 0;
+    double stddevNanos = 0;
+};
+
+/**
+ * @brief Reads the passing rows of a CSV statistics file written by TestRunner::writeBenchmarkFile().
+ * @return The rows keyed by name; empty, with a message on stderr, if the file is missing or malformed.
+ */
+std::map<std::string, BaselineEntry> readBaseline(const std::string& path) {
+    std::map<std::string, BaselineEntry> baseline;
+    std::ifstream in(path);
+    std::string line;
+    if (!std::getline(in, line) || line != kBenchmarkFileHeader) {
+        std::cerr << "Ignoring baseline " << path << ": not a benchmark statistics file" << std::endl;
+        return baseline;
+    }
+    while (std::getline(in, line)) {
+        // The name may itself contain commas, so the eight numeric fields are taken from the end.
+        std::vector<std::string> fields;
+        size_t end = line.size();
+        for (int field = 0; field < 8; ++field) {
+            size_t comma = end == 0 ? std::string::npos : line.rfind(',', end - 1);
+            if (comma == std::string::npos) {
+                break;
+            }
+            fields.push_back(line.substr(comma + 1, end - comma - 1));
+            end = comma;
+        }
+        if (fields.size() != 8) {
+            std::cerr << "Ignoring malformed baseline line: " << line << std::endl;
+            continue;
+        }
+        // fields[7] is Passed and fields[0] StdDevNs, in reverse order of the header.
+        try {
+            if (fields[7] != "1") {
+                continue;
+            }
+            BaselineEntry entry;
+            entry.samples = static_cast<uint32_t>(std::stoul(fields[5]));
+            entry.medianNanos = std::stod(fields[3]);
+            entry.stddevNanos = std::stod(fields[0]);
+            // A hand-edited or corrupt file may hold a zero median, which no relative threshold can be taken from.
+            if (!(entry.medianNanos > 0) || !std::isfinite(entry.medianNanos)) {
+                std::cerr << "Ignoring baseline line without a positive median: " << line << std::endl;
+                continue;
+            }
+            baseline[line.substr(0, end)] = entry;
+        } catch (const std::exception&) {
+            std::cerr << "Ignoring malformed baseline line: " << line << std::endl;
+        }
+    }
+    return baseline;
+}
+
+/**
+ * @brief Whether a measurement is slower than its baseline by more than both the relative threshold and the noise.
+ *
+ * The noise is the combined standard error of both sides, so a slowdown must be large compared to the spread of
+ * the samples it is derived from. checkBaseline() only compares sides with enough samples to estimate it.
+ */
+bool isRegression(const BaselineEntry& baseline, const BenchmarkResult& measured, double threshold, double sigmas) {
+    double slowdown = measured.medianNanos - baseline.medianNanos;
+    if (slowdown <= baseline.medianNanos * threshold) {
+        return false;
+    }
+    double variance = 0;
+    if (baseline.samples > 0) {
+        variance += baseline.stddevNanos * baseline.stddevNanos / baseline.samples;
+    }
+    if (measured.samples > 0) {
+        variance += measured.stddevNanos * measured.stddevNanos / measured.samples;
+    }
+    return slowdown > sigmas * std::sqrt(variance);
+}
+
+/**
+ * @brief Escapes a string for use inside a JSON string literal.
+ */
+std::string jsonEscaped(const std::string& text) {
+    std::string escaped;
+    escaped.reserve(text.size());
+    for (char c : text) {
+        if (c == '"' || c == '\\') {
+            escaped += '\\';
+            escaped += c;
+        } else if (static_cast<unsigned char>(c) < 0x20) {
+            char code[8];
+            std::snprintf(code, sizeof(code), "\\u%04x", static_cast<unsigned int>(static_cast<unsigned char>(c)));
+            escaped += code;
+        } else {
+            escaped += c;
+        }
+    }
+    return escaped;
+}
+
+/**
+ * @brief Writes a report file on a background thread, so formatting a report never waits for the disk.
+ *
+ * The reporter formats into `buffer`; once it holds a chunk, the chunk is handed to the writer thread, which
+ * writes it with a single call.
+ */
+class ReportFileWriter {
+public:
+    static constexpr size_t kChunkBytes = size_t(1) << 20;
+
+    explicit ReportFileWriter(const std::string& path) : path(path), file(std::fopen(path.c_str(), "wb")) {
+        if (!file) {
+            std::cerr << "Failed to open report file " << path << std::endl;
+            return;
+        }
+        // Chunks are already large; stdio buffering would only copy them once more.
+        std::setvbuf(file, nullptr, _IONBF, 0);
+        buffer.reserve(kChunkBytes + kChunkBytes / 4);
+        thread = std::thread([this] { writeLoop(); });
+    }
+
+    ~ReportFileWriter() {
+        close();
+    }
+
+    ReportFileWriter(const ReportFileWriter&) = delete;
+    ReportFileWriter& operator=(const ReportFileWriter&) = delete;
+
+    // Formatted output not yet handed to the writer thread.
+    std::string buffer;
+
+    /**
+     * @brief Hands the buffer to the writer thread once it holds a whole chunk.
+     */
+    void flushIfFull() {
+        if (buffer.size() >= kChunkBytes) {
+            submit();
+        }
+    }
+
+    /**
+     * @brief Writes whatever is buffered, waits for the writer thread and closes the file.
+     */
+    void close() {
+        if (!file) {
+            return;
+        }
+        submit();
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            closing = true;
+        }
+        cv.notify_one();
+        thread.join();
+        if (std::fclose(file) != 0) {
+            failed = true;
+        }
+        file = nullptr;
+        if (failed) {
+            std::cerr << "Failed to write report file " << path << std::endl;
+        }
+    }
+
+private:
+    std::string path;
+    std::FILE* file;
+    std::thread thread;
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::deque<std::string> chunks;
+    bool closing = false;
+    // Only touched by the writer thread until it has been joined.
+    bool failed = false;
+
+    void submit() {
+        if (buffer.empty()) {
+            return;
+        }
+        std::string chunk;
+        chunk.reserve(kChunkBytes + kChunkBytes / 4);
+        chunk.swap(buffer);
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            chunks.push_back(std::move(chunk));
+        }
+        cv.notify_one();
+    }
+
+    void writeLoop() {
+        ActivePlacement::instance().placeService(currentThreadHandle());
+        nameTraceThread("Report writer");
+        std::unique_lock<std::mutex> lock(mutex);
+        while (true) {
+            cv.wait(lock, [this] { return closing || !chunks.empty(); });
+            if (chunks.empty()) {
+                return;
+            }
+            std::string chunk = std::move(chunks.front());
+            chunks.pop_front();
+            lock.unlock();
+            {
+                TraceScope write("reporter", "Write report file");
+                if (std::fwrite(chunk.data(), 1, chunk.size(), file) != chunk.size()) {
+                    failed = true;
+                }
+            }
+            lock.lock();
+        }
+    }
+};
+
+/**
+ * @brief "Test", "Test/instance" or "Test (Repetition r)", naming one repetition within its suite.
+ */
+std::string reportedTestName(const ReportEvent& event) {
+    std::string name(event.testCase->name);
+    if (event.instance >= 0) {
+        name += "/" + std::to_string(event.instance);
+    }
+    if (event.testCase->repetitions > 1) {
+        name += " (Repetition " + std::to_string(event.repetition) + ")";
+    }
+    return name;
+}
+
+/**
+ * @brief Streams every event as one JSON object per line.
+ */
+class JsonLinesReporter : public TestReporter {
+public:
+    explicit JsonLinesReporter(const std::string& path) : writer(path) {}
+
+    void runStarted() override {
+        writer.buffer += "{\"type\":\"run_start\"}\n";
+    }
+
+    void report(const ReportEvent& event) override {
+        static constexpr const char* kTypeNames[] = {"suite_start", "suite_finish", "test_skipped", "test_start",
+                                                     "assertion_failure", "test_failure", "test_finish"};
+        std::string& out = writer.buffer;
+        out += "{\"type\":\"";
+        out += kTypeNames[static_cast<size_t>(event.type)];
+        out += "\",\"suite\":\"" + jsonEscaped(event.suite->name) + "\"";
+        if (event.testCase) {
+            out += ",\"test\":\"" + jsonEscaped(std::string(event.testCase->name)) + "\"";
+            if (event.instance >= 0) {
+                out += ",\"instance\":" + std::to_string(event.instance);
+            }
+            out += ",\"repetition\":" + std::to_string(event.repetition);
+        }
+        switch (event.type) {
+            case ReportEvent::Type::AssertionFailure:
+                out += ",\"file\":\"" + jsonEscaped(event.file ? event.file : "") + "\",\"line\":"
+                       + std::to_string(event.line);
+                [[fallthrough]];
+            case ReportEvent::Type::TestFailure:
+                out += ",\"message\":\"" + jsonEscaped(std::string(event.message)) + "\"";
+                break;
+            case ReportEvent::Type::TestFinish:
+                out += ",\"status\":\"";
+                out += statusName(event.status);
+                out += "\",\"duration_ns\":" + std::to_string(event.durationNanos);
+                break;
+            default:
+                break;
+        }
+        out += "}\n";
+        writer.flushIfFull();
+    }
+
+    void runFinished(size_t passed, size_t failed, size_t skipped) override {
+        writer.buffer += "{\"type\":\"summary\",\"passed\":" + std::to_string(passed) + ",\"failed\":"
+                         + std::to_string(failed) + ",\"skipped\":" + std::to_string(skipped) + "}\n";
+        writer.close();
+    }
+
+private:
+    ReportFileWriter writer;
+};
+
+std::string xmlEscaped(std::string_view text) {
+    std::string escaped;
+    escaped.reserve(text.size());
+    for (char c : text) {
+        switch (c) {
+            case '&': escaped += "&amp;"; break;
+            case '<': escaped += "&lt;"; break;
+            case '>': escaped += "&gt;"; break;
+            case '"': escaped += "&quot;"; break;
+            default:
+                // XML 1.0 cannot represent most control characters, even as references.
+                escaped += static_cast<unsigned char>(c) < 0x20 && c != '\t' && c != '\n' && c != '\r' ? '?' : c;
+        }
+    }
+    return escaped;
+}
+
+/**
+ * @brief Writes a JUnit XML document. The test cases of a suite are collected until the suite finishes, since the
+ * <testsuite> element carries their counts; the suite is then written out and forgotten.
+ */
+class JUnitReporter : public TestReporter {
+public:
+    explicit JUnitReporter(const std::string& path) : writer(path) {}
+
+    void runStarted() override {
+        writer.buffer += "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n<testsuites>\n";
+    }
+
+    void report(const ReportEvent& event) override {
+        switch (event.type) {
+            case ReportEvent::Type::SuiteStart:
+                suites.try_emplace(event.suite);
+                break;
+            case ReportEvent::Type::SuiteFinish:
+                writeSuite(event.suite);
+                break;
+            case ReportEvent::Type::TestSkipped: {
+                PendingSuite& suite = suites[event.suite];
+                ++suite.tests;
+                ++suite.skipped;
+                suite.cases += "    <testcase classname=\"" + xmlEscaped(event.suite->name) + "\" name=\""
+                               + xmlEscaped(event.testCase->name) + "\" time=\"0\">\n      <skipped/>\n"
+                               + "    </testcase>\n";
+                break;
+            }
+            case ReportEvent::Type::AssertionFailure:
+            case ReportEvent::Type::TestFailure: {
+                std::string& failures = failuresOf[{event.testCase, event.instance, event.repetition}];
+                if (event.type == ReportEvent::Type::AssertionFailure && event.file) {
+                    failures += std::string(event.file) + ":" + std::to_string(event.line) + ": ";
+                }
+                failures += std::string(event.message) + "\n";
+                break;
+            }
+            case ReportEvent::Type::TestFinish:
+                addCase(event);
+                break;
+            default:
+                break;
+        }
+    }
+
+    void runFinished(size_t, size_t, size_t) override {
+        // Isolated runs may leave a suite unfinished when its worker process crashed.
+        while (!suites.empty()) {
+            writeSuite(suites.begin()->first);
+        }
+        writer.buffer += "</testsuites>\n";
+        writer.close();
+    }
+
+private:
+    struct PendingSuite {
+        size_t tests = 0;
+        size_t failures = 0;
+        size_t skipped = 0;
+        uint64_t nanos = 0;
+        std::string cases;
+    };
+
+    ReportFileWriter writer;
+    std::map<const TestSuite*, PendingSuite> suites;
+    // Failure messages of tests that have not finished yet, keyed by test, instance and repetition.
+    std::map<std::tuple<const TestCase*, int, int>, std::string> failuresOf;
+
+    static std::string seconds(uint64_t nanos) {
+        char text[32];
+        std::snprintf(text, sizeof(text), "%.6f", static_cast<double>(nanos) / 1e9);
+        return text;
+    }
+
+    void addCase(const ReportEvent& event) {
+        PendingSuite& suite = suites[event.suite];
+        ++suite.tests;
+        suite.nanos += event.durationNanos;
+        suite.cases += "    <testcase classname=\"" + xmlEscaped(event.suite->name) + "\" name=\""
+                       + xmlEscaped(reportedTestName(event)) + "\" time=\"" + seconds(event.durationNanos) + "\"";
+        auto failures = failuresOf.find({event.testCase, event.instance, event.repetition});
+        if (event.status == TestStatus::Passed) {
+            suite.cases += "/>\n";
+        } else {
+            ++suite.failures;
+            std::string details = failures == failuresOf.end() ? std::string() : failures->second;
+            std::string firstLine = details.substr(0, details.find('\n'));
+            suite.cases += ">\n      <failure message=\""
+                           + xmlEscaped(firstLine.empty() ? statusName(event.status) : firstLine) + "\" type=\""
+                           + statusName(event.status) + "\">" + xmlEscaped(details) + "</failure>\n    </testcase>\n";
+        }
+        if (failures != failuresOf.end()) {
+            failuresOf.erase(failures);
+        }
+        writer.flushIfFull();
+    }
+
+    void writeSuite(const TestSuite* testSuite) {
+        auto it = suites.find(testSuite);
+        if (it == suites.end()) {
+            return;
+        }
+        const PendingSuite& suite = it->second;
+        writer.buffer += "  <testsuite name=\"" + xmlEscaped(testSuite->name) + "\" tests=\""
+                         + std::to_string(suite.tests) + "\" failures=\"" + std::to_string(suite.failures)
+                         + "\" errors=\"0\" skipped=\"" + std::to_string(suite.skipped) + "\" time=\""
+                         + seconds(suite.nanos) + "\">\n" + suite.cases + "  </testsuite>\n";
+        suites.erase(it);
+        writer.flushIfFull();
+    }
+};
+
+// Starts every binary report; the digit is the format version.
+constexpr char kBinaryReportMagic[8] = {'C', 'U', 'N', 'I', 'T', 'R', 'B', '1'};
+
+// Record kinds of a binary report. A name record assigns an id to a suite and test name pair; every result record
+// refers to an id defined before it. Integers are little-endian.
+constexpr char kBinaryNameRecord = 'N';
+constexpr char kBinaryResultRecord = 'R';
+
+void appendLittleEndian(std::string& out, uint64_t value, int bytes) {
+    for (int i = 0; i < bytes; ++i) {
+        out += static_cast<char>((value >> (8 * i)) & 0xff);
+    }
+}
+
+/**
+ * @brief Appends a name record: u32 id, then the suite and the test name, each as a u16 length and its bytes.
+ */
+void appendBinaryName(std::string& out, uint32_t id, std::string_view suite, std::string_view test) {
+    out += kBinaryNameRecord;
+    appendLittleEndian(out, id, 4);
+    for (std::string_view name : {suite, test}) {
+        name = name.substr(0, 0xffff);
+        appendLittleEndian(out, name.size(), 2);
+        out += name;
+    }
+}
+
+/**
+ * @brief Appends a result record: u32 name id, i32 instance, i32 repetition, u8 status and u64 duration in ns.
+ */
+void appendBinaryResult(std::string& out, uint32_t id, const ReportedResult& result) {
+    out += kBinaryResultRecord;
+    appendLittleEndian(out, id, 4);
+    appendLittleEndian(out, static_cast<uint32_t>(result.instance), 4);
+    appendLittleEndian(out, static_cast<uint32_t>(result.repetition), 4);
+    appendLittleEndian(out, static_cast<uint8_t>(result.status), 1);
+    appendLittleEndian(out, result.durationNanos, 8);
+}
+
+/**
+ * @brief Records the outcome of every finished and every skipped test as compact binary records.
+ */
+class BinaryReporter : public TestReporter {
+public:
+    explicit BinaryReporter(const std::string& path) : writer(path) {}
+
+    void runStarted() override {
+        writer.buffer.append(kBinaryReportMagic, sizeof(kBinaryReportMagic));
+    }
+
+    void report(const ReportEvent& event) override {
+        if (event.type != ReportEvent::Type::TestFinish && event.type != ReportEvent::Type::TestSkipped) {
+            return;
+        }
+        auto [id, added] = ids.emplace(event.testCase, static_cast<uint32_t>(ids.size()));
+        if (added) {
+            appendBinaryName(writer.buffer, id->second, event.suite->name, event.testCase->name);
+        }
+        ReportedResult result;
+        result.instance = event.instance;
+        result.repetition = event.repetition;
+        result.status = event.type == ReportEvent::Type::TestSkipped ? TestStatus::Skipped : event.status;
+        result.durationNanos = event.durationNanos;
+        appendBinaryResult(writer.buffer, id->second, result);
+        writer.flushIfFull();
+    }
+
+    void runFinished(size_t, size_t, size_t) override {
+        writer.close();
+    }
+
+private:
+    ReportFileWriter writer;
+    std::map<const TestCase*, uint32_t> ids;
+};
+
+/**
+ * @brief Creates the built-in reporter writing the given report file.
+ */
+std::shared_ptr<TestReporter> makeFileReporter(const ReportFile& report) {
+    switch (report.format) {
+        case ReportFormat::JUnitXml:
+            return std::make_shared<JUnitReporter>(report.path);
+        case ReportFormat::Binary:
+            return std::make_shared<BinaryReporter>(report.path);
+        case ReportFormat::JsonLines:
+        default:
+            return std::make_shared<JsonLinesReporter>(report.path);
+    }
+}
+
+/**
+ * @brief The reporters of a run: those of the options, followed by one for each report file.
+ */
+std::vector<std::shared_ptr<TestReporter>> sessionReporters(const RunnerOptions& options) {
+    std::vector<std::shared_ptr<TestReporter>> reporters = options.reporters;
+    for (const ReportFile& report : options.reportFiles) {
+        reporters.push_back(makeFileReporter(report));
+    }
+    return reporters;
+}
+
+/**
+ * @brief Counts an assertion failure against the current test and queues its event, or prints it outside a run.
+ */
+void recordAssertionFailure(const char* file, int line, const char* expression, std::string message) {
+    ArenaSuspend heapOnly;
+    if (currentTest.result) {
+        addAssertionFailures(*currentTest.result, 1);
+    }
+    EventReporter& reporter = EventReporter::instance();
+    if (!reporter.active()) {
+        std::cout << "Assertion failed in " << file << " at line " << line << ": "
+                  << checkDescription(expression, message) << std::endl;
+        return;
+    }
+    TestEvent event;
+    event.type = TestEventType::AssertionFailure;
+    event.suite = currentTest.suite;
+    event.testCase = currentTest.testCase;
+    event.repetition = currentTest.repetition;
+    event.instance = currentTest.instance;
+    event.showRepetition = currentTest.showRepetition;
+    event.file = file;
+    event.line = line;
+    event.expression = expression;
+    event.message = std::move(message);
+    reporter.emit(std::move(event));
+}
+
+} // namespace
+
+RegistryArena& RegistryArena::instance() {
+    // Never destroyed, like the reporter: names and bodies must stay valid for threads still running at exit.
+    static RegistryArena* arena = new RegistryArena();
+    return *arena;
+}
+
+char* RegistryArena::allocate(size_t size) {
+    if (size > remaining) {
+        // Mock methods are interned while tests run, and the blocks outlive the test.
+        ArenaSuspend heapOnly;
+        size_t blockSize = std::max(kBlockSize, size);
+        blocks.push_back(std::make_unique<char[]>(blockSize));
+        cursor = blocks.back().get();
+        remaining = blockSize;
+    }
+    char* result = cursor;
+    cursor += size;
+    remaining -= size;
+    return result;
+}
+
+std::string_view RegistryArena::store(std::string_view text) {
+    std::lock_guard<std::mutex> lock(mutex);
+    char* copy = allocate(text.size());
+    std::memcpy(copy, text.data(), text.size());
+    return {copy, text.size()};
+}
+
+std::string_view RegistryArena::storeNumbered(std::string_view prefix, size_t number) {
+    char digits[24];
+    size_t digitCount = static_cast<size_t>(std::to_chars(digits, digits + sizeof(digits), number).ptr - digits);
+    size_t size = prefix.size() + 1 + digitCount;
+
+    std::lock_guard<std::mutex> lock(mutex);
+    char* name = allocate(size);
+    std::memcpy(name, prefix.data(), prefix.size());
+    name[prefix.size()] = '_';
+    std::memcpy(name + prefix.size() + 1, digits, digitCount);
+    return {name, size};
+}
+
+namespace {
+
+/**
+ * @brief Process-wide table of interned mock method names.
+ */
+struct MockMethodTable {
+    std::mutex mutex;
+    std::map<std::string_view, uint32_t, std::less<>> ids;
+    std::vector<std::string_view> names;
+
+    static MockMethodTable& instance() {
+        static MockMethodTable table;
+        return table;
+    }
+};
+
+/**
+ * @brief Whether an argument holds a number of any kind.
+ */
+bool isNumericMockArg(const MockArg& arg) {
+    return arg.kind == MockArg::Kind::Signed || arg.kind == MockArg::Kind::Unsigned
+           || arg.kind == MockArg::Kind::Floating;
+}
+
+/**
+ * @brief Compares a floating-point argument with an integral one by value, without rounding the integer.
+ */
+bool floatingEqualsIntegral(double value, const MockArg& integral) {
+    if (std::trunc(value) != value) {
+        return false;
+    }
+    if (integral.kind == MockArg::Kind::Signed) {
+        return value >= -0x1p63 && value < 0x1p63 && static_cast<int64_t>(value) == integral.signedValue;
+    }
+    return value >= 0 && value < 0x1p64 && static_cast<uint64_t>(value) == integral.unsignedValue;
+}
+
+/**
+ * @brief Final mixing step of SplitMix64, spreading every input bit over the whole hash.
+ */
+uint64_t mixHash(uint64_t value) {
+    value += 0x9e3779b97f4a7c15ull;
+    value = (value ^ (value >> 30)) * 0xbf58476d1ce4e5b9ull;
+    value = (value ^ (value >> 27)) * 0x94d049bb133111ebull;
+    return value ^ (value >> 31);
+}
+
+/**
+ * @brief Bump allocator owned by a mock shard; it holds the recorded arguments and is reused after a clear.
+ */
+class MockArena {
+public:
+    MockArena() = default;
+    MockArena(const MockArena&) = delete;
+    MockArena& operator=(const MockArena&) = delete;
+
+    ~MockArena() {
+        clear();
+    }
+
+    void* allocate(size_t size, size_t alignment) {
+        for (;;) {
+            if (currentBlock < blocks.size()) {
+                auto& [memory, capacity] = blocks[currentBlock];
+                size_t offset = (used + alignment - 1) & ~(alignment - 1);
+                if (offset + size <= capacity) {
+                    used = offset + size;
+                    return memory.get() + offset;
+                }
+                if (currentBlock + 1 < blocks.size()) {
+                    ++currentBlock;
+                    used = 0;
+                    continue;
+                }
+            }
+            // Blocks double in size, so a mock recording millions of calls allocates only a handful of them.
+            size_t blockSize = blocks.empty() ? kFirstBlockSize : std::min(blocks.back().second * 2, kMaxBlockSize);
+            blockSize = std::max(blockSize, size + alignment);
+            blocks.emplace_back(std::make_unique<char[]>(blockSize), blockSize);
+            currentBlock = blocks.size() - 1;
+            used = 0;
+        }
+    }
+
+    /**
+     * @brief Registers an object stored in the arena to be destroyed by clear() or destruction.
+     */
+    void destroyLater(void (*destroy)(void*), void* object) {
+        pendingDestructors.emplace_back(destroy, object);
+    }
+
+    /**
+     * @brief Destroys the registered objects and makes the memory available again, keeping the blocks.
+     */
+    void clear() {
+        for (auto it = pendingDestructors.rbegin(); it != pendingDestructors.rend(); ++it) {
+            it->first(it->second);
+        }
+        pendingDestructors.clear();
+        currentBlock = 0;
+        used = 0;
+    }
+
+private:
+    static constexpr size_t kFirstBlockSize = 4 * 1024;
+    static constexpr size_t kMaxBlockSize = 256 * 1024;
+
+    std::vector<std::pair<std::unique_ptr<char[]>, size_t>> blocks;
+    size_t currentBlock = 0;
+    size_t used = 0;
+    std::vector<std::pair<void (*)(void*), void*>> pendingDestructors;
+};
+
+/**
+ * @brief Copies the text or object an argument refers to into an arena, so the copy outlives the call.
+ */
+MockArg storeMockArg(const MockArg& arg, MockArena& arena) {
+    MockArg stored = arg;
+    if (arg.kind == MockArg::Kind::Text && arg.size > 0) {
+        char* text = static_cast<char*>(arena.allocate(arg.size, 1));
+        std::memcpy(text, arg.text, arg.size);
+        stored.text = text;
+    } else if (arg.kind == MockArg::Kind::Object) {
+        void* object = arena.allocate(arg.ops->size, arg.ops->alignment);
+        arg.ops->copy(object, arg.pointer);
+        if (arg.ops->destroy) {
+            arena.destroyLater(arg.ops->destroy, object);
+        }
+        stored.pointer = object;
+    }
+    return stored;
+}
+
+/**
+ * @brief Hash of a call, combining the method id with every argument.
+ */
+uint64_t hashMockCall(uint32_t methodId, const MockArg* args, uint32_t argCount) {
+    uint64_t hash = mixHash(methodId);
+    for (uint32_t i = 0; i < argCount; ++i) {
+        hash = mixHash(hash ^ hashMockArg(args[i]));
+    }
+    return hash;
+}
+
+/**
+ * @brief Whether a recorded call has the given method and arguments.
+ */
+bool callMatches(const Mock::CallRecord& call, uint32_t methodId, const MockArg* args, uint32_t argCount) {
+    if (call.methodId != methodId || call.argCount != argCount) {
+        return false;
+    }
+    for (uint32_t i = 0; i < argCount; ++i) {
+        if (!mockArgsEqual(call.args[i], args[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/// End of an index chain.
+constexpr uint32_t kNoMockEntry = UINT32_MAX;
+
+/**
+ * @brief Writes a call as `method(arg, arg)`, for expectation violations.
+ */
+std::string formatMockCall(uint32_t methodId, const MockArg* args, uint32_t argCount) {
+    std::ostringstream text;
+    text << mockMethodName(methodId) << "(";
+    for (uint32_t i = 0; i < argCount; ++i) {
+        if (i > 0) {
+            text << ", ";
+        }
+        formatMockArg(text, args[i]);
+    }
+    text << ")";
+    return text.str();
+}
+
+/**
+ * @brief Describes an allowed number of calls, such as "exactly 2 times" or "between 1 and 3 times".
+ */
+std::string describeCallRange(size_t minCalls, size_t maxCalls) {
+    if (minCalls == maxCalls) {
+        return "exactly " + std::to_string(minCalls) + (minCalls == 1 ? " time" : " times");
+    }
+    return "between " + std::to_string(minCalls) + " and " + std::to_string(maxCalls) + " times";
+}
+
+} // namespace
+
+/**
+ * @brief One EXPECT_CALL: which calls it accepts, how many it needs, and its place in a sequence.
+ *
+ * Updated under the owning mock's expectation lock. The call count is atomic because a sequence shared by several
+ * mocks reads the counts of other mocks' expectations under the sequence lock only.
+ */
+struct MockExpectationState {
+    uint32_t methodId = 0;
+    const char* file = nullptr;
+    int line = 0;
+    bool anyArgs = true;
+    const MockArg* args = nullptr;
+    uint32_t argCount = 0;
+    size_t minCalls = 1;
+    size_t maxCalls = 1;
+    std::atomic<size_t> calls{0};
+    MockSequence* sequence = nullptr;
+    size_t position = 0;
+};
+
+/**
+ * @brief The expectations of a mock, created by its first EXPECT_CALL.
+ */
+struct Mock::Expectations {
+    std::mutex mutex;
+    MockArena arena;
+    std::vector<std::shared_ptr<MockExpectationState>> states;
+    size_t violations = 0;
+    /// Violations on threads without a running test, which verifyExpectations() reports again for the test.
+    size_t unattributedViolations = 0;
+    bool verified = false;
+
+    /**
+     * @brief Reports a broken expectation at the call that broke it.
+     */
+    void violate(const MockExpectationState& state, const std::string& message) {
+        ++violations;
+        if (currentTest.testCase) {
+            reportAssertionFailure(state.file, state.line, message);
+        } else {
+            ++unattributedViolations;
+            std::cerr << "Mock expectation violated in " << state.file << " at line " << state.line << ": " << message
+                      << std::endl;
+        }
+    }
+
+    /**
+     * @brief Matches a call against the expectations of its method and advances their counts and sequences.
+     */
+    void match(uint32_t methodId, const MockArg* args, uint32_t argCount) {
+        std::lock_guard<std::mutex> lock(mutex);
+        MockExpectationState* chosen = nullptr;
+        MockExpectationState* saturated = nullptr;
+        MockExpectationState* sameMethod = nullptr;
+        for (const std::shared_ptr<MockExpectationState>& state : states) {
+            if (state->methodId != methodId) {
+                continue;
+            }
+            if (!sameMethod) {
+                sameMethod = state.get();
+            }
+            if (!state->anyArgs) {
+                bool fits = state->argCount == argCount;
+                for (uint32_t i = 0; fits && i < argCount; ++i) {
+                    fits = mockArgsEqual(state->args[i], args[i]);
+                }
+                if (!fits) {
+                    continue;
+                }
+            }
+            if (state->calls.load(std::memory_order_relaxed) < state->maxCalls) {
+                chosen = state.get();
+                break;
+            }
+            saturated = state.get();
+        }
+        if (!sameMethod) {
+            return;
+        }
+        if (!chosen) {
+            if (saturated) {
+                saturated->calls.fetch_add(1, std::memory_order_relaxed);
+                violate(*saturated, formatMockCall(methodId, args, argCount) + " called more often than expected ("
+                                            + describeCallRange(saturated->minCalls, saturated->maxCalls) + ")");
+            } else {
+                violate(*sameMethod, "Unexpected call " + formatMockCall(methodId, args, argCount)
+                                             + ": no EXPECT_CALL matches its arguments");
+            }
+            return;
+        }
+        chosen->calls.fetch_add(1, std::memory_order_relaxed);
+        if (!chosen->sequence) {
+            return;
+        }
+        MockSequence& sequence = *chosen->sequence;
+        std::lock_guard<std::mutex> sequenceLock(sequence.mutex);
+        if (chosen->position < sequence.current) {
+            violate(*chosen, formatMockCall(methodId, args, argCount)
+                                     + " called out of sequence, after a later expectation of its sequence");
+            return;
+        }
+        for (size_t step = sequence.current; step < chosen->position; ++step) {
+            const MockExpectationState& earlier = *sequence.steps[step];
+            if (earlier.calls.load(std::memory_order_relaxed) < earlier.minCalls) {
+                violate(*chosen, formatMockCall(methodId, args, argCount) + " called before the expectation in "
+                                         + earlier.file + " at line " + std::to_string(earlier.line) + " was met");
+                break;
+            }
+        }
+        sequence.current = chosen->position;
+    }
+};
+
+/**
+ * @brief The calls recorded by the threads mapped to one slot, with their own lock and indexes.
+ *
+ * Entries are chained through indexes into `entries`: once per hash bucket and once per method, newest first.
+ */
+struct alignas(64) Mock::Shard {
+    struct Entry {
+        CallRecord call;
+        uint64_t hash;
+        uint32_t nextSameHash;
+        uint32_t nextSameMethod;
+    };
+
+    struct MethodChain {
+        uint32_t newest = kNoMockEntry;
+        uint32_t count = 0;
+    };
+
+    mutable std::mutex mutex;
+    MockArena arena;
+    std::vector<Entry> entries;
+    std::vector<uint32_t> buckets;
+    std::vector<MethodChain> methods;
+
+    void add(const CallRecord& call, uint64_t hash) {
+        uint32_t index = static_cast<uint32_t>(entries.size());
+        if (call.methodId >= methods.size()) {
+            methods.resize(call.methodId + 1);
+        }
+        MethodChain& method = methods[call.methodId];
+        entries.push_back({call, hash, kNoMockEntry, method.newest});
+        method.newest = index;
+        ++method.count;
+
+        // Keep at most one entry per bucket on average; a rebuild relinks every entry from its stored hash.
+        if (entries.size() > buckets.size()) {
+            buckets.assign(std::max<size_t>(64, buckets.size() * 2), kNoMockEntry);
+            for (uint32_t i = 0; i < entries.size(); ++i) {
+                link(i);
+            }
+        } else {
+            link(index);
+        }
+    }
+
+    void link(uint32_t index) {
+        uint32_t& head = buckets[entries[index].hash & (buckets.size() - 1)];
+        entries[index].nextSameHash = head;
+        head = index;
+    }
+
+    /**
+     * @brief Counts a call without storing it, for mocks whose call log is off.
+     */
+    void count(uint32_t methodId) {
+        if (methodId >= methods.size()) {
+            methods.resize(methodId + 1);
+        }
+        ++methods[methodId].count;
+    }
+
+    void clear() {
+        entries.clear();
+        buckets.clear();
+        methods.clear();
+        arena.clear();
+    }
+};
+
+uint32_t internMockMethod(std::string_view name) {
+    MockMethodTable& table = MockMethodTable::instance();
+    ArenaSuspend heapOnly;
+    std::lock_guard<std::mutex> lock(table.mutex);
+    auto found = table.ids.find(name);
+    if (found != table.ids.end()) {
+        return found->second;
+    }
+    std::string_view stored = RegistryArena::instance().store(name);
+    uint32_t id = static_cast<uint32_t>(table.names.size());
+    table.names.push_back(stored);
+    table.ids.emplace(stored, id);
+    return id;
+}
+
+uint32_t findMockMethod(std::string_view name) {
+    MockMethodTable& table = MockMethodTable::instance();
+    std::lock_guard<std::mutex> lock(table.mutex);
+    auto found = table.ids.find(name);
+    return found == table.ids.end() ? kNoMockMethod : found->second;
+}
+
+std::string_view mockMethodName(uint32_t id) {
+    MockMethodTable& table = MockMethodTable::instance();
+    std::lock_guard<std::mutex> lock(table.mutex);
+    return id < table.names.size() ? table.names[id] : std::string_view();
+}
+
+void formatMockArg(std::ostream& out, const MockArg& arg) {
+    switch (arg.kind) {
+        case MockArg::Kind::Signed:
+            out << arg.signedValue;
+            break;
+        case MockArg::Kind::Unsigned:
+            out << arg.unsignedValue;
+            break;
+        case MockArg::Kind::Floating:
+            out << arg.floatingValue;
+            break;
+        case MockArg::Kind::Text:
+            out.write(arg.text, static_cast<std::streamsize>(arg.size));
+            break;
+        case MockArg::Kind::Pointer:
+            out << arg.pointer;
+            break;
+        case MockArg::Kind::Object:
+            arg.ops->format(out, arg.pointer);
+            break;
+    }
+}
+
+bool mockArgsEqual(const MockArg& lhs, const MockArg& rhs) {
+    if (isNumericMockArg(lhs) && isNumericMockArg(rhs)) {
+        if (lhs.kind == rhs.kind) {
+            switch (lhs.kind) {
+                case MockArg::Kind::Signed:
+                    return lhs.signedValue == rhs.signedValue;
+                case MockArg::Kind::Unsigned:
+                    return lhs.unsignedValue == rhs.unsignedValue;
+                default:
+                    return lhs.floatingValue == rhs.floatingValue;
+            }
+        }
+        if (lhs.kind == MockArg::Kind::Floating) {
+            return floatingEqualsIntegral(lhs.floatingValue, rhs);
+        }
+        if (rhs.kind == MockArg::Kind::Floating) {
+            return floatingEqualsIntegral(rhs.floatingValue, lhs);
+        }
+        const MockArg& signedArg = lhs.kind == MockArg::Kind::Signed ? lhs : rhs;
+        const MockArg& unsignedArg = lhs.kind == MockArg::Kind::Signed ? rhs : lhs;
+        return signedArg.signedValue >= 0 && static_cast<uint64_t>(signedArg.signedValue) == unsignedArg.unsignedValue;
+    }
+    if (lhs.kind != rhs.kind) {
+        return false;
+    }
+    switch (lhs.kind) {
+        case MockArg::Kind::Text:
+            return lhs.size == rhs.size && (lhs.size == 0 || std::memcmp(lhs.text, rhs.text, lhs.size) == 0);
+        case MockArg::Kind::Pointer:
+            return lhs.pointer == rhs.pointer;
+        default:
+            return *lhs.ops->type == *rhs.ops->type && lhs.ops->equals(lhs.pointer, rhs.pointer);
+    }
+}
+
+uint64_t hashMockArg(const MockArg& arg) {
+    // Numbers that compare equal across kinds must hash alike, so integral values hash as the integer they hold.
+    switch (arg.kind) {
+        case MockArg::Kind::Signed:
+            return mixHash(static_cast<uint64_t>(arg.signedValue));
+        case MockArg::Kind::Unsigned:
+            return mixHash(arg.unsignedValue);
+        case MockArg::Kind::Floating: {
+            double value = arg.floatingValue;
+            if (std::trunc(value) == value) {
+                if (value >= -0x1p63 && value < 0x1p63) {
+                    return mixHash(static_cast<uint64_t>(static_cast<int64_t>(value)));
+                }
+                if (value >= 0 && value < 0x1p64) {
+                    return mixHash(static_cast<uint64_t>(value));
+                }
+            }
+            uint64_t bits;
+            std::memcpy(&bits, &value, sizeof(bits));
+            return mixHash(bits);
+        }
+        case MockArg::Kind::Text:
+            return mixHash(std::hash<std::string_view>{}(std::string_view(arg.text, arg.size)));
+        case MockArg::Kind::Pointer:
+            return mixHash(reinterpret_cast<uintptr_t>(arg.pointer));
+        case MockArg::Kind::Object:
+            return mixHash(arg.ops->type->hash_code() ^ arg.ops->hash(arg.pointer));
+    }
+    return 0;
+}
+
+Mock::~Mock() {
+    if (Expectations* pending = expectations.load(std::memory_order_acquire)) {
+        if (!pending->verified) {
+            verifyExpectations();
+        }
+        delete pending;
+    }
+    for (std::atomic<Shard*>& shard : shards) {
+        delete shard.load(std::memory_order_relaxed);
+    }
+}
+
+Mock::Expectations& Mock::expectationsForUpdate() {
+    Expectations* current = expectations.load(std::memory_order_acquire);
+    if (!current) {
+        Expectations* created = new Expectations;
+        if (expectations.compare_exchange_strong(current, created, std::memory_order_acq_rel)) {
+            current = created;
+        } else {
+            delete created;
+        }
+    }
+    return *current;
+}
+
+MockExpectation Mock::expectCall(std::string_view methodName, const char* file, int line) {
+    auto state = std::make_shared<MockExpectationState>();
+    state->methodId = internMockMethod(methodName);
+    state->file = file;
+    state->line = line;
+    Expectations& pending = expectationsForUpdate();
+    std::lock_guard<std::mutex> lock(pending.mutex);
+    pending.states.push_back(state);
+    pending.verified = false;
+    return MockExpectation(*this, std::move(state));
+}
+
+bool Mock::verifyExpectations() {
+    Expectations* pending = expectations.load(std::memory_order_acquire);
+    if (!pending) {
+        return true;
+    }
+    std::lock_guard<std::mutex> lock(pending->mutex);
+    pending->verified = true;
+    bool met = pending->violations == 0;
+    if (pending->unattributedViolations > 0 && !pending->states.empty()) {
+        const MockExpectationState& first = *pending->states.front();
+        reportAssertionFailure(first.file, first.line,
+                               std::to_string(pending->unattributedViolations)
+                                       + " mock expectation violation(s) occurred on threads not running a test");
+        pending->unattributedViolations = 0;
+    }
+    for (const std::shared_ptr<MockExpectationState>& state : pending->states) {
+        size_t calls = state->calls.load(std::memory_order_relaxed);
+        if (calls < state->minCalls) {
+            met = false;
+            reportAssertionFailure(state->file, state->line,
+                                   "Expected " + std::string(mockMethodName(state->methodId)) + " to be called "
+                                           + describeCallRange(state->minCalls, state->maxCalls) + ", called "
+                                           + std::to_string(calls) + (calls == 1 ? " time" : " times"));
+        }
+    }
+    return met;
+}
+
+void MockExpectation::setArgs(const MockArg* args, uint32_t argCount) {
+    Mock::Expectations& pending = mock->expectationsForUpdate();
+    std::lock_guard<std::mutex> lock(pending.mutex);
+    MockArg* stored = argCount > 0 ? static_cast<MockArg*>(pending.arena.allocate(sizeof(MockArg) * argCount,
+                                                                                    alignof(MockArg)))
+                                   : nullptr;
+    for (uint32_t i = 0; i < argCount; ++i) {
+        new (&stored[i]) MockArg(storeMockArg(args[i], pending.arena));
+    }
+    state->anyArgs = false;
+    state->args = stored;
+    state->argCount = argCount;
+}
+
+MockExpectation& MockExpectation::Times(size_t minCalls, size_t maxCalls) {
+    Mock::Expectations& pending = mock->expectationsForUpdate();
+    std::lock_guard<std::mutex> lock(pending.mutex);
+    state->minCalls = minCalls;
+    state->maxCalls = std::max(minCalls, maxCalls);
+    return *this;
+}
+
+MockExpectation& MockExpectation::InSequence(MockSequence& sequence) {
+    std::lock_guard<std::mutex> lock(sequence.mutex);
+    if (!state->sequence) {
+        state->sequence = &sequence;
+        state->position = sequence.steps.size();
+        sequence.steps.push_back(state);
+    }
+    return *this;
+}
+
+Mock::Shard& Mock::shardForCurrentThread() {
+    static std::atomic<uint32_t> nextSlot{0};
+    thread_local uint32_t slot = nextSlot.fetch_add(1, std::memory_order_relaxed) % kShardCount;
+    Shard* shard = shards[slot].load(std::memory_order_acquire);
+    if (!shard) {
+        Shard* created = new Shard;
+        if (shards[slot].compare_exchange_strong(shard, created, std::memory_order_acq_rel)) {
+            shard = created;
+        } else {
+            delete created;
+        }
+    }
+    return *shard;
+}
+
+void Mock::record(uint32_t methodId, const MockArg* args, uint32_t argCount) {
+    if (Expectations* pending = expectations.load(std::memory_order_acquire)) {
+        pending->match(methodId, args, argCount);
+    }
+    Shard& shard = shardForCurrentThread();
+    if (!logCalls.load(std::memory_order_relaxed)) {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        shard.count(methodId);
+        return;
+    }
+    uint64_t hash = hashMockCall(methodId, args, argCount);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    MockArg* stored = nullptr;
+    if (argCount > 0) {
+        stored = static_cast<MockArg*>(shard.arena.allocate(sizeof(MockArg) * argCount, alignof(MockArg)));
+        for (uint32_t i = 0; i < argCount; ++i) {
+            new (&stored[i]) MockArg(storeMockArg(args[i], shard.arena));
+        }
+    }
+    uint64_t sequence = nextSequence.fetch_add(1, std::memory_order_relaxed);
+    shard.add({methodId, argCount, stored, sequence}, hash);
+}
+
+void Mock::clearExpectations() {
+    for (std::atomic<Shard*>& slot : shards) {
+        if (Shard* shard = slot.load(std::memory_order_acquire)) {
+            std::lock_guard<std::mutex> lock(shard->mutex);
+            shard->clear();
+        }
+    }
+    nextSequence.store(0, std::memory_order_relaxed);
+}
+
+void Mock::recordCall(const std::string& methodName, const std::vector<std::string>& args) {
+    std::vector<MockArg> converted;
+    converted.reserve(args.size());
+    for (const std::string& arg : args) {
+        converted.push_back(makeMockArg(arg));
+    }
+    record(internMockMethod(methodName), converted.data(), static_cast<uint32_t>(converted.size()));
+}
+
+size_t Mock::callCount(uint32_t methodId) const {
+    size_t count = 0;
+    for (const std::atomic<Shard*>& slot : shards) {
+        if (const Shard* shard = slot.load(std::memory_order_acquire)) {
+            std::lock_guard<std::mutex> lock(shard->mutex);
+            if (methodId < shard->methods.size()) {
+                count += shard->methods[methodId].count;
+            }
+        }
+    }
+    return count;
+}
+
+bool Mock::hasCall(uint32_t methodId, const MockArg* args, uint32_t argCount) const {
+    uint64_t hash = hashMockCall(methodId, args, argCount);
+    for (const std::atomic<Shard*>& slot : shards) {
+        const Shard* shard = slot.load(std::memory_order_acquire);
+        if (!shard) {
+            continue;
+        }
+        std::lock_guard<std::mutex> lock(shard->mutex);
+        if (shard->buckets.empty()) {
+            continue;
+        }
+        for (uint32_t index = shard->buckets[hash & (shard->buckets.size() - 1)]; index != kNoMockEntry;
+             index = shard->entries[index].nextSameHash) {
+            const Shard::Entry& entry = shard->entries[index];
+            if (entry.hash == hash && callMatches(entry.call, methodId, args, argCount)) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+bool Mock::hasCallFormattedAs(uint32_t methodId, const std::vector<std::string>& args) const {
+    std::ostringstream text;
+    for (const std::atomic<Shard*>& slot : shards) {
+        const Shard* shard = slot.load(std::memory_order_acquire);
+        if (!shard) {
+            continue;
+        }
+        std::lock_guard<std::mutex> lock(shard->mutex);
+        if (methodId >= shard->methods.size()) {
+            continue;
+        }
+        for (uint32_t index = shard->methods[methodId].newest; index != kNoMockEntry;
+             index = shard->entries[index].nextSameMethod) {
+            const CallRecord& call = shard->entries[index].call;
+            if (call.argCount != args.size()) {
+                continue;
+            }
+            bool matches = true;
+            for (uint32_t i = 0; matches && i < call.argCount; ++i) {
+                text.str(std::string());
+                formatMockArg(text, call.args[i]);
+                matches = text.str() == args[i];
+            }
+            if (matches) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+std::vector<Mock::CallRecord> Mock::callRecords() const {
+    std::vector<CallRecord> calls;
+    for (const std::atomic<Shard*>& slot : shards) {
+        if (const Shard* shard = slot.load(std::memory_order_acquire)) {
+            std::lock_guard<std::mutex> lock(shard->mutex);
+            for (const Shard::Entry& entry : shard->entries) {
+                calls.push_back(entry.call);
+            }
+        }
+    }
+    std::sort(calls.begin(), calls.end(),
+              [](const CallRecord& a, const CallRecord& b) { return a.sequence < b.sequence; });
+    return calls;
+}
+
+std::vector<Mock::CallInfo> Mock::describeCalls() const {
+    std::vector<CallRecord> records = callRecords();
+    std::vector<CallInfo> calls;
+    calls.reserve(records.size());
+    std::ostringstream text;
+    for (const CallRecord& record : records) {
+        CallInfo info;
+        info.methodName = std::string(mockMethodName(record.methodId));
+        for (uint32_t i = 0; i < record.argCount; ++i) {
+            text.str(std::string());
+            formatMockArg(text, record.args[i]);
+            info.args.push_back(text.str());
+        }
+        calls.push_back(std::move(info));
+    }
+    return calls;
+}
+
+bool verifyCall(const Mock& mock, std::string_view methodName, const std::vector<std::string>& expectedArgs) {
+    uint32_t methodId = findMockMethod(methodName);
+    return methodId != kNoMockMethod && mock.hasCallFormattedAs(methodId, expectedArgs);
+}
+
+int getCallCount(const Mock& mock, std::string_view methodName) {
+    uint32_t methodId = findMockMethod(methodName);
+    return methodId == kNoMockMethod ? 0 : static_cast<int>(mock.callCount(methodId));
+}
+
+void reportAssertionFailure(const char* file, int line, const std::string& message) {
+    recordAssertionFailure(file, line, nullptr, message);
+}
+
+namespace {
+
+thread_local std::ostringstream checkValues;
+
+} // namespace
+
+std::ostream& checkValueStream() {
+    // The stream's buffer outlives the test.
+    ArenaSuspend heapOnly;
+    checkValues.str(std::string());
+    checkValues.clear();
+    return checkValues;
+}
+
+std::string takeCheckValues() {
+    ArenaSuspend heapOnly;
+    std::string values = checkValues.str();
+    checkValues.str(std::string());
+    return values;
+}
+
+void reportCheckFailure(const char* file, int line, const char* expression, std::string values, bool fatal) {
+    recordAssertionFailure(file, line, expression, std::move(values));
+    if (fatal && currentTest.testCase) {
+        throw FatalAssertionFailure{};
+    }
+}
+
+size_t currentTestInstance() {
+    return currentTest.instance < 0 ? 0 : static_cast<size_t>(currentTest.instance);
+}
+
+unsigned int currentStressThread() {
+    return stressThreadIndex;
+}
+
+unsigned int currentStressThreadCount() {
+    return stressThreadCount;
+}
+
+void recordLockAcquisition(bool contended, uint64_t waitNanos) {
+    if (LockProfile* profile = lockProfile) {
+        ++profile->acquisitions;
+        if (contended) {
+            ++profile->contended;
+            profile->waitNanos += waitNanos;
+        }
+    }
+}
+
+bool testRunCancelled() {
+    return RunCancellation::instance().requested();
+}
+
+std::vector<const TestResult*> TestRunner::findResults(const std::string& suiteName, const std::string& testName) const {
+    std::vector<const TestResult*> found;
+    for (size_t s = 0; s < suites.size() && s < resultOffsets.size(); ++s) {
+        if (suites[s]->name != suiteName) {
+            continue;
+        }
+        const auto& testCases = suites[s]->testCases;
+        for (size_t t = 0; t < testCases.size() && t < resultOffsets[s].size(); ++t) {
+            if (testCases[t].name != testName) {
+                continue;
+            }
+            for (size_t r = resultOffsets[s][t]; r < testResults.size() && testResults[r].suiteIndex == s
+                                                 && testResults[r].testIndex == t; ++r) {
+                found.push_back(&testResults[r]);
+            }
+        }
+    }
+    return found;
+}
+
+void SuiteRegistration::link(TestRegistration& registration) {
+    registration.next = newestTest;
+    newestTest = &registration;
+}
+
+void SuiteRegistration::addTestCase(const TestCase& testCase) {
+    // Runtime registrations are rare and live as long as the program, like the constinit ones.
+    link(*new TestRegistration(*this, testCase));
+}
+
+const std::shared_ptr<TestSuite>& SuiteRegistration::suite() {
+    if (!materialized) {
+        materialized = std::make_shared<TestSuite>(name, createFixture());
+        materialized->cloneFixture = cloneFixture;
+        materialized->perWorkerFixtures = perWorkerFixtures;
+    }
+    if (newestTest != newestDiscovered) {
+        // The list runs newest first; collect the undiscovered part and append it in declaration order.
+        std::vector<const TestRegistration*> pending;
+        for (const TestRegistration* test = newestTest; test != newestDiscovered; test = test->next) {
+            pending.push_back(test);
+        }
+        materialized->testCases.reserve(materialized->testCases.size() + pending.size());
+        for (auto it = pending.rbegin(); it != pending.rend(); ++it) {
+            materialized->addTestCase((*it)->testCase);
+        }
+        newestDiscovered = newestTest;
+    }
+    return materialized;
+}
+
+void TestRunner::discoverRegisteredSuites() {
+    std::vector<SuiteRegistration*> registrations;
+    for (SuiteRegistration* registration = SuiteRegistration::first; registration; registration = registration->next) {
+        registrations.push_back(registration);
+    }
+    // Suites are linked newest first too; walk them backwards so suite indices follow declaration order.
+    for (auto it = registrations.rbegin(); it != registrations.rend(); ++it) {
+        SuiteRegistration& registration = **it;
+        const std::shared_ptr<TestSuite>& suite = registration.suite();
+        if (!registration.addedToRunner) {
+            registration.addedToRunner = true;
+            suites.push_back(suite);
+        }
+    }
+}
+
+void TestRunner::prepareResults() {
+    discoverRegisteredSuites();
+    // Family sizes are read once here, so they can follow settings made after registration.
+    itemCounts.assign(suites.size(), {});
+    size_t total = 0;
+    for (size_t s = 0; s < suites.size(); ++s) {
+        const auto& testCases = suites[s]->testCases;
+        itemCounts[s].resize(testCases.size());
+        for (size_t t = 0; t < testCases.size(); ++t) {
+            const TestCase& testCase = testCases[t];
+            size_t instances = testCase.instanceCount ? testCase.instanceCount() : 1;
+            itemCounts[s][t] = testCase.disabled ? 1 : instances * static_cast<size_t>(std::max(1, testCase.repetitions));
+            total += itemCounts[s][t];
+        }
+    }
+
+    testResults.assign(total, TestResult{});
+    testCounters.assign(runnerOptions.hardwareCounters ? total : 0, PerfCounters{});
+    bool trackingAllocations = runnerOptions.trackAllocations && allocationHooksInstalled.load(std::memory_order_relaxed);
+    testAllocations.assign(trackingAllocations ? total : 0, AllocationStats{});
+    flakyTallies.clear();
+    for (size_t s = 0; s < suites.size(); ++s) {
+        const auto& testCases = suites[s]->testCases;
+        for (size_t t = 0; t < testCases.size(); ++t) {
+            if (testCases[t].isNondeterministic && !testCases[t].disabled) {
+                flakyTallies.emplace(std::make_pair(static_cast<uint32_t>(s), static_cast<uint32_t>(t)),
+                                     std::make_unique<FlakyTally>());
+            }
+        }
+    }
+    lastWorkerCounters.clear();
+    lastWorkerCpus.clear();
+    resultOffsets.assign(suites.size(), {});
+    size_t next = 0;
+    for (size_t s = 0; s < suites.size(); ++s) {
+        const auto& testCases = suites[s]->testCases;
+        resultOffsets[s].resize(testCases.size());
+        for (size_t t = 0; t < testCases.size(); ++t) {
+            resultOffsets[s][t] = next;
+            for (size_t item = 0; item < itemCounts[s][t]; ++item) {
+                TestResult& result = testResults[next++];
+                ItemPosition position = decodeItem(item, testCases[t]);
+                result.suiteIndex = static_cast<uint32_t>(s);
+                result.testIndex = static_cast<uint32_t>(t);
+                result.repetition = position.repetition;
+                result.instance = testCases[t].disabled ? -1 : position.instance;
+            }
+        }
+    }
+}
+
+TestRunner::FlakyTally* TestRunner::flakyTallyFor(size_t suiteIndex, size_t testIndex) {
+    auto it = flakyTallies.find({static_cast<uint32_t>(suiteIndex), static_cast<uint32_t>(testIndex)});
+    return it == flakyTallies.end() ? nullptr : it->second.get();
+}
+
+void TestRunner::tallyRepetition(FlakyTally& tally, TestStatus status) {
+    uint32_t passes;
+    uint32_t failures;
+    if (status == TestStatus::Passed) {
+        passes = tally.passes.fetch_add(1, std::memory_order_relaxed) + 1;
+        failures = tally.failures.load(std::memory_order_relaxed);
+    } else {
+        failures = tally.failures.fetch_add(1, std::memory_order_relaxed) + 1;
+        passes = tally.passes.load(std::memory_order_relaxed);
+    }
+    // Repetitions already running on other workers still finish and are counted in the report.
+    auto [lower, upper] = wilsonInterval(passes, passes + failures, flakyZ);
+    if ((upper - lower) / 2 <= runnerOptions.flakyMargin) {
+        tally.decided.store(true, std::memory_order_relaxed);
+    }
+}
+
+void TestRunner::summarizeFlakiness() {
+    lastFlakiness.clear();
+    for (const auto& [key, tally] : flakyTallies) {
+        auto [s, t] = key;
+        if (!selected[s][t]) {
+            continue;
+        }
+        FlakinessReport report;
+        report.suiteIndex = s;
+        report.testIndex = t;
+        report.maxRepetitions = static_cast<uint32_t>(itemCounts[s][t]);
+        for (size_t item = 0; item < itemCounts[s][t]; ++item) {
+            TestResult& result = testResults[resultOffsets[s][t] + item];
+            if (result.status == TestStatus::Skipped) {
+                // Never started: the pass rate was known before this repetition's turn came.
+                result.status = TestStatus::NotSelected;
+                continue;
+            }
+            ++report.runs;
+            report.passes += result.status == TestStatus::Passed;
+        }
+        if (report.runs == 0) {
+            continue;
+        }
+        report.passRate = static_cast<double>(report.passes) / report.runs;
+        std::tie(report.lowerBound, report.upperBound) = wilsonInterval(report.passes, report.runs, flakyZ);
+        lastFlakiness.push_back(report);
+    }
+}
+
+void TestRunner::loadTimingEstimates() {
+    estimatedNanos.assign(suites.size(), {});
+    lastSchedule = {};
+    TimingTable table = readTimingTable(runnerOptions.timingDatabasePath);
+
+    // First pass: look every test up and collect per-suite and overall averages of the known ones.
+    std::vector<std::vector<bool>> known(suites.size());
+    uint64_t globalSum = 0;
+    size_t globalCount = 0;
+    std::vector<std::pair<uint64_t, size_t>> suiteTotals(suites.size(), {0, 0});
+    for (size_t s = 0; s < suites.size(); ++s) {
+        const auto& testCases = suites[s]->testCases;
+        estimatedNanos[s].assign(testCases.size(), 0);
+        known[s].assign(testCases.size(), false);
+        for (size_t t = 0; t < testCases.size(); ++t) {
+            auto it = table.find(timingKey(suites[s]->name, testCases[t].name));
+            if (it == table.end()) {
+                continue;
+            }
+            estimatedNanos[s][t] = it->second.nanos;
+            known[s][t] = true;
+            suiteTotals[s].first += it->second.nanos;
+            ++suiteTotals[s].second;
+            globalSum += it->second.nanos;
+            ++globalCount;
+        }
+    }
+
+    // Second pass: tests never seen before are assumed to cost as much as an average test of their suite.
+    uint64_t globalAverage = globalCount > 0 ? globalSum / globalCount : kDefaultEstimateNanos;
+    for (size_t s = 0; s < suites.size(); ++s) {
+        uint64_t fallback = suiteTotals[s].second > 0 ? suiteTotals[s].first / suiteTotals[s].second : globalAverage;
+        for (size_t t = 0; t < estimatedNanos[s].size(); ++t) {
+            if (suites[s]->testCases[t].disabled) {
+                continue;
+            }
+            if (known[s][t]) {
+                ++lastSchedule.knownTests;
+            } else {
+                estimatedNanos[s][t] = fallback;
+                ++lastSchedule.unknownTests;
+            }
+        }
+    }
+}
+
+void TestRunner::saveTimingDatabase() const {
+    // Entries of tests that are not registered in this binary are kept as they are.
+    TimingTable table = readTimingTable(runnerOptions.timingDatabasePath);
+    for (size_t s = 0; s < suites.size(); ++s) {
+        const auto& testCases = suites[s]->testCases;
+        for (size_t t = 0; t < testCases.size(); ++t) {
+            if (testCases[t].disabled) {
+                continue;
+            }
+            uint64_t total = 0;
+            size_t executed = 0;
+            size_t passes = 0;
+            for (size_t item = 0; item < itemCounts[s][t]; ++item) {
+                const TestResult& result = testResults[resultOffsets[s][t] + item];
+                if (result.status != TestStatus::Skipped && result.status != TestStatus::NotSelected) {
+                    total += result.wallNanos;
+                    ++executed;
+                    passes += result.status == TestStatus::Passed;
+                }
+            }
+            if (executed == 0) {
+                continue;
+            }
+            // Blend with the previous record so a single noisy run does not reorder the schedule.
+            uint64_t measured = total / executed;
+            auto [it, inserted] = table.emplace(timingKey(suites[s]->name, testCases[t].name), TimingRecord{measured});
+            if (!inserted) {
+                it->second.nanos = (it->second.nanos + measured) / 2;
+            }
+            it->second.passes += passes;
+            it->second.failures += executed - passes;
+        }
+    }
+    writeTimingTable(runnerOptions.timingDatabasePath, table);
+}
+
+void TestRunner::selectChangedTests() {
+    testDependencies.clear();
+    sourceHashes.clear();
+    if (runnerOptions.selectionCachePath.empty()) {
+        return;
+    }
+    SelectionCache cache = readSelectionCache(runnerOptions.selectionCachePath);
+    std::vector<std::pair<std::string, std::string>> dependencyMap;
+    if (!runnerOptions.dependencyMapPath.empty()) {
+        dependencyMap = readDependencyMap(runnerOptions.dependencyMapPath);
+    }
+
+    size_t considered = 0;
+    size_t affected = 0;
+    size_t failedBefore = 0;
+    testDependencies.resize(suites.size());
+    for (size_t s = 0; s < suites.size(); ++s) {
+        const auto& testCases = suites[s]->testCases;
+        testDependencies[s].resize(testCases.size());
+        for (size_t t = 0; t < testCases.size(); ++t) {
+            const TestCase& testCase = testCases[t];
+            if (!selected[s][t] || testCase.disabled) {
+                continue;
+            }
+            ++considered;
+            std::vector<std::string>& dependencies = testDependencies[s][t];
+            if (!testCase.sourceFile.empty()) {
+                dependencies.emplace_back(testCase.sourceFile);
+            }
+            std::string name = qualifiedTestName(suites[s]->name, testCase.name);
+            for (const auto& [pattern, path] : dependencyMap) {
+                if (globMatches(pattern, name)) {
+                    dependencies.push_back(path);
+                }
+            }
+            dependencies.insert(dependencies.end(), runnerOptions.sharedDependencies.begin(),
+                                runnerOptions.sharedDependencies.end());
+            std::sort(dependencies.begin(), dependencies.end());
+            dependencies.erase(std::unique(dependencies.begin(), dependencies.end()), dependencies.end());
+
+            // A test is only left out when everything it depends on is known and unchanged since it last passed.
+            std::vector<std::pair<std::string, uint64_t>> current;
+            bool readable = !dependencies.empty();
+            for (const std::string& dependency : dependencies) {
+                auto [it, inserted] = sourceHashes.emplace(dependency, 0);
+                if (inserted) {
+                    it->second = hashFileContents(dependency);
+                }
+                readable = readable && it->second != 0;
+                current.emplace_back(dependency, it->second);
+            }
+            auto record = cache.find(timingKey(suites[s]->name, testCase.name));
+            if (record != cache.end() && !record->second.passed) {
+                ++failedBefore;
+                continue;
+            }
+            if (record == cache.end() || !readable || record->second.dependencies != current) {
+                ++affected;
+                continue;
+            }
+            selected[s][t] = false;
+            for (size_t item = 0; item < itemCounts[s][t]; ++item) {
+                testResults[resultOffsets[s][t] + item].status = TestStatus::NotSelected;
+            }
+        }
+    }
+    if (!runnerOptions.quiet) {
+        std::cout << "Incremental selection: running " << affected + failedBefore << " of " << considered
+                  << " tests (" << affected << " new or changed, " << failedBefore << " failed last time)\n";
+    }
+}
+
+void TestRunner::saveSelectionCache() const {
+    // Tests that did not run, including those of other binaries sharing the cache, keep their records.
+    SelectionCache cache = readSelectionCache(runnerOptions.selectionCachePath);
+    for (size_t s = 0; s < testDependencies.size(); ++s) {
+        const auto& testCases = suites[s]->testCases;
+        for (size_t t = 0; t < testDependencies[s].size(); ++t) {
+            size_t executed = 0;
+            size_t passes = 0;
+            for (size_t item = 0; item < itemCounts[s][t]; ++item) {
+                TestStatus status = testResults[resultOffsets[s][t] + item].status;
+                if (status != TestStatus::Skipped && status != TestStatus::NotSelected) {
+                    ++executed;
+                    passes += status == TestStatus::Passed;
+                }
+            }
+            if (executed == 0) {
+                continue;
+            }
+            SelectionRecord record;
+            record.passed = passes == executed;
+            for (const std::string& dependency : testDependencies[s][t]) {
+                record.dependencies.emplace_back(dependency, sourceHashes.at(dependency));
+            }
+            cache[timingKey(suites[s]->name, testCases[t].name)] = std::move(record);
+        }
+    }
+    writeSelectionCache(runnerOptions.selectionCachePath, cache);
+}
+
+bool TestRunner::matchFilter(std::vector<std::vector<bool>>& matches) {
+    size_t testCount = 0;
+    for (const auto& suite : suites) {
+        testCount += suite->testCases.size();
+    }
+    if (nameIndex.empty() || indexedTestCount != testCount) {
+        nameIndex.clear();
+        nameIndex.reserve(testCount);
+        for (size_t s = 0; s < suites.size(); ++s) {
+            for (size_t t = 0; t < suites[s]->testCases.size(); ++t) {
+                nameIndex.push_back({qualifiedTestName(suites[s]->name, suites[s]->testCases[t].name), static_cast<uint32_t>(s),
+                                     static_cast<uint32_t>(t)});
+            }
+        }
+        std::sort(nameIndex.begin(), nameIndex.end(),
+                  [](const NameIndexEntry& a, const NameIndexEntry& b) { return a.name < b.name; });
+        indexedTestCount = testCount;
+    }
+
+    const std::string& filter = runnerOptions.filter;
+    size_t start = 0;
+    while (start <= filter.size()) {
+        size_t end = filter.find(':', start);
+        if (end == std::string::npos) {
+            end = filter.size();
+        }
+        std::string pattern = filter.substr(start, end - start);
+        start = end + 1;
+        if (pattern.empty()) {
+            continue;
+        }
+
+        bool isRegex = pattern.size() >= 2 && pattern.front() == '/' && pattern.back() == '/';
+        std::regex expression;
+        std::string prefix;
+        if (isRegex) {
+            pattern = pattern.substr(1, pattern.size() - 2);
+            try {
+                expression = std::regex(pattern, std::regex::ECMAScript | std::regex::optimize);
+            } catch (const std::regex_error& e) {
+                std::cerr << "Invalid filter expression '" << pattern << "': " << e.what() << std::endl;
+                return false;
+            }
+            prefix = regexLiteralPrefix(pattern);
+        } else {
+            prefix = pattern.substr(0, pattern.find_first_of("*?"));
+        }
+
+        // Every match starts with the literal prefix, so only that slice of the sorted index is examined.
+        auto first = std::lower_bound(nameIndex.begin(), nameIndex.end(), prefix,
+                                      [](const NameIndexEntry& entry, const std::string& value) {
+                                          return entry.name < value;
+                                      });
+        for (auto it = first; it != nameIndex.end() && it->name.compare(0, prefix.size(), prefix) == 0; ++it) {
+            bool matched = isRegex ? std::regex_match(it->name, expression) : globMatches(pattern, it->name);
+            if (matched) {
+                matches[it->suiteIndex][it->testIndex] = true;
+            }
+        }
+    }
+    return true;
+}
+
+void TestRunner::selectTests() {
+    selected.assign(suites.size(), {});
+    for (size_t s = 0; s < suites.size(); ++s) {
+        selected[s].assign(suites[s]->testCases.size(), true);
+    }
+
+    std::vector<std::vector<bool>> filterMatches;
+    if (!runnerOptions.filter.empty()) {
+        filterMatches = selected;
+        for (auto& suiteMatches : filterMatches) {
+            std::fill(suiteMatches.begin(), suiteMatches.end(), false);
+        }
+        if (!matchFilter(filterMatches)) {
+            // An unusable filter selects nothing rather than silently running everything.
+            for (auto& suiteMatches : filterMatches) {
+                std::fill(suiteMatches.begin(), suiteMatches.end(), false);
+            }
+        }
+    }
+
+    unsigned int shardCount = std::max(1u, runnerOptions.shardCount);
+    if (shardCount > 1) {
+        for (auto& suiteSelection : selected) {
+            std::fill(suiteSelection.begin(), suiteSelection.end(), false);
+        }
+        ShardStrategy strategy = runnerOptions.shardStrategy;
+        if (strategy == ShardStrategy::Duration && estimatedNanos.empty()) {
+            std::cerr << "Duration-balanced sharding needs a timing database; falling back to hash sharding."
+                      << std::endl;
+            strategy = ShardStrategy::Hash;
+        }
+
+        if (strategy == ShardStrategy::Hash) {
+            for (size_t s = 0; s < suites.size(); ++s) {
+                for (size_t t = 0; t < suites[s]->testCases.size(); ++t) {
+                    uint64_t hash = stableHash(qualifiedTestName(suites[s]->name, suites[s]->testCases[t].name));
+                    selected[s][t] = hash % shardCount == runnerOptions.shardIndex;
+                }
+            }
+        } else {
+            // Longest first onto the least loaded shard. Ties are broken by name, never by registration order or
+            // memory layout, so every node computes the same assignment from the same database.
+            struct Weighted {
+                uint64_t cost;
+                std::string name;
+                WorkRef ref;
+            };
+            std::vector<Weighted> tests;
+            for (size_t s = 0; s < suites.size(); ++s) {
+                for (size_t t = 0; t < suites[s]->testCases.size(); ++t) {
+                    const TestCase& testCase = suites[s]->testCases[t];
+                    uint64_t cost = testCase.disabled ? 0 : estimatedNanos[s][t] * itemCounts[s][t];
+                    tests.push_back({cost, qualifiedTestName(suites[s]->name, testCase.name),
+                                     {static_cast<uint32_t>(s), static_cast<uint32_t>(t)}});
+                }
+            }
+            std::sort(tests.begin(), tests.end(), [](const Weighted& a, const Weighted& b) {
+                return a.cost != b.cost ? a.cost > b.cost : a.name < b.name;
+            });
+            std::vector<uint64_t> loads(shardCount, 0);
+            for (const Weighted& test : tests) {
+                size_t shard = static_cast<size_t>(std::min_element(loads.begin(), loads.end()) - loads.begin());
+                loads[shard] += test.cost;
+                selected[test.ref.suiteIndex][test.ref.testIndex] = shard == runnerOptions.shardIndex;
+            }
+        }
+    }
+
+    // Shards are computed over the whole registry so the filter does not move tests between shards.
+    for (size_t s = 0; s < suites.size() && !filterMatches.empty(); ++s) {
+        for (size_t t = 0; t < suites[s]->testCases.size(); ++t) {
+            selected[s][t] = selected[s][t] && filterMatches[s][t];
+        }
+    }
+
+    for (size_t s = 0; s < suites.size(); ++s) {
+        for (size_t t = 0; t < suites[s]->testCases.size(); ++t) {
+            if (selected[s][t]) {
+                continue;
+            }
+            for (size_t item = 0; item < itemCounts[s][t]; ++item) {
+                testResults[resultOffsets[s][t] + item].status = TestStatus::NotSelected;
+            }
+        }
+    }
+}
+
+std::vector<TestRunner::WorkRef> TestRunner::selectedItems() const {
+    std::vector<WorkRef> items;
+    for (size_t s = 0; s < suites.size(); ++s) {
+        for (size_t t = 0; t < suites[s]->testCases.size(); ++t) {
+            if (selected[s][t]) {
+                items.push_back({static_cast<uint32_t>(s), static_cast<uint32_t>(t)});
+            }
+        }
+    }
+    return items;
+}
+
+void TestRunner::writeResultFile() const {
+    std::ofstream out(runnerOptions.resultFilePath, std::ios::trunc);
+    out << kResultFileHeader << " shard " << runnerOptions.shardIndex << "/" << std::max(1u, runnerOptions.shardCount)
+        << "\n";
+    // The last column is the position of the repetition in the results table, which every shard lays out the same
+    // way in registration order, so mergeResultFiles() can restore the order of an unsharded run.
+    for (size_t index = 0; index < testResults.size(); ++index) {
+        const TestResult& result = testResults[index];
+        if (result.status == TestStatus::NotSelected) {
+            continue;
+        }
+        out << suites[result.suiteIndex]->name << '\t' << suites[result.suiteIndex]->testCases[result.testIndex].name;
+        if (result.instance >= 0) {
+            out << '/' << result.instance;
+        }
+        out << '\t' << result.repetition << '\t' << statusName(result.status) << '\t' << result.assertionFailures
+            << '\t' << result.wallNanos << '\t' << result.cpuNanos << '\t' << index << "\n";
+    }
+    if (!out) {
+        std::cerr << "Failed to write result file " << runnerOptions.resultFilePath << std::endl;
+    }
+}
+
+const std::vector<BenchmarkResult>& TestRunner::runBenchmarks() {
+    prepareResults();
+    estimatedNanos.clear();
+    selectTests();
+    lastBenchmarks.clear();
+    for (size_t s = 0; s < suites.size(); ++s) {
+        for (size_t t = 0; t < suites[s]->testCases.size(); ++t) {
+            const TestCase& testCase = suites[s]->testCases[t];
+            if (testCase.benchmark && !testCase.disabled) {
+                continue;
+            }
+            selected[s][t] = false;
+            for (size_t item = 0; item < itemCounts[s][t]; ++item) {
+                testResults[resultOffsets[s][t] + item].status = TestStatus::NotSelected;
+            }
+        }
+    }
+
+    EventReporter& reporter = EventReporter::instance();
+    reporter.start(false, runnerOptions.quiet, sessionReporters(runnerOptions));
+    // With a placement the watchdog of timed benchmarks runs off the pinned CPU.
+    CpuPlacement placement = planPlacement(runnerOptions);
+    ActivePlacement::instance().set(placement);
+    ScopedCpuPin pin(runnerOptions.benchmarkCpu >= 0 ? runnerOptions.benchmarkCpu : placement.cpuForWorker(0));
+    TimeoutWatchdog watchdog;
+    uint64_t sampleNanos = std::max<uint64_t>(1000, static_cast<uint64_t>(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(runnerOptions.benchmarkSampleTime).count()));
+    auto warmupTime = runnerOptions.benchmarkWarmupTime;
+    unsigned int sampleCount = std::max(1u, runnerOptions.benchmarkSamples);
+
+    std::vector<WorkRef> items = selectedItems();
+    for (size_t position = 0; position < items.size(); ++position) {
+        size_t s = items[position].suiteIndex;
+        size_t t = items[position].testIndex;
+        TestSuite& suite = *suites[s];
+        TestFixture* fixture = suite.fixture.get();
+        if (position == 0 || items[position - 1].suiteIndex != s) {
+            reporter.emit(makeSuiteEvent(TestEventType::SuiteStart, suite));
+            if (fixture) {
+                fixture->BeforeAll();
+            }
+        }
+
+        const TestCase& testCase = suite.testCases[t];
+        TestResult& result = testResults[resultOffsets[s][t]];
+        BenchmarkResult benchmark;
+        benchmark.suiteIndex = static_cast<uint32_t>(s);
+        benchmark.testIndex = static_cast<uint32_t>(t);
+
+        // A body that fails once is not worth timing, and would flood the output with the same failure.
+        runTestCase(suite, fixture, testCase, result.repetition, result.instance, false, result,
+                    countersFor(resultOffsets[s][t]), allocationsFor(resultOffsets[s][t]), watchdog, nullptr);
+        if (result.status == TestStatus::Passed) {
+            if (fixture) {
+                fixture->BeforeEach();
+            }
+            TestResult scratch;
+            currentTest = {&suite, &testCase, 1, -1, false, &scratch};
+            try {
+                auto warmupEnd = std::chrono::steady_clock::now() + warmupTime;
+                while (std::chrono::steady_clock::now() < warmupEnd) {
+                    timeIterations(testCase, fixture, 1);
+                }
+
+                // Grow the batch until one batch fills a sample, aiming a little past the target from the rate seen
+                // so far but at most tenfold per step, so a single fast batch cannot overshoot by much.
+                uint64_t iterations = 1;
+                for (;;) {
+                    uint64_t elapsed = timeIterations(testCase, fixture, iterations);
+                    if (elapsed >= sampleNanos || iterations >= kMaxBenchmarkIterations) {
+                        break;
+                    }
+                    double wanted = 1.1 * static_cast<double>(iterations) * static_cast<double>(sampleNanos)
+                                    / static_cast<double>(std::max<uint64_t>(elapsed, 1));
+                    iterations = std::clamp(static_cast<uint64_t>(wanted), iterations + 1, iterations * 10);
+                }
+
+                std::vector<double> perCall;
+                perCall.reserve(sampleCount);
+                for (unsigned int sample = 0; sample < sampleCount; ++sample) {
+                    uint64_t elapsed = timeIterations(testCase, fixture, iterations);
+                    perCall.push_back(static_cast<double>(elapsed) / static_cast<double>(iterations));
+                }
+                benchmark.iterations = iterations;
+                summarizeSamples(perCall, benchmark);
+                benchmark.passed = scratch.assertionFailures == 0;
+            } catch (const FatalAssertionFailure&) {
+            } catch (const std::exception& e) {
+                TestEvent event = makeTestEvent(TestEventType::TestFailure, suite, testCase, 1, false);
+                event.message = "Unexpected exception thrown in benchmark '" + std::string(testCase.name) + "': " + e.what();
+                reporter.emit(std::move(event));
+            } catch (...) {
+                TestEvent event = makeTestEvent(TestEventType::TestFailure, suite, testCase, 1, false);
+                event.message = "Unexpected unknown exception thrown in benchmark '" + std::string(testCase.name) + "'";
+                reporter.emit(std::move(event));
+            }
+            currentTest = {};
+            if (!benchmark.passed) {
+                result.status = TestStatus::Failed;
+                result.assertionFailures += scratch.assertionFailures;
+            }
+            if (fixture) {
+                fixture->AfterEach();
+            }
+        }
+        lastBenchmarks.push_back(benchmark);
+
+        if (position + 1 == items.size() || items[position + 1].suiteIndex != s) {
+            if (fixture) {
+                fixture->AfterAll();
+            }
+            reporter.emit(makeSuiteEvent(TestEventType::SuiteFinish, suite));
+        }
+    }
+    reporter.stop();
+
+    for (const BenchmarkResult& benchmark : lastBenchmarks) {
+        const TestSuite& suite = *suites[benchmark.suiteIndex];
+        std::cout << "Benchmark " << qualifiedTestName(suite.name, suite.testCases[benchmark.testIndex].name) << ": ";
+        if (!benchmark.passed) {
+            std::cout << "FAILED\n";
+            continue;
+        }
+        std::cout << "median " << benchmark.medianNanos << " ns, min " << benchmark.minNanos << " ns, p99 "
+                  << benchmark.p99Nanos << " ns, stddev " << benchmark.stddevNanos << " ns (" << benchmark.samples
+                  << " samples of " << benchmark.iterations << " iterations)\n";
+    }
+    std::cout.flush();
+
+    if (!runnerOptions.benchmarkOutputPath.empty()) {
+        writeBenchmarkFile(lastBenchmarks);
+    }
+    checkBaseline(lastBenchmarks);
+    return lastBenchmarks;
+}
+
+std::vector<BenchmarkResult> TestRunner::testTimingStatistics() const {
+    std::vector<BenchmarkResult> statistics;
+    for (size_t s = 0; s < suites.size(); ++s) {
+        for (size_t t = 0; t < suites[s]->testCases.size(); ++t) {
+            if (!selected[s][t] || suites[s]->testCases[t].benchmark || suites[s]->testCases[t].disabled) {
+                continue;
+            }
+            std::vector<double> wallTimes;
+            bool passed = true;
+            for (size_t item = 0; item < itemCounts[s][t]; ++item) {
+                const TestResult& result = testResults[resultOffsets[s][t] + item];
+                passed = passed && result.status == TestStatus::Passed;
+                wallTimes.push_back(static_cast<double>(result.wallNanos));
+            }
+            // A failed or timed-out test's duration says nothing about its speed.
+            if (!passed || wallTimes.empty()) {
+                continue;
+            }
+            BenchmarkResult timing;
+            timing.suiteIndex = static_cast<uint32_t>(s);
+            timing.testIndex = static_cast<uint32_t>(t);
+            timing.iterations = 1;
+            timing.passed = true;
+            summarizeSamples(wallTimes, timing);
+            statistics.push_back(timing);
+        }
+    }
+    return statistics;
+}
+
+void TestRunner::checkBaseline(const std::vector<BenchmarkResult>& statistics) {
+    lastRegressions.clear();
+    if (runnerOptions.baselinePath.empty()) {
+        return;
+    }
+    std::map<std::string, BaselineEntry> baseline = readBaseline(runnerOptions.baselinePath);
+    size_t compared = 0;
+    size_t skipped = 0;
+    for (const BenchmarkResult& measured : statistics) {
+        const TestSuite& suite = *suites[measured.suiteIndex];
+        std::string name = qualifiedTestName(suite.name, suite.testCases[measured.testIndex].name);
+        auto entry = baseline.find(name);
+        if (!measured.passed || entry == baseline.end()) {
+            continue;
+        }
+        uint64_t fewestSamples = std::min<uint64_t>(measured.samples, entry->second.samples);
+        if (fewestSamples < runnerOptions.regressionMinSamples) {
+            std::cout << "Not gating " << name << ": " << fewestSamples << " samples, fewer than the "
+                      << runnerOptions.regressionMinSamples << " needed to estimate its noise\n";
+            ++skipped;
+            continue;
+        }
+        ++compared;
+        if (isRegression(entry->second, measured, runnerOptions.regressionThreshold, runnerOptions.regressionSigmas)) {
+            lastRegressions.push_back({name, entry->second.medianNanos, measured.medianNanos});
+        }
+    }
+
+    for (const PerformanceRegression& regression : lastRegressions) {
+        std::cout << "Performance regression in " << regression.name << ": median " << regression.medianNanos
+                  << " ns, baseline " << regression.baselineMedianNanos << " ns (+"
+                  << (regression.medianNanos / regression.baselineMedianNanos - 1) * 100 << "%)\n";
+    }
+    std::cout << "Performance gate: " << lastRegressions.size() << " regressions in " << compared
+              << " comparisons against " << runnerOptions.baselinePath;
+    if (skipped > 0) {
+        std::cout << " (" << skipped << " skipped for too few samples)";
+    }
+    std::cout << std::endl;
+}
+
+void TestRunner::writeBenchmarkFile(const std::vector<BenchmarkResult>& statistics) const {
+    const std::string& path = runnerOptions.benchmarkOutputPath;
+    bool json = path.size() >= 5 && path.compare(path.size() - 5, 5, ".json") == 0;
+    std::ofstream out(path, std::ios::trunc);
+    if (json) {
+        out << "{\n  \"benchmarks\": [";
+    } else {
+        out << kBenchmarkFileHeader << "\n";
+    }
+    for (size_t i = 0; i < statistics.size(); ++i) {
+        const BenchmarkResult& benchmark = statistics[i];
+        const TestSuite& suite = *suites[benchmark.suiteIndex];
+        std::string name = qualifiedTestName(suite.name, suite.testCases[benchmark.testIndex].name);
+        if (json) {
+            out << (i ? "," : "") << "\n    {\"name\": \"" << jsonEscaped(name) << "\", \"passed\": "
+                << (benchmark.passed ? "true" : "false") << ", \"iterations\": " << benchmark.iterations
+                << ", \"samples\": " << benchmark.samples << ", \"min_ns\": " << benchmark.minNanos
+                << ", \"median_ns\": " << benchmark.medianNanos << ", \"p99_ns\": " << benchmark.p99Nanos
+                << ", \"mean_ns\": " << benchmark.meanNanos << ", \"stddev_ns\": " << benchmark.stddevNanos << "}";
+        } else {
+            out << name << ',' << (benchmark.passed ? 1 : 0) << ',' << benchmark.iterations << ',' << benchmark.samples
+                << ',' << benchmark.minNanos << ',' << benchmark.medianNanos << ',' << benchmark.p99Nanos << ','
+                << benchmark.meanNanos << ',' << benchmark.stddevNanos << "\n";
+        }
+    }
+    if (json) {
+        out << "\n  ]\n}\n";
+    }
+    if (!out) {
+        std::cerr << "Failed to write benchmark file " << path << std::endl;
+    }
+}
+
+bool TestRunner::mergeResultFiles(const std::vector<std::string>& inputPaths, const std::string& outputPath) {
+    struct Line {
+        uint64_t position;
+        std::string text;
+    };
+    std::vector<Line> lines;
+    for (const std::string& path : inputPaths) {
+        std::ifstream in(path);
+        if (!in) {
+            std::cerr << "Failed to read result file " << path << std::endl;
+            return false;
+        }
+        std::string text;
+        while (std::getline(in, text)) {
+            if (text.empty() || text[0] == '#') {
+                continue;
+            }
+            size_t last = text.rfind('\t');
+            uint64_t position = 0;
+            if (last == std::string::npos
+                || std::from_chars(text.data() + last + 1, text.data() + text.size(), position).ec != std::errc()) {
+                std::cerr << "Ignoring malformed line in result file " << path << ": " << text << std::endl;
+                continue;
+            }
+            lines.push_back({position, text});
+        }
+    }
+    std::stable_sort(lines.begin(), lines.end(), [](const Line& a, const Line& b) {
+        return a.position < b.position;
+    });
+
+    std::ofstream out(outputPath, std::ios::trunc);
+    out << kResultFileHeader << " merged from " << inputPaths.size() << " shards\n";
+    for (const Line& line : lines) {
+        out << line.text << "\n";
+    }
+    if (!out) {
+        std::cerr << "Failed to write result file " << outputPath << std::endl;
+        return false;
+    }
+    return true;
+}
 
-void TestRunner::run(bool runConcurrently) {
-    for (auto& suite : suites) {
-        std::cout << "Running Test Suite: " << suite->name << std::endl;
+bool TestRunner::readBinaryReport(const std::string& path, std::vector<ReportedResult>& results) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in) {
+        std::cerr << "Failed to read binary report " << path << std::endl;
+        return false;
+    }
+    std::string data((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    if (data.compare(0, sizeof(kBinaryReportMagic), kBinaryReportMagic, sizeof(kBinaryReportMagic)) != 0) {
+        std::cerr << path << " is not a binary report" << std::endl;
+        return false;
+    }
+    size_t pos = sizeof(kBinaryReportMagic);
+    auto read = [&](int bytes, uint64_t& value) {
+        if (data.size() - pos < static_cast<size_t>(bytes)) {
+            return false;
+        }
+        value = 0;
+        for (int i = 0; i < bytes; ++i) {
+            value |= static_cast<uint64_t>(static_cast<unsigned char>(data[pos++])) << (8 * i);
+        }
+        return true;
+    };
+    auto readName = [&](std::string& name) {
+        uint64_t length;
+        if (!read(2, length) || data.size() - pos < length) {
+            return false;
+        }
+        name = data.substr(pos, length);
+        pos += length;
+        return true;
+    };
+
+    std::vector<std::pair<std::string, std::string>> names;
+    std::vector<ReportedResult> fileResults;
+    bool complete = true;
+    while (complete && pos < data.size()) {
+        char kind = data[pos++];
+        uint64_t id;
+        if (!read(4, id)) {
+            complete = false;
+        } else if (kind == kBinaryNameRecord) {
+            std::pair<std::string, std::string> name;
+            complete = id == names.size() && readName(name.first) && readName(name.second);
+            names.push_back(std::move(name));
+        } else if (kind == kBinaryResultRecord) {
+            uint64_t instance, repetition, status, nanos;
+            complete = id < names.size() && read(4, instance) && read(4, repetition) && read(1, status)
+                       && read(8, nanos) && status <= static_cast<uint64_t>(TestStatus::NotSelected);
+            if (complete) {
+                ReportedResult result;
+                result.suite = names[id].first;
+                result.test = names[id].second;
+                result.instance = static_cast<int32_t>(static_cast<uint32_t>(instance));
+                result.repetition = static_cast<int32_t>(static_cast<uint32_t>(repetition));
+                result.status = static_cast<TestStatus>(status);
+                result.durationNanos = nanos;
+                fileResults.push_back(std::move(result));
+            }
+        } else {
+            complete = false;
+        }
+    }
+    if (!complete) {
+        std::cerr << "Binary report " << path << " is truncated or corrupt" << std::endl;
+        return false;
+    }
+    results.insert(results.end(), std::make_move_iterator(fileResults.begin()),
+                   std::make_move_iterator(fileResults.end()));
+    return true;
+}
+
+bool TestRunner::mergeBinaryReports(const std::vector<std::string>& inputPaths, const std::string& outputPath) {
+    std::vector<ReportedResult> results;
+    for (const std::string& path : inputPaths) {
+        if (!readBinaryReport(path, results)) {
+            return false;
+        }
+    }
+    std::stable_sort(results.begin(), results.end(), [](const ReportedResult& a, const ReportedResult& b) {
+        return std::tie(a.suite, a.test, a.instance, a.repetition)
+               < std::tie(b.suite, b.test, b.instance, b.repetition);
+    });
 
-        if (suite->fixture) {
-            suite->fixture->BeforeAll();
+    std::string out(kBinaryReportMagic, sizeof(kBinaryReportMagic));
+    uint32_t nextId = 0;
+    for (size_t i = 0; i < results.size(); ++i) {
+        // Sorted results of one test are adjacent, so each name is stored once.
+        if (i == 0 || results[i].suite != results[i - 1].suite || results[i].test != results[i - 1].test) {
+            appendBinaryName(out, nextId++, results[i].suite, results[i].test);
         }
+        appendBinaryResult(out, nextId - 1, results[i]);
+    }
+    std::string tempPath = outputPath + ".tmp";
+    std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+    file.write(out.data(), static_cast<std::streamsize>(out.size()));
+    file.close();
+    if (!file || std::rename(tempPath.c_str(), outputPath.c_str()) != 0) {
+        std::remove(tempPath.c_str());
+        std::cerr << "Failed to write binary report " << outputPath << std::endl;
+        return false;
+    }
+    return true;
+}
 
-        std::mutex coutMutex;
+bool TestRunner::parseCommandLine(int argc, char** argv) {
+    bool ok = true;
+    for (int i = 1; i < argc; ++i) {
+        std::string argument = argv[i];
+        std::string value;
+        size_t equals = argument.find('=');
+        bool hasValue = equals != std::string::npos;
+        if (hasValue) {
+            value = argument.substr(equals + 1);
+            argument.resize(equals);
+        }
+        auto takeValue = [&]() {
+            if (!hasValue && i + 1 < argc) {
+                value = argv[++i];
+                hasValue = true;
+            }
+            if (!hasValue) {
+                std::cerr << "Missing value for " << argument << std::endl;
+                ok = false;
+            }
+            return hasValue;
+        };
 
-        if (runConcurrently) {
-            unsigned int numThreads = std::thread::hardware_concurrency();
-            if (numThreads == 0) {
-                numThreads = 2;
+        if (argument == "--quiet") {
+            runnerOptions.quiet = true;
+        } else if (argument == "--track-allocations") {
+            runnerOptions.trackAllocations = true;
+        } else if (argument == "--test-arena") {
+            unsigned int parsed = 0;
+            if (!takeValue()) {
+                continue;
+            }
+            if (!parseCount(value, parsed)) {
+                std::cerr << "Invalid value for " << argument << ": " << value << std::endl;
+                ok = false;
+            } else {
+                runnerOptions.testArenaBytes = parsed;
+            }
+        } else if (argument == "--fail-fast") {
+            runnerOptions.maxFailures = 1;
+        } else if (argument == "--max-failures" || argument == "--time-budget-ms") {
+            unsigned int parsed = 0;
+            if (!takeValue()) {
+                continue;
+            }
+            if (!parseCount(value, parsed)) {
+                std::cerr << "Invalid value for " << argument << ": " << value << std::endl;
+                ok = false;
+            } else if (argument == "--max-failures") {
+                runnerOptions.maxFailures = parsed;
+            } else {
+                runnerOptions.timeBudget = std::chrono::milliseconds(parsed);
+            }
+        } else if (argument == "--hardware-counters") {
+            runnerOptions.hardwareCounters = true;
+        } else if (argument == "--stress-scaling") {
+            runnerOptions.stressScaling = true;
+        } else if (argument == "--stress-threads" || argument == "--stress-iterations") {
+            unsigned int& target = argument == "--stress-threads" ? runnerOptions.stressThreads
+                                                                  : runnerOptions.stressIterations;
+            if (takeValue() && !parseCount(value, target)) {
+                std::cerr << "Invalid value for " << argument << ": " << value << std::endl;
+                ok = false;
+            }
+        } else if (argument == "--workers" || argument == "--reserve-cpus") {
+            unsigned int& target = argument == "--workers" ? runnerOptions.workerThreads : runnerOptions.reservedCpus;
+            if (takeValue() && !parseCount(value, target)) {
+                std::cerr << "Invalid value for " << argument << ": " << value << std::endl;
+                ok = false;
+            }
+        } else if (argument == "--pin") {
+            if (!takeValue()) {
+                continue;
+            }
+            if (value == "none") {
+                runnerOptions.pinning = CpuPinning::None;
+            } else if (value == "compact") {
+                runnerOptions.pinning = CpuPinning::Compact;
+            } else if (value == "scatter") {
+                runnerOptions.pinning = CpuPinning::Scatter;
+            } else if (parseCpuList(value, runnerOptions.pinnedCpus)) {
+                runnerOptions.pinning = CpuPinning::List;
+            } else {
+                std::cerr << "Unknown pinning policy or CPU list: " << value << std::endl;
+                ok = false;
+            }
+        } else if (argument == "--trace") {
+            if (takeValue()) {
+                runnerOptions.tracePath = value;
             }
+        } else if (argument == "--shard-index" || argument == "--shard-count") {
+            unsigned int& target = argument == "--shard-index" ? runnerOptions.shardIndex : runnerOptions.shardCount;
+            if (takeValue() && !parseCount(value, target)) {
+                std::cerr << "Invalid value for " << argument << ": " << value << std::endl;
+                ok = false;
+            }
+        } else if (argument == "--shard-strategy") {
+            if (!takeValue()) {
+                continue;
+            }
+            if (value == "hash") {
+                runnerOptions.shardStrategy = ShardStrategy::Hash;
+            } else if (value == "duration") {
+                runnerOptions.shardStrategy = ShardStrategy::Duration;
+            } else {
+                std::cerr << "Unknown shard strategy: " << value << std::endl;
+                ok = false;
+            }
+        } else if (argument == "--result-file") {
+            if (takeValue()) {
+                runnerOptions.resultFilePath = value;
+            }
+        } else if (argument == "--report") {
+            if (!takeValue()) {
+                continue;
+            }
+            size_t colon = value.find(':');
+            std::string format = value.substr(0, colon);
+            ReportFile report;
+            report.path = colon == std::string::npos ? std::string() : value.substr(colon + 1);
+            if (format == "jsonl") {
+                report.format = ReportFormat::JsonLines;
+            } else if (format == "junit") {
+                report.format = ReportFormat::JUnitXml;
+            } else if (format == "binary") {
+                report.format = ReportFormat::Binary;
+            } else {
+                std::cerr << "Unknown report format: " << format << std::endl;
+                ok = false;
+                continue;
+            }
+            if (report.path.empty()) {
+                std::cerr << "--report needs a path, as in --report=" << format << ":PATH" << std::endl;
+                ok = false;
+                continue;
+            }
+            runnerOptions.reportFiles.push_back(report);
+        } else if (argument == "--filter") {
+            if (takeValue()) {
+                runnerOptions.filter = value;
+            }
+        } else if (argument == "--timing-db") {
+            if (takeValue()) {
+                runnerOptions.timingDatabasePath = value;
+            }
+        } else if (argument == "--selection-cache") {
+            if (takeValue()) {
+                runnerOptions.selectionCachePath = value;
+            }
+        } else if (argument == "--dependency-map") {
+            if (takeValue()) {
+                runnerOptions.dependencyMapPath = value;
+            }
+        } else if (argument == "--depends-on") {
+            if (takeValue()) {
+                runnerOptions.sharedDependencies.push_back(value);
+            }
+        } else if (argument == "--benchmark-samples" || argument == "--benchmark-sample-ms"
+                   || argument == "--benchmark-warmup-ms" || argument == "--benchmark-cpu"
+                   || argument == "--regression-min-samples") {
+            unsigned int parsed = 0;
+            if (!takeValue()) {
+                continue;
+            }
+            if (!parseCount(value, parsed)) {
+                std::cerr << "Invalid value for " << argument << ": " << value << std::endl;
+                ok = false;
+            } else if (argument == "--benchmark-samples") {
+                runnerOptions.benchmarkSamples = parsed;
+            } else if (argument == "--benchmark-sample-ms") {
+                runnerOptions.benchmarkSampleTime = std::chrono::milliseconds(parsed);
+            } else if (argument == "--benchmark-warmup-ms") {
+                runnerOptions.benchmarkWarmupTime = std::chrono::milliseconds(parsed);
+            } else if (argument == "--regression-min-samples") {
+                runnerOptions.regressionMinSamples = parsed;
+            } else {
+                runnerOptions.benchmarkCpu = static_cast<int>(parsed);
+            }
+        } else if (argument == "--benchmark-out") {
+            if (takeValue()) {
+                runnerOptions.benchmarkOutputPath = value;
+            }
+        } else if (argument == "--baseline") {
+            if (takeValue()) {
+                runnerOptions.baselinePath = value;
+            }
+        } else if (argument == "--regression-threshold" || argument == "--regression-sigmas"
+                   || argument == "--flaky-confidence" || argument == "--flaky-margin") {
+            if (!takeValue()) {
+                continue;
+            }
+            double& target = argument == "--regression-threshold" ? runnerOptions.regressionThreshold
+                             : argument == "--regression-sigmas"  ? runnerOptions.regressionSigmas
+                             : argument == "--flaky-confidence"   ? runnerOptions.flakyConfidence
+                                                                  : runnerOptions.flakyMargin;
+            char* parsedEnd = nullptr;
+            double parsed = std::strtod(value.c_str(), &parsedEnd);
+            if (value.empty() || *parsedEnd != '\0' || !(parsed >= 0)) {
+                std::cerr << "Invalid value for " << argument << ": " << value << std::endl;
+                ok = false;
+            } else {
+                target = parsed;
+            }
+        } else {
+            std::cerr << "Unknown argument: " << argv[i] << std::endl;
+            ok = false;
+        }
+    }
 
-            std::vector<std::thread> threadPool;
-            std::queue<std::function<void()>> taskQueue;
-            std::mutex queueMutex;
-            std::condition_variable cv;
-            bool done = false;
+    if (runnerOptions.shardCount == 0 || runnerOptions.shardIndex >= runnerOptions.shardCount) {
+        std::cerr << "Shard index " << runnerOptions.shardIndex << " is out of range for " << runnerOptions.shardCount
+                  << " shards" << std::endl;
+        ok = false;
+    }
+    return ok;
+}
 
-            auto worker = [&]() {
-                while (true) {
-                    std::function<void()> task;
-                    {
-                        std::unique_lock<std::mutex> lock(queueMutex);
-                        cv.wait(lock, [&] { return done || !taskQueue.empty(); });
-                        if (done && taskQueue.empty()) {
-                            return;
-                        }
-                        task = std::move(taskQueue.front());
-                        taskQueue.pop();
+void TestRunner::run(bool runConcurrently) {
+    RunCancellation& cancellation = RunCancellation::instance();
+    cancellation.begin(runnerOptions.maxFailures, runnerOptions.timeBudget);
+    prepareResults();
+    bool useTimings = !runnerOptions.timingDatabasePath.empty();
+    if (useTimings) {
+        loadTimingEstimates();
+    } else {
+        estimatedNanos.clear();
+    }
+    selectTests();
+    selectChangedTests();
+
+    stressSettings.threads = runnerOptions.stressThreads
+                                     ? runnerOptions.stressThreads
+                                     : std::max(2u, std::thread::hardware_concurrency());
+    stressSettings.iterations = std::max(1u, runnerOptions.stressIterations);
+    stressSettings.scaling = runnerOptions.stressScaling;
+    StressLog::instance().clear();
+    flakyZ = normalQuantile(runnerOptions.flakyConfidence);
+    if (allocationHooksInstalled.load(std::memory_order_relaxed)) {
+        testArenaBytes = runnerOptions.testArenaBytes;
+    } else if (runnerOptions.trackAllocations || runnerOptions.testArenaBytes > 0) {
+        testArenaBytes = 0;
+        static std::once_flag warned;
+        std::call_once(warned, [] {
+            std::cerr << "Allocation tracking and test arenas need the testframework_allocation_hooks target linked "
+                         "in; they are off" << std::endl;
+        });
+    }
+
+    bool tracing = !runnerOptions.tracePath.empty();
+    if (tracing) {
+        TraceRecorder::instance().begin();
+        nameTraceThread("Runner");
+    }
+
+    CpuPlacement placement = planPlacement(runnerOptions);
+    ActivePlacement::instance().set(placement);
+    abandonableWatchdog().place();
+
+    EventReporter& reporter = EventReporter::instance();
+    reporter.start(runConcurrently && runnerOptions.isolatedProcesses == 0, runnerOptions.quiet,
+                   sessionReporters(runnerOptions));
+
+    if (runnerOptions.isolatedProcesses > 0) {
+        runIsolated();
+    } else if (runConcurrently) {
+        runConcurrent();
+    } else {
+        // A sequential run is one worker: the calling thread.
+        ScopedCpuPin pin(placement.cpuForWorker(0));
+        lastWorkerCpus.push_back(placement.cpuForWorker(0));
+        if (runnerOptions.hardwareCounters) {
+            ThreadCounters::current().beginWorker();
+            runSequential(selectedItems(), 0, 0, -1);
+            lastWorkerCounters.push_back(ThreadCounters::current().endWorker());
+        } else {
+            runSequential(selectedItems(), 0, 0, -1);
+        }
+    }
+
+    RunCancellation::Reason cancelReason = cancellation.end();
+    lastRunCancelled = cancelReason != RunCancellation::Reason::None;
+    size_t notRun = 0;
+    if (lastRunCancelled) {
+        // Whatever never started keeps its initial status; report it like the other tests left out of the run.
+        for (size_t s = 0; s < suites.size(); ++s) {
+            for (size_t t = 0; t < suites[s]->testCases.size(); ++t) {
+                if (!selected[s][t] || suites[s]->testCases[t].disabled) {
+                    continue;
+                }
+                for (size_t item = 0; item < itemCounts[s][t]; ++item) {
+                    TestResult& result = testResults[resultOffsets[s][t] + item];
+                    if (result.status == TestStatus::Skipped) {
+                        result.status = TestStatus::NotSelected;
+                        ++notRun;
                     }
-                    task();
                 }
-            };
+            }
+        }
+    }
+
+    reporter.stop();
+    if (lastRunCancelled) {
+        std::cout << "Run cancelled: "
+                  << (cancelReason == RunCancellation::Reason::MaxFailures
+                              ? "reached --max-failures=" + std::to_string(runnerOptions.maxFailures)
+                      : cancelReason == RunCancellation::Reason::TimeBudget
+                              ? "time budget of " + std::to_string(runnerOptions.timeBudget.count()) + " ms used up"
+                              : std::string("cancel() was called"))
+                  << ", " << notRun << " test repetitions not run\n";
+    }
+    lastStressResults = StressLog::instance().take();
+    summarizeFlakiness();
+
+    if (tracing) {
+        TraceRecorder::instance().end();
+        if (!TraceRecorder::instance().writeChromeTrace(runnerOptions.tracePath)) {
+            std::cerr << "Failed to write trace file " << runnerOptions.tracePath << std::endl;
+        }
+    }
 
-            for (unsigned int i = 0; i < numThreads; ++i) {
-                threadPool.emplace_back(worker);
+    for (size_t worker = 0; worker < lastWorkerCounters.size(); ++worker) {
+        const WorkerCounters& counters = lastWorkerCounters[worker];
+        double cyclesInTests = counters.total.cycles ? 100.0 * static_cast<double>(counters.inTests.cycles)
+                                                               / static_cast<double>(counters.total.cycles) : 0;
+        double instructionsPerCycle = counters.total.cycles ? static_cast<double>(counters.total.instructions)
+                                                                    / static_cast<double>(counters.total.cycles) : 0;
+        std::cout << "Worker " << worker << ": " << counters.testsRun << " tests, " << counters.total.cycles
+                  << " cycles (" << cyclesInTests << "% in tests), " << instructionsPerCycle << " instructions per cycle, "
+                  << counters.total.cacheMisses << " cache misses, " << counters.total.branchMisses
+                  << " branch misses, " << counters.total.contextSwitches << " context switches\n";
+    }
+
+    if (!runnerOptions.quiet && !testAllocations.empty()) {
+        printHeaviestAllocators();
+    }
+
+    if (!runnerOptions.quiet) {
+        for (const FlakinessReport& report : lastFlakiness) {
+            const TestSuite& suite = *suites[report.suiteIndex];
+            std::cout << "Flakiness of " << suite.name << '.' << suite.testCases[report.testIndex].name << ": "
+                      << report.passes << " of " << report.runs << " repetitions passed (" << 100 * report.passRate
+                      << "%, " << 100 * runnerOptions.flakyConfidence << "% interval " << 100 * report.lowerBound
+                      << "% to " << 100 * report.upperBound << "%), " << report.maxRepetitions - report.runs
+                      << " not needed\n";
+        }
+        for (const StressResult& stress : lastStressResults) {
+            const TestSuite& suite = *suites[stress.suiteIndex];
+            const TestCase& testCase = suite.testCases[stress.testIndex];
+            std::cout << "Scaling of " << suite.name << '.' << testCase.name;
+            if (stress.instance >= 0) {
+                std::cout << '/' << stress.instance;
+            }
+            if (testCase.repetitions > 1) {
+                std::cout << " #" << stress.repetition;
+            }
+            std::cout << ":\n";
+            // Speedups are relative to the first point of the curve, the single-threaded one when scaling.
+            double baseline = stress.points.front().callsPerSecond;
+            for (const StressPoint& point : stress.points) {
+                double contendedShare = point.lockAcquisitions ? 100.0 * static_cast<double>(point.contendedAcquisitions)
+                                                                         / static_cast<double>(point.lockAcquisitions) : 0;
+                std::cout << "  " << point.threads << (point.threads == 1 ? " thread: " : " threads: ")
+                          << point.callsPerSecond << " calls/s";
+                if (stress.points.size() > 1 && baseline > 0) {
+                    std::cout << " (speedup " << point.callsPerSecond / baseline << ")";
+                }
+                std::cout << ", " << point.lockAcquisitions << " lock acquisitions, " << contendedShare
+                          << "% contended, " << point.lockWaitNanos / 1000000.0 << " ms waiting\n";
             }
+        }
+    }
 
-            for (auto& testCase : suite->testCases) {
-                if (testCase.disabled) {
-                    std::lock_guard<std::mutex> lock(coutMutex);
-                    std::cout << "Skipping Disabled Test Case: " << testCase.name << std::endl;
-                    continue;
+    if (!runnerOptions.resultFilePath.empty()) {
+        writeResultFile();
+    }
+
+    if (!runnerOptions.benchmarkOutputPath.empty() || !runnerOptions.baselinePath.empty()) {
+        std::vector<BenchmarkResult> statistics = testTimingStatistics();
+        if (!runnerOptions.benchmarkOutputPath.empty()) {
+            writeBenchmarkFile(statistics);
+        }
+        checkBaseline(statistics);
+    } else {
+        lastRegressions.clear();
+    }
+
+    if (!runnerOptions.selectionCachePath.empty()) {
+        saveSelectionCache();
+    }
+    if (useTimings) {
+        saveTimingDatabase();
+        if (runConcurrently && runnerOptions.isolatedProcesses == 0) {
+            std::cout << "Schedule: " << lastSchedule.workers << " workers, estimated makespan "
+                      << lastSchedule.estimatedMakespanNanos / 1000000.0 << " ms, achieved "
+                      << lastSchedule.achievedMakespanNanos / 1000000.0 << " ms (" << lastSchedule.knownTests
+                      << " tests with recorded durations, " << lastSchedule.unknownTests << " estimated)\n";
+        }
+    }
+}
+
+void TestRunner::printHeaviestAllocators() const {
+    // Summed over the repetitions and instances of each test.
+    std::map<std::pair<uint32_t, uint32_t>, AllocationStats> perTest;
+    for (size_t i = 0; i < testResults.size(); ++i) {
+        const TestResult& result = testResults[i];
+        if (result.status == TestStatus::NotSelected || result.status == TestStatus::Skipped) {
+            continue;
+        }
+        const AllocationStats& stats = testAllocations[i];
+        AllocationStats& total = perTest[{result.suiteIndex, result.testIndex}];
+        total.allocations += stats.allocations;
+        total.bytes += stats.bytes;
+        total.bodyAllocations += stats.bodyAllocations;
+        total.bodyBytes += stats.bodyBytes;
+        total.peakLiveBytes = std::max(total.peakLiveBytes, stats.peakLiveBytes);
+        total.leakedBytes += stats.leakedBytes;
+        total.arenaBytes += stats.arenaBytes;
+    }
+    std::vector<std::pair<std::pair<uint32_t, uint32_t>, AllocationStats>> heaviest(perTest.begin(), perTest.end());
+    std::stable_sort(heaviest.begin(), heaviest.end(),
+                     [](const auto& a, const auto& b) { return a.second.bytes > b.second.bytes; });
+    heaviest.resize(std::min<size_t>(heaviest.size(), kHeaviestAllocatorsShown));
+    for (const auto& [key, stats] : heaviest) {
+        const TestSuite& suite = *suites[key.first];
+        std::cout << "Allocations of " << suite.name << '.' << suite.testCases[key.second].name << ": "
+                  << stats.allocations << " allocations of " << stats.bytes << " bytes (" << stats.bodyAllocations
+                  << " of " << stats.bodyBytes << " bytes in the body), peak " << stats.peakLiveBytes
+                  << " bytes live, " << stats.leakedBytes << " bytes leaked";
+        if (testArenaBytes > 0) {
+            std::cout << ", " << stats.arenaBytes << " bytes from the arena";
+        }
+        std::cout << "\n";
+    }
+}
+
+void TestRunner::cancel() {
+    RunCancellation::instance().cancel(RunCancellation::Reason::Requested);
+}
+
+void TestRunner::runSequential(const std::vector<WorkRef>& items, size_t begin, size_t beginItem, int isolationFd) {
+    EventReporter& reporter = EventReporter::instance();
+    TimeoutWatchdog watchdog;
+    // Created for the first async test; in a sequential run it waits on this thread, one test at a time.
+    std::unique_ptr<AsyncLoop> asyncLoop;
+
+    const size_t noSuite = static_cast<size_t>(-1);
+    size_t openSuite = noSuite;
+    auto closeSuite = [&]() {
+        if (openSuite == noSuite) {
+            return;
+        }
+        TestSuite& suite = *suites[openSuite];
+        if (suite.fixture) {
+            TraceScope hook("fixture", "AfterAll", &suite);
+            suite.fixture->AfterAll();
+        }
+        reporter.emit(makeSuiteEvent(TestEventType::SuiteFinish, suite));
+        openSuite = noSuite;
+    };
+
+    RunCancellation& cancellation = RunCancellation::instance();
+    for (size_t position = begin; position < items.size() && !cancellation.requested(); ++position) {
+        size_t s = items[position].suiteIndex;
+        size_t t = items[position].testIndex;
+        TestSuite& suite = *suites[s];
+        if (s != openSuite) {
+            closeSuite();
+            openSuite = s;
+            reporter.emit(makeSuiteEvent(TestEventType::SuiteStart, suite));
+            if (suite.fixture) {
+                TraceScope hook("fixture", "BeforeAll", &suite);
+                suite.fixture->BeforeAll();
+            }
+        }
+
+        const TestCase& testCase = suite.testCases[t];
+        if (testCase.disabled) {
+            reporter.emit(makeTestEvent(TestEventType::TestSkipped, suite, testCase, 1, false));
+            continue;
+        }
+
+        bool showRepetition = testCase.repetitions > 1;
+        size_t firstItem = position == begin ? beginItem : 0;
+        FlakyTally* tally = testCase.isNondeterministic ? flakyTallyFor(s, t) : nullptr;
+        for (size_t item = firstItem; item < itemCounts[s][t]; ++item) {
+            if ((tally && tally->decided.load(std::memory_order_relaxed)) || cancellation.requested()) {
+                break;
+            }
+            ItemPosition at = decodeItem(item, testCase);
+            size_t resultIndex = resultOffsets[s][t] + item;
+            if (testCase.asyncFunction) {
+                if (!asyncLoop) {
+                    asyncLoop = std::make_unique<AsyncLoop>();
+                }
+                if (isolationFd >= 0) {
+                    sendIsolationRecord(isolationFd, IsolationRecord::Started, position, resultIndex,
+                                        testResults[resultIndex], nullptr);
                 }
+                AsyncTestState& test = asyncLoop->create(suite, testCase, at.repetition, at.instance, showRepetition,
+                                                         testResults[resultIndex]);
+                test.fixture = suite.fixture.get();
+                asyncLoop->start(test);
+                asyncLoop->runUntilComplete(test);
+                if (isolationFd >= 0) {
+                    sendIsolationRecord(isolationFd, IsolationRecord::Finished, position, resultIndex,
+                                        testResults[resultIndex], nullptr);
+                }
+                continue;
+            }
+            if (isolationFd < 0) {
+                runTestCase(suite, suite.fixture.get(), testCase, at.repetition, at.instance, showRepetition,
+                            testResults[resultIndex], countersFor(resultIndex), allocationsFor(resultIndex), watchdog,
+                            nullptr);
+                if (tally) {
+                    tallyRepetition(*tally, testResults[resultIndex].status);
+                }
+                continue;
+            }
 
-                auto runTest = [&, testCase](int rep) {
-                    if (suite->fixture) {
-                        suite->fixture->BeforeEach();
-                    }
+            // Inside an isolated worker a timed-out test is killed along with its process; the parent re-forks and
+            // continues after it.
+            sendIsolationRecord(isolationFd, IsolationRecord::Started, position, resultIndex, testResults[resultIndex],
+                                nullptr);
+            std::function<void()> killProcess = [&, position, resultIndex] {
+                sendIsolationRecord(isolationFd, IsolationRecord::Finished, position, resultIndex,
+                                    testResults[resultIndex], nullptr);
+                _exit(kIsolationTimeoutExitCode);
+            };
+            runTestCase(suite, suite.fixture.get(), testCase, at.repetition, at.instance, showRepetition,
+                        testResults[resultIndex], countersFor(resultIndex), allocationsFor(resultIndex), watchdog,
+                        &killProcess);
+            sendIsolationRecord(isolationFd, IsolationRecord::Finished, position, resultIndex, testResults[resultIndex],
+                                countersFor(resultIndex), allocationsFor(resultIndex));
+            if (tally) {
+                tallyRepetition(*tally, testResults[resultIndex].status);
+            }
+        }
+    }
+    closeSuite();
+}
 
-                    {
-                        std::lock_guard<std::mutex> lock(coutMutex);
-                        std::cout << "Running Test Case: " << testCase.name;
-                        if (testCase.repetitions > 1) {
-                            std::cout << " (Repetition " << rep << ")";
-                        }
-                        std::cout << std::endl;
-                    }
+void TestRunner::runIsolated() {
+    EventReporter& reporter = EventReporter::instance();
 
-                    bool exceptionCaught = false;
-                    bool exceptionExpected = !testCase.expectedExceptionTypeName.empty();
-                    bool testPassed = true;
-
-                    auto executeTest = [&]() {
-                        try {
-                            testCase.function(suite->fixture.get(), rep);
-                        } catch (const std::exception& e) {
-                            exceptionCaught = true;
-                            if (!exceptionExpected) {
-                                std::lock_guard<std::mutex> lock(coutMutex);
-                                std::cout << "Unexpected exception thrown in test '" << testCase.name << "': " << e.what() << std::endl;
-                                testPassed = false;
-                            } else if (std::string(typeid(e).name()) != testCase.expectedExceptionTypeName) {
-                                std::lock_guard<std::mutex> lock(coutMutex);
-                                std::cout << "Unexpected exception type in test '" << testCase.name << "': " << e.what() << std::endl;
-                                testPassed = false;
-                            }
-                        } catch (...) {
-                            exceptionCaught = true;
-                            if (!exceptionExpected) {
-                                std::lock_guard<std::mutex> lock(coutMutex);
-                                std::cout << "Unexpected unknown exception thrown in test '" << testCase.name << "'" << std::endl;
-                                testPassed = false;
-                            }
-                        }
-                    };
-
-                    if (testCase.timeout.count() > 0) {
-                        std::future<void> future = std::async(std::launch::async, executeTest);
-                        if (future.wait_for(testCase.timeout) == std::future_status::timeout) {
-                            std::lock_guard<std::mutex> lock(coutMutex);
-                            std::cout << "Test '" << testCase.name << "' timed out after " << testCase.timeout.count() << " ms" << std::endl;
-                            testPassed = false;
-                        } else {
-                            future.get();
-                        }
-                    } else {
-                        executeTest();
-                    }
+#if TESTFRAMEWORK_HAS_FORK
+    // Disabled tests never reach a worker process; they are reported here.
+    size_t numShards = runnerOptions.isolatedProcesses;
+    std::vector<std::vector<WorkRef>> shards(numShards);
+    for (size_t s = 0; s < suites.size(); ++s) {
+        std::vector<WorkRef> enabled;
+        for (size_t t = 0; t < suites[s]->testCases.size(); ++t) {
+            if (!selected[s][t]) {
+                continue;
+            }
+            if (suites[s]->testCases[t].disabled) {
+                reporter.emit(makeTestEvent(TestEventType::TestSkipped, *suites[s], suites[s]->testCases[t], 1, false));
+            } else {
+                enabled.push_back({static_cast<uint32_t>(s), static_cast<uint32_t>(t)});
+            }
+        }
+        // Each shard receives a contiguous slice of the suite, so a suite's fixture is set up once per process.
+        size_t sliceSize = (enabled.size() + numShards - 1) / numShards;
+        for (size_t i = 0; i < enabled.size(); ++i) {
+            shards[i / sliceSize].push_back(enabled[i]);
+        }
+    }
 
-                    if (exceptionExpected && !exceptionCaught) {
-                        std::lock_guard<std::mutex> lock(coutMutex);
-                        std::cout << "Expected exception of type '" << testCase.expectedExceptionTypeName << "' was not thrown in test '" << testCase.name << "'" << std::endl;
-                        testPassed = false;
-                    }
+    struct ShardProcess {
+        std::vector<WorkRef> items;
+        // Where the next worker process starts: a position in items and a work item within that test.
+        size_t next = 0;
+        size_t nextItem = 0;
+        pid_t pid = -1;
+        int fd = -1;
+        std::string pending;
+        bool testRunning = false;
+        size_t runningPosition = 0;
+        size_t runningResult = 0;
+        size_t lastPosition = 0;
+        size_t lastResult = 0;
+        bool madeProgress = false;
+    };
 
-                    if (suite->fixture) {
-                        suite->fixture->AfterEach();
-                    }
-                };
+    std::vector<ShardProcess> processes(numShards);
+    for (size_t i = 0; i < numShards; ++i) {
+        processes[i].items = std::move(shards[i]);
+    }
+    // Set once the run is cancelled and the worker processes have been killed.
+    bool stopping = false;
 
-                if (testCase.isNondeterministic || testCase.repetitions > 1) {
-                    for (int rep = 1; rep <= testCase.repetitions; ++rep) {
-                        {
-                            std::lock_guard<std::mutex> lock(queueMutex);
-                            taskQueue.push([=] { runTest(rep); });
-                        }
-                        cv.notify_one();
-                    }
-                } else {
-                    {
-                        std::lock_guard<std::mutex> lock(queueMutex);
-                        taskQueue.push([=] { runTest(1); });
-                    }
-                    cv.notify_one();
+    auto spawn = [&](ShardProcess& process) {
+        int fds[2];
+        if (pipe(fds) != 0) {
+            std::cerr << "Failed to create a pipe for an isolated worker process" << std::endl;
+            process.next = process.items.size();
+            return;
+        }
+        std::cout.flush();
+        pid_t pid = fork();
+        if (pid == 0) {
+            close(fds[0]);
+            EventReporter::instance().muteReporters();
+            // The counters inherited from the parent keep counting the parent's thread.
+            ThreadCounters::current().reset();
+            // Whatever the tests print must reach the terminal before a crash can discard the stream buffer.
+            std::cout << std::unitbuf;
+            runSequential(process.items, process.next, process.nextItem, fds[1]);
+            std::cout.flush();
+            close(fds[1]);
+            _exit(0);
+        }
+        close(fds[1]);
+        if (pid < 0) {
+            close(fds[0]);
+            std::cerr << "Failed to fork an isolated worker process" << std::endl;
+            process.next = process.items.size();
+            return;
+        }
+        process.pid = pid;
+        process.fd = fds[0];
+        process.pending.clear();
+        process.testRunning = false;
+        process.madeProgress = false;
+    };
+
+    auto handleRecord = [&](ShardProcess& process, const IsolationRecord& record) {
+        process.lastPosition = record.position;
+        process.lastResult = record.resultIndex;
+        process.madeProgress = true;
+        if (record.type == IsolationRecord::Started) {
+            process.testRunning = true;
+            process.runningPosition = record.position;
+            process.runningResult = record.resultIndex;
+            return;
+        }
+        process.testRunning = false;
+        TestResult& result = testResults[record.resultIndex];
+        result.status = static_cast<TestStatus>(record.status);
+        result.assertionFailures = record.assertionFailures;
+        result.wallNanos = record.wallNanos;
+        result.cpuNanos = record.cpuNanos;
+        if (!testCounters.empty()) {
+            testCounters[record.resultIndex] = record.counters;
+        }
+        if (!testAllocations.empty()) {
+            testAllocations[record.resultIndex] = record.allocations;
+        }
+        TestEvent finish = makeTestEvent(TestEventType::TestFinish, *suites[result.suiteIndex],
+                                         suites[result.suiteIndex]->testCases[result.testIndex], result.repetition,
+                                         false, result.instance);
+        finish.status = result.status;
+        finish.durationNanos = result.wallNanos;
+        reporter.emit(std::move(finish));
+    };
+
+    // Called once a worker's pipe is closed: decides whether it finished its shard or has to be re-forked.
+    auto reap = [&](ShardProcess& process) {
+        int status = 0;
+        waitpid(process.pid, &status, 0);
+        close(process.fd);
+        process.fd = -1;
+        process.pid = -1;
+        if (stopping || (WIFEXITED(status) && WEXITSTATUS(status) == 0)) {
+            process.next = process.items.size();
+            return;
+        }
+
+        std::string reason = WIFSIGNALED(status) ? "signal " + std::to_string(WTERMSIG(status))
+                                                 : "exit code " + std::to_string(WEXITSTATUS(status));
+        auto markCrashed = [&](size_t resultIndex) {
+            TestResult& result = testResults[resultIndex];
+            const TestSuite& suite = *suites[result.suiteIndex];
+            const TestCase& testCase = suite.testCases[result.testIndex];
+            result.status = TestStatus::Failed;
+            bool showRepetition = testCase.repetitions > 1;
+            TestEvent failure = makeTestEvent(TestEventType::TestFailure, suite, testCase, result.repetition,
+                                              showRepetition, result.instance);
+            failure.message = "Test '" + std::string(testCase.name) + "' crashed its worker process (" + reason + ")";
+            reporter.emit(std::move(failure));
+            TestEvent finish = makeTestEvent(TestEventType::TestFinish, suite, testCase, result.repetition,
+                                             showRepetition, result.instance);
+            finish.status = TestStatus::Failed;
+            reporter.emit(std::move(finish));
+        };
+
+        // Continues with the work item after the given one, which may be in the same family or repeated test.
+        auto resumeAfter = [&](size_t position, size_t resultIndex) {
+            const WorkRef& ref = process.items[position];
+            size_t item = resultIndex - resultOffsets[ref.suiteIndex][ref.testIndex] + 1;
+            bool testDone = item >= itemCounts[ref.suiteIndex][ref.testIndex];
+            process.next = testDone ? position + 1 : position;
+            process.nextItem = testDone ? 0 : item;
+        };
+
+        if (process.testRunning) {
+            markCrashed(process.runningResult);
+            resumeAfter(process.runningPosition, process.runningResult);
+            return;
+        }
+        if (process.madeProgress) {
+            resumeAfter(process.lastPosition, process.lastResult);
+        }
+        bool timedOut = process.madeProgress && WIFEXITED(status) && WEXITSTATUS(status) == kIsolationTimeoutExitCode;
+        if (!timedOut && process.next < process.items.size()) {
+            // The process died outside a test body (for example in a fixture hook). Give up on the rest of the
+            // next test so the re-forked worker always makes progress.
+            const WorkRef& ref = process.items[process.next];
+            size_t first = resultOffsets[ref.suiteIndex][ref.testIndex];
+            for (size_t item = process.nextItem; item < itemCounts[ref.suiteIndex][ref.testIndex]; ++item) {
+                markCrashed(first + item);
+            }
+            process.next += 1;
+            process.nextItem = 0;
+        }
+    };
+
+    for (auto& process : processes) {
+        if (!process.items.empty()) {
+            spawn(process);
+        }
+    }
+
+    while (true) {
+        std::vector<pollfd> pollFds;
+        std::vector<ShardProcess*> polled;
+        for (auto& process : processes) {
+            if (process.fd >= 0) {
+                pollFds.push_back({process.fd, POLLIN, 0});
+                polled.push_back(&process);
+            }
+        }
+        if (pollFds.empty()) {
+            break;
+        }
+        RunCancellation& cancellation = RunCancellation::instance();
+        if (!stopping && cancellation.requested()) {
+            // Each process only counts its own failures, so the runner stops them all; the test a process was
+            // running when it was killed is reported as not run.
+            stopping = true;
+            for (auto& process : processes) {
+                if (process.pid > 0) {
+                    kill(process.pid, SIGKILL);
+                }
+            }
+        }
+        if (poll(pollFds.data(), pollFds.size(), stopping ? -1 : cancellation.millisecondsLeft()) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+        for (size_t i = 0; i < pollFds.size(); ++i) {
+            if (!(pollFds[i].revents & (POLLIN | POLLHUP | POLLERR))) {
+                continue;
+            }
+            ShardProcess& process = *polled[i];
+            char buffer[4096];
+            ssize_t bytes = read(process.fd, buffer, sizeof(buffer));
+            if (bytes > 0) {
+                process.pending.append(buffer, static_cast<size_t>(bytes));
+                size_t offset = 0;
+                while (process.pending.size() - offset >= sizeof(IsolationRecord)) {
+                    IsolationRecord record;
+                    std::memcpy(&record, process.pending.data() + offset, sizeof(record));
+                    handleRecord(process, record);
+                    offset += sizeof(IsolationRecord);
+                }
+                process.pending.erase(0, offset);
+                continue;
+            }
+            if (bytes < 0 && errno == EINTR) {
+                continue;
+            }
+            reap(process);
+            if (process.next < process.items.size()) {
+                spawn(process);
+            }
+        }
+    }
+#else
+    std::cerr << "Process isolation is not supported on this platform; running tests in-process." << std::endl;
+    runSequential(selectedItems(), 0, 0, -1);
+#endif
+}
+
+void TestRunner::runConcurrent() {
+    CpuPlacement placement = ActivePlacement::instance().current();
+    unsigned int numThreads = runnerOptions.workerThreads;
+    if (numThreads == 0) {
+        // One worker per CPU the workers may use; without a placement, every CPU in the affinity mask.
+        size_t cpus = runnerOptions.pinning == CpuPinning::List ? placement.workerCpus.size()
+                      : placement.active()                      ? placement.freeCpus.size()
+                                                                : availableCpuCount();
+        numThreads = static_cast<unsigned int>(cpus);
+    }
+    if (numThreads == 0) {
+        numThreads = std::thread::hardware_concurrency();
+    }
+    if (numThreads == 0) {
+        numThreads = 2;
+    }
+    for (unsigned int worker = 0; worker < numThreads; ++worker) {
+        lastWorkerCpus.push_back(placement.cpuForWorker(worker));
+    }
+
+    EventReporter& reporter = EventReporter::instance();
+    std::vector<std::unique_ptr<SuiteRun>> suiteRuns;
+    for (size_t s = 0; s < suites.size(); ++s) {
+        auto suiteRun = std::make_unique<SuiteRun>();
+        suiteRun->suite = suites[s].get();
+        suiteRun->suiteIndex = s;
+        suiteRuns.push_back(std::move(suiteRun));
+    }
+
+    // With recorded durations the most expensive work is dispatched first (longest processing time first), so a
+    // long test does not start last and run alone at the end. Without them registration order is kept.
+    std::vector<std::vector<size_t>> dispatchOrder(suites.size());
+    std::vector<SuiteRun*> suiteOrder;
+    for (size_t s = 0; s < suites.size(); ++s) {
+        dispatchOrder[s].resize(suites[s]->testCases.size());
+        for (size_t t = 0; t < dispatchOrder[s].size(); ++t) {
+            dispatchOrder[s][t] = t;
+        }
+        if (std::find(selected[s].begin(), selected[s].end(), true) != selected[s].end()) {
+            suiteOrder.push_back(suiteRuns[s].get());
+        }
+    }
+    if (!estimatedNanos.empty()) {
+        auto testCost = [&](size_t s, size_t t) {
+            const TestCase& testCase = suites[s]->testCases[t];
+            return testCase.disabled || !selected[s][t] ? 0 : estimatedNanos[s][t] * itemCounts[s][t];
+        };
+        std::vector<uint64_t> suiteCost(suites.size(), 0);
+        for (size_t s = 0; s < suites.size(); ++s) {
+            std::stable_sort(dispatchOrder[s].begin(), dispatchOrder[s].end(),
+                             [&](size_t a, size_t b) { return testCost(s, a) > testCost(s, b); });
+            for (size_t t : dispatchOrder[s]) {
+                suiteCost[s] += testCost(s, t);
+            }
+        }
+        std::stable_sort(suiteOrder.begin(), suiteOrder.end(), [&](const SuiteRun* a, const SuiteRun* b) {
+            return suiteCost[a->suiteIndex] > suiteCost[b->suiteIndex];
+        });
+
+        // Suites overlap on the pool, so the estimate is the longest-first schedule over every repetition.
+        std::vector<uint64_t> durations;
+        for (size_t s = 0; s < suites.size(); ++s) {
+            for (size_t t = 0; t < suites[s]->testCases.size(); ++t) {
+                const TestCase& testCase = suites[s]->testCases[t];
+                if (selected[s][t] && !testCase.disabled) {
+                    durations.insert(durations.end(), itemCounts[s][t],
+                                     estimatedNanos[s][t]);
                 }
             }
+        }
+        std::sort(durations.begin(), durations.end(), std::greater<uint64_t>());
+        lastSchedule.workers = numThreads;
+        lastSchedule.estimatedMakespanNanos = listScheduleMakespan(durations, numThreads);
+    }
+
+    std::mutex doneMutex;
+    std::condition_variable doneCv;
+    size_t remainingSuites = suiteOrder.size();
+
+    auto finishSuite = [&](SuiteRun& suiteRun) {
+        // Every item of the suite is done, so no worker still uses its clone.
+        suiteRun.workerFixtures.clear();
+        if (suiteRun.suite->fixture) {
+            TraceScope hook("fixture", "AfterAll", suiteRun.suite);
+            suiteRun.suite->fixture->AfterAll();
+        }
+        reporter.emit(makeSuiteEvent(TestEventType::SuiteFinish, *suiteRun.suite));
+        std::lock_guard<std::mutex> lock(doneMutex);
+        if (--remainingSuites == 0) {
+            doneCv.notify_all();
+        }
+    };
+
+    // A suite starts by running BeforeAll and then publishing all of its work items as one range, so BeforeAll of
+    // one suite overlaps with the tests of another.
+    auto startSuite = [&](SuiteRun& suiteRun, WorkStealingScheduler& scheduler) {
+        TestSuite& suite = *suiteRun.suite;
+        if (RunCancellation::instance().requested()) {
+            // Nothing of a suite that would only start after the run was cancelled runs, not even BeforeAll.
+            std::lock_guard<std::mutex> lock(doneMutex);
+            if (--remainingSuites == 0) {
+                doneCv.notify_all();
+            }
+            return;
+        }
+        reporter.emit(makeSuiteEvent(TestEventType::SuiteStart, suite));
 
+        if (suite.fixture) {
             {
-                std::unique_lock<std::mutex> lock(queueMutex);
-                done = true;
+                TraceScope hook("fixture", "BeforeAll", &suite);
+                suite.fixture->BeforeAll();
+            }
+            if (suite.perWorkerFixtures && suite.cloneFixture) {
+                suiteRun.workerFixtures.resize(scheduler.workerCount());
             }
-            cv.notify_all();
+        }
 
-            for (auto& thread : threadPool) {
-                thread.join();
+        suiteRun.segments.reserve(suite.testCases.size());
+        for (size_t i : dispatchOrder[suiteRun.suiteIndex]) {
+            if (!selected[suiteRun.suiteIndex][i]) {
+                continue;
             }
-        } else {
-            for (auto& testCase : suite->testCases) {
-                if (testCase.disabled) {
-                    std::cout << "Skipping Disabled Test Case: " << testCase.name << std::endl;
-                    continue;
-                }
+            const TestCase& testCase = suite.testCases[i];
+            if (testCase.disabled) {
+                reporter.emit(makeTestEvent(TestEventType::TestSkipped, suite, testCase, 1, false));
+                continue;
+            }
+            size_t items = itemCounts[suiteRun.suiteIndex][i];
+            if (items == 0) {
+                continue;
+            }
+            suiteRun.segments.push_back({i, suiteRun.itemCount, items, resultOffsets[suiteRun.suiteIndex][i]});
+            suiteRun.itemCount += items;
+        }
 
-                int repetitions = testCase.repetitions < 1 ? 1 : testCase.repetitions;
-                for (int rep = 1; rep <= repetitions; ++rep) {
-                    if (suite->fixture) {
-                        suite->fixture->BeforeEach();
-                    }
+        if (suiteRun.itemCount == 0) {
+            finishSuite(suiteRun);
+            return;
+        }
+        suiteRun.remainingItems = suiteRun.itemCount;
+        Task range;
+        range.kind = Task::Kind::RunRange;
+        range.suiteRun = &suiteRun;
+        range.begin = 0;
+        range.end = suiteRun.itemCount;
+        scheduler.submit(range);
+    };
 
-                    std::cout << "Running Test Case: " << testCase.name;
-                    if (repetitions > 1) {
-                        std::cout << " (Repetition " << rep << ")";
-                    }
-                    std::cout << std::endl;
-
-                    bool exceptionCaught = false;
-                    bool exceptionExpected = !testCase.expectedExceptionTypeName.empty();
-                    bool testPassed = true;
-
-                    auto executeTest = [&]() {
-                        try {
-                            testCase.function(suite->fixture.get(), rep);
-                        } catch (const std::exception& e) {
-                            exceptionCaught = true;
-                            if (!exceptionExpected) {
-                                std::cout << "Unexpected exception thrown in test '" << testCase.name << "': " << e.what() << std::endl;
-                                testPassed = false;
-                            } else if (std::string(typeid(e).name()) != testCase.expectedExceptionTypeName) {
-                                std::cout << "Unexpected exception type in test '" << testCase.name << "': " << e.what() << std::endl;
-                                testPassed = false;
-                            }
-                        } catch (...) {
-                            exceptionCaught = true;
-                            if (!exceptionExpected) {
-                                std::cout << "Unexpected unknown exception thrown in test '" << testCase.name << "'" << std::endl;
-                                testPassed = false;
-                            }
-                        }
-                    };
+    // An abandoned thread disarms its entry whenever its body returns, possibly after this run has ended.
+    TimeoutWatchdog& watchdog = abandonableWatchdog();
+    WorkStealingScheduler* schedulerPtr = nullptr;
+    AsyncLoop* asyncLoopPtr = nullptr;
+    bool hasAsyncTests = false;
+    for (size_t s = 0; s < suites.size() && !hasAsyncTests; ++s) {
+        for (size_t t = 0; t < suites[s]->testCases.size(); ++t) {
+            if (selected[s][t] && suites[s]->testCases[t].asyncFunction) {
+                hasAsyncTests = true;
+                break;
+            }
+        }
+    }
 
-                    if (testCase.timeout.count() > 0) {
-                        std::future<void> future = std::async(std::launch::async, executeTest);
-                        if (future.wait_for(testCase.timeout) == std::future_status::timeout) {
-                            std::cout << "Test '" << testCase.name << "' timed out after " << testCase.timeout.count() << " ms" << std::endl;
-                            testPassed = false;
-                        } else {
-                            future.get();
-                        }
-                    } else {
-                        executeTest();
-                    }
+    // Called on the watchdog thread when a timed test overruns on a worker: the stuck worker is replaced, the rest
+    // of its chunk is handed back to the pool, and the timed-out item counts as done for the suite. Async tests the
+    // chunk started count themselves when they complete.
+    auto abandonChunk = [&](SuiteRun& suiteRun, size_t worker, size_t begin, size_t item, size_t end,
+                            size_t asyncStarted) {
+        // The stuck thread keeps its fixture clone; the replacement worker creates a fresh one.
+        if (!suiteRun.workerFixtures.empty() && suiteRun.workerFixtures[worker]) {
+            parkAbandonedFixture(std::move(suiteRun.workerFixtures[worker]));
+        }
+        schedulerPtr->replaceWorker(worker);
+        if (item + 1 < end) {
+            Task rest;
+            rest.kind = Task::Kind::RunRange;
+            rest.suiteRun = &suiteRun;
+            rest.begin = item + 1;
+            rest.end = end;
+            schedulerPtr->submit(rest);
+        }
+        size_t done = item + 1 - begin - asyncStarted;
+        if (suiteRun.remainingItems.fetch_sub(done) == done) {
+            // AfterAll must not run on the watchdog thread, so the suite is finished by a worker instead.
+            Task finish;
+            finish.kind = Task::Kind::FinishSuite;
+            finish.suiteRun = &suiteRun;
+            schedulerPtr->submit(finish);
+        }
+    };
 
-                    if (exceptionExpected && !exceptionCaught) {
-                        std::cout << "Expected exception of type '" << testCase.expectedExceptionTypeName << "' was not thrown in test '" << testCase.name << "'" << std::endl;
-                        testPassed = false;
-                    }
+    auto runRange = [&](SuiteRun& suiteRun, size_t begin, size_t end) {
+        TestSuite& suite = *suiteRun.suite;
+        auto segment = std::upper_bound(suiteRun.segments.begin(), suiteRun.segments.end(), begin,
+                                        [](size_t item, const SuiteRun::Segment& s) { return item < s.firstItem; }) - 1;
 
-                    if (suite->fixture) {
-                        suite->fixture->AfterEach();
+        auto chunkStart = std::chrono::steady_clock::now();
+        size_t asyncStarted = 0;
+        RunCancellation& cancellation = RunCancellation::instance();
+        for (size_t item = begin; item < end; ++item) {
+            if (cancellation.requested()) {
+                // Drained without running; the rest of the range counts as done, so the suite still finishes.
+                break;
+            }
+            while (item >= segment->firstItem + segment->itemCount) {
+                ++segment;
+            }
+            const TestCase& testCase = suite.testCases[segment->testIndex];
+            FlakyTally* tally = testCase.isNondeterministic ? flakyTallyFor(suiteRun.suiteIndex, segment->testIndex)
+                                                            : nullptr;
+            if (tally && tally->decided.load(std::memory_order_relaxed)) {
+                // Left as it is; the run reports it as not selected once every worker is done.
+                continue;
+            }
+            ItemPosition at = decodeItem(item - segment->firstItem, testCase);
+            bool showRepetition = testCase.repetitions > 1;
+            size_t resultIndex = segment->firstResult + (item - segment->firstItem);
+            TestResult& result = testResults[resultIndex];
+            size_t worker = static_cast<size_t>(WorkStealingScheduler::currentWorkerIndex());
+            if (testCase.asyncFunction) {
+                // The test gives the worker back at its first co_await and counts itself done when it completes.
+                AsyncTestState& test = asyncLoopPtr->create(suite, testCase, at.repetition, at.instance,
+                                                            showRepetition, result);
+                if (suiteRun.workerFixtures.empty()) {
+                    test.fixture = suite.fixture.get();
+                } else {
+                    test.ownFixture = suite.cloneFixture(*suite.fixture);
+                    test.fixture = test.ownFixture.get();
+                }
+                SuiteRun* run = &suiteRun;
+                test.onComplete = [&finishSuite, run] {
+                    if (run->remainingItems.fetch_sub(1) == 1) {
+                        finishSuite(*run);
                     }
+                };
+                ++asyncStarted;
+                asyncLoopPtr->start(test);
+                continue;
+            }
+            if (testCase.timeout.count() > 0) {
+                std::function<void()> onAbandon = [&, worker, item, asyncStarted] {
+                    abandonChunk(suiteRun, worker, begin, item, end, asyncStarted);
+                };
+                if (runTestCase(suite, suiteRun.fixtureFor(worker), testCase, at.repetition, at.instance,
+                                showRepetition, result, countersFor(resultIndex), allocationsFor(resultIndex),
+                                watchdog, &onAbandon)
+                    == TestOutcome::Abandoned) {
+                    // Everything this chunk referred to may be gone by now; leave without touching it.
+                    return;
                 }
+            } else {
+                runTestCase(suite, suiteRun.fixtureFor(worker), testCase, at.repetition, at.instance, showRepetition,
+                            result, countersFor(resultIndex), allocationsFor(resultIndex), watchdog, nullptr);
             }
+            if (tally) {
+                tallyRepetition(*tally, result.status);
+            }
+        }
+        auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - chunkStart);
+        suiteRun.measuredNanos.fetch_add(static_cast<uint64_t>(elapsed.count()), std::memory_order_relaxed);
+        suiteRun.measuredItems.fetch_add(end - begin, std::memory_order_relaxed);
+
+        size_t done = end - begin - asyncStarted;
+        if (done > 0 && suiteRun.remainingItems.fetch_sub(done) == done) {
+            finishSuite(suiteRun);
+        }
+    };
+
+    {
+        // Each worker slot sums the threads that served it; a thread abandoned by a timeout never reports back.
+        WorkStealingScheduler::WorkerHook beginWorker;
+        WorkStealingScheduler::WorkerHook endWorker;
+        if (runnerOptions.hardwareCounters) {
+            lastWorkerCounters.assign(numThreads, WorkerCounters{});
+            beginWorker = [](size_t) { ThreadCounters::current().beginWorker(); };
+            endWorker = [this](size_t worker) {
+                WorkerCounters counters = ThreadCounters::current().endWorker();
+                addCounters(lastWorkerCounters[worker].total, counters.total);
+                addCounters(lastWorkerCounters[worker].inTests, counters.inTests);
+                lastWorkerCounters[worker].testsRun += counters.testsRun;
+            };
+        }
+
+        WorkStealingScheduler scheduler(numThreads, [&](const Task& task) {
+            switch (task.kind) {
+                case Task::Kind::StartSuite:
+                    startSuite(*task.suiteRun, *schedulerPtr);
+                    break;
+                case Task::Kind::RunRange:
+                    runRange(*task.suiteRun, task.begin, task.end);
+                    break;
+                case Task::Kind::ResumeAsync:
+                    asyncLoopPtr->resume(*task.asyncTest);
+                    break;
+                case Task::Kind::FinishSuite:
+                    finishSuite(*task.suiteRun);
+                    break;
+            }
+        }, beginWorker, endWorker);
+        schedulerPtr = &scheduler;
+
+        // Declared after the scheduler so its poller stops before the workers are joined.
+        std::unique_ptr<AsyncLoop> asyncLoop;
+        if (hasAsyncTests) {
+            asyncLoop = std::make_unique<AsyncLoop>([&](AsyncTestState& test) {
+                Task resume;
+                resume.kind = Task::Kind::ResumeAsync;
+                resume.asyncTest = &test;
+                schedulerPtr->submit(resume);
+            });
+            asyncLoopPtr = asyncLoop.get();
         }
 
-        if (suite->fixture) {
-            suite->fixture->AfterAll();
+        auto runStart = std::chrono::steady_clock::now();
+        for (SuiteRun* suiteRun : suiteOrder) {
+            Task start;
+            start.kind = Task::Kind::StartSuite;
+            start.suiteRun = suiteRun;
+            scheduler.submit(start);
         }
 
-        std::cout << std::endl;
+        std::unique_lock<std::mutex> lock(doneMutex);
+        TraceScope wait("runner", "Waiting for suites");
+        doneCv.wait(lock, [&] { return remainingSuites == 0; });
+        wait.end();
+        lastSchedule.achievedMakespanNanos = static_cast<uint64_t>(
+                std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - runStart)
+                        .count());
     }
 }
+
+void* allocationHookAllocate(std::size_t size) noexcept {
+    return trackedAllocate(size);
+}
+
+void allocationHookFree(void* pointer) noexcept {
+    trackedFree(pointer);
+}
+
+void registerAllocationHooks() noexcept {
+    allocationHooksInstalled.store(true, std::memory_order_relaxed);
+}
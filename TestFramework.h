@@ -3,14 +3,21 @@
 
 #include <string>
 #include <vector>
-#include <functional>
 #include <memory>
 #include <chrono>
 #include <cstdio>
 #include <typeinfo>
 #include <mutex>
-#include <future>
-#include <sstream>
+#include <ostream>
+#include <exception>
+#include <cstdint>
+#include <cstddef>
+#include <type_traits>
+#include <string_view>
+#include <initializer_list>
+#include <atomic>
+#include <utility>
+#include <map>
 
 /**
  * @brief A base fixture class that can be inherited by test suites to define shared setup/teardown logic.
@@ -43,240 +50,1728 @@ public:
     virtual void AfterEach() {}
 };
 
+/**
+ * @brief Append-only storage for the test registry: test names and the callables of capturing test bodies.
+ *
+ * Registering a test copies its name into large shared blocks instead of a heap allocation of its own, so
+ * generated suites with hundreds of thousands of tests start quickly and stay small. Stored data lives, at a fixed
+ * address, until the process exits.
+ */
+class RegistryArena {
+public:
+    /**
+     * @brief Retrieves the process-wide arena.
+     */
+    static RegistryArena& instance();
+
+    /**
+     * @brief Copies a string into the arena.
+     * @param text The string to store.
+     * @return A view of the stored copy.
+     */
+    std::string_view store(std::string_view text);
+
+    /**
+     * @brief Stores the name `prefix_number` without building a temporary string.
+     * @param prefix The part of the name before the underscore.
+     * @param number The number appended after the underscore.
+     * @return A view of the stored name.
+     */
+    std::string_view storeNumbered(std::string_view prefix, size_t number);
+
+    /**
+     * @brief Moves a callable into the arena.
+     * @param callable The callable to keep.
+     * @return A pointer to the stored callable.
+     */
+    template <typename Callable>
+    const std::decay_t<Callable>* keep(Callable&& callable) {
+        auto* object = new std::decay_t<Callable>(std::forward<Callable>(callable));
+        std::lock_guard<std::mutex> lock(mutex);
+        keptObjects.push_back(object);
+        return object;
+    }
+
+private:
+    static constexpr size_t kBlockSize = 64 * 1024;
+
+    RegistryArena() = default;
+    char* allocate(size_t size);
+
+    std::mutex mutex;
+    std::vector<std::unique_ptr<char[]>> blocks;
+    char* cursor = nullptr;
+    size_t remaining = 0;
+    // Kept objects are never destroyed; a test abandoned by a timeout may still be running one at exit.
+    std::vector<const void*> keptObjects;
+};
+
+/**
+ * @brief The body of a test: a plain function pointer, or a function pointer with a pointer to its payload.
+ *
+ * Captureless lambdas, which all test macros produce, are stored as plain function pointers. Any other callable is
+ * moved into the RegistryArena and invoked through a small trampoline.
+ */
+class TestBody {
+public:
+    using Function = void (*)(TestFixture* fixture, int repetition);
+    using PayloadFunction = void (*)(TestFixture* fixture, int repetition, const void* payload);
+
+    constexpr TestBody() = default;
+
+    constexpr TestBody(Function function) : plain(function) {}
+
+    constexpr TestBody(PayloadFunction function, const void* payload) : withPayload(function), payload(payload) {}
+
+    /**
+     * @brief Wraps any callable taking a TestFixture pointer and a repetition number.
+     * @param callable The test logic.
+     */
+    template <typename Callable>
+    static TestBody from(Callable&& callable) {
+        using Stored = std::decay_t<Callable>;
+        if constexpr (std::is_same_v<Stored, TestBody>) {
+            return callable;
+        } else if constexpr (std::is_convertible_v<Stored, Function>) {
+            return TestBody(static_cast<Function>(callable));
+        } else {
+            const Stored* stored = RegistryArena::instance().keep(std::forward<Callable>(callable));
+            return TestBody([](TestFixture* fixture, int repetition, const void* payload) {
+                (*static_cast<const Stored*>(payload))(fixture, repetition);
+            }, stored);
+        }
+    }
+
+    /**
+     * @brief Runs the test body.
+     */
+    void operator()(TestFixture* fixture, int repetition) const {
+        if (plain) {
+            plain(fixture, repetition);
+        } else {
+            withPayload(fixture, repetition, payload);
+        }
+    }
+
+    explicit operator bool() const {
+        return plain || withPayload;
+    }
+
+private:
+    Function plain = nullptr;
+    PayloadFunction withPayload = nullptr;
+    const void* payload = nullptr;
+};
+
+class AsyncTest;
+
 // Struct representing a test case
 /**
  * @brief Represents a single test definition, including the test's name, the function to run,
  * its disabled/enabled state, timeout, expected exception type, concurrency flag, and repetition count.
  *
- * Instances are usually created automatically by the test case macros, and then added to a TestSuite.
+ * Instances are usually created automatically by the test case macros, and then added to a TestSuite. The name is
+ * stored in the RegistryArena and the body is a TestBody, so a TestCase owns no heap memory and is cheap to copy.
  */
 class TestCase {
 public:
-    std::string name;
-    std::function<void(TestFixture*, int)> function;
-    bool disabled = false;
+    std::string_view name;
+    TestBody function;
     std::chrono::milliseconds timeout = std::chrono::milliseconds::zero();
+    bool (*expectedExceptionMatches)(const std::exception_ptr&) = nullptr;
+    // Must refer to storage that outlives the registry, such as the string literal the macros use.
+    std::string_view expectedExceptionTypeName;
     int repetitions = 1;
-    std::string expectedExceptionTypeName;
+    bool disabled = false;
+    // Declared with CONCURRENT_TEST_CASE or STRESS_TEST_CASE: the body runs on several threads at once.
     bool concurrent = false;
+    /**
+     * @brief Declared with FLAKY_TEST_CASE: the repetitions sample a pass rate, and the runner stops repeating once
+     * the rate is known closely enough, see RunnerOptions::flakyMargin.
+     */
     bool isNondeterministic = false;
+    // Declared with BENCHMARK_CASE: run() executes the body once as a test, TestRunner::runBenchmarks() times it.
+    bool benchmark = false;
+    // File that declared the test, from __FILE__ in the test case macros; empty for tests added at run time.
+    std::string_view sourceFile;
+
+    /**
+     * @brief For a parameterized family, returns how many instances it has; nullptr for an ordinary test.
+     *
+     * Called once when each run starts, so the count may depend on settings made at run time. Every instance is
+     * its own work item, and the body reads the index of the instance it runs via currentTestInstance().
+     */
+    size_t (*instanceCount)() = nullptr;
+
+    /**
+     * @brief For a concurrent test, how many threads run the body at once and how many times each thread calls it.
+     *
+     * Zero takes RunnerOptions::stressThreads and RunnerOptions::stressIterations.
+     */
+    unsigned int stressThreads = 0;
+    unsigned int stressIterations = 0;
+
+    /**
+     * @brief For an ASYNC_TEST_CASE, creates the coroutine of the body; `function` is then unused.
+     *
+     * The runner resumes the coroutine on its workers and gets the worker back at every co_await, see TestAsync.h.
+     */
+    AsyncTest (*asyncFunction)(TestFixture* fixture, int repetition) = nullptr;
+
+    /**
+     * @brief Constructs a TestCase with the given name and test function.
+     * @param name The name of the test case; it is copied into the RegistryArena.
+     * @param function A callable that takes a TestFixture pointer and repetition number, executing the test logic.
+     */
+    template <typename Callable>
+    TestCase(std::string_view name, Callable&& function)
+            : name(RegistryArena::instance().store(name)), function(TestBody::from(std::forward<Callable>(function))) {}
+
+    /**
+     * @brief Tag for the constructor that takes a name which already outlives the registry.
+     */
+    struct PreStoredName {};
+
+    /**
+     * @brief Constructs a TestCase without copying its name; usable in constant expressions.
+     * @param storedName A string literal or a view returned by RegistryArena.
+     * @param function The test body.
+     */
+    constexpr TestCase(std::string_view storedName, TestBody function, PreStoredName)
+            : name(storedName), function(function) {}
+};
+
+// Class representing a test suite
+/**
+ * @brief A collection of related test cases that share a common fixture.
+ *
+ * Each TestSuite holds a fixture instance and a list of TestCases. By grouping related tests, you can run setup
+ * and teardown code once for all tests in that group, or before/after each test.
+ */
+class TestSuite {
+public:
+    std::string name;
+    std::shared_ptr<TestFixture> fixture;
+    std::vector<TestCase> testCases;
+
+    /**
+     * @brief Creates another instance of the suite's fixture type from the prototype in `fixture`.
+     *
+     * Set by REGISTER_TEST_SUITE. Copyable fixtures are copy-constructed from the prototype after BeforeAll has
+     * run, so state prepared there (typically held through shared pointers) is shared by every clone.
+     */
+    std::shared_ptr<TestFixture> (*cloneFixture)(const TestFixture& prototype) = nullptr;
+
+    /**
+     * @brief When true, each worker of a concurrent run uses its own clone of the fixture.
+     *
+     * BeforeEach, the test body and AfterEach then run against a fixture no other thread touches, while BeforeAll
+     * and AfterAll still run once on the prototype. Enable it with REGISTER_PER_WORKER_TEST_SUITE.
+     */
+    bool perWorkerFixtures = false;
+
+    /**
+     * @brief Constructs a TestSuite with the specified name and fixture.
+     * @param suiteName The name of the test suite.
+     * @param fixtureInstance A shared pointer to a fixture object that will be used by the suite's tests.
+     */
+    TestSuite(const std::string& suiteName, std::shared_ptr<TestFixture> fixtureInstance)
+            : name(suiteName), fixture(fixtureInstance) {}
+
+    /**
+     * @brief Adds a TestCase to the suite's collection of tests.
+     * @param testCase The test case to be added.
+     */
+    void addTestCase(const TestCase& testCase) {
+        testCases.push_back(testCase);
+    }
+
+    /**
+     * @brief Adds `count` tests named `namePrefix_0` to `namePrefix_<count - 1>` that share one body.
+     *
+     * Meant for generated suites: the names are written straight into the RegistryArena, so registering many
+     * tests costs no allocation per test.
+     * @param namePrefix The common part of the test names.
+     * @param count The number of tests to add.
+     * @param function The body every test runs.
+     */
+    template <typename Callable>
+    void addGeneratedTests(std::string_view namePrefix, size_t count, Callable&& function) {
+        RegistryArena& arena = RegistryArena::instance();
+        TestBody body = TestBody::from(std::forward<Callable>(function));
+        testCases.reserve(testCases.size() + count);
+        for (size_t i = 0; i < count; ++i) {
+            testCases.emplace_back(arena.storeNumbered(namePrefix, i), body, TestCase::PreStoredName{});
+        }
+    }
+};
+
+/**
+ * @brief Creates a new fixture of the given type, copying the prototype when the type allows it.
+ * @tparam Fixture The concrete fixture type of the suite.
+ * @param prototype The suite's fixture after BeforeAll has run.
+ */
+template <typename Fixture>
+std::shared_ptr<TestFixture> cloneTestFixture(const TestFixture& prototype) {
+    if constexpr (std::is_copy_constructible_v<Fixture>) {
+        return std::make_shared<Fixture>(static_cast<const Fixture&>(prototype));
+    } else {
+        return std::make_shared<Fixture>();
+    }
+}
+
+/**
+ * @brief Creates the fixture of a suite declared with REGISTER_TEST_SUITE.
+ */
+template <typename Fixture>
+std::shared_ptr<TestFixture> makeTestFixture() {
+    return std::make_shared<Fixture>();
+}
+
+struct TestRegistration;
+
+/**
+ * @brief Constant-initialized record of a suite declared with REGISTER_TEST_SUITE.
+ *
+ * The record and the TestRegistration of every test in the suite are constinit globals, so program startup only
+ * links them into intrusive lists: no TestSuite, fixture, string or vector is created before main. The runner
+ * builds the TestSuite from the records when a run starts. Because every record is initialized at compile time,
+ * tests may be linked before or after their suite, whatever order the static initializers run in.
+ */
+class SuiteRegistration {
+public:
+    using FixtureFactory = std::shared_ptr<TestFixture> (*)();
+    using FixtureCloner = std::shared_ptr<TestFixture> (*)(const TestFixture& prototype);
+
+    constexpr SuiteRegistration(const char* name, FixtureFactory createFixture, FixtureCloner cloneFixture,
+                                bool perWorkerFixtures)
+            : name(name), createFixture(createFixture), cloneFixture(cloneFixture),
+              perWorkerFixtures(perWorkerFixtures) {}
+
+    SuiteRegistration(const SuiteRegistration&) = delete;
+    SuiteRegistration& operator=(const SuiteRegistration&) = delete;
+
+    /**
+     * @brief Adds the suite to the list the runner discovers; called once by the registration macro.
+     */
+    void link() {
+        next = first;
+        first = this;
+    }
+
+    /**
+     * @brief Adds a test to the suite, after the tests linked so far.
+     * @param registration The test's record; it must outlive the runner, as a constinit global does.
+     */
+    void link(TestRegistration& registration);
+
+    /**
+     * @brief Adds a test built at run time, such as one with a capturing body, after the tests linked so far.
+     * @param testCase The test; unlike the macros, this allocates a record for it.
+     */
+    void addTestCase(const TestCase& testCase);
+
+    /**
+     * @brief Adds generated tests, see TestSuite::addGeneratedTests(); this creates the suite if needed.
+     */
+    template <typename Callable>
+    void addGeneratedTests(std::string_view namePrefix, size_t count, Callable&& function) {
+        suite()->addGeneratedTests(namePrefix, count, std::forward<Callable>(function));
+    }
+
+    /**
+     * @brief The suite's TestSuite, created on first use and brought up to date with the tests linked since.
+     */
+    const std::shared_ptr<TestSuite>& suite();
+
+    /**
+     * @brief Keeps code written for the `std::shared_ptr<TestSuite>` the macros used to declare, such as
+     * `suiteName->addTestCase(testCase)`, working.
+     */
+    SuiteRegistration* operator->() {
+        return this;
+    }
+
+private:
+    friend class TestRunner;
+
+    const char* name;
+    FixtureFactory createFixture;
+    FixtureCloner cloneFixture;
+    bool perWorkerFixtures;
+    bool addedToRunner = false;
+    // Tests are linked newest first; newestDiscovered marks where suite() stopped reading last time.
+    TestRegistration* newestTest = nullptr;
+    TestRegistration* newestDiscovered = nullptr;
+    SuiteRegistration* next = nullptr;
+    std::shared_ptr<TestSuite> materialized;
+
+    static inline constinit SuiteRegistration* first = nullptr;
+};
+
+/**
+ * @brief Constant-initialized record of one test, declared by the test case macros next to the test body.
+ */
+struct TestRegistration {
+    constexpr TestRegistration(SuiteRegistration& suite, const TestCase& testCase)
+            : suite(&suite), testCase(testCase) {}
+
+    SuiteRegistration* suite;
+    TestCase testCase;
+    TestRegistration* next = nullptr;
+};
+
+/**
+ * @brief Links a registration record at startup: two pointer stores, no allocation.
+ */
+struct RegistryLink {
+    explicit RegistryLink(SuiteRegistration& suite) {
+        suite.link();
+    }
+
+    explicit RegistryLink(TestRegistration& test) {
+        test.suite->link(test);
+    }
+};
+
+/**
+ * @brief Outcome of one repetition of a test case.
+ */
+enum class TestStatus : uint8_t {
+    Passed,
+    Failed,
+    TimedOut,
+    Skipped,
+    // Left out by test selection, for example because it belongs to another shard, or a repetition of a
+    // nondeterministic test that was not needed once its pass rate was known.
+    NotSelected
+};
+
+/**
+ * @brief How tests are assigned to shards when RunnerOptions::shardCount is greater than one.
+ */
+enum class ShardStrategy : uint8_t {
+    // A stable hash of "Suite.Test" picks the shard, so assignments do not depend on other tests.
+    Hash,
+    // Tests are spread longest first over the shards using the timing database, balancing their total duration.
+    // Every node must read the same copy of the database, or the shards may overlap or miss tests.
+    Duration
+};
+
+/**
+ * @brief How the workers of a concurrent run are pinned to CPUs.
+ */
+enum class CpuPinning : uint8_t {
+    // Workers run wherever the operating system schedules them.
+    None,
+    // Worker i gets the i-th CPU in topology order: the cores of one NUMA node, hyperthread siblings side by side,
+    // are filled before the next node is used, so neighbouring workers share caches.
+    Compact,
+    // Consecutive workers alternate between NUMA nodes and use every physical core of a node before its
+    // hyperthread siblings, so workers share as little as possible.
+    Scatter,
+    // Worker i gets entry i of RunnerOptions::pinnedCpus, wrapping around when there are more workers than entries.
+    List
+};
+
+/**
+ * @brief One structured event of a run, as delivered to a TestReporter.
+ *
+ * The pointers and the message are only valid during the call that receives the event.
+ */
+struct ReportEvent {
+    enum class Type : uint8_t {
+        SuiteStart,
+        SuiteFinish,
+        // A disabled test that was not run.
+        TestSkipped,
+        TestStart,
+        // A failed check; `file`, `line` and `message` say where and what.
+        AssertionFailure,
+        // Any other reason for a test to fail, such as an exception or a timeout, described by `message`.
+        TestFailure,
+        // The end of one repetition of a test, with its `status` and `durationNanos`.
+        TestFinish
+    };
+
+    Type type = Type::TestStart;
+    const TestSuite* suite = nullptr;
+    // Null for suite events.
+    const TestCase* testCase = nullptr;
+    int repetition = 1;
+    // Index within a parameterized family, or -1.
+    int instance = -1;
+    TestStatus status = TestStatus::Passed;
+    const char* file = nullptr;
+    int line = 0;
+    uint64_t durationNanos = 0;
+    std::string_view message;
+};
+
+/**
+ * @brief Receives the structured events of every run, for example to write them in a format of its own.
+ *
+ * Register reporters through RunnerOptions::reporters. In concurrent runs they are called on the reporter's
+ * background thread, never on a worker; in sequential runs, on the thread running the tests. Calls never overlap.
+ * Events of one test arrive in order, but the events of tests running at the same time interleave. In isolated
+ * runs only suite and TestFinish events arrive, since the details of a test stay in its worker process.
+ */
+class TestReporter {
+public:
+    virtual ~TestReporter() = default;
+
+    /**
+     * @brief Called when a run starts, before its first event.
+     */
+    virtual void runStarted() {}
+
+    /**
+     * @brief Called for every event of the run.
+     */
+    virtual void report(const ReportEvent& event) = 0;
+
+    /**
+     * @brief Called after the last event of the run, with the counts of its console summary.
+     */
+    virtual void runFinished(size_t passed, size_t failed, size_t skipped) {
+        (void)passed;
+        (void)failed;
+        (void)skipped;
+    }
+};
+
+/**
+ * @brief Format of a report file written while a run is in progress, see RunnerOptions::reportFiles.
+ */
+enum class ReportFormat : uint8_t {
+    // One JSON object per event and line, starting with a "run_start" and ending with a "summary" line.
+    JsonLines,
+    // A JUnit XML document with one <testsuite> per suite, each written as soon as the suite finishes.
+    JUnitXml,
+    // Compact binary records of every finished test, read back with TestRunner::readBinaryReport() and combined
+    // across shards with TestRunner::mergeBinaryReports().
+    Binary
+};
+
+/**
+ * @brief A report file to write, and its format.
+ */
+struct ReportFile {
+    ReportFormat format = ReportFormat::JsonLines;
+    std::string path;
+};
+
+/**
+ * @brief One test outcome read back from a binary report.
+ */
+struct ReportedResult {
+    std::string suite;
+    std::string test;
+    int instance = -1;
+    int repetition = 1;
+    TestStatus status = TestStatus::Passed;
+    uint64_t durationNanos = 0;
+};
+
+/**
+ * @brief A compact record describing one executed (or skipped) repetition of a test case.
+ *
+ * TestRunner::run() preallocates one entry per repetition of every registered test before any test starts, and
+ * each worker only writes the entries of the repetitions it executes, so filling the table needs no locking.
+ */
+struct TestResult {
+    uint32_t suiteIndex = 0;
+    uint32_t testIndex = 0;
+    int repetition = 1;
+    // Index of the instance within a parameterized family, or -1 for an ordinary test.
+    int instance = -1;
+    TestStatus status = TestStatus::Skipped;
+    uint32_t assertionFailures = 0;
+    uint64_t wallNanos = 0;
+    uint64_t cpuNanos = 0;
+};
+
+/**
+ * @brief Hardware and kernel event counts of the calling thread over some interval.
+ *
+ * Counters the system does not provide (for example inside a virtual machine without a PMU) stay zero.
+ */
+struct PerfCounters {
+    uint64_t cycles = 0;
+    uint64_t instructions = 0;
+    uint64_t cacheMisses = 0;
+    uint64_t branchMisses = 0;
+    uint64_t contextSwitches = 0;
+};
+
+/**
+ * @brief Heap use of one test repetition, counted by the framework's global operator new and delete.
+ *
+ * Only allocations made on the thread running the test are attributed to it, from BeforeEach to AfterEach. Those
+ * include the runner's own work for the test, such as its events and timeout bookkeeping; the `body` fields are the
+ * share of the test body alone.
+ */
+struct AllocationStats {
+    uint64_t allocations = 0;
+    uint64_t bytes = 0;
+    uint64_t bodyAllocations = 0;
+    uint64_t bodyBytes = 0;
+    // Most bytes allocated by the test and alive at the same time.
+    uint64_t peakLiveBytes = 0;
+    // Bytes the test allocated and had not freed when AfterEach returned.
+    uint64_t leakedBytes = 0;
+    // Bytes served from the test's bump arena, see RunnerOptions::testArenaBytes.
+    uint64_t arenaBytes = 0;
+};
+
+/**
+ * @brief Entry points of the replacement operator new and delete in TestAllocationHooks.cpp.
+ *
+ * Only executables that link the testframework_allocation_hooks target replace the global operators; without it
+ * RunnerOptions::trackAllocations and RunnerOptions::testArenaBytes have no effect.
+ */
+void* allocationHookAllocate(std::size_t size) noexcept;
+void allocationHookFree(void* pointer) noexcept;
+
+/**
+ * @brief Called once by TestAllocationHooks.cpp, before main, to report that its operators are in use.
+ */
+void registerAllocationHooks() noexcept;
+
+/**
+ * @brief Counters of one worker thread over a whole run, split into the test bodies it ran and everything else.
+ *
+ * The difference between `total` and `inTests` is what the worker spent on scheduling, stealing, fixtures
+ * hooks, reporting and waiting for work.
+ */
+struct WorkerCounters {
+    PerfCounters total;
+    PerfCounters inTests;
+    size_t testsRun = 0;
+};
+
+/**
+ * @brief Throughput of a concurrent test at one thread count, and the contention on its ProfiledMutexes.
+ */
+struct StressPoint {
+    unsigned int threads = 0;
+    // Calls of the body made by all threads together; fewer than planned if a thread stopped at a fatal failure.
+    uint64_t calls = 0;
+    // From the release of the start barrier until the last thread finished.
+    uint64_t wallNanos = 0;
+    double callsPerSecond = 0;
+    uint64_t lockAcquisitions = 0;
+    // Acquisitions that found the mutex held and had to wait for it.
+    uint64_t contendedAcquisitions = 0;
+    uint64_t lockWaitNanos = 0;
+};
+
+/**
+ * @brief The scaling curve measured for one execution of a concurrent test, see TestRunner::stressResults().
+ */
+struct StressResult {
+    uint32_t suiteIndex = 0;
+    uint32_t testIndex = 0;
+    int repetition = 1;
+    int instance = -1;
+    // One point per thread count, in increasing order.
+    std::vector<StressPoint> points;
+};
+
+/**
+ * @brief Pass rate of a nondeterministic test over the repetitions the most recent run() executed.
+ *
+ * The bounds are the Wilson score interval at RunnerOptions::flakyConfidence.
+ */
+struct FlakinessReport {
+    uint32_t suiteIndex = 0;
+    uint32_t testIndex = 0;
+    // Repetitions executed; the others were not needed and are reported as NotSelected.
+    uint32_t runs = 0;
+    uint32_t passes = 0;
+    uint32_t maxRepetitions = 0;
+    double passRate = 0;
+    double lowerBound = 0;
+    double upperBound = 0;
+};
+
+/**
+ * @brief Settings that control how TestRunner::run() executes and reports tests.
+ */
+struct RunnerOptions {
+    /**
+     * @brief When true, only failures and the final summary are printed.
+     */
+    bool quiet = false;
+
+    /**
+     * @brief Number of failed or timed-out test repetitions after which the run is cancelled, or zero for no limit;
+     * `--fail-fast` sets it to one.
+     *
+     * Tests already running when the limit is reached finish. The tests that have not started are drained without
+     * running and reported as not selected, and suites that have not started skip BeforeAll and AfterAll.
+     */
+    unsigned int maxFailures = 0;
+
+    /**
+     * @brief Wall-clock time a run() may take before it is cancelled like at RunnerOptions::maxFailures, or zero for
+     * no limit.
+     *
+     * Running tests are not interrupted; a long test can poll testRunCancelled() and return early.
+     */
+    std::chrono::milliseconds timeBudget{0};
+
+    /**
+     * @brief When true, the allocations of every test are counted; see TestRunner::allocations().
+     *
+     * Needs the global operator new and delete of the framework, which an executable gets by linking the
+     * testframework_allocation_hooks target. Over-aligned allocations bypass them and are not counted, and async
+     * test cases are not tracked.
+     */
+    bool trackAllocations = false;
+
+    /**
+     * @brief Size in bytes of a bump arena serving the heap allocations of every test, or zero for none.
+     *
+     * While BeforeEach, the body and AfterEach of an ordinary test run, operator new on their thread takes memory
+     * from the arena, delete ignores it, and the arena is reset once AfterEach returns; allocations that do not fit
+     * fall back to the heap. Only suitable for tests none of whose allocations outlive AfterEach, such as capacity a
+     * shared fixture keeps: it shows how much of a test's cost is the allocator. The bodies of concurrent test cases,
+     * which run on several threads, and async test cases do not use it.
+     */
+    size_t testArenaBytes = 0;
+
+    /**
+     * @brief When true, cycles, instructions, cache misses, branch misses and context switches are counted around
+     * every test body and per worker; see TestRunner::counters() and TestRunner::workerCounters().
+     *
+     * Uses perf_event_open on Linux, which may need `kernel.perf_event_paranoid` lowered. Other platforms report
+     * that counters are unavailable and leave them at zero.
+     */
+    bool hardwareCounters = false;
+
+    /**
+     * @brief Path of a Chrome trace JSON file to write the timeline of each run() to, or empty for none.
+     *
+     * Every thread records spans for test bodies, fixture hooks, queue lock waits and holds, idle waits and the
+     * watchdog's deadline waits into its own buffer; the file is written after the run and opens in
+     * chrome://tracing or ui.perfetto.dev. When empty each probe costs a single relaxed atomic load. In isolated
+     * runs only the parent process is traced.
+     */
+    std::string tracePath;
+
+    /**
+     * @brief Number of forked worker processes used to run the tests, or zero to run them in-process.
+     *
+     * When non-zero, the enabled tests of every suite are split into contiguous shards, one per process, and each
+     * process runs its shard sequentially with the in-process engine. A crashing or timed-out test only takes down
+     * its own process, which is then re-forked to continue after that test. Only available on POSIX systems.
+     */
+    unsigned int isolatedProcesses = 0;
+
+    /**
+     * @brief Path of the timing database, or empty to disable it.
+     *
+     * When set, run() reads the per-test durations recorded by previous runs before it starts, dispatches the most
+     * expensive suites and tests first in concurrent mode, and writes the updated durations back afterwards.
+     */
+    std::string timingDatabasePath;
+
+    /**
+     * @brief Cache file of incremental selection, or empty to run every test.
+     *
+     * When set, run() records for every test it executes whether it passed and a content hash of each file the test
+     * depends on: its source file, the files dependencyMapPath assigns to it and sharedDependencies. The next run
+     * with the same cache executes only the tests that are new, failed last time, or have a dependency that changed
+     * since they last ran, and reports the rest as not selected. A test whose dependencies cannot be read always
+     * runs. Source files are found through the paths the compiler saw, so run from where the build can see them.
+     */
+    std::string selectionCachePath;
+
+    /**
+     * @brief File naming further dependencies of tests for incremental selection, or empty for none.
+     *
+     * One `PATTERN<TAB>PATH` line per dependency, where PATTERN is a glob on "Suite.Test" as in filter. Per-test
+     * coverage reports or a symbol map of the code under test can be turned into such a file, so a test also
+     * reruns when the code it exercises changes, not only when its own source does.
+     */
+    std::string dependencyMapPath;
+
+    /**
+     * @brief Files every test depends on for incremental selection, such as shared headers or build settings.
+     */
+    std::vector<std::string> sharedDependencies;
+
+    /**
+     * @brief Splits the registered tests into shardCount disjoint shards and runs only shard shardIndex.
+     *
+     * Every node of a CI job runs the same binary with the same count and its own index. The assignment is
+     * deterministic, so the shards together cover every test exactly once. Suites without a selected test do not run
+     * their BeforeAll/AfterAll.
+     */
+    unsigned int shardIndex = 0;
+    unsigned int shardCount = 1;
+    ShardStrategy shardStrategy = ShardStrategy::Hash;
+
+    /**
+     * @brief Path to write the results of the run to, or empty for none.
+     *
+     * One tab-separated line per executed repetition: suite, test, repetition, status, assertion failures, wall and
+     * CPU nanoseconds, and the position of the repetition in registration order, so the files of several shards
+     * can be combined with TestRunner::mergeResultFiles().
+     */
+    std::string resultFilePath;
+
+    /**
+     * @brief Report files every run() writes as it goes, in addition to the console output.
+     *
+     * Each file is formatted on the reporter's thread and written by a background writer in large chunks, so a
+     * slow disk never holds up a test. Files are replaced at the start of every run.
+     */
+    std::vector<ReportFile> reportFiles;
+
+    /**
+     * @brief Further reporters that receive the events of every run().
+     */
+    std::vector<std::shared_ptr<TestReporter>> reporters;
+
+    /**
+     * @brief Runs only the tests whose "Suite.Test" name matches, or every test when empty.
+     *
+     * A colon-separated list of patterns; a test is selected if any of them matches its whole name. Patterns are
+     * globs (`*` matches any run of characters, `?` a single one) unless wrapped in slashes, as in
+     * `/Heavy.*Test[0-9]+/`, which makes them ECMAScript regular expressions.
+     */
+    std::string filter;
+
+    /**
+     * @brief Number of timed samples runBenchmarks() takes of every benchmark.
+     */
+    unsigned int benchmarkSamples = 30;
+
+    /**
+     * @brief Minimum duration of one sample; the iteration count of every benchmark is calibrated to reach it.
+     */
+    std::chrono::milliseconds benchmarkSampleTime{10};
+
+    /**
+     * @brief How long each benchmark runs untimed before calibration, warming up caches, branch predictors and the
+     * CPU clock.
+     */
+    std::chrono::milliseconds benchmarkWarmupTime{50};
+
+    /**
+     * @brief CPU that runBenchmarks() pins the calling thread to, or -1 to leave it unpinned. Only supported on Linux.
+     */
+    int benchmarkCpu = -1;
+
+    /**
+     * @brief Path runBenchmarks() writes its statistics to, or empty for none.
+     *
+     * A path ending in `.json` gets a JSON document; any other path gets CSV with a header row, like the
+     * `speedup_vs_*.csv` files written by main.cpp. run() writes the same file with the wall-time statistics of
+     * every test it executed, one sample per repetition or instance, so either kind of run can record a baseline.
+     */
+    std::string benchmarkOutputPath;
+
+    /**
+     * @brief CSV file written through benchmarkOutputPath by an earlier run to compare against, or empty for none.
+     *
+     * After run() or runBenchmarks(), every measured test or benchmark with a passing row of the same name in the
+     * baseline is checked, and the regressions are available from TestRunner::regressions().
+     */
+    std::string baselinePath;
+
+    /**
+     * @brief Relative slowdown of the median, such as 0.10 for 10%, that a test may show without regressing.
+     */
+    double regressionThreshold = 0.10;
+
+    /**
+     * @brief How many standard errors the slowdown must also exceed to count, so noisy measurements do not fail
+     * the gate.
+     */
+    double regressionSigmas = 3.0;
+
+    /**
+     * @brief Fewest samples the measurement and its baseline row must each have for the gate to judge them.
+     *
+     * With fewer there is no usable estimate of the noise, so the comparison is skipped with a warning instead of
+     * failing on the relative threshold alone. A test contributes one sample per repetition.
+     */
+    unsigned int regressionMinSamples = 3;
+
+    /**
+     * @brief Number of worker threads of a concurrent run(), or zero for one per CPU the workers may use: the
+     * entries of pinnedCpus with CpuPinning::List, otherwise every CPU in the affinity mask of the process that
+     * is not in reservedCpus.
+     */
+    unsigned int workerThreads = 0;
+
+    /**
+     * @brief How workers are pinned to CPUs. Only supported on Linux.
+     *
+     * A pinned worker also first touches the memory it allocates for itself, such as its fixture clones, trace
+     * buffer and event ring, so with the kernel's default first-touch policy that memory is local to its NUMA node.
+     * A sequential run and runBenchmarks(), unless benchmarkCpu is set, pin the calling thread to the CPU of the
+     * first worker.
+     */
+    CpuPinning pinning = CpuPinning::None;
+
+    /**
+     * @brief CPUs the workers are pinned to, in worker order, with CpuPinning::List.
+     */
+    std::vector<int> pinnedCpus;
+
+    /**
+     * @brief Number of CPUs kept free of workers for the reporter, timeout watchdog and async poller threads.
+     *
+     * The first CPUs in compact order are reserved, and those threads are pinned to them. Only supported on Linux.
+     */
+    unsigned int reservedCpus = 0;
+
+    /**
+     * @brief Number of threads that run the body of a concurrent test at once, or zero for one per hardware thread,
+     * but at least two. STRESS_TEST_CASE sets its own count.
+     */
+    unsigned int stressThreads = 0;
+
+    /**
+     * @brief How many times each thread calls the body of a concurrent test, unless STRESS_TEST_CASE sets it.
+     */
+    unsigned int stressIterations = 1;
+
+    /**
+     * @brief When true, every concurrent test is measured at 1, 2, 4, ... threads up to its thread count, giving
+     * a scaling curve, instead of only at its thread count. BeforeEach and AfterEach still run once around the
+     * whole sweep.
+     */
+    bool stressScaling = false;
+
+    /**
+     * @brief Confidence level of the interval estimated for the pass rate of a FLAKY_TEST_CASE.
+     */
+    double flakyConfidence = 0.95;
+
+    /**
+     * @brief A FLAKY_TEST_CASE stops repeating once the confidence interval of its pass rate is at most twice this
+     * wide.
+     *
+     * A test that always passes or always fails is decided after 16 repetitions with the defaults, while one that
+     * passes half the time runs about 90.
+     */
+    double flakyMargin = 0.1;
+};
+
+/**
+ * @brief How well the duration-based schedule of the last concurrent run() worked out.
+ */
+struct ScheduleReport {
+    unsigned int workers = 0;
+    size_t knownTests = 0;
+    size_t unknownTests = 0;
+    // Makespan of a longest-first list schedule of the estimated durations over `workers` workers.
+    uint64_t estimatedMakespanNanos = 0;
+    uint64_t achievedMakespanNanos = 0;
+};
+
+/**
+ * @brief Timing statistics of one BENCHMARK_CASE from TestRunner::runBenchmarks().
+ *
+ * Every sample times `iterations` consecutive calls of the body; the statistics are per call, in nanoseconds.
+ */
+struct BenchmarkResult {
+    uint32_t suiteIndex = 0;
+    uint32_t testIndex = 0;
+    // Calls per sample, calibrated so that one sample lasts at least RunnerOptions::benchmarkSampleTime.
+    uint64_t iterations = 0;
+    uint32_t samples = 0;
+    double minNanos = 0;
+    double medianNanos = 0;
+    double p99Nanos = 0;
+    double meanNanos = 0;
+    double stddevNanos = 0;
+    // False if the body failed an assertion or threw; the statistics are then not filled in.
+    bool passed = false;
+};
+
+/**
+ * @brief A test or benchmark whose median time exceeds its baseline by more than the configured threshold.
+ */
+struct PerformanceRegression {
+    std::string name;
+    double baselineMedianNanos = 0;
+    double medianNanos = 0;
+};
+
+// Singleton TestRunner
+/**
+ * @brief A singleton class responsible for managing and running all registered test suites.
+ *
+ * Use getInstance() to retrieve the global TestRunner. Suites declared with REGISTER_TEST_SUITE are discovered
+ * when a run starts; others can be added with addTestSuite(). Then call run() to execute tests. By passing
+ * run(true), tests marked as concurrent can be run in parallel.
+ */
+class TestRunner {
+public:
+    /**
+     * @brief Retrieves the global TestRunner instance.
+     * @return A reference to the singleton TestRunner.
+     */
+    static TestRunner& getInstance() {
+        static TestRunner instance;
+        return instance;
+    }
+
+    /**
+     * @brief Registers a test suite built at run time with the runner.
+     * @param suite A shared pointer to the TestSuite being added.
+     */
+    void addTestSuite(std::shared_ptr<TestSuite> suite) {
+        suites.push_back(suite);
+    }
+
+    /**
+     * @brief Gives access to the options used by subsequent calls to run().
+     * @return A mutable reference to the runner's options.
+     */
+    RunnerOptions& options() {
+        return runnerOptions;
+    }
+
+    /**
+     * @brief Sets options from command-line arguments.
+     *
+     * Recognized options: --filter=PATTERNS, --shard-index=N, --shard-count=N, --shard-strategy=hash|duration,
+     * --result-file=PATH, --report=jsonl|junit|binary:PATH (may be repeated), --timing-db=PATH, --selection-cache=PATH,
+     * --dependency-map=PATH, --depends-on=PATH (may be repeated), --benchmark-samples=N, --benchmark-sample-ms=N,
+     * --benchmark-warmup-ms=N, --benchmark-cpu=N, --benchmark-out=PATH, --baseline=PATH,
+     * --regression-threshold=FRACTION, --regression-sigmas=N, --regression-min-samples=N, --stress-threads=N, --stress-iterations=N,
+     * --stress-scaling, --flaky-confidence=P, --flaky-margin=FRACTION, --workers=N, --pin=none|compact|scatter|CPULIST,
+     * --reserve-cpus=N, --fail-fast, --max-failures=N, --time-budget-ms=N, --track-allocations, --test-arena=BYTES,
+     * --hardware-counters, --trace=PATH and --quiet. Values may also be given as the following argument. Unknown
+     * arguments are reported on stderr.
+     * @return False if an argument was not understood, in which case the options should not be trusted.
+     */
+    bool parseCommandLine(int argc, char** argv);
+
+    /**
+     * @brief Combines result files written by several shards of the same binary into one file, in the order a
+     * single unsharded run writes its results: suites and tests in registration order, then instances and
+     * repetitions.
+     * @param inputPaths The per-shard result files.
+     * @param outputPath The file to write.
+     * @return False if an input could not be read or the output could not be written.
+     */
+    static bool mergeResultFiles(const std::vector<std::string>& inputPaths, const std::string& outputPath);
+
+    /**
+     * @brief Reads the test outcomes of a report file written with ReportFormat::Binary.
+     * @param path The report file.
+     * @param results Receives the outcomes in the order they were recorded.
+     * @return False if the file could not be read or is not a complete binary report.
+     */
+    static bool readBinaryReport(const std::string& path, std::vector<ReportedResult>& results);
+
+    /**
+     * @brief Combines binary reports written by several shards into one, ordered by suite, test, instance and
+     * repetition.
+     * @param inputPaths The per-shard binary reports.
+     * @param outputPath The binary report to write.
+     * @return False if an input could not be read or the output could not be written.
+     */
+    static bool mergeBinaryReports(const std::vector<std::string>& inputPaths, const std::string& outputPath);
+
+    /**
+     * @brief Gives read access to all registered test suites, in registration order.
+     *
+     * Suites and tests declared with the registration macros since the last run are discovered first.
+     * @return The registered suites; TestResult::suiteIndex indexes into this vector.
+     */
+    const std::vector<std::shared_ptr<TestSuite>>& getSuites() {
+        discoverRegisteredSuites();
+        return suites;
+    }
+
+    /**
+     * @brief Results of the most recent run(), one entry per repetition, ordered by suite and test registration.
+     * @return The results table. It stays valid until the next call to run().
+     */
+    const std::vector<TestResult>& results() const {
+        return testResults;
+    }
+
+    /**
+     * @brief Counters of the test bodies of the most recent run() with RunnerOptions::hardwareCounters set.
+     * @return One entry per entry of results(), at the same index, or an empty vector if counting was off.
+     */
+    const std::vector<PerfCounters>& counters() const {
+        return testCounters;
+    }
+
+    /**
+     * @brief Heap use of every test of the most recent run() with RunnerOptions::trackAllocations set.
+     * @return One entry per entry of results(), at the same index, or an empty vector if tracking was off.
+     */
+    const std::vector<AllocationStats>& allocations() const {
+        return testAllocations;
+    }
+
+    /**
+     * @brief Counters of every worker of the most recent run() with RunnerOptions::hardwareCounters set.
+     * @return One entry per worker thread; a sequential run has one worker. Empty for isolated runs, whose tests
+     * still get their counters() entries.
+     */
+    const std::vector<WorkerCounters>& workerCounters() const {
+        return lastWorkerCounters;
+    }
+
+    /**
+     * @brief Looks up the results of one test case from the most recent run().
+     * @param suiteName The name of the suite.
+     * @param testName The name of the test case.
+     * @return Pointers to the entries of every repetition of the test, or an empty vector if it does not exist.
+     */
+    std::vector<const TestResult*> findResults(const std::string& suiteName, const std::string& testName) const;
+
+    /**
+     * @brief Throughput and lock contention of every concurrent test the most recent run() executed to completion.
+     * @return One entry per executed repetition or instance, ordered by suite and test. Empty for isolated runs, whose
+     * measurements stay in the worker processes.
+     */
+    const std::vector<StressResult>& stressResults() const {
+        return lastStressResults;
+    }
+
+    /**
+     * @brief Pass rates of the nondeterministic tests the most recent run() executed, also in isolated runs.
+     * @return One entry per FLAKY_TEST_CASE with at least one executed repetition, in registration order.
+     */
+    const std::vector<FlakinessReport>& flakinessReports() const {
+        return lastFlakiness;
+    }
+
+    /**
+     * @brief CPU every worker of the most recent run() was pinned to.
+     * @return One entry per worker thread, -1 for a worker that was not pinned to a single CPU; a sequential run
+     * has one worker. Empty for isolated runs.
+     */
+    const std::vector<int>& workerCpus() const {
+        return lastWorkerCpus;
+    }
+
+    /**
+     * @brief Estimated and achieved makespan of the most recent concurrent run() with a timing database.
+     * @return The report; all fields are zero if no such run happened.
+     */
+    const ScheduleReport& scheduleReport() const {
+        return lastSchedule;
+    }
+
+    /**
+     * @brief Executes all registered test suites.
+     *
+     * In concurrent mode a single work-stealing pool is kept alive for the whole run, so tests from different
+     * suites may execute at the same time. BeforeAll still runs before any test of its suite, and AfterAll runs
+     * once the last test of that suite has finished.
+     * @param runConcurrently If true, eligible tests are run in parallel. Otherwise, all tests run sequentially.
+     */
+    void run(bool runConcurrently = false);
+
+    /**
+     * @brief Cancels the run in progress, as if it had reached RunnerOptions::maxFailures. Callable from any thread,
+     * including the tests themselves; ignored when no run is in progress.
+     */
+    void cancel();
+
+    /**
+     * @brief Whether the last run() was cancelled before all of its tests ran.
+     */
+    bool cancelled() const {
+        return lastRunCancelled;
+    }
+
+    /**
+     * @brief Times every selected BENCHMARK_CASE on the calling thread, one after another.
+     *
+     * Each benchmark first runs once as an ordinary test; if that passes it is warmed up, its iteration count is
+     * calibrated, and RunnerOptions::benchmarkSamples samples are timed. Other tests are not run, and results()
+     * afterwards reports them as not selected. The filter and shard options apply as in run().
+     * @return The statistics, one entry per benchmark in registration order.
+     */
+    const std::vector<BenchmarkResult>& runBenchmarks();
+
+    /**
+     * @brief Statistics of the most recent runBenchmarks().
+     */
+    const std::vector<BenchmarkResult>& benchmarkResults() const {
+        return lastBenchmarks;
+    }
+
+    /**
+     * @brief Tests and benchmarks that the most recent run() or runBenchmarks() found slower than
+     * RunnerOptions::baselinePath.
+     * @return The regressions; empty if there were none or no baseline was set. A CI job should fail when it is not.
+     */
+    const std::vector<PerformanceRegression>& regressions() const {
+        return lastRegressions;
+    }
+
+private:
+    std::vector<std::shared_ptr<TestSuite>> suites;
+    RunnerOptions runnerOptions;
+    std::vector<TestResult> testResults;
+    // Parallel to testResults when hardware counters are enabled, empty otherwise.
+    std::vector<PerfCounters> testCounters;
+    // Parallel to testResults when allocation tracking is enabled, empty otherwise.
+    std::vector<AllocationStats> testAllocations;
+    std::vector<WorkerCounters> lastWorkerCounters;
+    std::vector<int> lastWorkerCpus;
+    std::vector<StressResult> lastStressResults;
+    std::vector<FlakinessReport> lastFlakiness;
+
+    /**
+     * @brief Outcomes of a nondeterministic test counted while a run is in progress, shared by the workers that run
+     * its repetitions.
+     */
+    struct FlakyTally {
+        std::atomic<uint32_t> passes{0};
+        std::atomic<uint32_t> failures{0};
+        // Set once the pass rate is known closely enough; the remaining repetitions are then skipped.
+        std::atomic<bool> decided{false};
+    };
+    // One tally per enabled nondeterministic test, keyed by suite and test index. Built before a run starts and
+    // only read while it runs.
+    std::map<std::pair<uint32_t, uint32_t>, std::unique_ptr<FlakyTally>> flakyTallies;
+    // Standard normal quantile of RunnerOptions::flakyConfidence, computed when a run starts.
+    double flakyZ = 1.96;
+    // resultOffsets[suite][test] is the index of the test's first repetition in testResults.
+    std::vector<std::vector<size_t>> resultOffsets;
+    // itemCounts[suite][test] is the number of entries the test has in testResults: instances times repetitions,
+    // or one for a disabled test. Fixed when the run starts.
+    std::vector<std::vector<size_t>> itemCounts;
+    // estimatedNanos[suite][test] is the expected duration of one repetition, filled in by loadTimingEstimates().
+    std::vector<std::vector<uint64_t>> estimatedNanos;
+    ScheduleReport lastSchedule;
+    std::vector<BenchmarkResult> lastBenchmarks;
+    std::vector<PerformanceRegression> lastRegressions;
+    bool lastRunCancelled = false;
+    // Dependency files of every selected test, by suite and test index, and their content hashes (zero for a file
+    // that could not be read), taken by selectChangedTests() when an incremental run starts.
+    std::vector<std::vector<std::vector<std::string>>> testDependencies;
+    std::map<std::string, uint64_t> sourceHashes;
+    // selected[suite][test] is true for the tests the current run executes or reports as skipped.
+    std::vector<std::vector<bool>> selected;
+    // Every test's "Suite.Test" name in sorted order, built on the first filtered run.
+    struct NameIndexEntry {
+        std::string name;
+        uint32_t suiteIndex;
+        uint32_t testIndex;
+    };
+    std::vector<NameIndexEntry> nameIndex;
+    size_t indexedTestCount = 0;
+
+    TestRunner() = default;
+
+    /**
+     * @brief Identifies one registered test case by its position in the registry.
+     */
+    struct WorkRef {
+        uint32_t suiteIndex;
+        uint32_t testIndex;
+    };
+
+    /**
+     * @brief Sizes and initializes the results table for every registered test before a run starts.
+     */
+    void discoverRegisteredSuites();
+    void prepareResults();
 
     /**
-     * @brief Constructs a TestCase with the given name and test function.
-     * @param name The name of the test case.
-     * @param function A callable that takes a TestFixture pointer and repetition number, executing the test logic.
+     * @brief The counters entry for results-table entry `resultIndex`, or nullptr when counting is off.
      */
-    TestCase(const std::string& name,
-             const std::function<void(TestFixture*, int)>& function)
-            : name(name), function(function) {}
-};
-
-// Class representing a test suite
-/**
- * @brief A collection of related test cases that share a common fixture.
- *
- * Each TestSuite holds a fixture instance and a list of TestCases. By grouping related tests, you can run setup
- * and teardown code once for all tests in that group, or before/after each test.
- */
-class TestSuite {
-public:
-    std::string name;
-    std::shared_ptr<TestFixture> fixture;
-    std::vector<TestCase> testCases;
+    PerfCounters* countersFor(size_t resultIndex) {
+        return testCounters.empty() ? nullptr : &testCounters[resultIndex];
+    }
 
     /**
-     * @brief Constructs a TestSuite with the specified name and fixture.
-     * @param suiteName The name of the test suite.
-     * @param fixtureInstance A shared pointer to a fixture object that will be used by the suite's tests.
+     * @brief Prints the heap use of the tests that allocated the most bytes in the last run.
      */
-    TestSuite(const std::string& suiteName, std::shared_ptr<TestFixture> fixtureInstance)
-            : name(suiteName), fixture(fixtureInstance) {}
+    void printHeaviestAllocators() const;
 
     /**
-     * @brief Adds a TestCase to the suite's collection of tests.
-     * @param testCase The test case to be added.
+     * @brief The allocations entry for results-table entry `resultIndex`, or nullptr when tracking is off.
      */
-    void addTestCase(const TestCase& testCase) {
-        testCases.push_back(testCase);
+    AllocationStats* allocationsFor(size_t resultIndex) {
+        return testAllocations.empty() ? nullptr : &testAllocations[resultIndex];
     }
-};
 
-// Singleton TestRunner
-/**
- * @brief A singleton class responsible for managing and running all registered test suites.
- *
- * Use getInstance() to retrieve the global TestRunner. Add suites with addTestSuite(), and then call run() to
- * execute tests. By passing run(true), tests marked as concurrent can be run in parallel.
- */
-class TestRunner {
-public:
     /**
-     * @brief Retrieves the global TestRunner instance.
-     * @return A reference to the singleton TestRunner.
+     * @brief Reads the timing database and estimates the duration of every registered test.
+     *
+     * Tests missing from the database are estimated from the average of the known tests of the same suite, or of
+     * all known tests when none of their suite is known.
      */
-    static TestRunner& getInstance() {
-        static TestRunner instance;
-        return instance;
-    }
+    void loadTimingEstimates();
 
     /**
-     * @brief Registers a test suite with the runner.
-     * @param suite A shared pointer to the TestSuite being added.
+     * @brief Merges the durations measured by the last run into the timing database and writes it back.
      */
-    void addTestSuite(std::shared_ptr<TestSuite> suite) {
-        suites.push_back(suite);
-    }
+    void saveTimingDatabase() const;
 
     /**
-     * @brief Executes all registered test suites.
-     * @param runConcurrently If true, eligible tests are run in parallel. Otherwise, all tests run sequentially.
+     * @brief Decides which tests belong to this run according to the shard options.
+     *
+     * Tests that are left out get the NotSelected status.
      */
-    void run(bool runConcurrently = false);
+    void selectTests();
 
-private:
-    std::vector<std::shared_ptr<TestSuite>> suites;
+    /**
+     * @brief Narrows the selection to the tests the selection cache says are affected by changes.
+     *
+     * Hashes the dependency files of every selected test into sourceHashes; tests that are left out get the
+     * NotSelected status.
+     */
+    void selectChangedTests();
 
-    TestRunner() = default;
+    /**
+     * @brief Records the outcome and dependency hashes of every test the last run executed in the selection cache.
+     */
+    void saveSelectionCache() const;
+
+    /**
+     * @brief Marks the tests matching RunnerOptions::filter in `matches`, which is sized like `selected`.
+     *
+     * Only the range of the sorted name index that shares a pattern's literal prefix is scanned.
+     * @return False if a pattern is not a valid regular expression.
+     */
+    bool matchFilter(std::vector<std::vector<bool>>& matches);
+
+    /**
+     * @brief Collects the selected tests in registration order.
+     */
+    std::vector<WorkRef> selectedItems() const;
+
+    /**
+     * @brief The tally of a nondeterministic test, or nullptr for any other test.
+     */
+    FlakyTally* flakyTallyFor(size_t suiteIndex, size_t testIndex);
+
+    /**
+     * @brief Counts the outcome of one repetition of a nondeterministic test and decides whether more are needed.
+     */
+    void tallyRepetition(FlakyTally& tally, TestStatus status);
+
+    /**
+     * @brief Computes flakinessReports() from the results, marking the repetitions that never ran as not selected.
+     */
+    void summarizeFlakiness();
+
+    /**
+     * @brief Writes the results of the last run to RunnerOptions::resultFilePath.
+     */
+    void writeResultFile() const;
+
+    /**
+     * @brief Writes timing statistics to RunnerOptions::benchmarkOutputPath.
+     */
+    void writeBenchmarkFile(const std::vector<BenchmarkResult>& statistics) const;
+
+    /**
+     * @brief Wall-time statistics of every non-benchmark test the last run() executed and passed.
+     */
+    std::vector<BenchmarkResult> testTimingStatistics() const;
+
+    /**
+     * @brief Compares measured statistics against RunnerOptions::baselinePath and records the regressions.
+     */
+    void checkBaseline(const std::vector<BenchmarkResult>& statistics);
+
+    /**
+     * @brief Runs the given tests one after another on the calling thread.
+     * @param items The tests to run, grouped by suite.
+     * @param begin Index of the first item to run.
+     * @param beginItem Work item of items[begin] to start at, to resume a family or repeated test part way.
+     * @param isolationFd Pipe to stream results to when running inside an isolated worker process, or -1.
+     */
+    void runSequential(const std::vector<WorkRef>& items, size_t begin, size_t beginItem, int isolationFd);
+
+    /**
+     * @brief Shards the tests over forked worker processes and collects their results.
+     */
+    void runIsolated();
+
+    /**
+     * @brief Runs every registered suite on a runner-wide work-stealing pool.
+     */
+    void runConcurrent();
 };
 
 /**
- * @brief Asserts that a given condition is true.
- * Prints an error message if the assertion fails.
- * @param condition The boolean expression to verify.
+ * @brief Records an assertion failure for the test running on the calling thread.
+ *
+ * While a run is in progress the failure is queued on the calling thread's event buffer and printed by the
+ * reporter; outside of a run it is printed immediately.
+ * @param file The source file containing the assertion.
+ * @param line The line of the assertion.
+ * @param message A description of the failed check.
  */
-#undef ASSERT_TRUE
-#define ASSERT_TRUE(condition) \
-    if (!(condition)) { \
-        std::cout << "Assertion failed in " << __FILE__ << " at line " << __LINE__ \
-                  << ": " << #condition << std::endl; \
-    }
+void reportAssertionFailure(const char* file, int line, const std::string& message);
 
 /**
- * @brief Asserts that two values are equal.
- * Prints an error message if the assertion fails.
- * @param expected The expected value.
- * @param actual The actual value obtained.
+ * @brief Thrown by a failed fatal assertion (`ASSERT_*`) to end the running test.
+ *
+ * The failure has already been recorded when it is thrown, so the runner only stops the test body; it is not an
+ * unexpected exception. It deliberately does not derive from std::exception, so tests that catch those let it pass.
  */
-#undef ASSERT_EQ
-#define ASSERT_EQ(expected, actual) \
-    if ((expected) != (actual)) { \
-        std::cout << "Assertion failed in " << __FILE__ << " at line " << __LINE__ \
-                  << ": Expected " << (expected) << " == " << (actual) << std::endl; \
-    }
+struct FatalAssertionFailure {};
 
 /**
- * @brief Converts a value to its string representation.
- * @tparam T The type of the value.
- * @param value The value to convert.
- * @return A string representation of the input value.
+ * @brief Records a failed `EXPECT_*` or `ASSERT_*` check for the test running on the calling thread.
+ *
+ * The test's assertion failure count is incremented and the failure is reported like reportAssertionFailure().
+ * A fatal failure then throws FatalAssertionFailure to end the test, but only while a test body runs on this thread.
+ * @param file The source file containing the check.
+ * @param line The line of the check.
+ * @param expression The checked expression as written; must outlive the run, as a string literal does.
+ * @param values The operand values of a failed comparison, or empty.
+ * @param fatal Whether the check ends the test.
  */
-template<typename T>
-std::string toString(const T& value) {
-    std::ostringstream oss;
-    oss << value;
-    return oss.str();
-}
+void reportCheckFailure(const char* file, int line, const char* expression, std::string values, bool fatal);
 
 /**
- * @brief Converts a std::string to itself, acting as a pass-through.
- * @param value A std::string value.
- * @return The same string.
+ * @brief An emptied stream owned by the calling thread, for formatting the operands of a failed check.
  */
-inline std::string toString(const std::string& value) {
-    return value;
-}
+std::ostream& checkValueStream();
 
 /**
- * @brief Base case for argsToString, returns an empty vector.
- * @return An empty vector of strings.
+ * @brief Takes the text written to checkValueStream() since it was last emptied.
  */
-inline std::vector<std::string> argsToString() {
-    return {};
-}
+std::string takeCheckValues();
 
 /**
- * @brief Variadic template function that converts multiple arguments into a vector of strings.
- * @tparam T The type of the first argument.
- * @tparam Args The types of the remaining arguments.
- * @param first The first argument.
- * @param rest The remaining arguments.
- * @return A vector of string representations of all arguments.
- */
-template<typename T, typename... Args>
-std::vector<std::string> argsToString(T&& first, Args&&... rest) {
-    std::vector<std::string> result;
-    result.push_back(toString(std::forward<T>(first)));
-    auto tail = argsToString(std::forward<Args>(rest)...);
-    result.insert(result.end(), tail.begin(), tail.end());
-    return result;
-}
+ * @brief Index of the parameterized-family instance running on the calling thread, or zero for ordinary tests.
+ */
+size_t currentTestInstance();
+
+/**
+ * @brief Index of the calling thread among the threads running a concurrent test, from zero; zero elsewhere.
+ */
+unsigned int currentStressThread();
+
+/**
+ * @brief Number of threads running the concurrent test on the calling thread at once; one elsewhere.
+ */
+unsigned int currentStressThreadCount();
+
+/**
+ * @brief Whether the run in progress has been cancelled by RunnerOptions::maxFailures, RunnerOptions::timeBudget or
+ * TestRunner::cancel().
+ *
+ * Workers check it before every test. A long test can poll it and return early; it is one relaxed atomic load, plus
+ * a clock read while a time budget is set.
+ */
+bool testRunCancelled();
+
+/**
+ * @brief Adds a lock acquisition to the measurement of the concurrent test running on the calling thread, if any.
+ * @param contended Whether the lock was held by another thread when it was requested.
+ * @param waitNanos How long the calling thread waited for it.
+ */
+void recordLockAcquisition(bool contended, uint64_t waitNanos);
 
 /**
- * @brief A base class for creating mock objects that record and verify method calls.
+ * @brief A std::mutex that counts its acquisitions and the time threads spend waiting for it.
  *
- * Derive from this class and use MOCK_METHOD macros to define mocked methods. The calls are recorded in callLog,
- * which can be verified using verifyCall and getCallCount.
+ * Use it in place of std::mutex in code exercised by concurrent tests: the acquisitions made by the threads of a
+ * CONCURRENT_TEST_CASE are added to its StressPoint, so the scaling curve shows where a lock starts to serialize
+ * them. An uncontended lock() costs one try_lock() and two counter updates more than a plain mutex.
  */
-class Mock {
+class ProfiledMutex {
 public:
-    virtual ~Mock() = default;
+    ProfiledMutex() = default;
+    ProfiledMutex(const ProfiledMutex&) = delete;
+    ProfiledMutex& operator=(const ProfiledMutex&) = delete;
+
+    void lock() {
+        if (mutex.try_lock()) {
+            acquiredCount.fetch_add(1, std::memory_order_relaxed);
+            recordLockAcquisition(false, 0);
+            return;
+        }
+        auto waitStart = std::chrono::steady_clock::now();
+        mutex.lock();
+        auto waited = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now() - waitStart).count());
+        acquiredCount.fetch_add(1, std::memory_order_relaxed);
+        contendedCount.fetch_add(1, std::memory_order_relaxed);
+        waitedNanos.fetch_add(waited, std::memory_order_relaxed);
+        recordLockAcquisition(true, waited);
+    }
+
+    bool try_lock() {
+        if (!mutex.try_lock()) {
+            return false;
+        }
+        acquiredCount.fetch_add(1, std::memory_order_relaxed);
+        recordLockAcquisition(false, 0);
+        return true;
+    }
+
+    void unlock() {
+        mutex.unlock();
+    }
 
     /**
-     * @brief Clears all recorded expectations (method calls).
+     * @brief Acquisitions since construction or the last resetCounts().
      */
-    void clearExpectations() {
-        callLog.clear();
+    uint64_t acquisitions() const {
+        return acquiredCount.load(std::memory_order_relaxed);
     }
 
     /**
-     * @brief Records a method call on the mock object.
-     * @param methodName The name of the method that was called.
-     * @param args A vector of string representations of the arguments passed.
+     * @brief Acquisitions that had to wait because another thread held the mutex.
      */
-    void recordCall(const std::string& methodName, const std::vector<std::string>& args) {
-        callLog.push_back({methodName, args});
+    uint64_t contentions() const {
+        return contendedCount.load(std::memory_order_relaxed);
     }
 
-    struct CallInfo {
-        std::string methodName;
-        std::vector<std::string> args;
-    };
+    /**
+     * @brief Total time threads waited for the mutex.
+     */
+    uint64_t waitNanos() const {
+        return waitedNanos.load(std::memory_order_relaxed);
+    }
 
-    std::vector<CallInfo> callLog;
+    void resetCounts() {
+        acquiredCount.store(0, std::memory_order_relaxed);
+        contendedCount.store(0, std::memory_order_relaxed);
+        waitedNanos.store(0, std::memory_order_relaxed);
+    }
+
+private:
+    std::mutex mutex;
+    std::atomic<uint64_t> acquiredCount{0};
+    std::atomic<uint64_t> contendedCount{0};
+    std::atomic<uint64_t> waitedNanos{0};
 };
 
 /**
- * @brief Checks if a specified call with certain arguments was recorded on a mock.
- * @param mock The mock object to check.
- * @param methodName The method name to look for.
- * @param expectedArgs The expected arguments for the call.
- * @return True if the call was found, false otherwise.
+ * @brief Makes the compiler assume `value` is read, so a benchmark's computation is not optimized away.
+ * @param value The result to keep.
  */
-inline bool verifyCall(Mock& mock, const std::string& methodName, const std::vector<std::string>& expectedArgs) {
-    for (const auto& call : mock.callLog) {
-        if (call.methodName == methodName && call.args == expectedArgs) {
-            return true;
-        }
-    }
-    return false;
+template <typename T>
+inline void DoNotOptimize(const T& value) {
+#if defined(__GNUC__) || defined(__clang__)
+    asm volatile("" : : "r,m"(value) : "memory");
+#else
+    static volatile const void* sink;
+    sink = &value;
+#endif
 }
 
 /**
- * @brief Counts how many times a method was called on the mock.
- * @param mock The mock object to check.
- * @param methodName The method name to count occurrences of.
- * @return The number of times the method was called.
+ * @brief Makes the compiler assume all memory is read and written, forcing pending stores to be emitted.
  */
-inline int getCallCount(Mock& mock, const std::string& methodName) {
-    int count = 0;
-    for (const auto& call : mock.callLog) {
-        if (call.methodName == methodName) {
-            count++;
-        }
+inline void ClobberMemory() {
+#if defined(__GNUC__) || defined(__clang__)
+    asm volatile("" : : : "memory");
+#else
+    std::atomic_signal_fence(std::memory_order_seq_cst);
+#endif
+}
+
+/**
+ * @brief Parameter generator for the values begin, begin + 1, ..., end - 1.
+ *
+ * The end may be given as a function, which is evaluated each time a run starts; that lets the size of a family
+ * follow settings changed at run time.
+ * @tparam T An integral or other arithmetic type.
+ */
+template <typename T>
+class ParamRange {
+public:
+    ParamRange(T begin, T end) : first(begin), fixedEnd(end) {}
+
+    ParamRange(T begin, T (*end)()) : first(begin), endFunction(end) {}
+
+    size_t size() const {
+        T end = endFunction ? endFunction() : fixedEnd;
+        return end > first ? static_cast<size_t>(end - first) : 0;
+    }
+
+    T operator[](size_t index) const {
+        return static_cast<T>(first + static_cast<T>(index));
+    }
+
+private:
+    T first;
+    T fixedEnd{};
+    T (*endFunction)() = nullptr;
+};
+
+/**
+ * @brief Parameter generator over an explicit list of values.
+ * @tparam T The parameter type.
+ */
+template <typename T>
+class ParamValues {
+public:
+    ParamValues(std::initializer_list<T> values) : values(values) {}
+
+    explicit ParamValues(std::vector<T> values) : values(std::move(values)) {}
+
+    size_t size() const {
+        return values.size();
+    }
+
+    const T& operator[](size_t index) const {
+        return values[index];
     }
-    return count;
+
+private:
+    std::vector<T> values;
+};
+
+#if defined(__GNUC__) || defined(__clang__)
+#define TESTFRAMEWORK_COLD __attribute__((noinline, cold))
+#else
+#define TESTFRAMEWORK_COLD
+#endif
+
+/**
+ * @brief Whether `out << value` compiles for a value of type T.
+ */
+template <typename T, typename = void>
+struct IsStreamable : std::false_type {};
+
+template <typename T>
+struct IsStreamable<T, std::void_t<decltype(std::declval<std::ostream&>() << std::declval<const T&>())>>
+        : std::true_type {};
+
+/**
+ * @brief Writes an operand of a failed comparison; enums print their value and other unprintable types their size.
+ */
+template <typename T>
+void printCheckOperand(std::ostream& out, const T& value) {
+    if constexpr (std::is_same_v<T, bool>) {
+        out << (value ? "true" : "false");
+    } else if constexpr (IsStreamable<T>::value) {
+        out << value;
+    } else if constexpr (std::is_enum_v<T>) {
+        out << static_cast<std::underlying_type_t<T>>(value);
+    } else {
+        out << "<" << sizeof(T) << "-byte object>";
+    }
+}
+
+/**
+ * @brief Formats the operands of a failed comparison and records the failure.
+ *
+ * Kept out of line and marked cold so a passing check costs only the comparison; the message is built only here.
+ * With TESTFRAMEWORK_NO_ASSERTION_MESSAGES defined the operands are not formatted at all and only the expression
+ * text is reported, so no strings are built even for failures.
+ */
+template <typename L, typename R>
+TESTFRAMEWORK_COLD void reportComparisonFailure(const char* file, int line, const char* expression, const L& lhs,
+                                                const R& rhs, bool fatal) {
+#ifdef TESTFRAMEWORK_NO_ASSERTION_MESSAGES
+    (void)lhs;
+    (void)rhs;
+    reportCheckFailure(file, line, expression, std::string(), fatal);
+#else
+    std::ostream& values = checkValueStream();
+    printCheckOperand(values, lhs);
+    values << " vs ";
+    printCheckOperand(values, rhs);
+    reportCheckFailure(file, line, expression, takeCheckValues(), fatal);
+#endif
 }
 
+/**
+ * @brief Shared body of the boolean checks; the condition is evaluated exactly once.
+ */
+#define TESTFRAMEWORK_CHECK_BOOL(condition, expected, text, fatal) \
+    do { \
+        if (static_cast<bool>(condition) != (expected)) [[unlikely]] { \
+            reportCheckFailure(__FILE__, __LINE__, text, std::string(), fatal); \
+        } \
+    } while (false)
+
+/**
+ * @brief Shared body of the comparison checks; each operand is evaluated exactly once and bound by reference.
+ */
+#define TESTFRAMEWORK_CHECK_COMPARE(lhs, op, rhs, fatal) \
+    do { \
+        const auto& testFrameworkLhs = (lhs); \
+        const auto& testFrameworkRhs = (rhs); \
+        if (!(testFrameworkLhs op testFrameworkRhs)) [[unlikely]] { \
+            reportComparisonFailure(__FILE__, __LINE__, #lhs " " #op " " #rhs, testFrameworkLhs, testFrameworkRhs, \
+                                    fatal); \
+        } \
+    } while (false)
+
+/**
+ * @brief Checks that a condition is true; on failure the test is marked failed and continues.
+ * @param condition The boolean expression to verify.
+ */
+#define EXPECT_TRUE(condition) TESTFRAMEWORK_CHECK_BOOL(condition, true, #condition, false)
+
+/**
+ * @brief Checks that a condition is false; on failure the test is marked failed and continues.
+ * @param condition The boolean expression to verify.
+ */
+#define EXPECT_FALSE(condition) TESTFRAMEWORK_CHECK_BOOL(condition, false, "!(" #condition ")", false)
+
+/**
+ * @brief Non-fatal comparisons of two values; a failure reports both operands.
+ * @param expected The expected value.
+ * @param actual The actual value obtained.
+ */
+#define EXPECT_EQ(expected, actual) TESTFRAMEWORK_CHECK_COMPARE(expected, ==, actual, false)
+#define EXPECT_NE(expected, actual) TESTFRAMEWORK_CHECK_COMPARE(expected, !=, actual, false)
+#define EXPECT_LT(lhs, rhs) TESTFRAMEWORK_CHECK_COMPARE(lhs, <, rhs, false)
+#define EXPECT_LE(lhs, rhs) TESTFRAMEWORK_CHECK_COMPARE(lhs, <=, rhs, false)
+#define EXPECT_GT(lhs, rhs) TESTFRAMEWORK_CHECK_COMPARE(lhs, >, rhs, false)
+#define EXPECT_GE(lhs, rhs) TESTFRAMEWORK_CHECK_COMPARE(lhs, >=, rhs, false)
+
+/**
+ * @brief Asserts that a given condition is true.
+ * Reports an error message and ends the test if the assertion fails.
+ * @param condition The boolean expression to verify.
+ */
+#undef ASSERT_TRUE
+#define ASSERT_TRUE(condition) TESTFRAMEWORK_CHECK_BOOL(condition, true, #condition, true)
+
+/**
+ * @brief Asserts that a given condition is false, ending the test if it is not.
+ * @param condition The boolean expression to verify.
+ */
+#undef ASSERT_FALSE
+#define ASSERT_FALSE(condition) TESTFRAMEWORK_CHECK_BOOL(condition, false, "!(" #condition ")", true)
+
+/**
+ * @brief Asserts that two values are equal.
+ * Reports both values and ends the test if the assertion fails.
+ * @param expected The expected value.
+ * @param actual The actual value obtained.
+ */
+#undef ASSERT_EQ
+#define ASSERT_EQ(expected, actual) TESTFRAMEWORK_CHECK_COMPARE(expected, ==, actual, true)
+
+/**
+ * @brief Fatal comparisons of two values; a failure reports both operands and ends the test.
+ */
+#undef ASSERT_NE
+#define ASSERT_NE(expected, actual) TESTFRAMEWORK_CHECK_COMPARE(expected, !=, actual, true)
+#undef ASSERT_LT
+#define ASSERT_LT(lhs, rhs) TESTFRAMEWORK_CHECK_COMPARE(lhs, <, rhs, true)
+#undef ASSERT_LE
+#define ASSERT_LE(lhs, rhs) TESTFRAMEWORK_CHECK_COMPARE(lhs, <=, rhs, true)
+#undef ASSERT_GT
+#define ASSERT_GT(lhs, rhs) TESTFRAMEWORK_CHECK_COMPARE(lhs, >, rhs, true)
+#undef ASSERT_GE
+#define ASSERT_GE(lhs, rhs) TESTFRAMEWORK_CHECK_COMPARE(lhs, >=, rhs, true)
 
 /**
  * @brief Declares a new test suite and defines its fixture class.
@@ -287,15 +1782,27 @@ inline int getCallCount(Mock& mock, const std::string& methodName) {
 
 /**
  * @brief Registers the test suite with the TestRunner so it can be discovered and executed.
+ *
+ * The suite is a constinit SuiteRegistration; its TestSuite and fixture are created when a run starts.
  * @param suiteName The name of the test suite previously declared with TEST_SUITE.
  */
 #define REGISTER_TEST_SUITE(suiteName) \
-    std::shared_ptr<TestSuite> suiteName = std::make_shared<TestSuite>(#suiteName, std::make_shared<suiteName##_Fixture>()); \
-    static struct suiteName##_Registrar { \
-        suiteName##_Registrar() { \
-            TestRunner::getInstance().addTestSuite(suiteName); \
-        } \
-    } suiteName##_registrar;
+    TESTFRAMEWORK_REGISTER_SUITE(suiteName, false)
+
+/**
+ * @brief Registers the test suite like REGISTER_TEST_SUITE, giving each concurrent worker its own fixture instance.
+ *
+ * Use this for suites whose fixture members are modified by BeforeEach, AfterEach or the tests themselves, so
+ * concurrent tests do not need to lock them.
+ * @param suiteName The name of the test suite previously declared with TEST_SUITE.
+ */
+#define REGISTER_PER_WORKER_TEST_SUITE(suiteName) \
+    TESTFRAMEWORK_REGISTER_SUITE(suiteName, true)
+
+#define TESTFRAMEWORK_REGISTER_SUITE(suiteName, perWorker) \
+    constinit SuiteRegistration suiteName(#suiteName, &makeTestFixture<suiteName##_Fixture>, \
+                                          &cloneTestFixture<suiteName##_Fixture>, perWorker); \
+    static RegistryLink suiteName##_link(suiteName);
 
 /**
  * @brief Defines a method to be run once before all tests in the specified suite.
@@ -325,6 +1832,22 @@ inline int getCallCount(Mock& mock, const std::string& methodName) {
 #define AFTER_EACH(suiteName) \
     void suiteName##_Fixture::AfterEach()
 
+/**
+ * @brief Declares the constinit record of a test whose body is `suiteName##_##testName`, and links it at startup.
+ * @param tag Distinguishes the record's name between the test case macros.
+ * @param ... Statements adjusting `testCase` before it is registered; they are evaluated at compile time.
+ */
+#define TESTFRAMEWORK_REGISTER_TEST(suiteName, testName, tag, ...) \
+    static constinit TestRegistration suiteName##_##tag##testName##_registration(suiteName, [] { \
+        TestCase testCase(#testName, +[](TestFixture* baseFixture, int repetition) { \
+            suiteName##_##testName(static_cast<suiteName##_Fixture*>(baseFixture), repetition); \
+        }, TestCase::PreStoredName{}); \
+        testCase.sourceFile = __FILE__; \
+        __VA_ARGS__ \
+        return testCase; \
+    }()); \
+    static RegistryLink suiteName##_##tag##testName##_link(suiteName##_##tag##testName##_registration);
+
 /**
  * @brief Declares a single test case within the specified suite.
  * @param suiteName The suite in which to declare this test.
@@ -332,31 +1855,35 @@ inline int getCallCount(Mock& mock, const std::string& methodName) {
  */
 #define TEST_CASE(suiteName, testName) \
     void suiteName##_##testName(suiteName##_Fixture* fixture, int repetition = 1); \
-    static struct suiteName##_##testName##_Registrar { \
-        suiteName##_##testName##_Registrar() { \
-            suiteName->addTestCase(TestCase(#testName, [](TestFixture* baseFixture, int repetition) { \
-                suiteName##_##testName(static_cast<suiteName##_Fixture*>(baseFixture), repetition); \
-            })); \
-        } \
-    } suiteName##_##testName##_registrar; \
+    TESTFRAMEWORK_REGISTER_TEST(suiteName, testName, ) \
     void suiteName##_##testName(suiteName##_Fixture* fixture, int repetition)
 
 /**
- * @brief Declares a single test case within the specified suite that can be run concurrently.
+ * @brief Declares a test case whose body runs on several threads at once, to load-test thread-safe code.
+ *
+ * The threads are started first and released together from a barrier; each then calls the body
+ * RunnerOptions::stressIterations times against the same fixture, and currentStressThread() tells them apart.
+ * Failures on any thread count towards the test. The runner reports the throughput of the calls and the contention
+ * on every ProfiledMutex they used, see TestRunner::stressResults().
  * @param suiteName The suite in which to declare this concurrent test.
  * @param testName The name of the test case.
  */
 #define CONCURRENT_TEST_CASE(suiteName, testName) \
     void suiteName##_##testName(suiteName##_Fixture* fixture, int repetition = 1); \
-    static struct suiteName##_CONCURRENT_##testName##_Registrar { \
-        suiteName##_CONCURRENT_##testName##_Registrar() { \
-            TestCase testCase(#testName, [](TestFixture* baseFixture, int repetition) { \
-                suiteName##_##testName(static_cast<suiteName##_Fixture*>(baseFixture), repetition); \
-            }); \
-            testCase.concurrent = true; \
-            suiteName->addTestCase(testCase); \
-        } \
-    } suiteName##_CONCURRENT_##testName##_registrar; \
+    TESTFRAMEWORK_REGISTER_TEST(suiteName, testName, CONCURRENT_, testCase.concurrent = true;) \
+    void suiteName##_##testName(suiteName##_Fixture* fixture, int repetition)
+
+/**
+ * @brief Declares a concurrent test case like CONCURRENT_TEST_CASE with its own thread and iteration counts.
+ * @param suiteName The suite in which to declare this test.
+ * @param testName The name of the test case.
+ * @param threads The number of threads that run the body at once.
+ * @param iterations How many times each thread calls the body.
+ */
+#define STRESS_TEST_CASE(suiteName, testName, threads, iterations) \
+    void suiteName##_##testName(suiteName##_Fixture* fixture, int repetition = 1); \
+    TESTFRAMEWORK_REGISTER_TEST(suiteName, testName, STRESS_, testCase.concurrent = true; \
+                                testCase.stressThreads = (threads); testCase.stressIterations = (iterations);) \
     void suiteName##_##testName(suiteName##_Fixture* fixture, int repetition)
 
 /**
@@ -366,15 +1893,7 @@ inline int getCallCount(Mock& mock, const std::string& methodName) {
  */
 #define DISABLED_TEST_CASE(suiteName, testName) \
     void suiteName##_##testName(suiteName##_Fixture* fixture, int repetition = 1); \
-    static struct suiteName##_DISABLED_##testName##_Registrar { \
-        suiteName##_DISABLED_##testName##_Registrar() { \
-            TestCase testCase(#testName, [](TestFixture* baseFixture, int repetition) { \
-                suiteName##_##testName(static_cast<suiteName##_Fixture*>(baseFixture), repetition); \
-            }); \
-            testCase.disabled = true; \
-            suiteName->addTestCase(testCase); \
-        } \
-    } suiteName##_DISABLED_##testName##_registrar; \
+    TESTFRAMEWORK_REGISTER_TEST(suiteName, testName, DISABLED_, testCase.disabled = true;) \
     void suiteName##_##testName(suiteName##_Fixture* fixture, int repetition)
 
 /**
@@ -385,15 +1904,17 @@ inline int getCallCount(Mock& mock, const std::string& methodName) {
  */
 #define EXPECT_EXCEPTION_TEST_CASE(suiteName, testName, exceptionType) \
     void suiteName##_##testName(suiteName##_Fixture* fixture, int repetition = 1); \
-    static struct suiteName##_EXCEPTION_##testName##_Registrar { \
-        suiteName##_EXCEPTION_##testName##_Registrar() { \
-            TestCase testCase(#testName, [](TestFixture* baseFixture, int repetition) { \
-                suiteName##_##testName(static_cast<suiteName##_Fixture*>(baseFixture), repetition); \
-            }); \
-            testCase.expectedExceptionTypeName = #exceptionType; \
-            suiteName->addTestCase(testCase); \
-        } \
-    } suiteName##_EXCEPTION_##testName##_registrar; \
+    TESTFRAMEWORK_REGISTER_TEST(suiteName, testName, EXCEPTION_, \
+        testCase.expectedExceptionTypeName = #exceptionType; \
+        testCase.expectedExceptionMatches = [](const std::exception_ptr& error) { \
+            try { \
+                std::rethrow_exception(error); \
+            } catch (const exceptionType&) { \
+                return true; \
+            } catch (...) { \
+                return false; \
+            } \
+        };) \
     void suiteName##_##testName(suiteName##_Fixture* fixture, int repetition)
 
 /**
@@ -404,52 +1925,79 @@ inline int getCallCount(Mock& mock, const std::string& methodName) {
  */
 #define TIMEOUT_TEST_CASE(suiteName, testName, timeoutMs) \
     void suiteName##_##testName(suiteName##_Fixture* fixture, int repetition = 1); \
-    static struct suiteName##_TIMEOUT_##testName##_Registrar { \
-        suiteName##_TIMEOUT_##testName##_Registrar() { \
-            TestCase testCase(#testName, [](TestFixture* baseFixture, int repetition) { \
-                suiteName##_##testName(static_cast<suiteName##_Fixture*>(baseFixture), repetition); \
-            }); \
-            testCase.timeout = std::chrono::milliseconds(timeoutMs); \
-            suiteName->addTestCase(testCase); \
-        } \
-    } suiteName##_TIMEOUT_##testName##_registrar; \
+    TESTFRAMEWORK_REGISTER_TEST(suiteName, testName, TIMEOUT_, testCase.timeout = std::chrono::milliseconds(timeoutMs);) \
     void suiteName##_##testName(suiteName##_Fixture* fixture, int repetition)
 
 /**
  * @brief Declares a test case that runs multiple times (repetitions).
  * @param suiteName The suite in which to declare this test.
  * @param testName The name of the test case.
- * @param repetitions The number of times this test should be run.
+ * @param repetitionCount The number of times this test should be run.
  */
-#define REPEATED_TEST_CASE(suiteName, testName, repetitions) \
+#define REPEATED_TEST_CASE(suiteName, testName, repetitionCount) \
     void suiteName##_##testName(suiteName##_Fixture* fixture, int repetition); \
-    static struct suiteName##_REPEAT_##testName##_Registrar { \
-        suiteName##_REPEAT_##testName##_Registrar() { \
-            TestCase testCase(#testName, [](TestFixture* baseFixture, int repetition) { \
-                suiteName##_##testName(static_cast<suiteName##_Fixture*>(baseFixture), repetition); \
-            }); \
-            testCase.repetitions = (repetitions); \
-            suiteName->addTestCase(testCase); \
-        } \
-    } suiteName##_REPEAT_##testName##_registrar; \
+    TESTFRAMEWORK_REGISTER_TEST(suiteName, testName, REPEAT_, testCase.repetitions = (repetitionCount);) \
     void suiteName##_##testName(suiteName##_Fixture* fixture, int repetition)
 
 /**
- * @brief Declares a mock method inside a mock class, recording calls and allowing for custom return behavior.
- * @param methodName The name of the mocked method.
- * @param returnType The return type of the mocked method.
- * @param PARAMS The parameter list in parentheses for the mocked method.
- * @param ARGS The argument list in parentheses used when calling argsToString for logging.
+ * @brief Declares a nondeterministic test whose repetitions measure its pass rate.
+ *
+ * Repetitions run like those of REPEATED_TEST_CASE, spread over the workers in concurrent mode, but the runner
+ * stops as soon as the confidence interval of the pass rate is narrow enough (RunnerOptions::flakyConfidence and
+ * flakyMargin), so a stable or clearly broken test costs a handful of runs instead of all of them. The repetitions
+ * not needed are reported as not selected, the measured rate is available from TestRunner::flakinessReports(), and
+ * the timing database keeps counts of passes and failures across runs.
+ * @param suiteName The suite in which to declare this test.
+ * @param testName The name of the test case.
+ * @param maxRepetitions The most repetitions to run.
  */
-#define MOCK_METHOD(methodName, returnType, PARAMS, ARGS) \
-    std::function<returnType PARAMS> methodName##_mock; \
-    virtual returnType methodName PARAMS override { \
-        std::vector<std::string> args = argsToString ARGS; \
-        this->recordCall(#methodName, args); \
-        if (methodName##_mock) \
-            return methodName##_mock ARGS; \
-        else \
-            return returnType(); \
-    }
+#define FLAKY_TEST_CASE(suiteName, testName, maxRepetitions) \
+    void suiteName##_##testName(suiteName##_Fixture* fixture, int repetition); \
+    TESTFRAMEWORK_REGISTER_TEST(suiteName, testName, FLAKY_, testCase.repetitions = (maxRepetitions); \
+                                testCase.isNondeterministic = true;) \
+    void suiteName##_##testName(suiteName##_Fixture* fixture, int repetition)
+
+/**
+ * @brief Declares a microbenchmark: the body is one iteration, and TestRunner::runBenchmarks() times it.
+ *
+ * A plain run() executes the body once like a TEST_CASE. Wrap results in DoNotOptimize() so the compiler keeps
+ * the computation being measured.
+ * @param suiteName The suite in which to declare this benchmark.
+ * @param benchmarkName The name of the benchmark.
+ */
+#define BENCHMARK_CASE(suiteName, benchmarkName) \
+    void suiteName##_##benchmarkName(suiteName##_Fixture* fixture, int repetition = 1); \
+    TESTFRAMEWORK_REGISTER_TEST(suiteName, benchmarkName, BENCHMARK_, testCase.benchmark = true;) \
+    void suiteName##_##benchmarkName(suiteName##_Fixture* fixture, int repetition)
+
+/**
+ * @brief Declares a family of test instances, one per value produced by a parameter generator.
+ *
+ * The family is a single registry entry. Its size is taken from the generator when a run starts, and each
+ * instance's parameter is produced only when that instance is dispatched. Instances are reported as
+ * `testName/index`. The generator is any object with `size()` and `operator[](size_t)`, such as ParamRange or
+ * ParamValues.
+ * @param suiteName The suite in which to declare this family.
+ * @param testName The name of the family.
+ * @param paramType The type of the parameter passed to the test body as `param`.
+ * @param generator An expression creating the generator, evaluated once.
+ */
+#define PARAMETERIZED_TEST_CASE(suiteName, testName, paramType, generator) \
+    void suiteName##_##testName(suiteName##_Fixture* fixture, const paramType& param); \
+    static const auto& suiteName##_##testName##_params() { \
+        static const auto params = generator; \
+        return params; \
+    } \
+    static constinit TestRegistration suiteName##_PARAM_##testName##_registration(suiteName, [] { \
+        TestCase testCase(#testName, +[](TestFixture* baseFixture, int) { \
+            suiteName##_##testName(static_cast<suiteName##_Fixture*>(baseFixture), \
+                                   suiteName##_##testName##_params()[currentTestInstance()]); \
+        }, TestCase::PreStoredName{}); \
+        testCase.instanceCount = [] { return static_cast<size_t>(suiteName##_##testName##_params().size()); }; \
+        testCase.sourceFile = __FILE__; \
+        return testCase; \
+    }()); \
+    static RegistryLink suiteName##_PARAM_##testName##_link(suiteName##_PARAM_##testName##_registration); \
+    void suiteName##_##testName(suiteName##_Fixture* fixture, const paramType& param)
 
 #endif // TESTFRAMEWORK_H
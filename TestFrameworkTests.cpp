@@ -1,9 +1,24 @@
 // TestFrameworkTests.cpp
 #include "TestFramework.h"
+#include "TestMock.h"
+#include "TestAsync.h"
+#include <algorithm>
+#include <atomic>
 #include <iostream>
 #include <stdexcept>
 #include <chrono>
 #include <thread>
+#include <string>
+#include <mutex>
+#include <utility>
+#include <memory>
+#include <vector>
+#if defined(__unix__) || defined(__APPLE__)
+#include <unistd.h>
+#endif
+#if defined(__linux__)
+#include <sched.h>
+#endif
 
 /**
  * @brief Test fixture for internal tests of the framework.
@@ -112,3 +127,550 @@ static struct TestFrameworkInternalTests_TestRepeatedMixed_Registrar {
         TestFrameworkInternalTests->addTestCase(testCase);
     }
 } TestFrameworkInternalTests_TestRepeatedMixed_registrar;
+
+/**
+ * @brief A nondeterministic test that never fails.
+ * Expectation: Stops after the few repetitions that establish its pass rate; the rest are not selected.
+ */
+FLAKY_TEST_CASE(TestFrameworkInternalTests, TestFlakyStable, 200) {
+    EXPECT_TRUE(repetition > 0);
+}
+
+/**
+ * @brief A nondeterministic test that fails every fourth repetition, a pass rate of 75%.
+ * Expectation: Runs until the interval around the measured rate is narrow enough, well before its 400 repetitions.
+ */
+FLAKY_TEST_CASE(TestFrameworkInternalTests, TestFlakyThreeQuarters, 400) {
+    EXPECT_TRUE(repetition % 4 != 0);
+}
+
+/**
+ * @brief A tiny benchmark body; a plain run executes it once as a test.
+ * Expectation: Passes, and runBenchmarks() reports consistent statistics for it.
+ */
+BENCHMARK_CASE(TestFrameworkInternalTests, TestBenchmarkAccumulate) {
+    int sum = 0;
+    for (int i = 0; i < 100; ++i) {
+        sum += i;
+        DoNotOptimize(sum);
+    }
+    ASSERT_TRUE(sum == 4950);
+}
+
+// Size of TestParameterizedFamily; RunInternalTests changes it after registration
+static int g_familySize = 3;
+
+void setParameterizedFamilySize(int n) {
+    g_familySize = n;
+}
+
+/**
+ * @brief A family with one instance per value in [0, g_familySize).
+ * Expectation: Every instance passes except the one with parameter 4.
+ */
+PARAMETERIZED_TEST_CASE(TestFrameworkInternalTests, TestParameterizedFamily, int,
+                        ParamRange<int>(0, [] { return g_familySize; })) {
+    ASSERT_TRUE(param != 4);
+}
+
+static int g_operandEvaluations = 0;
+
+static int countedOperand(int value) {
+    ++g_operandEvaluations;
+    return value;
+}
+
+/**
+ * @brief Passing checks whose operands have side effects.
+ * Expectation: Passes, and each operand is evaluated exactly once per check.
+ */
+TEST_CASE(TestFrameworkInternalTests, TestCheckOperandsEvaluatedOnce) {
+    g_operandEvaluations = 0;
+    EXPECT_EQ(countedOperand(3), countedOperand(3));
+    EXPECT_LT(countedOperand(1), countedOperand(2));
+    ASSERT_TRUE(countedOperand(1) == 1);
+    ASSERT_FALSE(countedOperand(0));
+    ASSERT_EQ(6, g_operandEvaluations);
+}
+
+/**
+ * @brief Non-fatal checks that fail.
+ * Expectation: Fails with three assertion failures; the body keeps running past each of them.
+ */
+TEST_CASE(TestFrameworkInternalTests, TestNonFatalChecks) {
+    int reached = 0;
+    EXPECT_EQ(1, 2);
+    ++reached;
+    EXPECT_TRUE(reached == 0);
+    ++reached;
+    EXPECT_GE(std::string("abc"), std::string("abd"));
+    ASSERT_EQ(2, reached);
+}
+
+/**
+ * @brief Adds a passing test to the suite after its static registration, as a plugin loaded at run time would.
+ * Expectation: The next run discovers it and runs it after every test declared with the macros.
+ */
+void registerLateTest() {
+    TestFrameworkInternalTests->addTestCase(TestCase("TestRegisteredLate", [](TestFixture*, int) {
+        ASSERT_TRUE(true);
+    }));
+}
+
+static bool g_pastFatalAssertion = false;
+
+bool reachedPastFatalAssertion() {
+    return g_pastFatalAssertion;
+}
+
+/**
+ * @brief A fatal assertion that fails inside a try block catching std::exception.
+ * Expectation: Fails with one assertion failure, not an unexpected exception, and the rest of the body is skipped.
+ */
+TEST_CASE(TestFrameworkInternalTests, TestFatalAssertion) {
+    g_pastFatalAssertion = false;
+    try {
+        ASSERT_NE(7, 7);
+    } catch (const std::exception&) {
+    }
+    g_pastFatalAssertion = true;
+}
+
+/**
+ * @brief A value type without a canonical mock form, recorded as a copy and compared with its own operator==.
+ */
+struct MockPoint {
+    int x;
+    int y;
+    bool operator==(const MockPoint&) const = default;
+};
+
+std::ostream& operator<<(std::ostream& out, const MockPoint& point) {
+    return out << "(" << point.x << ", " << point.y << ")";
+}
+
+class MockedStore {
+public:
+    virtual ~MockedStore() = default;
+    virtual void put(int key, const std::string& value) = 0;
+    virtual void move(MockPoint to) = 0;
+    virtual double scale(double a, double b, double c, double d) = 0;
+};
+
+class MockStore : public MockedStore, public Mock {
+public:
+    MOCK_METHOD(put, void, (int key, const std::string& value), (key, value));
+    MOCK_METHOD(move, void, (MockPoint to), (to));
+    MOCK_METHOD(scale, double, (double a, double b, double c, double d), (a, b, c, d));
+};
+
+/**
+ * @brief Records many calls with typed arguments and verifies them by value and by their string form.
+ * Expectation: Passes; numbers match across types, strings by contents and other types through operator==.
+ */
+TEST_CASE(TestFrameworkInternalTests, TestMockTypedRecording) {
+    MockStore mock;
+    for (int i = 0; i < 1000; ++i) {
+        mock.put(i, "value");
+    }
+    mock.move(MockPoint{1, 2});
+
+    EXPECT_EQ(1000, getCallCount(mock, "put"));
+    EXPECT_TRUE(verifyCall(mock, "put", 999, "value"));
+    EXPECT_TRUE(verifyCall(mock, "put", 7L, std::string("value")));
+    EXPECT_TRUE(verifyCall(mock, "put", 7.0, std::string_view("value")));
+    EXPECT_FALSE(verifyCall(mock, "put", 1000, "value"));
+    EXPECT_FALSE(verifyCall(mock, "put", 7));
+    EXPECT_TRUE(verifyCall(mock, "put", {"3", "value"}));
+    EXPECT_TRUE(verifyCall(mock, "move", MockPoint{1, 2}));
+    EXPECT_FALSE(verifyCall(mock, "move", MockPoint{2, 1}));
+    EXPECT_FALSE(verifyCall(mock, "neverMocked"));
+
+    // Several floating-point arguments, verified in typed form and through their canonical strings
+    mock.scale_mock = [](double a, double b, double c, double d) {
+        return a * b * c * d;
+    };
+    EXPECT_EQ(120.0, mock.scale(2.0, 3.0, 4.0, 5.0));
+    EXPECT_TRUE(verifyCall(mock, "scale", 2.0, 3.0, 4.0, 5.0));
+    EXPECT_TRUE(verifyCall(mock, "scale", 2, 3, 4, 5));
+    EXPECT_TRUE(verifyCall(mock, "scale", {"2", "3", "4", "5"}));
+    EXPECT_FALSE(verifyCall(mock, "scale", 2.0, 3.0, 4.0, 5.5));
+
+    std::vector<Mock::CallInfo> calls = mock.describeCalls();
+    ASSERT_EQ(size_t(1002), calls.size());
+    EXPECT_EQ("scale", calls.back().methodName);
+    EXPECT_TRUE(calls[1000].args == std::vector<std::string>{"(1, 2)"});
+
+    mock.clearExpectations();
+    EXPECT_EQ(0, getCallCount(mock, "put"));
+    mock.put(1, "again");
+    EXPECT_TRUE(verifyCall(mock, "put", 1, "again"));
+}
+
+ProfiledMutex g_stressMutex;
+int g_stressGuardedCalls = 0;
+std::atomic<unsigned int> g_stressThreadsSeen{0};
+
+// Returns the calls TestStressFanOut made since the last call, and resets the count.
+int takeStressCalls() {
+    std::lock_guard<ProfiledMutex> lock(g_stressMutex);
+    return std::exchange(g_stressGuardedCalls, 0);
+}
+
+// Returns the set of stress thread indices, one bit each, TestStressFanOut saw since the last call.
+unsigned int takeStressThreadsSeen() {
+    return g_stressThreadsSeen.exchange(0);
+}
+
+/**
+ * @brief Four threads count their calls under a ProfiledMutex, holding it long enough for the others to queue up.
+ * Expectation: Passes; 80 calls from four distinct threads, and the mutex is reported as contended.
+ */
+STRESS_TEST_CASE(TestFrameworkInternalTests, TestStressFanOut, 4, 20) {
+    EXPECT_TRUE(currentStressThread() < currentStressThreadCount());
+    g_stressThreadsSeen.fetch_or(1u << currentStressThread());
+    std::lock_guard<ProfiledMutex> lock(g_stressMutex);
+    ++g_stressGuardedCalls;
+    std::this_thread::sleep_for(std::chrono::microseconds(200));
+}
+
+/**
+ * @brief Only the second of three threads fails its check, on each of its five calls.
+ * Expectation: Fails with exactly five assertion failures, although none was made on the runner's own thread.
+ */
+STRESS_TEST_CASE(TestFrameworkInternalTests, TestStressFailuresCounted, 3, 5) {
+    EXPECT_TRUE(currentStressThread() != 1);
+}
+
+/**
+ * @brief The second of two threads fails a fatal assertion on its first call.
+ * Expectation: Fails with one assertion failure; the other thread stops calling and no exception is reported.
+ */
+STRESS_TEST_CASE(TestFrameworkInternalTests, TestStressFatalStops, 2, 100) {
+    ASSERT_TRUE(currentStressThread() == 0);
+}
+
+std::atomic<int> g_placementCpuCount{0};
+std::atomic<int> g_placementCpu{-1};
+
+// Returns how many CPUs the thread that last ran TestRecordsPlacement was allowed to use, or 0 where unknown.
+int placementCpuCount() {
+    return g_placementCpuCount.load();
+}
+
+// Returns the CPU TestRecordsPlacement last ran on, or -1 where unknown.
+int placementCpu() {
+    return g_placementCpu.load();
+}
+
+/**
+ * @brief Records the CPU affinity of the thread running it, for the checks of worker pinning.
+ * Expectation: Passes.
+ */
+TEST_CASE(TestFrameworkInternalTests, TestRecordsPlacement) {
+#if defined(__linux__)
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    ASSERT_TRUE(sched_getaffinity(0, sizeof(allowed), &allowed) == 0);
+    g_placementCpuCount.store(CPU_COUNT(&allowed));
+    g_placementCpu.store(sched_getcpu());
+#endif
+}
+
+/**
+ * @brief Polls for cancellation while the run has a time budget, as a long test should.
+ * Expectation: Passes; with a budget every repetition that starts waits until the run is cancelled, and the
+ * remaining repetitions are not run. Without one it returns at once.
+ */
+REPEATED_TEST_CASE(TestFrameworkInternalTests, TestWaitsForCancellation, 50) {
+    if (TestRunner::getInstance().options().timeBudget.count() == 0) {
+        return;
+    }
+    auto giveUp = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+    while (!testRunCancelled() && std::chrono::steady_clock::now() < giveUp) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    EXPECT_TRUE(testRunCancelled());
+}
+
+// Kept from one repetition of TestAllocationProfile to the next, so the bytes it holds count as leaked.
+std::unique_ptr<char[]> g_keptAllocation;
+
+/**
+ * @brief Allocates ten blocks of 1000 bytes at once, frees nine of them and keeps the last one beyond the test.
+ * Expectation: Passes; at least 10000 bytes are allocated by the body with a peak of as many live, and 1000 of
+ * them leak. Nothing is kept when the run uses a test arena, whose memory is reused after the test.
+ */
+TEST_CASE(TestFrameworkInternalTests, TestAllocationProfile) {
+    std::vector<std::unique_ptr<char[]>> blocks;
+    blocks.reserve(10);
+    for (int i = 0; i < 10; ++i) {
+        blocks.push_back(std::make_unique<char[]>(1000));
+    }
+    if (TestRunner::getInstance().options().testArenaBytes == 0) {
+        g_keptAllocation = std::move(blocks.back());
+    }
+    blocks.clear();
+}
+
+/**
+ * @brief Records calls on one mock from several threads at once.
+ * Expectation: Passes; every call is counted and found through the index, and the log keeps each thread's order.
+ */
+TEST_CASE(TestFrameworkInternalTests, TestMockConcurrentRecording) {
+    constexpr int kThreads = 4;
+    constexpr int kCallsPerThread = 5000;
+    MockStore mock;
+    std::vector<std::thread> threads;
+    for (int t = 0; t < kThreads; ++t) {
+        threads.emplace_back([&mock, t] {
+            for (int i = 0; i < kCallsPerThread; ++i) {
+                mock.put(t * kCallsPerThread + i, "concurrent");
+            }
+        });
+    }
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+
+    EXPECT_EQ(kThreads * kCallsPerThread, getCallCount(mock, "put"));
+    EXPECT_EQ(0, getCallCount(mock, "move"));
+    EXPECT_TRUE(verifyCall(mock, "put", 0, "concurrent"));
+    EXPECT_TRUE(verifyCall(mock, "put", kThreads * kCallsPerThread - 1, "concurrent"));
+    EXPECT_FALSE(verifyCall(mock, "put", kThreads * kCallsPerThread, "concurrent"));
+    EXPECT_TRUE(verifyCall(mock, "put", {"4321", "concurrent"}));
+
+    std::vector<int> lastKey(kThreads, -1);
+    bool ordered = true;
+    for (const Mock::CallRecord& call : mock.callRecords()) {
+        int key = static_cast<int>(call.args[0].signedValue);
+        ordered &= key > lastKey[key / kCallsPerThread];
+        lastKey[key / kCallsPerThread] = key;
+    }
+    EXPECT_TRUE(ordered);
+}
+
+/**
+ * @brief Expectations that every call satisfies, on a mock that keeps no call log.
+ * Expectation: Passes; calls are still counted, but not stored.
+ */
+TEST_CASE(TestFrameworkInternalTests, TestMockExpectationsMet) {
+    MockStore mock;
+    mock.keepCallLog(false);
+    MockSequence sequence;
+    EXPECT_CALL(mock, put).With(1, "first").Times(2).InSequence(sequence);
+    EXPECT_CALL(mock, move).With(MockPoint{3, 4}).InSequence(sequence);
+    EXPECT_CALL(mock, put).With(2, "last").Times(1, 10000).InSequence(sequence);
+
+    mock.put(1, "first");
+    mock.put(1, "first");
+    mock.move(MockPoint{3, 4});
+    for (int i = 0; i < 10000; ++i) {
+        mock.put(2, "last");
+    }
+
+    EXPECT_EQ(10002, getCallCount(mock, "put"));
+    EXPECT_FALSE(verifyCall(mock, "put", 2, "last"));
+    EXPECT_TRUE(mock.verifyExpectations());
+}
+
+/**
+ * @brief Calls that break expectations in each way, plus an expectation left unmet.
+ * Expectation: Fails with five assertion failures: four reported at the offending calls, one when the mock is
+ * destroyed.
+ */
+TEST_CASE(TestFrameworkInternalTests, TestMockExpectationViolations) {
+    MockStore mock;
+    MockSequence sequence;
+    EXPECT_CALL(mock, put).With(1, "first").InSequence(sequence);
+    EXPECT_CALL(mock, put).With(2, "second").InSequence(sequence);
+    EXPECT_CALL(mock, move).Times(0);
+
+    mock.put(2, "second"); // Before the first step of the sequence
+    mock.put(1, "first");  // After a later step
+    mock.put(3, "third");  // No expectation takes these arguments
+    mock.move(MockPoint{0, 0}); // More often than expected
+
+    {
+        MockStore unmet;
+        EXPECT_CALL(unmet, put).Times(3);
+        unmet.put(1, "once");
+    }
+}
+
+/**
+ * @brief A coroutine helper awaited by TestAsyncSleeps; it suspends and then hands back a value.
+ */
+AsyncTest sleepAndStore(int value, int* out) {
+    co_await sleepFor(std::chrono::milliseconds(1));
+    *out = value;
+}
+
+/**
+ * @brief Sleeps a few times, yields, and awaits a helper coroutine.
+ * Expectation: Passes.
+ */
+ASYNC_TEST_CASE(TestFrameworkInternalTests, TestAsyncSleeps) {
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < 3; ++i) {
+        co_await sleepFor(std::chrono::milliseconds(2));
+    }
+    co_await sleepFor(std::chrono::milliseconds(0));
+    ASSERT_GE(std::chrono::steady_clock::now() - start, std::chrono::milliseconds(6));
+    int stored = 0;
+    co_await sleepAndStore(7, &stored);
+    ASSERT_EQ(7, stored);
+}
+
+/**
+ * @brief Waits on an AsyncEvent set by another thread and, where poll() exists, on a pipe it writes to.
+ * Expectation: Passes.
+ */
+ASYNC_TEST_CASE(TestFrameworkInternalTests, TestAsyncEventAndDescriptor) {
+    AsyncEvent event;
+    std::thread setter([&event] {
+        std::this_thread::sleep_for(std::chrono::milliseconds(2));
+        event.set();
+    });
+    co_await event;
+    setter.join();
+    EXPECT_TRUE(event.isSet());
+    co_await event;
+#if defined(__unix__) || defined(__APPLE__)
+    int fds[2];
+    ASSERT_EQ(0, pipe(fds));
+    std::thread writer([fd = fds[1]] {
+        std::this_thread::sleep_for(std::chrono::milliseconds(2));
+        char byte = 'x';
+        [[maybe_unused]] ssize_t written = write(fd, &byte, 1);
+    });
+    co_await waitReadable(fds[0]);
+    char byte = 0;
+    EXPECT_EQ(1, static_cast<int>(read(fds[0], &byte, 1)));
+    EXPECT_EQ('x', byte);
+    writer.join();
+    close(fds[0]);
+    close(fds[1]);
+#endif
+}
+
+/**
+ * @brief A fatal assertion after a suspension.
+ * Expectation: Fails with one assertion failure.
+ */
+ASYNC_TEST_CASE(TestFrameworkInternalTests, TestAsyncFatalAssertion) {
+    co_await sleepFor(std::chrono::milliseconds(1));
+    ASSERT_EQ(1, 2);
+    co_await sleepFor(std::chrono::milliseconds(1));
+}
+
+static std::atomic<int> g_asyncCancelledLocals{0};
+
+// Declared at namespace scope: a local class in the coroutine frame trips -Wsubobject-linkage in unity builds.
+struct CountOnDestruction {
+    ~CountOnDestruction() {
+        ++g_asyncCancelledLocals;
+    }
+};
+
+/**
+ * @brief Sleeps far beyond its timeout, holding a local whose destructor records that the frame was destroyed.
+ * Expectation: Timed out after 20 ms, with the local destroyed, rather than left sleeping.
+ */
+ASYNC_TIMEOUT_TEST_CASE(TestFrameworkInternalTests, TestAsyncTimeoutCancels, 20) {
+    CountOnDestruction local;
+    co_await sleepFor(std::chrono::seconds(10));
+    EXPECT_TRUE(false); // Never reached: the timeout destroys the frame while it sleeps
+}
+
+int asyncCancelledLocals() {
+    return g_asyncCancelledLocals.exchange(0);
+}
+
+static std::atomic<int> g_asyncInFlight{0};
+static std::atomic<int> g_maxAsyncInFlight{0};
+
+int maxAsyncInFlight() {
+    return g_maxAsyncInFlight.exchange(0);
+}
+
+// TestAsyncOverlap_0 to _31 each sleep 20 ms; a concurrent run overlaps all of them whatever the worker count.
+static struct TestFrameworkInternalTests_AsyncOverlap_Registrar {
+    TestFrameworkInternalTests_AsyncOverlap_Registrar() {
+        for (int i = 0; i < 32; ++i) {
+            TestCase testCase(RegistryArena::instance().store("TestAsyncOverlap_" + std::to_string(i)), TestBody(),
+                              TestCase::PreStoredName{});
+            testCase.asyncFunction = [](TestFixture*, int) -> AsyncTest {
+                int inFlight = ++g_asyncInFlight;
+                int seen = g_maxAsyncInFlight.load();
+                while (inFlight > seen && !g_maxAsyncInFlight.compare_exchange_weak(seen, inFlight)) {
+                }
+                co_await sleepFor(std::chrono::milliseconds(20));
+                --g_asyncInFlight;
+            };
+            TestFrameworkInternalTests->addTestCase(testCase);
+        }
+    }
+} TestFrameworkInternalTests_AsyncOverlap_registrar;
+
+static bool g_exitAfterPerWorkerSuite = false;
+
+void setExitAfterPerWorkerSuite(bool exit) {
+    g_exitAfterPerWorkerSuite = exit;
+}
+
+/**
+ * @brief Fixture whose members are modified by every test, used to check per-worker fixture clones.
+ * BeforeAll prepares read-only state that every clone shares through a shared pointer.
+ */
+TEST_SUITE(TestPerWorkerFixtures) {
+public:
+    void BeforeAll() override {
+        sharedConfig = std::make_shared<const int>(42);
+    }
+    void AfterAll() override {
+#if defined(__unix__) || defined(__APPLE__)
+        // Lets the isolated run check that a worker dying after its last test does not blame a finished one.
+        if (g_exitAfterPerWorkerSuite) {
+            _exit(3);
+        }
+#endif
+    }
+    void BeforeEach() override {
+        inTest = false;
+    }
+
+    std::shared_ptr<const int> sharedConfig;
+    bool inTest = false;
+    int testsRun = 0;
+};
+
+// Each concurrent worker gets its own copy of the fixture
+REGISTER_PER_WORKER_TEST_SUITE(TestPerWorkerFixtures);
+
+/**
+ * @brief Mutates the fixture without locking; a fixture shared between workers would trip the assertion.
+ * Expectation: Every repetition sees the BeforeAll state and passes.
+ */
+REPEATED_TEST_CASE(TestPerWorkerFixtures, TestClonedFixtureState, 50) {
+    ASSERT_TRUE(fixture->sharedConfig && *fixture->sharedConfig == 42);
+    ASSERT_TRUE(!fixture->inTest);
+    fixture->inTest = true;
+    ++fixture->testsRun;
+    std::this_thread::yield();
+    ASSERT_TRUE(fixture->inTest);
+    fixture->inTest = false;
+}
+
+/**
+ * @brief Marks the fixture across a suspension, while other tests of the suite run on the same workers.
+ * Expectation: Passes; the async test has a fixture clone of its own.
+ */
+ASYNC_TEST_CASE(TestPerWorkerFixtures, TestAsyncOwnFixture) {
+    ASSERT_TRUE(fixture->sharedConfig && *fixture->sharedConfig == 42);
+    ASSERT_TRUE(!fixture->inTest);
+    fixture->inTest = true;
+    co_await sleepFor(std::chrono::milliseconds(5));
+    ASSERT_TRUE(fixture->inTest);
+    fixture->inTest = false;
+}
@@ -0,0 +1,518 @@
+#ifndef TESTMOCK_H
+#define TESTMOCK_H
+
+#include "TestFramework.h"
+#include <string>
+#include <vector>
+#include <functional>
+#include <memory>
+#include <new>
+#include <mutex>
+#include <sstream>
+#include <typeinfo>
+#include <cstdint>
+#include <type_traits>
+#include <string_view>
+#include <atomic>
+#include <utility>
+
+/**
+ * @brief Converts a value to its string representation.
+ * @tparam T The type of the value.
+ * @param value The value to convert.
+ * @return A string representation of the input value.
+ */
+template<typename T>
+std::string toString(const T& value) {
+    std::ostringstream oss;
+    oss << value;
+    return oss.str();
+}
+
+/**
+ * @brief Converts a std::string to itself, acting as a pass-through.
+ * @param value A std::string value.
+ * @return The same string.
+ */
+inline std::string toString(const std::string& value) {
+    return value;
+}
+
+/**
+ * @brief Base case for argsToString, returns an empty vector.
+ * @return An empty vector of strings.
+ */
+inline std::vector<std::string> argsToString() {
+    return {};
+}
+
+/**
+ * @brief Variadic template function that converts multiple arguments into a vector of strings.
+ * @tparam T The type of the first argument.
+ * @tparam Args The types of the remaining arguments.
+ * @param first The first argument.
+ * @param rest The remaining arguments.
+ * @return A vector of string representations of all arguments.
+ */
+template<typename T, typename... Args>
+std::vector<std::string> argsToString(T&& first, Args&&... rest) {
+    std::vector<std::string> result;
+    result.push_back(toString(std::forward<T>(first)));
+    auto tail = argsToString(std::forward<Args>(rest)...);
+    result.insert(result.end(), tail.begin(), tail.end());
+    return result;
+}
+
+/**
+ * @brief Interns a mocked method name as a small integer id that stays the same for the whole process.
+ * @param name The method name; it is copied into the RegistryArena the first time it is seen.
+ * @return The id of the name.
+ */
+uint32_t internMockMethod(std::string_view name);
+
+/// Returned by findMockMethod for a name that no mock has recorded.
+inline constexpr uint32_t kNoMockMethod = UINT32_MAX;
+
+/**
+ * @brief Looks up the id of an interned method name without interning it.
+ * @return The id, or kNoMockMethod if the name was never interned.
+ */
+uint32_t findMockMethod(std::string_view name);
+
+/**
+ * @brief The interned method name with the given id.
+ */
+std::string_view mockMethodName(uint32_t id);
+
+/**
+ * @brief A mock call argument in a canonical form, so calls can be compared without converting them to strings.
+ *
+ * Numbers compare by value whatever their type, and strings, string views and character pointers by their
+ * contents. Arguments of other types are copied into the mock's arena and compared with their own `==`.
+ */
+struct MockArg {
+    enum class Kind : uint8_t {
+        Signed,
+        Unsigned,
+        Floating,
+        Text,
+        Pointer,
+        Object
+    };
+
+    /**
+     * @brief Type-erased operations on an argument of a class type.
+     */
+    struct ObjectOps {
+        const std::type_info* type;
+        size_t size;
+        size_t alignment;
+        void (*copy)(void* destination, const void* source);
+        /// Null for trivially destructible types.
+        void (*destroy)(void* object);
+        void (*format)(std::ostream& out, const void* object);
+        bool (*equals)(const void* lhs, const void* rhs);
+        /// Zero for types without a std::hash specialization.
+        uint64_t (*hash)(const void* object);
+    };
+
+    Kind kind = Kind::Signed;
+    /// Length of a Text argument.
+    uint32_t size = 0;
+    union {
+        int64_t signedValue = 0;
+        uint64_t unsignedValue;
+        double floatingValue;
+        const char* text;
+        const void* pointer;
+    };
+    /// Operations of an Object argument, whose value is at `pointer`.
+    const ObjectOps* ops = nullptr;
+};
+
+/**
+ * @brief Writes an argument the way toString() would have written the original value.
+ */
+void formatMockArg(std::ostream& out, const MockArg& arg);
+
+/**
+ * @brief Whether two canonical arguments hold the same value.
+ */
+bool mockArgsEqual(const MockArg& lhs, const MockArg& rhs);
+
+/**
+ * @brief Hash of an argument; arguments that compare equal through mockArgsEqual() hash alike.
+ */
+uint64_t hashMockArg(const MockArg& arg);
+
+/**
+ * @brief Whether a std::hash specialization exists for T.
+ */
+template <typename T, typename = void>
+struct IsStdHashable : std::false_type {};
+
+template <typename T>
+struct IsStdHashable<T, std::void_t<decltype(std::hash<T>{}(std::declval<const T&>()))>> : std::true_type {};
+
+/**
+ * @brief Operations for arguments of class type T stored as MockArg::Kind::Object.
+ */
+template <typename T>
+const MockArg::ObjectOps* mockObjectOps() {
+    static const MockArg::ObjectOps ops = {
+            &typeid(T),
+            sizeof(T),
+            alignof(T),
+            [](void* destination, const void* source) { new (destination) T(*static_cast<const T*>(source)); },
+            std::is_trivially_destructible_v<T> ? nullptr : +[](void* object) { static_cast<T*>(object)->~T(); },
+            [](std::ostream& out, const void* object) { printCheckOperand(out, *static_cast<const T*>(object)); },
+            [](const void* lhs, const void* rhs) {
+                if constexpr (std::is_invocable_r_v<bool, std::equal_to<>, const T&, const T&>) {
+                    return static_cast<bool>(*static_cast<const T*>(lhs) == *static_cast<const T*>(rhs));
+                } else {
+                    return false;
+                }
+            },
+            [](const void* object) -> uint64_t {
+                if constexpr (IsStdHashable<T>::value) {
+                    return static_cast<uint64_t>(std::hash<T>{}(*static_cast<const T*>(object)));
+                } else {
+                    (void)object;
+                    return 0;
+                }
+            }};
+    return &ops;
+}
+
+/**
+ * @brief Converts an argument to its canonical form, referring to `value` for text and objects.
+ *
+ * The result is only valid while `value` is; Mock copies what it keeps into its own arena.
+ */
+template <typename T>
+MockArg makeMockArg(const T& value) {
+    MockArg arg;
+    if constexpr (std::is_same_v<T, bool>) {
+        arg.kind = MockArg::Kind::Signed;
+        arg.signedValue = value ? 1 : 0;
+    } else if constexpr (std::is_same_v<T, char>) {
+        arg.kind = MockArg::Kind::Text;
+        arg.size = 1;
+        arg.text = &value;
+    } else if constexpr (std::is_enum_v<T>) {
+        return makeMockArg(static_cast<std::underlying_type_t<T>>(value));
+    } else if constexpr (std::is_integral_v<T> && std::is_signed_v<T>) {
+        arg.kind = MockArg::Kind::Signed;
+        arg.signedValue = static_cast<int64_t>(value);
+    } else if constexpr (std::is_integral_v<T>) {
+        arg.kind = MockArg::Kind::Unsigned;
+        arg.unsignedValue = static_cast<uint64_t>(value);
+    } else if constexpr (std::is_floating_point_v<T>) {
+        arg.kind = MockArg::Kind::Floating;
+        arg.floatingValue = static_cast<double>(value);
+    } else if constexpr (std::is_convertible_v<const T&, std::string_view>) {
+        std::string_view view;
+        if constexpr (std::is_pointer_v<T>) {
+            view = value ? std::string_view(value) : std::string_view();
+        } else {
+            view = value;
+        }
+        arg.kind = MockArg::Kind::Text;
+        arg.size = static_cast<uint32_t>(view.size());
+        arg.text = view.data();
+    } else if constexpr (std::is_pointer_v<T> || std::is_null_pointer_v<T>) {
+        arg.kind = MockArg::Kind::Pointer;
+        arg.pointer = static_cast<const void*>(value);
+    } else {
+        arg.kind = MockArg::Kind::Object;
+        arg.ops = mockObjectOps<T>();
+        arg.pointer = &value;
+    }
+    return arg;
+}
+
+class Mock;
+struct MockExpectationState;
+
+/**
+ * @brief Orders expectations: calls matching them must arrive in the order InSequence() added them.
+ *
+ * A sequence may span several mocks. It must outlive the expectations added to it.
+ */
+class MockSequence {
+public:
+    MockSequence() = default;
+    MockSequence(const MockSequence&) = delete;
+    MockSequence& operator=(const MockSequence&) = delete;
+
+private:
+    friend class Mock;
+    friend class MockExpectation;
+
+    std::mutex mutex;
+    std::vector<std::shared_ptr<MockExpectationState>> steps;
+    /// Position of the step that received the latest call.
+    size_t current = 0;
+};
+
+/**
+ * @brief Handle returned by EXPECT_CALL that refines an expectation before the calls arrive.
+ *
+ * Without refinement an expectation accepts any arguments and must be met exactly once.
+ */
+class MockExpectation {
+public:
+    /**
+     * @brief Restricts the expectation to calls with these arguments, compared as by the typed verifyCall().
+     */
+    template <typename... Args>
+    MockExpectation& With(const Args&... args) {
+        if constexpr (sizeof...(Args) == 0) {
+            setArgs(nullptr, 0);
+        } else {
+            const MockArg converted[] = {makeMockArg(args)...};
+            setArgs(converted, sizeof...(Args));
+        }
+        return *this;
+    }
+
+    /**
+     * @brief Requires exactly `count` matching calls.
+     */
+    MockExpectation& Times(size_t count) {
+        return Times(count, count);
+    }
+
+    /**
+     * @brief Requires between `minCalls` and `maxCalls` matching calls.
+     */
+    MockExpectation& Times(size_t minCalls, size_t maxCalls);
+
+    /**
+     * @brief Appends the expectation to a sequence; an expectation belongs to at most one sequence.
+     */
+    MockExpectation& InSequence(MockSequence& sequence);
+
+private:
+    friend class Mock;
+
+    MockExpectation(Mock& mock, std::shared_ptr<MockExpectationState> state)
+            : mock(&mock), state(std::move(state)) {}
+
+    void setArgs(const MockArg* args, uint32_t argCount);
+
+    Mock* mock;
+    std::shared_ptr<MockExpectationState> state;
+};
+
+/**
+ * @brief A base class for creating mock objects that record and verify method calls.
+ *
+ * Derive from this class and use MOCK_METHOD macros to define mocked methods. Calls are recorded with an interned
+ * method id and their arguments in canonical form, so recording a call converts nothing to a string; strings are
+ * only produced by describeCalls() and the string-based verifyCall().
+ *
+ * Mocks may be called from several threads at once. Each thread records into one of a fixed set of shards, each
+ * with its own lock, arena, per-method call chains and argument-hash index, so threads do not contend unless they
+ * share a shard, and verification only looks at the calls of the method or with the hash it asks about.
+ *
+ * Expectations set up front with EXPECT_CALL are instead checked as each call arrives, and a call that breaks one
+ * is reported at once. Together with keepCallLog(false) that keeps memory bounded however many calls a test makes.
+ */
+class Mock {
+public:
+    /**
+     * @brief A recorded call: the method id and its arguments, stored in the mock's arena.
+     */
+    struct CallRecord {
+        uint32_t methodId;
+        uint32_t argCount;
+        const MockArg* args;
+        /// Position of the call among all calls on the mock.
+        uint64_t sequence;
+    };
+
+    /**
+     * @brief A recorded call converted to strings.
+     */
+    struct CallInfo {
+        std::string methodName;
+        std::vector<std::string> args;
+    };
+
+    Mock() = default;
+    Mock(const Mock&) = delete;
+    Mock& operator=(const Mock&) = delete;
+    virtual ~Mock();
+
+    /**
+     * @brief Clears all recorded expectations (method calls).
+     *
+     * Must not run while other threads call or verify the mock.
+     */
+    void clearExpectations();
+
+    /**
+     * @brief Records a method call on the mock object.
+     * @param methodId The id of the method, from internMockMethod().
+     * @param args The arguments passed.
+     */
+    template <typename... Args>
+    void recordCall(uint32_t methodId, const Args&... args) {
+        if constexpr (sizeof...(Args) == 0) {
+            record(methodId, nullptr, 0);
+        } else {
+            const MockArg converted[] = {makeMockArg(args)...};
+            record(methodId, converted, sizeof...(Args));
+        }
+    }
+
+    /**
+     * @brief Records a method call whose arguments are already strings.
+     * @param methodName The name of the method that was called.
+     * @param args A vector of string representations of the arguments passed.
+     */
+    void recordCall(const std::string& methodName, const std::vector<std::string>& args);
+
+    /**
+     * @brief Adds an expectation on a method; use the EXPECT_CALL macro.
+     *
+     * A call is matched against the expectations of its method in the order they were added, taking the first whose
+     * arguments fit and that has not reached its maximum. Calls of methods without expectations are not checked.
+     */
+    MockExpectation expectCall(std::string_view methodName, const char* file, int line);
+
+    /**
+     * @brief Reports every expectation that has not received its minimum number of calls.
+     *
+     * Runs from the destructor if it was not called before. Violations that happened on threads not running a test
+     * are reported here as well, since they could not be attributed to the test when they occurred.
+     * @return True if every expectation was met and no call violated one.
+     */
+    bool verifyExpectations();
+
+    /**
+     * @brief Chooses whether calls are stored; without the log only call counts and expectations are kept.
+     *
+     * verifyCall() finds no calls that were made while the log was off.
+     */
+    void keepCallLog(bool keep) {
+        logCalls.store(keep, std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief Used by MOCK_METHOD: `recorder(methodId)(args...)` records a call, including one without arguments.
+     */
+    auto recorder(uint32_t methodId) {
+        return [this, methodId](const auto&... args) { recordCall(methodId, args...); };
+    }
+
+    /**
+     * @brief Number of recorded calls of a method, from per-method counters.
+     */
+    size_t callCount(uint32_t methodId) const;
+
+    /**
+     * @brief Whether a call of a method with exactly these arguments was recorded, found through the hash index.
+     */
+    bool hasCall(uint32_t methodId, const MockArg* args, uint32_t argCount) const;
+
+    /**
+     * @brief Whether a call of a method has arguments that toString() would write as `args`.
+     *
+     * Only the calls of that method are formatted.
+     */
+    bool hasCallFormattedAs(uint32_t methodId, const std::vector<std::string>& args) const;
+
+    /**
+     * @brief The recorded calls in the order they were made.
+     */
+    std::vector<CallRecord> callRecords() const;
+
+    /**
+     * @brief Converts the recorded calls to strings, in call order, for diagnostics.
+     */
+    std::vector<CallInfo> describeCalls() const;
+
+private:
+    friend class MockExpectation;
+    struct Shard;
+    struct Expectations;
+    static constexpr size_t kShardCount = 16;
+
+    void record(uint32_t methodId, const MockArg* args, uint32_t argCount);
+    Shard& shardForCurrentThread();
+    Expectations& expectationsForUpdate();
+
+    // Created on first use, so a mock only used from one thread allocates a single shard.
+    std::atomic<Shard*> shards[kShardCount] = {};
+    std::atomic<uint64_t> nextSequence{0};
+    std::atomic<Expectations*> expectations{nullptr};
+    std::atomic<bool> logCalls{true};
+};
+
+/**
+ * @brief Checks whether a call to a method with the given arguments was recorded, comparing by value.
+ *
+ * The expected values are compared with the recorded arguments in canonical form, so `verifyCall(mock, "add", 1, 2)`
+ * matches a call with `int`, `long` or `double` arguments of those values; nothing is converted to a string.
+ * @param mock The mock object to check.
+ * @param methodName The method name to look for.
+ * @param expected The expected arguments.
+ * @return True if the call was found, false otherwise.
+ */
+template <typename... Expected>
+bool verifyCall(const Mock& mock, std::string_view methodName, const Expected&... expected) {
+    uint32_t methodId = findMockMethod(methodName);
+    if (methodId == kNoMockMethod) {
+        return false;
+    }
+    const MockArg args[] = {makeMockArg(expected)..., MockArg()};
+    return mock.hasCall(methodId, args, sizeof...(Expected));
+}
+
+/**
+ * @brief Checks if a specified call with certain arguments was recorded on a mock.
+ *
+ * Only calls of the named method are converted to strings for the comparison.
+ * @param mock The mock object to check.
+ * @param methodName The method name to look for.
+ * @param expectedArgs The expected arguments for the call, as toString() writes them.
+ * @return True if the call was found, false otherwise.
+ */
+bool verifyCall(const Mock& mock, std::string_view methodName, const std::vector<std::string>& expectedArgs);
+
+/**
+ * @brief Counts how many times a method was called on the mock.
+ * @param mock The mock object to check.
+ * @param methodName The method name to count occurrences of.
+ * @return The number of times the method was called.
+ */
+int getCallCount(const Mock& mock, std::string_view methodName);
+
+/**
+ * @brief Sets up an expectation on a mocked method, refined with `.With(args...)`, `.Times(n)` and `.InSequence(s)`.
+ * @param mock The mock object.
+ * @param method The name of the mocked method.
+ */
+#define EXPECT_CALL(mock, method) (mock).expectCall(#method, __FILE__, __LINE__)
+
+/**
+ * @brief Declares a mock method inside a mock class, recording calls and allowing for custom return behavior.
+ * @param methodName The name of the mocked method.
+ * @param returnType The return type of the mocked method.
+ * @param PARAMS The parameter list in parentheses for the mocked method.
+ * @param ARGS The argument list in parentheses, recorded with the call and forwarded to the custom behavior.
+ */
+#define MOCK_METHOD(methodName, returnType, PARAMS, ARGS) \
+    std::function<returnType PARAMS> methodName##_mock; \
+    virtual returnType methodName PARAMS override { \
+        static const uint32_t methodName##_id = internMockMethod(#methodName); \
+        this->recorder(methodName##_id) ARGS; \
+        if (methodName##_mock) \
+            return methodName##_mock ARGS; \
+        else \
+            return returnType(); \
+    }
+
+#endif // TESTMOCK_H
@@ -2,27 +2,55 @@
 #include "TestFramework.h"
 #include <iostream>
 #include <chrono>
+#include <filesystem>
+#include <string>
 
-int main() {
+int main(int argc, char** argv) {
     TestRunner& runner = TestRunner::getInstance();
 
+    // Accepts --shard-index/--shard-count etc. so CI nodes can each run a slice of the tests
+    if (!runner.parseCommandLine(argc, argv)) {
+        return 2;
+    }
+
+    // The sequential and concurrent runs record and compare their statistics separately, in PATH.sequential.EXT
+    // and PATH.concurrent.EXT, so the second run does not overwrite the first
+    const std::string benchmarkOutputPath = runner.options().benchmarkOutputPath;
+    const std::string baselinePath = runner.options().baselinePath;
+    auto pathFor = [](const std::string& path, const std::string& mode) {
+        if (path.empty()) {
+            return path;
+        }
+        std::filesystem::path modePath(path);
+        return modePath.replace_extension("." + mode + modePath.extension().string()).string();
+    };
+    auto useStatisticsFiles = [&](const std::string& mode) {
+        runner.options().benchmarkOutputPath = pathFor(benchmarkOutputPath, mode);
+        runner.options().baselinePath = pathFor(baselinePath, mode);
+    };
+
     std::cout << "Running tests sequentially..." << std::endl;
+    useStatisticsFiles("sequential");
     auto startSequential = std::chrono::high_resolution_clock::now();
     runner.run(false); // Run tests sequentially
     auto endSequential = std::chrono::high_resolution_clock::now();
     std::chrono::duration<double> durationSequential = endSequential - startSequential;
+    // With --baseline=PATH, slowdowns against a recorded run fail the process so CI catches them
+    bool regressed = !runner.regressions().empty();
     std::cout << "Total time for sequential execution: " << durationSequential.count() << " seconds" << std::endl;
 
     std::cout << "\nRunning tests concurrently..." << std::endl;
+    useStatisticsFiles("concurrent");
     auto startConcurrent = std::chrono::high_resolution_clock::now();
     runner.run(true); // Run tests concurrently
     auto endConcurrent = std::chrono::high_resolution_clock::now();
     std::chrono::duration<double> durationConcurrent = endConcurrent - startConcurrent;
+    regressed = regressed || !runner.regressions().empty();
     std::cout << "Total time for concurrent execution: " << durationConcurrent.count() << " seconds" << std::endl;
 
     // Calculate and display the performance improvement
     double speedup = durationSequential.count() / durationConcurrent.count();
     std::cout << "\nPerformance Improvement: " << speedup << "x faster when running concurrently." << std::endl;
 
-    return 0;
+    return regressed ? 1 : 0;
 }
\ No newline at end of file
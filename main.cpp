@@ -22,6 +22,9 @@ double runAndMeasure(TestRunner& runner, bool concurrent) {
 int main() {
     TestRunner& runner = TestRunner::getInstance();
 
+    // Durations recorded by earlier runs let the concurrent runs start the heavy tests first
+    runner.options().timingDatabasePath = "test_timings.db";
+
     // -------------------------------
     // 1. Speedup vs Number of Tests
     // Vary number of light tests: {10, 100, 500, 1000}
@@ -83,6 +86,16 @@ int main() {
         std::cout << "Results written to speedup_vs_complexity.csv\n";
     }
 
+    // -------------------------------
+    // 3. Microbenchmarks
+    // Times the BENCHMARK_CASE hot paths on their own, without fixture setup or console output in the measurement.
+    // -------------------------------
+    {
+        runner.options().benchmarkOutputPath = "benchmarks.csv";
+        runner.runBenchmarks();
+        std::cout << "Results written to benchmarks.csv\n";
+    }
+
     std::cout << "All performance experiments completed.\n";
     return 0;
 }